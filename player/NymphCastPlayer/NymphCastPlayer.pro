@@ -92,7 +92,8 @@ SOURCES += \
         mainwindow.cpp \
         qlitehtmlwidget.cpp \
 		remotes.cpp \
-		custom_remotes.cpp
+		custom_remotes.cpp \
+		app_cache.cpp
 
 HEADERS += \
         container_qpainter.h \
@@ -167,7 +168,8 @@ HEADERS += \
         qlitehtml_global.h \
         qlitehtmlwidget.h \
 		remotes.h \
-		custom_remotes.h
+		custom_remotes.h \
+		app_cache.h
 
 FORMS += \
         mainwindow.ui \
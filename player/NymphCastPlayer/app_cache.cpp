@@ -0,0 +1,281 @@
+/*
+	app_cache.cpp - Implementation of the AppCache class.
+	
+	Revision 0.
+	
+	Notes:
+			- Resources are requested with app_loadResourceCached, asking for gzip compression.
+			- A remote is only treated as not having app_loadResourceCached when NymphRPC reports
+				the method as unknown. Other failures fall back to app_loadResource for that
+				request only.
+	
+	2026/10/18, Maya Posch
+*/
+
+
+#include "app_cache.h"
+
+#include <QRunnable>
+#include <QMutexLocker>
+#include <QStandardPaths>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QDateTime>
+#include <QCryptographicHash>
+
+#include <sstream>
+
+#ifdef NPOCO
+	#include <npoco/InflatingStream.h>
+	#include <npoco/StreamCopier.h>
+#else
+	#include <Poco/InflatingStream.h>
+	#include <Poco/StreamCopier.h>
+#endif
+
+// Debug
+#include <iostream>
+
+
+#define AC_FRESH 30							// Seconds a copy is used without checking the remote.
+#define AC_MEMORY_MAX (16 * 1024 * 1024)	// Size of the memory cache in bytes.
+#define AC_THREADS 4						// Number of resources fetched in parallel.
+
+// app_loadResourceCached status & flags.
+#define AC_STATUS_OK 0
+#define AC_STATUS_NOT_MODIFIED 1
+#define AC_FLAG_GZIP 0x01
+
+// Part of the NymphRPC error for a method the remote does not have.
+#define AC_UNKNOWN_METHOD "not found"
+
+
+// Fetches a resource on the thread pool.
+class AppCacheTask : public QRunnable {
+	AppCache* cache;
+	uint32_t handle;
+	QString remote;
+	std::string appId;
+	std::string name;
+	QUrl url;
+
+public:
+	AppCacheTask(AppCache* cache, uint32_t handle, const QString &remote, const std::string &appId,
+												const std::string &name, const QUrl &url) :
+		cache(cache), handle(handle), remote(remote), appId(appId), name(name), url(url) { }
+	
+	void run() override {
+		QByteArray data = cache->get(handle, remote, appId, name);
+		
+		// Queued to the thread of the receiver.
+		emit cache->resourceReady(url, data);
+	}
+};
+
+
+// --- CONSTRUCTOR ---
+AppCache::AppCache(NymphCastClient &client, QObject* parent) : QObject(parent), client(client) {
+	memory.setMaxCost(AC_MEMORY_MAX);
+	pool.setMaxThreadCount(AC_THREADS);
+	
+	folder = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/apps";
+	QDir().mkpath(folder);
+}
+
+
+// --- DESTRUCTOR ---
+AppCache::~AppCache() {
+	pool.clear();
+	pool.waitForDone();
+}
+
+
+// --- DISK PATH ---
+QString AppCache::diskPath(const QString &key) {
+	QByteArray hash = QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1);
+	return folder + "/" + QString::fromLatin1(hash.toHex());
+}
+
+
+// --- LOOKUP ---
+// Find a resource in memory, or on disk. Copies read from disk have not been validated yet.
+bool AppCache::lookup(const QString &key, AppCacheEntry &entry) {
+	{
+		QMutexLocker lock(&mutex);
+		AppCacheEntry* cached = memory.object(key);
+		if (cached) {
+			entry = *cached;
+			return true;
+		}
+	}
+	
+	QFile file(diskPath(key));
+	if (!file.open(QIODevice::ReadOnly)) { return false; }
+	
+	QDataStream in(&file);
+	QString storedKey;
+	in >> storedKey >> entry.token >> entry.data;
+	if (in.status() != QDataStream::Ok || storedKey != key) { return false; }
+	
+	entry.validated = 0;
+	store(key, entry, false);
+	return true;
+}
+
+
+// --- STORE ---
+// Keep a resource in memory, and write it to disk if it has a token.
+void AppCache::store(const QString &key, const AppCacheEntry &entry, bool write) {
+	{
+		QMutexLocker lock(&mutex);
+		memory.insert(key, new AppCacheEntry(entry), entry.data.size());
+	}
+	
+	if (!write || entry.token.isEmpty()) { return; }
+	
+	QSaveFile file(diskPath(key));
+	if (!file.open(QIODevice::WriteOnly)) { return; }
+	
+	QDataStream out(&file);
+	out << key << entry.token << entry.data;
+	if (out.status() == QDataStream::Ok) { file.commit(); }
+	else { file.cancelWriting(); }
+}
+
+
+// --- REMOVE ---
+void AppCache::remove(const QString &key) {
+	{
+		QMutexLocker lock(&mutex);
+		memory.remove(key);
+	}
+	
+	QFile::remove(diskPath(key));
+}
+
+
+// --- REQUEST ---
+// Request a resource from the remote, passing the token of the copy we have (if any).
+// Returns false if the remote could not be reached.
+bool AppCache::request(uint32_t handle, const QString &remote, const std::string &appId,
+					const std::string &name, const QByteArray &token, uint8_t &status,
+					QByteArray &newToken, QByteArray &data) {
+	bool cached;
+	{
+		QMutexLocker lock(&mutex);
+		cached = !legacy.contains(remote);
+	}
+	
+	if (cached) {
+		std::vector<NymphType*> values;
+		values.push_back(new NymphType(new std::string(appId), true));
+		values.push_back(new NymphType(new std::string(name), true));
+		values.push_back(new NymphType(new std::string(token.toStdString()), true));
+		values.push_back(new NymphType((uint8_t) AC_FLAG_GZIP));
+		NymphType* returnValue = 0;
+		std::string result;
+		if (NymphRemoteServer::callMethod(handle, "app_loadResourceCached", values, returnValue, result)) {
+			NymphType* status_v = 0;
+			NymphType* token_v = 0;
+			NymphType* encoding_v = 0;
+			NymphType* data_v = 0;
+			if (!returnValue->getStructValue("status", status_v) ||
+					!returnValue->getStructValue("token", token_v) ||
+					!returnValue->getStructValue("encoding", encoding_v) ||
+					!returnValue->getStructValue("data", data_v)) {
+				std::cerr << "Invalid reply to app_loadResourceCached." << std::endl;
+				delete returnValue;
+				return false;
+			}
+			
+			status = status_v->getUint8();
+			newToken = QByteArray(token_v->getChar(), token_v->string_length());
+			std::string encoding(encoding_v->getChar(), encoding_v->string_length());
+			std::string raw(data_v->getChar(), data_v->string_length());
+			delete returnValue;
+			
+			if (encoding == "gzip") {
+				std::istringstream in(raw);
+				Poco::InflatingInputStream inflater(in, Poco::InflatingStreamBuf::STREAM_GZIP);
+				raw.clear();
+				try {
+					Poco::StreamCopier::copyToString(inflater, raw);
+				}
+				catch (Poco::Exception &e) {
+					std::cerr << "Failed to decompress resource " << appId << "/" << name << ": "
+								<< e.displayText() << std::endl;
+					return false;
+				}
+			}
+			
+			data = QByteArray::fromStdString(raw);
+			return true;
+		}
+		
+		std::cerr << "Calling app_loadResourceCached failed: " << result << std::endl;
+		if (result.find(AC_UNKNOWN_METHOD) != std::string::npos) {
+			QMutexLocker lock(&mutex);
+			legacy.insert(remote);
+		}
+	}
+	
+	// Remotes which do not have app_loadResourceCached, or the call failed. No token is returned,
+	// so the copy is not written to disk.
+	std::string raw = client.loadResource(handle, appId, name);
+	if (raw.empty()) { return false; }
+	
+	status = AC_STATUS_OK;
+	newToken.clear();
+	data = QByteArray::fromStdString(raw);
+	return true;
+}
+
+
+// --- GET ---
+// Get a resource, from the cache if our copy is current. Blocks while the remote is checked.
+// remote	: identifies the remote (address & port), as handles are reused.
+// Returns an empty array if the resource does not exist.
+QByteArray AppCache::get(uint32_t handle, const QString &remote, const std::string &appId,
+																		const std::string &name) {
+	QString key = remote + "/" + QString::fromStdString(appId) + "/" + QString::fromStdString(name);
+	AppCacheEntry entry;
+	bool found = lookup(key, entry);
+	qint64 now = QDateTime::currentMSecsSinceEpoch();
+	if (found && now - entry.validated < AC_FRESH * 1000) { return entry.data; }
+	
+	uint8_t status;
+	QByteArray token;
+	QByteArray data;
+	if (!request(handle, remote, appId, name, found ? entry.token : QByteArray(), status, token, data)) {
+		// Use the copy we have while the remote can not be reached.
+		return found ? entry.data : QByteArray();
+	}
+	
+	if (status == AC_STATUS_NOT_MODIFIED && found) {
+		entry.validated = now;
+		store(key, entry, false);
+		return entry.data;
+	}
+	
+	if (status == AC_STATUS_OK) {
+		entry.token = token;
+		entry.data = data;
+		entry.validated = now;
+		store(key, entry, true);
+		return entry.data;
+	}
+	
+	if (found) { remove(key); }
+	return QByteArray();
+}
+
+
+// --- FETCH ---
+// Get a resource on the thread pool. resourceReady() is emitted with the data and the URL passed.
+void AppCache::fetch(uint32_t handle, const QString &remote, const std::string &appId,
+															const std::string &name, const QUrl &url) {
+	pool.start(new AppCacheTask(this, handle, remote, appId, name, url));
+}
+
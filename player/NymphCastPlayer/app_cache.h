@@ -0,0 +1,71 @@
+/*
+	app_cache.h - Cache of the pages & resources of remote apps.
+	
+	Notes:
+			- Resources are kept in memory and on disk, by remote, app ID & name. Copies are
+				revalidated with the remote using the token it returned with them, unless they were
+				checked less than AC_FRESH seconds ago.
+			- Remotes without the app_loadResourceCached method get the resource requested with
+				app_loadResource. Those copies are only kept in memory.
+			- A cached copy is used while the remote can not be reached.
+	
+	2026/10/18, Maya Posch
+*/
+
+
+#ifndef APP_CACHE_H
+#define APP_CACHE_H
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QUrl>
+#include <QCache>
+#include <QSet>
+#include <QMutex>
+#include <QThreadPool>
+
+#include <string>
+
+#include "nymphcast_client.h"
+
+
+struct AppCacheEntry {
+	QByteArray token;				// Empty if the remote did not return one.
+	QByteArray data;
+	qint64 validated = 0;			// Last check with the remote, in ms since the epoch.
+};
+
+
+class AppCache : public QObject {
+	Q_OBJECT
+	
+	NymphCastClient &client;
+	QCache<QString, AppCacheEntry> memory;		// Cost is the size in bytes.
+	QSet<QString> legacy;						// Remotes without app_loadResourceCached.
+	QMutex mutex;
+	QThreadPool pool;
+	QString folder;
+	
+	bool lookup(const QString &key, AppCacheEntry &entry);
+	void store(const QString &key, const AppCacheEntry &entry, bool write);
+	void remove(const QString &key);
+	QString diskPath(const QString &key);
+	bool request(uint32_t handle, const QString &remote, const std::string &appId,
+						const std::string &name, const QByteArray &token, uint8_t &status,
+						QByteArray &newToken, QByteArray &data);
+
+public:
+	explicit AppCache(NymphCastClient &client, QObject* parent = nullptr);
+	~AppCache();
+	
+	QByteArray get(uint32_t handle, const QString &remote, const std::string &appId,
+																		const std::string &name);
+	void fetch(uint32_t handle, const QString &remote, const std::string &appId,
+															const std::string &name, const QUrl &url);
+
+signals:
+	void resourceReady(const QUrl &url, const QByteArray &data);
+};
+
+#endif
@@ -604,6 +604,14 @@ void DocumentContainerPrivate::load_image(const litehtml::tchar_t *src,
     if (m_pixmaps.contains(url))
         return;
 
+    if (m_requestCallback) {
+        // drawn as empty until the data arrives
+        m_pixmaps.insert(url, QPixmap());
+        m_pendingUrls.insert(url);
+        m_requestCallback(url);
+        return;
+    }
+
     QPixmap pixmap;
     pixmap.loadFromData(m_dataCallback(url));
     m_pixmaps.insert(url, pixmap);
@@ -936,6 +944,7 @@ void DocumentContainer::setScrollPosition(const QPoint &pos)
 void DocumentContainer::setDocument(const QByteArray &data, DocumentContainerContext *context)
 {
     d->m_pixmaps.clear();
+    d->m_pendingUrls.clear();
     d->m_selection = {};
     d->m_document = litehtml::document::createFromUTF8(data.constData(), d.get(), &context->d->context);
     d->buildIndex();
@@ -1247,6 +1256,22 @@ void DocumentContainer::setDataCallback(const DocumentContainer::DataCallback &c
     d->m_dataCallback = callback;
 }
 
+void DocumentContainer::setRequestCallback(const DocumentContainer::RequestCallback &callback)
+{
+    d->m_requestCallback = callback;
+}
+
+// returns false if the image was not requested by the current document
+bool DocumentContainer::setResource(const QUrl &url, const QByteArray &data)
+{
+    if (!d->m_pendingUrls.remove(url))
+        return false;
+    QPixmap pixmap;
+    pixmap.loadFromData(data);
+    d->m_pixmaps.insert(url, pixmap);
+    return true;
+}
+
 void DocumentContainer::setCursorCallback(const DocumentContainer::CursorCallback &callback)
 {
     d->m_cursorCallback = callback;
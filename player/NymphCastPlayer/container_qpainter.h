@@ -108,6 +108,12 @@ public: // outside API
     using DataCallback = std::function<QByteArray(QUrl)>;
     void setDataCallback(const DataCallback &callback);
 
+    // images are requested with this callback if set, instead of loaded with the data callback,
+    // and drawn once they are passed to setResource()
+    using RequestCallback = std::function<void(QUrl)>;
+    void setRequestCallback(const RequestCallback &callback);
+    bool setResource(const QUrl &url, const QByteArray &data);
+
     using CursorCallback = std::function<void(QCursor)>;
     void setCursorCallback(const CursorCallback &callback);
 
@@ -33,6 +33,7 @@
 #include <QPixmap>
 #include <QPoint>
 #include <QRect>
+#include <QSet>
 #include <QString>
 #include <QVector>
 
@@ -148,8 +149,10 @@ public: // document_container API
     QFont m_defaultFont = QFont(sansSerifFont(), 16);
     QByteArray m_defaultFontFamilyName = m_defaultFont.family().toUtf8();
     QHash<QUrl, QPixmap> m_pixmaps;
+    QSet<QUrl> m_pendingUrls;
     Selection m_selection;
     DocumentContainer::DataCallback m_dataCallback;
+    DocumentContainer::RequestCallback m_requestCallback;
     DocumentContainer::CursorCallback m_cursorCallback;
     DocumentContainer::LinkCallback m_linkCallback;
     DocumentContainer::PaletteCallback m_paletteCallback;
@@ -4,6 +4,8 @@
 #include <iostream>
 #include <vector>
 #include <sstream>
+#include <map>
+#include <algorithm>
 
 #include <QFileDialog>
 #include <QInputDialog>
@@ -27,6 +29,11 @@
 #define STR(x) XSTR(x)
 
 
+#define SHARE_FOLDER_ROLE (Qt::UserRole + 1)	// Server & folder of a folder item not yet filled.
+#define SHARE_BATCH 500							// Items added to a folder at a time.
+#define SHARE_THREADS 8							// Media servers queried in parallel.
+
+
 #if defined(Q_OS_ANDROID)
 
 static int pfd[2];
@@ -96,6 +103,12 @@ MainWindow::MainWindow(QWidget *parent) :	 QMainWindow(parent), ui(new Ui::MainW
 	// Set location for user data.
 	appDataLocation = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
 	
+	// Cache for the pages & resources of remote apps.
+	appCache = new AppCache(client, this);
+	
+	// Threads for finding media servers & requesting their file lists.
+	sharePool.setMaxThreadCount(SHARE_THREADS);
+	
 	// Set configured or default stylesheet. Read out current value.
 	// Skip stylesheet if file isn't found.
 	QSettings settings;
@@ -178,10 +191,19 @@ MainWindow::MainWindow(QWidget *parent) :	 QMainWindow(parent), ui(new Ui::MainW
     
     using namespace std::placeholders; 
     ui->appTabGuiTextBrowser->setResourceHandler(std::bind(&MainWindow::loadResource, this, _1));
+	
+	// Images are fetched in parallel, and drawn as they arrive.
+	ui->appTabGuiTextBrowser->setResourceRequestHandler(std::bind(&MainWindow::requestResource, 
+																	this, _1));
+	connect(appCache, &AppCache::resourceReady, 
+			ui->appTabGuiTextBrowser, &QLiteHtmlWidget::setResource);
     
     // Shares tab.
     connect(ui->sharesScanButton, SIGNAL(clicked()), this, SLOT(scanForShares()));
     connect(ui->sharesPlayButton, SIGNAL(clicked()), this, SLOT(playSelectedShare()));
+    connect(ui->sharesTreeView, SIGNAL(expanded(QModelIndex)), this, SLOT(expandShareFolder(QModelIndex)));
+    connect(this, SIGNAL(sharesFound(uint32_t)), this, SLOT(addShareServers(uint32_t)));
+    connect(this, SIGNAL(sharesReceived(uint32_t, uint32_t)), this, SLOT(addShares(uint32_t, uint32_t)));
 	
 	// Receiver shares tab.
     connect(ui->receiverScanButton, SIGNAL(clicked()), this, SLOT(receiverSharesRefresh()));
@@ -347,6 +369,10 @@ MainWindow::~MainWindow() {
 	settings.setValue("ui/singlePlayCheckBox", ui->singlePlayCheckBox->isChecked());
 	settings.value("ui/repeatQueueCheckBox", ui->repeatQueueCheckBox->isChecked());
 	
+	// Share scan threads emit signals on this object.
+	sharePool.clear();
+	sharePool.waitForDone();
+	
 	delete ui;
 }
 
@@ -1311,7 +1337,7 @@ void MainWindow::appsHome() {
     // Request the starting Apps page from the remote.
 	std::string home = std::string();
 	std::string resource = "apps.html";
-    QString page = QString::fromStdString(client.loadResource(remotes[ncid].handle, home, 
+    QString page = QString::fromUtf8(appCache->get(remotes[ncid].handle, remoteKey(ncid), home, 
                                                                                resource));
     
     
@@ -1341,9 +1367,10 @@ void MainWindow::anchorClicked(const QUrl &link) {
         // Try to load the index page for the specified app.
 		std::string appId = list[1].toStdString();
 		std::string resource = "index.html";
-        QString page = QString::fromStdString(client.loadResource(remotes[ncid].handle, 
-                                                                  appId, 
-                                                                   resource));
+        QString page = QString::fromUtf8(appCache->get(remotes[ncid].handle, 
+                                                       remoteKey(ncid), 
+                                                       appId, 
+                                                       resource));
         
         if (page.isEmpty()) { 
             QMessageBox::warning(this, tr("Failed to start"), tr("The selected app could not be started."));
@@ -1400,25 +1427,56 @@ void MainWindow::anchorClicked(const QUrl &link) {
 }
 
 
-// --- LOAD RESOURCE ---
-QByteArray MainWindow::loadResource(const QUrl &name) {
-	uint32_t ncid;
-    if (!remoteEnsureConnected(ncid)) { return QByteArray(); }
-	
-    // Parse the URL for the desired resource.
+// --- RESOURCE NAME ---
+// Get the app ID & filename from the URL of a resource.
+static void resourceName(const QUrl &name, std::string &appId, std::string &filename) {
     QFileInfo dir(name.path());
     QString qAppId = dir.path();
-    std::string filename = name.fileName().toStdString();
+    filename = name.fileName().toStdString();
     
     // FIXME: Hack to deal with weird QLiteHtml behaviour with relative URLs.
     if (qAppId.startsWith("/")) {
         qAppId.remove(0, 1);
     }
     
-    std::string appId = qAppId.toStdString();
+    appId = qAppId.toStdString();
+}
+
+
+// --- REMOTE KEY ---
+// Identifies a remote in the app cache.
+QString MainWindow::remoteKey(uint32_t ncid) {
+	return QString::fromStdString(remotes[ncid].remote.ipv4) + ":" + 
+							QString::number(remotes[ncid].remote.port);
+}
+
+
+// --- LOAD RESOURCE ---
+// Used for stylesheets, which are needed while the page is parsed.
+QByteArray MainWindow::loadResource(const QUrl &name) {
+	uint32_t ncid;
+    if (!remoteEnsureConnected(ncid)) { return QByteArray(); }
+	
+    // Parse the URL for the desired resource.
+    std::string appId;
+    std::string filename;
+    resourceName(name, appId, filename);
     
-    QByteArray page = QByteArray::fromStdString(client.loadResource(remotes[ncid].handle, appId, filename));
-    return page;
+    return appCache->get(remotes[ncid].handle, remoteKey(ncid), appId, filename);
+}
+
+
+// --- REQUEST RESOURCE ---
+// Used for images. The data is passed to the browser once it has been fetched.
+void MainWindow::requestResource(const QUrl &name) {
+	uint32_t ncid;
+    if (!remoteEnsureConnected(ncid)) { return; }
+	
+    std::string appId;
+    std::string filename;
+    resourceName(name, appId, filename);
+    
+    appCache->fetch(remotes[ncid].handle, remoteKey(ncid), appId, filename, name);
 }
 
 
@@ -1437,149 +1495,214 @@ std::vector<std::string> explode(std::string& str, char sep) {
 }
 
 
-// --- INSERT FOLDER VIEW ---
-// Insert the provided item into a view list.
-void MainWindow::insertFolderView(QStandardItem* fn, NymphMediaFile& file, QStandardItem* root, 
-						std::map<std::string, QStandardItem*>& items) {
-	if (file.rel_path == "") {
-		// File is in root folder. Straight insert.
-		root->appendRow(fn);
-		return;
-	}
-
-	std::map<std::string, QStandardItem*>::iterator it;
-	it = items.find(file.rel_path);
-	if (it != items.end()) {
-		// Item found, insert into found folder.
-		it->second->appendRow(fn);
-	}
-	else {
-		// Item not found, create one QStandardItem per missing path entry.
-		// First explode the path, then match path IDs starting from the root until the
-		// first not found one.
-		std::vector<std::string> parts = explode(file.rel_path, '/');
-		std::string tpath = "";
-		std::map<std::string, QStandardItem*>::iterator oit; // old iterator.
-		for (uint32_t k = 0; k < parts.size(); k++) {
-			// Add current index to the tpath string before testing it.
-			tpath += "/" + parts[k];
-			
-			oit = it;
-			it = items.find(tpath);
-			if (it != items.end()) { continue; }
-			
-			// Debug
-			//std::cout << "tpath: " << tpath << std::endl;
-			//std::cout << "parts[" << k << "]:" << parts[k] << std::endl;
-			
-			// Create new folder with the current folder name and insert it.
-			QStandardItem* fd = new QStandardItem(QString::fromStdString(parts[k]));
-			fd->setSelectable(false);
-			std::pair<std::map<std::string, QStandardItem*>::iterator, bool> ret;
-			ret = items.insert(std::pair<std::string, QStandardItem*>(tpath, fd));
-			if (ret.second == false) {
-				QMessageBox::warning(this, tr("Insert failed"), tr("Cannot display list."));
-				return;
-			}
-			
-			it = ret.first;
-			if (k == 0) {
-				// Still in the root folder.
-				root->appendRow(fd);
+// --- BUILD SHARE FOLDERS ---
+// Sort the files of a media server into folders by type & relative path. The first three folders
+// are the audio, video & playlist roots.
+static void buildShareFolders(std::vector<NymphMediaFile> &files, std::vector<ShareFolder> &folders) {
+	folders.assign(3, ShareFolder());
+	folders[0].name = "audio";
+	folders[1].name = "video";
+	folders[2].name = "playlist";
+	std::map<std::string, uint32_t> paths[3];		// Relative path, folder.
+	for (uint32_t i = 0; i < files.size(); ++i) {
+		uint32_t root;
+		if 		(files[i].type == FILE_TYPE_AUDIO) 		{ root = 0; }
+		else if (files[i].type == FILE_TYPE_VIDEO) 		{ root = 1; }
+		else if (files[i].type == FILE_TYPE_PLAYLIST) 	{ root = 2; }
+		else { continue; }
+		
+		uint32_t folder = root;
+		if (files[i].rel_path != "") {
+			std::map<std::string, uint32_t>::iterator it = paths[root].find(files[i].rel_path);
+			if (it != paths[root].end()) {
+				folder = it->second;
 			}
 			else {
-				// The oit iterator points to the parent folder.
-				oit->second->appendRow(fd);
+				// Match the path starting from the root, adding the folders which are missing.
+				std::string rel_path = files[i].rel_path;
+				std::vector<std::string> parts = explode(rel_path, '/');
+				std::string tpath = "";
+				for (uint32_t k = 0; k < parts.size(); k++) {
+					tpath += "/" + parts[k];
+					it = paths[root].find(tpath);
+					if (it != paths[root].end()) {
+						folder = it->second;
+						continue;
+					}
+					
+					ShareFolder fd;
+					fd.name = parts[k];
+					folders.push_back(fd);
+					uint32_t id = folders.size() - 1;
+					folders[folder].folders.push_back(id);
+					paths[root].insert(std::pair<std::string, uint32_t>(tpath, id));
+					folder = id;
+				}
+				
+				paths[root].insert(std::pair<std::string, uint32_t>(files[i].rel_path, folder));
 			}
 		}
 		
-		// Retry inserting the file item.
-		it = items.find(file.rel_path);
-		if (it == items.end()) {
-			// Error out.
-			QMessageBox::warning(this, tr("List failed"), tr("Cannot display list."));
-			return;
-		}
-		
-		// Insert item.
-		it->second->appendRow(fn);
+		folders[folder].files.push_back(i);
+	}
+}
+
+
+// --- SHARE FOLDER ITEM ---
+// Create the item for a folder. Its entries are added when it is expanded, until then it has a
+// placeholder row.
+QStandardItem* MainWindow::shareFolderItem(uint32_t server, uint32_t folder) {
+	ShareFolder& sf = mediaFolders[server][folder];
+	QStandardItem* fd = new QStandardItem(QString::fromStdString(sf.name));
+	fd->setSelectable(false);
+	if (sf.folders.empty() && sf.files.empty()) { return fd; }
+	
+	QList<QVariant> ids;
+	ids.append(QVariant(server));
+	ids.append(QVariant(folder));
+	fd->setData(QVariant(ids), SHARE_FOLDER_ROLE);
+	
+	QStandardItem* placeholder = new QStandardItem(tr("Loading..."));
+	placeholder->setSelectable(false);
+	fd->appendRow(placeholder);
+	return fd;
+}
+
+
+// --- SHARE FILE ITEM ---
+QStandardItem* MainWindow::shareFileItem(uint32_t server, uint32_t file) {
+	NymphMediaFile& mf = mediaFiles[server][file];
+	QStandardItem* fn = new QStandardItem(QString::fromStdString(mf.name));
+	QList<QVariant> ids;
+	ids.append(QVariant(server));
+	ids.append(QVariant(file));
+	ids.append(QVariant(mf.id));
+	fn->setData(QVariant(ids), Qt::UserRole);
+	return fn;
+}
+
+
+// --- POPULATE SHARE FOLDER ---
+// Add the subfolders & files of a folder to its item, SHARE_BATCH at a time. The next batch is 
+// added from the event loop, so that large folders do not block the UI.
+void MainWindow::populateShareFolder(QPersistentModelIndex index, uint32_t server, uint32_t folder, 
+																				uint32_t start) {
+	// The index is invalid once the model has been cleared for a new scan.
+	if (!index.isValid()) { return; }
+	QStandardItem* item = sharesModel.itemFromIndex(index);
+	if (!item) { return; }
+	
+	ShareFolder& sf = mediaFolders[server][folder];
+	uint32_t total = sf.folders.size() + sf.files.size();
+	uint32_t end = std::min(total, start + SHARE_BATCH);
+	QList<QStandardItem*> rows;
+	for (uint32_t i = start; i < end; i++) {
+		if (i < sf.folders.size()) 	{ rows.append(shareFolderItem(server, sf.folders[i])); }
+		else 						{ rows.append(shareFileItem(server, sf.files[i - sf.folders.size()])); }
 	}
+	
+	item->appendRows(rows);
+	if (end < total) {
+		QTimer::singleShot(0, this, [this, index, server, folder, end] {
+			populateShareFolder(index, server, folder, end);
+		});
+	}
+}
+
+
+// --- EXPAND SHARE FOLDER ---
+// Called when an item in the shares view is expanded. Fills in folders on first use.
+void MainWindow::expandShareFolder(const QModelIndex &index) {
+	QStandardItem* item = sharesModel.itemFromIndex(index);
+	if (!item) { return; }
+	
+	QList<QVariant> ids = item->data(SHARE_FOLDER_ROLE).toList();
+	if (ids.size() < 2) { return; }
+	item->setData(QVariant(), SHARE_FOLDER_ROLE);
+	
+	// Remove the placeholder after the first batch, so that the folder stays expanded.
+	populateShareFolder(QPersistentModelIndex(index), ids[0].toUInt(), ids[1].toUInt(), 0);
+	item->removeRow(0);
 }
 
 
 // --- SCAN FOR SHARES ---
+// Find the media servers on the network and request their file lists, on the share threads.
+// The results are added to the view as they arrive (addShareServers, addShares).
 void MainWindow::scanForShares() {
-    // Scan for media server instances on the network.
-    std::vector<NymphCastRemote> mediaservers = client.findShares();
-    if (mediaservers.empty()) {
-        QMessageBox::warning(this, tr("No media servers found."), tr("No media servers found."));
-        return;
-    }
-    
-    // For each media server, request the shared file list.
+	// Results of a previous scan which are still coming in are ignored.
+	shareScan = std::make_shared<ShareScan>();
+	shareScan->id = ++shareScanCount;
+	sharesPending = 0;
     sharesModel.clear();
     mediaFiles.clear();
-    QStandardItem* parentItem = sharesModel.invisibleRootItem();
-    for (uint32_t i = 0; i < mediaservers.size(); ++i) {
-        std::vector<NymphMediaFile> files = client.getShares(mediaservers[i]);
-        if (files.empty()) { continue; }
-        
-        // Insert into model. Use the media server's host name as top folder, with the shared
-        // files inserted underneath it in their respective media type categories.
-		// Use the provided relative path to create a mapping of QStandardItems to relative
-		// 			path. Each folder is represented by one QStandardItem. 
-		//			The std::map<std::string, QStandardItem*> allows sorting of items into their
-		//			respective folders.
-		std::map<std::string, QStandardItem*> audioItems;
-		std::map<std::string, QStandardItem*> videoItems;
-		std::map<std::string, QStandardItem*> playlistItems;
-        QStandardItem* item = new QStandardItem(QString::fromStdString(mediaservers[i].name));
-        item->setSelectable(false);
-		QStandardItem* audioRoot = new QStandardItem("audio");
-		QStandardItem* videoRoot = new QStandardItem("video");
-		//QStandardItem* imageRoot = new QStandardItem("image");
-		QStandardItem* playlistRoot = new QStandardItem("playlist");
-		audioRoot->setSelectable(false);
-		videoRoot->setSelectable(false);
-		playlistRoot->setSelectable(false);
-        for (uint32_t j = 0; j < files.size(); ++j) {
-			if (files[j].type == FILE_TYPE_IMAGE) { continue; }
-            QStandardItem* fn = new QStandardItem(QString::fromStdString(files[j].name));
-            QList<QVariant> ids;
-			ids.append(QVariant(i));
-			ids.append(QVariant(j));
-            ids.append(QVariant(files[j].id));
-            mediaFiles.push_back(files);
-            ids.append(QVariant((uint32_t) mediaFiles.size()));
-            
-            fn->setData(QVariant(ids), Qt::UserRole);
-            //item->appendRow(fn);
-			
-			// TODO: depending on type, try inserting into folder associated with the relative
-			//			path. If no entry found, create one QStandardItem per missing folders in 
-			//			the path.
-			if 		(files[j].type == FILE_TYPE_AUDIO) 		{
-				insertFolderView(fn, files[j], audioRoot, audioItems);
-			}
-			else if (files[j].type == FILE_TYPE_VIDEO) 		{ 
-				insertFolderView(fn, files[j], videoRoot, videoItems);
-				//videoRoot->appendRow(fn); 
-			}
-			else if (files[j].type == FILE_TYPE_PLAYLIST) 	{ 
-				insertFolderView(fn, files[j], playlistRoot, playlistItems);
-				//playlistRoot->appendRow(fn); 
-			}
-        }
-        
-		item->appendRow(audioRoot);
-		item->appendRow(videoRoot);
-		//item->appendRow(imageRoot);
-		item->appendRow(playlistRoot);
-		parentItem->appendRow(item);
+    mediaFolders.clear();
+	ui->sharesScanButton->setEnabled(false);
+	
+	std::shared_ptr<ShareScan> scan = shareScan;
+	sharePool.start([this, scan] {
+		// Scan for media server instances on the network.
+		scan->servers = client.findShares();
+		scan->files.resize(scan->servers.size());
+		scan->folders.resize(scan->servers.size());
+		emit sharesFound(scan->id);
 		
-		// Expand each root item.
-		ui->sharesTreeView->setExpanded(sharesModel.indexFromItem(item), true);
-    }
+		// Request the shared file list of each media server in parallel. Each thread only
+		// writes the entries for its server.
+		for (uint32_t i = 0; i < scan->servers.size(); ++i) {
+			sharePool.start([this, scan, i] {
+				scan->files[i] = client.getShares(scan->servers[i]);
+				buildShareFolders(scan->files[i], scan->folders[i]);
+				emit sharesReceived(scan->id, i);
+			});
+		}
+	});
+}
+
+
+// --- ADD SHARE SERVERS ---
+// Called once the media servers of a scan have been found.
+void MainWindow::addShareServers(uint32_t scan) {
+	if (!shareScan || shareScan->id != scan) { return; }
+	
+	if (shareScan->servers.empty()) {
+		ui->sharesScanButton->setEnabled(true);
+        QMessageBox::warning(this, tr("No media servers found."), tr("No media servers found."));
+        return;
+	}
+	
+	mediaFiles.resize(shareScan->servers.size());
+	mediaFolders.resize(shareScan->servers.size());
+	sharesPending = shareScan->servers.size();
+}
+
+
+// --- ADD SHARES ---
+// Called when the file list of a media server has been received.
+void MainWindow::addShares(uint32_t scan, uint32_t server) {
+	if (!shareScan || shareScan->id != scan) { return; }
+	
+	// Take over the lists, the worker thread is done with them.
+	mediaFiles[server].swap(shareScan->files[server]);
+	mediaFolders[server].swap(shareScan->folders[server]);
+	if (--sharesPending == 0) {
+		ui->sharesScanButton->setEnabled(true);
+	}
+	
+	if (mediaFiles[server].empty()) { return; }
+	
+	// Insert into model. Use the media server's host name as top folder, with the shared
+	// files inserted underneath it in their respective media type categories.
+	QStandardItem* item = new QStandardItem(QString::fromStdString(shareScan->servers[server].name));
+	item->setSelectable(false);
+	for (uint32_t i = 0; i < 3; ++i) {
+		item->appendRow(shareFolderItem(server, i));
+	}
+	
+	sharesModel.invisibleRootItem()->appendRow(item);
+	
+	// Expand each root item.
+	ui->sharesTreeView->setExpanded(sharesModel.indexFromItem(item), true);
 }
 
 
@@ -1683,8 +1806,6 @@ void MainWindow::receiverSharesRefresh() {
 		//ids.append(QVariant(i));
 		ids.append(QVariant(j));
 		ids.append(QVariant(files[j].id));
-		receiverFiles.push_back(files);
-		ids.append(QVariant((uint32_t) mediaFiles.size()));
 		
 		fn->setData(QVariant(ids), Qt::UserRole);
 		//item->appendRow(fn);
@@ -1698,6 +1819,7 @@ void MainWindow::receiverSharesRefresh() {
 	//item->appendRow(imageRoot);
 	item->appendRow(playlistRoot);
 	parentItem->appendRow(item);
+	receiverFiles.push_back(std::move(files));
 	
 	// Expand each root item.
 	ui->receiverSharesView->setExpanded(receiverSharesModel.indexFromItem(item), true);
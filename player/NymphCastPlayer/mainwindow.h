@@ -4,13 +4,16 @@
 #include <QMainWindow>
 #include <QStandardItemModel>
 #include <QTimer>
+#include <QThreadPool>
 
 #include "nymphcast_client.h"
 
 #include <vector>
+#include <memory>
 
 #include "remotes.h"
 #include "custom_remotes.h"
+#include "app_cache.h"
 
 #if defined(Q_OS_ANDROID)
 #include <QtAndroidExtras>
@@ -53,6 +56,23 @@ namespace Ui {
 	class MainWindow;
 }
 
+
+// Folder in the file list of a media server.
+struct ShareFolder {
+	std::string name;
+	std::vector<uint32_t> folders;		// Subfolders, by index in the folders of the server.
+	std::vector<uint32_t> files;		// By index in the files of the server.
+};
+
+
+// Results of a share scan, filled in by the worker threads.
+struct ShareScan {
+	uint32_t id;
+	std::vector<NymphCastRemote> servers;
+	std::vector<std::vector<NymphMediaFile> > files;
+	std::vector<std::vector<ShareFolder> > folders;
+};
+
 class MainWindow : public QMainWindow {
 	Q_OBJECT
 	
@@ -104,6 +124,9 @@ private slots:
     
     // Shares tab.
     void scanForShares();
+    void addShareServers(uint32_t scan);
+    void addShares(uint32_t scan, uint32_t server);
+    void expandShareFolder(const QModelIndex &index);
     void playSelectedShare();
 	
 	// Receiver tab.
@@ -122,6 +145,8 @@ private slots:
 	
 signals:
 	void playbackStatusChange(uint32_t handle, NymphPlaybackStatus status);
+	void sharesFound(uint32_t scan);
+	void sharesReceived(uint32_t scan, uint32_t server);
 	
 private:
 	Ui::MainWindow *ui;
@@ -129,7 +154,12 @@ private:
 	std::vector<NCRemoteInstance> remotes;
 	std::vector<NCRemoteInstance> custom_remotes;
 	std::vector<NCRemoteGroup> groups;
-    std::vector<std::vector<NymphMediaFile> > mediaFiles;
+    std::vector<std::vector<NymphMediaFile> > mediaFiles;		// By media server.
+    std::vector<std::vector<ShareFolder> > mediaFolders;
+    std::shared_ptr<ShareScan> shareScan;
+    uint32_t shareScanCount = 0;
+    uint32_t sharesPending = 0;
+    QThreadPool sharePool;
     std::vector<std::vector<NymphMediaFile> > receiverFiles;
 	bool muted = false;
 	bool playingTrack = false;
@@ -144,8 +174,11 @@ private:
 	CustomRemotesDialog* crd;
 	QTimer posTimer;
 	uint32_t current_remote;
+	AppCache* appCache;
 	
+	QString remoteKey(uint32_t ncid);
     QByteArray loadResource(const QUrl &name);
+	void requestResource(const QUrl &name);
 	void statusUpdateCallback(uint32_t handle, NymphPlaybackStatus status);
 	bool remoteIsConnected();
 	bool remoteEnsureConnected(uint32_t &handle);
@@ -158,8 +191,10 @@ private:
 	bool loadRemotes();
 	bool saveRemotes();
 	
-	void insertFolderView(QStandardItem* fn, NymphMediaFile& file, QStandardItem* root, 
-						std::map<std::string, QStandardItem*>& items);
+	QStandardItem* shareFolderItem(uint32_t server, uint32_t folder);
+	QStandardItem* shareFileItem(uint32_t server, uint32_t file);
+	void populateShareFolder(QPersistentModelIndex index, uint32_t server, uint32_t folder, 
+																			uint32_t start);
 };
 
 #endif // MAINWINDOW_H
@@ -373,6 +373,7 @@ public:
     QUrl url;
     DocumentContainer documentContainer;
     qreal zoomFactor = 1;
+    bool renderPending = false;
 };
 
 QLiteHtmlWidget::QLiteHtmlWidget(QWidget *parent)
@@ -511,6 +512,25 @@ void QLiteHtmlWidget::setResourceHandler(const QLiteHtmlWidget::ResourceHandler
     d->documentContainer.setDataCallback(handler);
 }
 
+void QLiteHtmlWidget::setResourceRequestHandler(const QLiteHtmlWidget::ResourceRequestHandler &handler)
+{
+    d->documentContainer.setRequestCallback(handler);
+}
+
+void QLiteHtmlWidget::setResource(const QUrl &url, const QByteArray &data)
+{
+    if (!d->documentContainer.setResource(url, data))
+        return;
+    // lay out once for all images arriving together, their sizes can change the layout
+    if (d->renderPending)
+        return;
+    d->renderPending = true;
+    QTimer::singleShot(0, this, [this] {
+        d->renderPending = false;
+        withFixedTextPosition([this] { render(); });
+    });
+}
+
 QString QLiteHtmlWidget::selectedText() const
 {
     return d->documentContainer.selectedText();
@@ -64,6 +64,11 @@ public:
     using ResourceHandler = std::function<QByteArray(QUrl)>;
     void setResourceHandler(const ResourceHandler &handler);
 
+    // images are requested with this handler if set, and drawn as they are passed to setResource()
+    using ResourceRequestHandler = std::function<void(QUrl)>;
+    void setResourceRequestHandler(const ResourceRequestHandler &handler);
+    void setResource(const QUrl &url, const QByteArray &data);
+
     // declaring this Q_INVOKABLE to make it Squish-testable
     Q_INVOKABLE QString selectedText() const;
 
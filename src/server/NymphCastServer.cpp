@@ -45,9 +45,14 @@ namespace fs = std::filesystem;
 #endif
 
 #include "ffplay/types.h"
+#include "ffplay/audio_renderer.h"
 #include "sdl_renderer.h"
 
 #include "databuffer.h"
+#include "session_registry.h"
+#include "clock_sync.h"
+#include "slave_queue.h"
+#include "multicast.h"
 #include "screensaver.h"
 
 #include <nymph/nymph.h>
@@ -77,6 +82,11 @@ using namespace Poco;
 #include "mimetype.h"
 
 #include "nc_apps.h"
+#include "http_client.h"
+#include "playback_status.h"
+#include "media_index.h"
+#include "media_probe.h"
+#include "resource_cache.h"
 #include "gui.h"
 
 #ifdef __ANDROID__
@@ -176,6 +186,11 @@ char *afilters = NULL;
 int autorotate = 1;
 int find_stream_info = 1;
 int filter_nbthreads = 0;
+bool gapless = true;
+bool refresh_rate_match = false;
+std::string hwaccel = "none";
+uint32_t status_rate = 4;
+uint32_t app_resource_cache = 16;
 std::atomic<uint32_t> audio_volume = { 100 };
 std::atomic<bool> muted = { false };
 std::atomic<uint32_t> muted_volume;
@@ -199,6 +214,7 @@ std::atomic<bool> playerStopped = { false };	// Playback was stopped by the user
 Poco::Thread avThread;
 Poco::Condition slavePlayCon;
 Poco::Mutex slavePlayMutex;
+std::atomic<int64_t> slaveStartTime = { 0 };
 
 //#ifndef _MSC_VER
 // LCDProc client.
@@ -222,13 +238,6 @@ std::string loggerName = "NymphCastServer";
 NCApps nc_apps;
 std::map<int, CastClient> clients;
 
-// -- BLOCK SIZE ---
-// This defines the size of the data blocks requested from the client with a read request.
-// Defined in kilobytes.
-uint32_t readBlockSize = 200;
-// ---
-
-
 // Data structure.
 struct SessionParams {
 	int max_buffer;
@@ -241,58 +250,70 @@ struct NymphCastSlaveRemote {
 	uint16_t port;
 	uint32_t handle;
 	int64_t delay;
+	std::shared_ptr<SlaveQueue> queue;	// Media data on its way to the slave.
+	bool multicast;						// Receives the media data over multicast instead.
 };
 
 NcsMode serverMode = NCS_MODE_STANDALONE;
 std::vector<NymphCastSlaveRemote> slave_remotes;
-uint32_t slaveLatencyMax = 0;	// Max latency to slave remote in milliseconds.
-
-// Types:
-// 0	Audio
-// 1	Video
-// 2	Image
-// 3	Playlist
-struct MediaFile {
-	std::string section;
-	std::string filename;
-	uint8_t type;
-	fs::path path;
-};
-// ---
+uint32_t slaveLatencyMax = 0;	// Max latency to slave remote in microseconds.
+const int64_t slaveStartMargin = 50000;	// Minimum time until a scheduled slave start, in us.
+
+// Multicast transport of media data to slaves.
+bool multicastEnable = false;
+std::string multicastGroup;
+uint16_t multicastPort = 4005;
+McastSender mcastSender;			// Master.
+std::atomic<uint32_t> masterSession = { 0 };	// Slave: session of the master.
+uint32_t slaveWriteData(uint32_t session, const char* data, uint32_t length, bool done, 
+																				int64_t when);
+void slaveNack(uint32_t stream, uint32_t seq, uint32_t count);
+McastReceiver mcastReceiver([](const char* data, uint32_t length, bool done) {
+								return slaveWriteData(masterSession, data, length, done, 0);
+							}, slaveNack);	// Slave.
+
+MediaIndex mediaIndex;
+
+
+// --- MEDIA FILE STRUCT ---
+// Struct with the details of a media file, for a file list. Files which have been probed also get
+// their format, duration, codecs, dimensions, tags & whether a thumbnail is available.
+NymphType* mediaFileStruct(const MediaFile &mf, bool changes) {
+	std::map<std::string, NymphPair>* pairs = new std::map<std::string, NymphPair>;
+	addPair(pairs, "id", new NymphType(mf.id));
+	addPair(pairs, "section", new NymphType(new std::string(mf.section), true));
+	addPair(pairs, "filename", new NymphType(new std::string(mf.filename), true));
+	addPair(pairs, "type", new NymphType(mf.type));
+	if (changes) { addPair(pairs, "removed", new NymphType(mf.removed)); }
+	
+	MediaInfo info;
+	if (!mf.removed && mediaIndex.getInfo(mf.id, info) && info.valid) {
+		addPair(pairs, "format", new NymphType(new std::string(info.format), true));
+		addPair(pairs, "duration", new NymphType(info.duration));
+		addPair(pairs, "video_codec", new NymphType(new std::string(info.videoCodec), true));
+		addPair(pairs, "audio_codec", new NymphType(new std::string(info.audioCodec), true));
+		addPair(pairs, "width", new NymphType(info.width));
+		addPair(pairs, "height", new NymphType(info.height));
+		addPair(pairs, "title", new NymphType(new std::string(info.title), true));
+		addPair(pairs, "artist", new NymphType(new std::string(info.artist), true));
+		addPair(pairs, "album", new NymphType(new std::string(info.album), true));
+		addPair(pairs, "thumbnail", new NymphType(info.thumbnail));
+	}
+	
+	return new NymphType(pairs, true);
+}
 
 
 // array getFileList()
-std::vector<MediaFile> mediaFiles;
 NymphMessage* getFileList(int session, NymphMessage* msg, void* data) {
 	NymphMessage* returnMsg = msg->getReplyMessage();
 	
-	// Copy values from the media file array into the new array.
+	// Copy values from the media index into the new array.
+	uint32_t next;
+	std::vector<MediaFile> files = mediaIndex.list(0, 0, 0, std::string(), next);
 	std::vector<NymphType*>* tArr = new std::vector<NymphType*>();
-	for (uint32_t i = 0; i < mediaFiles.size(); ++i) {
-		std::map<std::string, NymphPair>* pairs = new std::map<std::string, NymphPair>;
-		
-		NymphPair pair;
-		std::string* key = new std::string("id");
-		pair.key = new NymphType(key, true);
-		pair.value = new NymphType(i);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-	
-		key = new std::string("section");
-		pair.key = new NymphType(key, true);
-		pair.value = new NymphType(&mediaFiles[i].section);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		
-		key = new std::string("filename");
-		pair.key = new NymphType(key, true);
-		pair.value = new NymphType(&mediaFiles[i].filename);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		
-		key = new std::string("type");
-		pair.key = new NymphType(key, true);
-		pair.value = new NymphType(mediaFiles[i].type);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		
-		tArr->push_back(new NymphType(pairs, true));
+	for (uint32_t i = 0; i < files.size(); ++i) {
+		tArr->push_back(mediaFileStruct(files[i], false));
 	}
 	
 	returnMsg->setResultValue(new NymphType(tArr, true));
@@ -301,6 +322,53 @@ NymphMessage* getFileList(int session, NymphMessage* msg, void* data) {
 }
 
 
+// struct getFileListPage(uint32 since, uint32 start, uint32 count, string filter)
+// Returns a struct with the current 'generation' of the media index, the 'next' ID to continue
+// from (0 if done) and the 'files' array.
+NymphMessage* getFileListPage(int session, NymphMessage* msg, void* data) {
+	NymphMessage* returnMsg = msg->getReplyMessage();
+	
+	uint32_t since = msg->parameters()[0]->getUint32();
+	uint32_t start = msg->parameters()[1]->getUint32();
+	uint32_t count = msg->parameters()[2]->getUint32();
+	std::string filter = msg->parameters()[3]->getString();
+	if (count == 0 || count > MI_PAGE_MAX) { count = MI_PAGE_MAX; }
+	
+	// Read the generation first, so that changes made while paging are listed with the next call.
+	uint32_t generation = mediaIndex.getGeneration();
+	uint32_t next;
+	std::vector<MediaFile> files = mediaIndex.list(since, start, count, filter, next);
+	std::vector<NymphType*>* tArr = new std::vector<NymphType*>();
+	for (uint32_t i = 0; i < files.size(); ++i) {
+		tArr->push_back(mediaFileStruct(files[i], true));
+	}
+	
+	std::map<std::string, NymphPair>* pairs = new std::map<std::string, NymphPair>;
+	addPair(pairs, "generation", new NymphType(generation));
+	addPair(pairs, "next", new NymphType(next));
+	addPair(pairs, "files", new NymphType(tArr, true));
+	
+	returnMsg->setResultValue(new NymphType(pairs, true));
+	msg->discard();
+	return returnMsg;
+}
+
+
+// string getFileThumbnail(uint32 id)
+// Returns the JPEG thumbnail of a media file, or an empty string if there is none.
+NymphMessage* getFileThumbnail(int session, NymphMessage* msg, void* data) {
+	NymphMessage* returnMsg = msg->getReplyMessage();
+	
+	uint32_t fileId = msg->parameters()[0]->getUint32();
+	std::string* jpeg = new std::string;
+	mediaIndex.getThumbnail(fileId, *jpeg);
+	
+	returnMsg->setResultValue(new NymphType(jpeg, true));
+	msg->discard();
+	return returnMsg;
+}
+
+
 // uint8 playMedia(uint32 id)
 // Returns: 0 on success. 1 on error.
 NymphMessage* playMedia(int session, NymphMessage* msg, void* data) {
@@ -310,18 +378,17 @@ NymphMessage* playMedia(int session, NymphMessage* msg, void* data) {
 	uint32_t fileId = msg->parameters()[0]->getUint32();
 	
 	// Obtain the file record using its ID.
-	if (fileId > mediaFiles.size()) {
+	MediaFile mf;
+	if (!mediaIndex.get(fileId, mf)) {
 		// Invalid file ID.
 		returnMsg->setResultValue(new NymphType((uint8_t) 1));
 		msg->discard();
 		return returnMsg;
 	}
 	
-	MediaFile& mf = mediaFiles[fileId];
-	
 	// Play media file.
 	// First get the filename, then handle the window mode change (if any) and start playback.
-	std::string url = mediaFiles[fileId].filename;
+	std::string url = mf.filename;
 	
 	// Stop screensaver.
 	if (!video_disable) {
@@ -343,7 +410,12 @@ NymphMessage* playMedia(int session, NymphMessage* msg, void* data) {
 		}
 	}
 	
-	ffplay.streamTrack(url);
+	// The format found when the file was probed saves probing it again.
+	MediaInfo info;
+	std::string format;
+	if (mediaIndex.getInfo(fileId, info) && info.valid) { format = info.format; }
+	
+	ffplay.streamTrack(url, format);
 	
 	returnMsg->setResultValue(new NymphType((uint8_t) 0));
 	msg->discard();
@@ -379,218 +451,77 @@ void MediaStatusCallback(uint32_t session, NymphMessage* msg, void* data) {
 }
 
 
-// --- GET PLAYBACK STATUS ---
-std::map<std::string, NymphPair>* getPlaybackStatus() {
-	// Set the playback status.
-	// We're sending back whether we are playing something currently. If so, also includes:
-	// * duration of media in seconds.
-	// * position in the media, in seconds with remainder.
-	// * title of the media, if available.
-	// * artist of the media, if available.
-	std::map<std::string, NymphPair>* pairs = new std::map<std::string, NymphPair>();
-	NymphPair pair;
-	std::string* key;
+// --- MASTER NACK CALLBACK ---
+// Called by a slave remote for multicast packets it did not receive. These are multicast again.
+// void MasterNackCallback(uint32 stream, uint32 seq, uint32 count)
+void MasterNackCallback(uint32_t session, NymphMessage* msg, void* data) {
+	uint32_t stream = msg->parameters()[0]->getUint32();
+	uint32_t seq = msg->parameters()[1]->getUint32();
+	uint32_t count = msg->parameters()[2]->getUint32();
+	mcastSender.resend(stream, seq, count);
+}
+
+
+// --- READ PLAYBACK STATUS ---
+// Read the current playback status, for the status struct sent to clients.
+void readPlaybackStatus(PlaybackState &state) {
+	state.volume = (uint8_t) audio_volume.load();
+	state.subtitleDisable = subtitle_disable;
 	if (ffplay.playbackActive()) {
 		// Distinguish between playing and paused for the player.
-		if (playerPaused) {
-			key = new std::string("status");
-			pair.key = new NymphType(key, true);
-			pair.value = new NymphType((uint32_t) NYMPH_PLAYBACK_STATUS_PAUSED);
-			pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		}
-		else {
-			key = new std::string("status");
-			pair.key = new NymphType(key, true);
-			pair.value = new NymphType((uint32_t) NYMPH_PLAYBACK_STATUS_PLAYING);
-			pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		}
-		
-		key = new std::string("playing");
-		pair.key = new NymphType(key, true);
-		pair.value = new NymphType(true);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		
-		key = new std::string("stopped");
-		pair.key = new NymphType(key, true);
-		pair.value = new NymphType(false);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		
-		key = new std::string("duration");
-		pair.key = new NymphType(key, true);
-		//pair.value = new NymphType(FileMetaInfo::getDuration());
-		pair.value = new NymphType(file_meta.getDuration());
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		
-		key = new std::string("position");
-		pair.key = new NymphType(key, true);
-		//pair.value = new NymphType(FileMetaInfo::getPosition());
-		//pair.value = new NymphType(file_meta.getPosition());
-		pair.value = new NymphType(file_meta.position);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		
-		key = new std::string("title");
-		pair.key = new NymphType(key, true);
-		//std::string* val = new std::string(FileMetaInfo::getTitle());
-		std::string* val = new std::string(file_meta.getTitle());
-		pair.value = new NymphType(val, true);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		
-		key = new std::string("artist");
-		pair.key = new NymphType(key, true);
-		//val = new std::string(FileMetaInfo::getArtist());
-		val = new std::string(file_meta.getArtist());
-		pair.value = new NymphType(val, true);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		
-		key = new std::string("volume");
-		pair.key = new NymphType(key, true);
-		pair.value = new NymphType((uint8_t) audio_volume.load());
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		
-		key = new std::string("subtitle_disable");
-		pair.key = new NymphType(key, true);
-		pair.value = new NymphType(subtitle_disable);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
+		state.status = playerPaused ? (uint32_t) NYMPH_PLAYBACK_STATUS_PAUSED : 
+										(uint32_t) NYMPH_PLAYBACK_STATUS_PLAYING;
+		state.playing = true;
+		state.stopped = false;
+		state.duration = file_meta.getDuration();
+		state.position = file_meta.position;
+		state.title = file_meta.getTitle();
+		state.artist = file_meta.getArtist();
+		
+		// Read-ahead statistics for the session being played.
+		std::shared_ptr<DataBuffer> db = SessionRegistry::getActive();
+		if (db) { db->getStats(state.buffer); }
 	}
 	else {
-		if (playerStopped) {
-			// Stopped by user.
-			key = new std::string("stopped");
-			pair.key = new NymphType(key, true);
-			pair.value = new NymphType(true);
-			pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		}
-		else {
-			key = new std::string("stopped");
-			pair.key = new NymphType(key, true);
-			pair.value = new NymphType(false);
-			pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		}
-		
-		key = new std::string("status");
-		pair.key = new NymphType(key, true);
-		pair.value = new NymphType((uint32_t) NYMPH_PLAYBACK_STATUS_STOPPED);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		
-		key = new std::string("playing");
-		pair.key = new NymphType(key, true);
-		pair.value = new NymphType(false);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		
-		key = new std::string("duration");
-		pair.key = new NymphType(key, true);
-		pair.value = new NymphType((uint64_t) 0);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		
-		key = new std::string("position");
-		pair.key = new NymphType(key, true);
-		pair.value = new NymphType((double) 0.0);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		
-		key = new std::string("title");
-		pair.key = new NymphType(key, true);
-		pair.value = new NymphType((char*) 0, 0);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		
-		key = new std::string("artist");
-		pair.key = new NymphType(key, true);
-		pair.value = new NymphType((char*) 0, 0);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		
-		key = new std::string("volume");
-		pair.key = new NymphType(key, true);
-		pair.value = new NymphType((uint8_t) audio_volume.load());
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		
-		key = new std::string("subtitle_disable");
-		pair.key = new NymphType(key, true);
-		pair.value = new NymphType(subtitle_disable);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
+		// Stopped is only set if playback was stopped by the user.
+		state.status = (uint32_t) NYMPH_PLAYBACK_STATUS_STOPPED;
+		state.playing = false;
+		state.stopped = playerStopped;
+		state.duration = 0;
+		state.position = 0.0;
 	}
-	
-	return pairs;
 }
 
 
 // --- SEND STATUS UPDATE ---
 void sendStatusUpdate(uint32_t handle) {
 	// Call the status update callback with the current playback status.
-	std::vector<NymphType*> values;
-	std::map<std::string, NymphPair>* status = getPlaybackStatus();
-	values.push_back(new NymphType(status, true));
-	NymphType* resVal = 0;
-	std::string result;
-	if (!NymphRemoteClient::callCallback(handle, "MediaStatusCallback", values, result)) {
-		NYMPH_LOG_ERROR("Calling media status callback failed: " + result);
-		return;
-	}
+	PlaybackStatus::push(handle);
 }
 
 
 // --- SEND GLOBAL STATUS UPDATE ---
 // Send playback status update to all connected clients.
+// Updates are coalesced, and sent at most 'status_rate' times per second.
 void sendGlobalStatusUpdate() {
-	NYMPH_LOG_INFORMATION("Sending status update to all " + Poco::NumberFormatter::format(clients.size()) 
-					+ " clients.");
-					
-	std::map<std::string, NymphPair>* pairs = getPlaybackStatus();
-	std::map<int, CastClient>::const_iterator it;
-	for (it = clients.begin(); it != clients.end();/**/) {
-		NYMPH_LOG_DEBUG("Client ID: " + Poco::NumberFormatter::format(it->first) + "/" + it->second.name);
-		
-		// Call the status update callback with the current playback status.
-		NymphType* resVal = 0;
-		std::string result;
-		std::vector<NymphType*> values;
-		values.push_back(new NymphType(pairs));
-		if (!NymphRemoteClient::callCallback(it->first, "MediaStatusCallback", values, result)) {
-			NYMPH_LOG_ERROR("Calling media status callback failed: " + result);
-			
-			// An error here very likely means that the client no long exists. Remove it.
-			it = clients.erase(it);
-		}
-		else {
-			++it;
-		}
-	}
-	
-	// Delete the map and its values.
-	// TODO: persist the data somehow.
-	std::map<std::string, NymphPair>::iterator sit;
-	for (sit = pairs->begin(); sit != pairs->end(); ++sit) {
-		delete sit->second.key;
-		delete sit->second.value;
-	}
-	
-	delete pairs;
+	PlaybackStatus::update();
 }
 
 
 // --- START SLAVE PLAYBACK ---
 // [Master] Signal slaves that they can begin playback.
+// All receivers start on the same absolute time, which is converted into the local time of each
+// slave. Returns at the start time.
 bool startSlavePlayback() {
-	// Start slaves according to the average connection latency.
-	Poco::Timestamp ts;
-	int64_t now = (int64_t) ts.epochMicroseconds();
-	//then = now + (slaveLatencyMax * 2);
-		
-	// Timing: 	Multiply the max slave latency by the number of slaves. After sending this delay
-	// 			to the first slave (minus half its recorded latency), 
-	// 			subtract the time it took to send to this slave from the
-	//			first delay, then send this new delay to the second slave, and so on.
-	int64_t countdown = slaveLatencyMax * slave_remotes.size();
-	
-	int64_t then = 0;
+	// Leave time for the start message to reach each slave, as these are sent one after another.
+	int64_t start = ClockSync::now() + slaveStartMargin + 
+										(ClockSync::maxRtt() * (int64_t) slave_remotes.size());
 	for (int i = 0; i < slave_remotes.size(); ++i) {
 		NymphCastSlaveRemote& rm = slave_remotes[i];
-		//then = slaveLatencyMax - rm.delay;
-		then = countdown - (rm.delay / 2);
-		ts.update();
-		int64_t send = (int64_t) ts.epochMicroseconds();
 		
 		// Prepare data vector.
 		std::vector<NymphType*> values;
-		values.push_back(new NymphType(then));
+		values.push_back(new NymphType(ClockSync::toSlave(rm.handle, start)));
 			
 		std::string result;
 		NymphType* returnValue = 0;
@@ -600,54 +531,61 @@ bool startSlavePlayback() {
 		}
 			
 		delete returnValue;
-			
-		ts.update();
-		int64_t receive = (int64_t) ts.epochMicroseconds();
-			
-		countdown -= (receive - send);
 	}
 	
-	if (countdown > 0) {
-		// Wait out the countdown before returning.
-		std::condition_variable cv;
-		std::mutex cv_m;
-		std::unique_lock<std::mutex> lk(cv_m);
-		std::chrono::microseconds dur(countdown);
-		while (cv.wait_for(lk, dur) != std::cv_status::timeout) { }
+	if (ClockSync::now() > start) {
+		NYMPH_LOG_WARNING("Slave start scheduled too early, slaves will start late.");
 	}
 	
-	/* for (uint32_t i = 0; i < slave_remotes.size(); ++i) {
-		//
-		NymphType* resVal = 0;
-		std::string result;
-		std::vector<NymphType*> values;
-		if (!NymphRemoteClient::callCallback(slave_remotes[i].handle, "slave_start", values, result)) {
-			NYMPH_LOG_ERROR("Calling slave_start failed: " + result);
-			return false;
-		}
-	} */
+	ClockSync::waitUntil(start);
 	
 	return true;
 }
 
 
+// --- SYNC SLAVE CLOCK ---
+// [Master] Called after the clock estimates for a slave have been updated. Sends the current
+// audio clock, with the time it was read at converted into the slave's local time.
+void syncSlaveClock(uint32_t handle) {
+	int64_t pts, time;
+	if (!AudioRenderer::getClock(pts, time)) { return; }
+	
+	std::vector<NymphType*> values;
+	values.push_back(new NymphType(ClockSync::toSlave(handle, time)));
+	values.push_back(new NymphType(pts));
+	
+	std::string result;
+	NymphType* returnValue = 0;
+	if (!NymphRemoteServer::callMethod(handle, "slave_sync", values, returnValue, result)) {
+		NYMPH_LOG_ERROR("Calling slave_sync failed: " + result);
+		return;
+	}
+	
+	delete returnValue;
+}
+
+
 // --- DATA REQUEST HANDLER ---
-// Allows the DataBuffer to request more file data from a client.
-bool dataRequestHandler(uint32_t session) {
-	if (DataBuffer::seeking()) {
-		NYMPH_LOG_ERROR("Cannot request data while seeking. Abort.");
+// Allows the DataBuffer to request more file data from a client. 'size' is in kB.
+bool dataRequestHandler(uint32_t session, uint32_t size) {
+	std::shared_ptr<DataBuffer> db = SessionRegistry::get(session);
+	if (!db) {
+		NYMPH_LOG_ERROR("No buffer for session " + Poco::NumberFormatter::format(session) + ".");
 		return false;
 	}
 	
-	DataBuffer::dataRequestPending = true;
+	if (db->seeking()) {
+		NYMPH_LOG_ERROR("Cannot request data while seeking. Abort.");
+		return false;
+	}
 	
 	NYMPH_LOG_INFORMATION("Asking for data...");
 
 	// Request more data.
 	std::vector<NymphType*> values;
-	values.push_back(new NymphType(readBlockSize));
+	values.push_back(new NymphType(size));
 	std::string result;
-	if (!NymphRemoteClient::callCallback(DataBuffer::getSessionHandle(), "MediaReadCallback", values, result)) {
+	if (!NymphRemoteClient::callCallback(session, "MediaReadCallback", values, result)) {
 		NYMPH_LOG_ERROR("Calling callback failed: " + result);
 		return false;
 	}
@@ -658,12 +596,19 @@ bool dataRequestHandler(uint32_t session) {
 
 // --- SEEKING HANDLER ---
 void seekingHandler(uint32_t session, int64_t offset) {
-	if (DataBuffer::seeking()) {
+	std::shared_ptr<DataBuffer> db = SessionRegistry::get(session);
+	if (db && db->seeking()) {
 		if (serverMode == NCS_MODE_MASTER) {
 			// Send data buffer reset notification. This ensures that those are all reset as well.
+			// Data still queued for the slave is from before the seek and gets dropped first.
+			// Multicast data continues as a new stream, earlier packets are dropped by slaves.
+			mcastSender.reset();
 			for (int i = 0; i < slave_remotes.size(); ++i) {
 				NymphCastSlaveRemote& rm = slave_remotes[i];
+				if (rm.queue) { rm.queue->flush(); }
+				
 				std::vector<NymphType*> values;
+				values.push_back(new NymphType(mcastSender.getStream()));
 				std::string result;
 				NymphType* returnValue = 0;
 				if (!NymphRemoteServer::callMethod(rm.handle, "slave_buffer_reset", values, returnValue, result)) {
@@ -678,7 +623,7 @@ void seekingHandler(uint32_t session, int64_t offset) {
 		// Send message to client indicating that we're seeking in the file.
 		std::vector<NymphType*> values;
 		values.push_back(new NymphType((uint64_t) offset));
-		values.push_back(new NymphType(readBlockSize));
+		values.push_back(new NymphType(db->getBlockSize()));
 		std::string result;
 		NymphType* resVal = 0;
 		if (!NymphRemoteClient::callCallback(session, "MediaSeekCallback", values, result)) {
@@ -696,7 +641,7 @@ void seekingHandler(uint32_t session, int64_t offset) {
 // If a stream is queued, play it, otherwise end playback.
 void finishPlayback() {
 	// Send message to client indicating that we're done.
-	uint32_t handle = DataBuffer::getSessionHandle();
+	uint32_t handle = SessionRegistry::getActiveSession();
 	std::vector<NymphType*> values;
 	std::string result;
 	if (!NymphRemoteClient::callCallback(handle, "MediaStopCallback", values, result)) {
@@ -709,8 +654,11 @@ void finishPlayback() {
 		// TODO: Clear the screen?
 	}
 	
-	// Start the Screensaver here for now.
-	if (!display_disable) {
+	// Start the Screensaver here for now, unless a queued session or stream is played next.
+	if (SessionRegistry::hasNext() || SessionRegistry::hasStreamTrack()) {
+		// Do nothing.
+	}
+	else if (!display_disable) {
 		if (gui_enable) {
 			// Using same window. Do nothing.
 			
@@ -750,7 +698,7 @@ bool streamTrack(std::string url) {
 	// TODO: allow to cancel any currently playing track/empty queue?
 	if (ffplay.playbackActive()) {
 		// Add to queue.
-		DataBuffer::addStreamTrack(url);
+		SessionRegistry::addStreamTrack(url);
 		
 		return true;
 	}
@@ -759,7 +707,7 @@ bool streamTrack(std::string url) {
 	ffplay.streamTrack(url);
 	
 	// Send status update to client.
-	sendStatusUpdate(DataBuffer::getSessionHandle());
+	sendStatusUpdate(SessionRegistry::getActiveSession());
 	
 	return true;
 }
@@ -782,6 +730,7 @@ NymphMessage* connectClient(int session, NymphMessage* msg, void* data) {
 	// TODO: check whether we're not operating in slave or master mode already.
 	NYMPH_LOG_INFORMATION("Switching to stand-alone server mode.");
 	serverMode = NCS_MODE_STANDALONE;
+	mcastReceiver.stop();
 	
 	// Register this client with its ID. Return error if the client ID already exists.
 	NymphMessage* returnMsg = msg->getReplyMessage();
@@ -799,17 +748,12 @@ NymphMessage* connectClient(int session, NymphMessage* msg, void* data) {
 		c.sessionActive = false;
 		c.filesize = 0;
 		clients.insert(std::pair<int, CastClient>(session, c));
+		PlaybackStatus::addClient(session);
 		retVal = new NymphType(true);
 	}
 	
 	// Send the client the current playback status.
-	std::vector<NymphType*> values;
-	std::map<std::string, NymphPair>* status = getPlaybackStatus();
-	values.push_back(new NymphType(status, true));
-	std::string result;
-	if (!NymphRemoteClient::callCallback(session, "MediaStatusCallback", values, result)) {
-		NYMPH_LOG_ERROR("Calling media status callback failed: " + result);
-	}
+	PlaybackStatus::push(session);
 	
 	returnMsg->setResultValue(retVal);
 	msg->discard();
@@ -838,8 +782,15 @@ NymphMessage* connectMaster(int session, NymphMessage* msg, void* data) {
 		// FIXME: for now we just return the current time.
 		NYMPH_LOG_INFORMATION("Switching to slave server mode.");
 		serverMode = NCS_MODE_SLAVE;
-		//DataBuffer::setFileSize(it->second.filesize);
-		DataBuffer::setSessionHandle(session);
+		masterSession = session;
+		
+		// Multicast reception is started separately by the new master, if used.
+		mcastReceiver.stop();
+		
+		// The master streams the file data to us on its own session.
+		if (!SessionRegistry::create(session, 0, false)) {
+			NYMPH_LOG_ERROR("Failed to create buffer for master session.");
+		}
 		
 		Poco::Timestamp ts;
 		int64_t now = (int64_t) ts.epochMicroseconds();
@@ -859,76 +810,159 @@ NymphMessage* connectMaster(int session, NymphMessage* msg, void* data) {
 }
 
 
+// --- SLAVE WRITE DATA ---
+// Writes media data from the master into the buffer of the master's session and starts the
+// player if needed. Called for data received over RPC and multicast. (Slave-only)
+// Returns the number of bytes written. EOF is only set once all data has been written.
+uint32_t slaveWriteData(uint32_t session, const char* data, uint32_t length, bool done, 
+																				int64_t when) {
+	// The buffer of a finished track is dropped by the player, so the next track needs a new one.
+	std::shared_ptr<DataBuffer> db = SessionRegistry::get(session);
+	if (!db) { db = SessionRegistry::create(session, 0, false); }
+	if (!db) {
+		NYMPH_LOG_ERROR("No buffer for master session. Abort.");
+		return 0;
+	}
+	
+	// Write string into buffer.
+	uint32_t written = db->write(data, length);
+	
+	// Playback is started in its own function, which is called by the master when it's ready.
+	if (!ffplay.playbackActive()) {
+		// Start player. It waits for the start time set by the master.
+		ffplay.playTrack(when);
+	}
+	
+	if (done && written == length) {
+		db->setEof(done);
+	}
+	
+	return written;
+}
+
+
 // --- RECEIVE DATA MASTER ---
 // Receives data chunks for playback from a master receiver. (Slave-only)
-// uint8 receiveDataMaster(blob data, bool done, sint64 when)
+// Returns the free space in the buffer, in bytes.
+// uint32 receiveDataMaster(blob data, bool done, sint64 when)
 NymphMessage* receiveDataMaster(int session, NymphMessage* msg, void* data) {
 	NymphMessage* returnMsg = msg->getReplyMessage();
 	
 	// Extract data blob and add it to the buffer.
 	NymphType* mediaData = msg->parameters()[0];
 	bool done = msg->parameters()[1]->getBool();
+	int64_t when = msg->parameters()[2]->getInt64();
+	slaveWriteData(session, mediaData->getChar(), mediaData->string_length(), done, when);
 	
-	// Write string into buffer.
-	DataBuffer::write(mediaData->getChar(), mediaData->string_length());
+	msg->discard();
 	
-	// Playback is started in its own function, which is called by the master when it's ready.
-	int64_t then = 0;
-	if (!ffplay.playbackActive()) {
-		int64_t when = msg->parameters()[2]->getInt64();
-		
-		// Start the player when the delay in 'when' has been reached.
-		/* std::condition_variable cv;
-		std::mutex cv_m;
-		std::unique_lock<std::mutex> lk(cv_m);
-		//std::chrono::system_clock::time_point then = std::chrono::system_clock::from_time_t(when);
-		std::chrono::microseconds dur(when);
-		std::chrono::time_point<std::chrono::system_clock> then(dur);
-		//while (cv.wait_until(lk, then) != std::cv_status::timeout) { }
-		while (cv.wait_for(lk, dur) != std::cv_status::timeout) { } */
-		
-		// Start player.
-		ffplay.playTrack(when);
+	std::shared_ptr<DataBuffer> db = SessionRegistry::get(session);
+	returnMsg->setResultValue(new NymphType(db ? db->getFree() : (uint32_t) 0));
+	return returnMsg;
+}
+
+
+// --- SLAVE NACK ---
+// Requests multicast packets which were lost and could not be restored from the master.
+// (Slave-only)
+void slaveNack(uint32_t stream, uint32_t seq, uint32_t count) {
+	std::vector<NymphType*> values;
+	values.push_back(new NymphType(stream));
+	values.push_back(new NymphType(seq));
+	values.push_back(new NymphType(count));
+	std::string result;
+	if (!NymphRemoteClient::callCallback(masterSession, "MasterNackCallback", values, result)) {
+		NYMPH_LOG_ERROR("Calling master NACK callback failed: " + result);
 	}
+}
+
+
+// --- SLAVE MULTICAST ---
+// Starts receiving media data from the master over multicast. Data sent over RPC is still
+// accepted. (Slave-only)
+// Returns: OK (0), ERROR (1).
+// uint8 slave_multicast(string group, uint16 port)
+NymphMessage* slave_multicast(int session, NymphMessage* msg, void* data) {
+	NymphMessage* returnMsg = msg->getReplyMessage();
 	
-	if (done) {
-		DataBuffer::setEof(done);
-	}
+	std::string group = msg->parameters()[0]->getString();
+	uint16_t port = msg->parameters()[1]->getUint16();
+	
+	masterSession = session;
+	bool success = (serverMode == NCS_MODE_SLAVE) && mcastReceiver.start(group, port);
 	
+	returnMsg->setResultValue(new NymphType((uint8_t) (success ? 0 : 1)));
+	msg->discard();
+	
+	return returnMsg;
+}
+
+
+// --- SLAVE BUFFER FREE ---
+// Returns the free space in the buffer for data from the master, in bytes. (Slave-only)
+// uint32 slave_buffer_free()
+NymphMessage* slave_buffer_free(int session, NymphMessage* msg, void* data) {
+	NymphMessage* returnMsg = msg->getReplyMessage();
+	
+	std::shared_ptr<DataBuffer> db = SessionRegistry::get(session);
+	if (!db) { db = SessionRegistry::create(session, 0, false); }
+	
+	returnMsg->setResultValue(new NymphType(db ? db->getFree() : (uint32_t) 0));
 	msg->discard();
 	
-	returnMsg->setResultValue(new NymphType((uint8_t) 0));
 	return returnMsg;
 }
 
 
 // --- SLAVE START ---
-// Receives data chunks for playback from a master receiver. (Slave-only)
+// Sets the time at which this slave receiver starts playback. (Slave-only)
+// 'when' is the local time in microseconds since the epoch.
 // uint8 slave_start(int64 when)
 NymphMessage* slave_start(int session, NymphMessage* msg, void* data) {
 	NymphMessage* returnMsg = msg->getReplyMessage();
 	
-	// Extract data blob and add it to the buffer.
-	//NymphType* mediaData = msg->parameters()[0];
-	//bool done = msg->parameters()[1]->getBool();
 	int64_t when = msg->parameters()[0]->getInt64();
 	
-	if (!ffplay.playbackActive()) {
-		// Start the player when the delay in 'when' has been reached.
-		std::condition_variable cv;
-		std::mutex cv_m;
-		std::unique_lock<std::mutex> lk(cv_m);
-		//std::chrono::system_clock::time_point then = std::chrono::system_clock::from_time_t(when);
-		std::chrono::microseconds dur(when);
-		std::chrono::time_point<std::chrono::system_clock> then(dur);
-		//while (cv.wait_until(lk, then) != std::cv_status::timeout) { }
-		while (cv.wait_for(lk, dur) != std::cv_status::timeout) { }
-	}
-	
-	// Trigger the playback start condition variable that will resume the read_thread of this slave
-	// receiver's ffplay module.
+	// Resume the read_thread of this slave receiver's ffplay module, which waits for the start
+	// time before starting playback.
 	if (serverMode == NCS_MODE_SLAVE) {
+		slavePlayMutex.lock();
+		slaveStartTime = when;
 		slavePlayCon.signal();
+		slavePlayMutex.unlock();
+	}
+	
+	msg->discard();
+	
+	returnMsg->setResultValue(new NymphType((uint8_t) 0));
+	return returnMsg;
+}
+
+
+// --- SLAVE TIME ---
+// Returns the current local time in microseconds, for the clock synchronisation of the master.
+// (Slave-only)
+// int64 slave_time()
+NymphMessage* slave_time(int session, NymphMessage* msg, void* data) {
+	NymphMessage* returnMsg = msg->getReplyMessage();
+	returnMsg->setResultValue(new NymphType(ClockSync::now()));
+	msg->discard();
+	
+	return returnMsg;
+}
+
+
+// --- SLAVE SYNC ---
+// The audio clock of the master read 'pts' at the local time 'when', both in microseconds. Used
+// to keep the audio output of this receiver on that of the master. (Slave-only)
+// uint8 slave_sync(int64 when, int64 pts)
+NymphMessage* slave_sync(int session, NymphMessage* msg, void* data) {
+	NymphMessage* returnMsg = msg->getReplyMessage();
+	
+	int64_t when = msg->parameters()[0]->getInt64();
+	int64_t pts = msg->parameters()[1]->getInt64();
+	if (serverMode == NCS_MODE_SLAVE) {
+		AudioRenderer::setMasterClock(pts, when);
 	}
 	
 	msg->discard();
@@ -949,16 +983,26 @@ NymphMessage* disconnect(int session, NymphMessage* msg, void* data) {
 		clients.erase(it);
 	}
 	
+	PlaybackStatus::removeClient(session);
+	
+	// Drop the client's file stream. A player still reading from it keeps it alive until done.
+	SessionRegistry::remove(session);
+	
 	NYMPH_LOG_INFORMATION("Current server mode: " + Poco::NumberFormatter::format(serverMode));
 	
 	// Disconnect any slave remotes if we're connected.
 	if (serverMode == NCS_MODE_MASTER) {
 		NYMPH_LOG_DEBUG("# of slave remotes: " + 
 								Poco::NumberFormatter::format(slave_remotes.size()));
+		ClockSync::stop();
+		ClockSync::clear();
+		mcastSender.stop();
 		for (int i = 0; i < slave_remotes.size(); ++i) {
 			// Disconnect from slave remote.
 			NymphCastSlaveRemote& rm = slave_remotes[i];
 			NYMPH_LOG_DEBUG("Disconnecting slave: " + rm.name);
+			if (rm.queue) { rm.queue->stop(); }
+			
 			std::string result;
 			if (!NymphRemoteServer::disconnect(rm.handle, result)) {
 				// Failed to connect, error out. Disconnect from any already connected slaves.
@@ -971,6 +1015,7 @@ NymphMessage* disconnect(int session, NymphMessage* msg, void* data) {
 	
 	NYMPH_LOG_INFORMATION("Switching to stand-alone server mode.");
 	serverMode = NCS_MODE_STANDALONE;
+	mcastReceiver.stop();
 	
 	NymphMessage* returnMsg = msg->getReplyMessage();
 	returnMsg->setResultValue(new NymphType(true));
@@ -1009,11 +1054,12 @@ NymphMessage* session_start(int session, NymphMessage* msg, void* data) {
 	
 	it->second.filesize = num->getUint32();
 	
-	// Check whether we're already playing or not. If we continue here, this will forcefully 
-	// end current playback.
+	// Check whether we're already playing or not. A new session while another session is
+	// playing gets queued behind it. Restarting the session being played is an error.
 	//	FIXME:	=> this likely happens due to a status update glitch. Fix by sending back status update
 	// 			along with error?
-	if (ffplay.playbackActive()) {
+	bool playing = ffplay.playbackActive();
+	if (playing && (SessionRegistry::isActive(session) || serverMode != NCS_MODE_STANDALONE)) {
 		NYMPH_LOG_ERROR("Trying to start a new session with session already active. Abort.");
 		returnMsg->setResultValue(new NymphType((uint8_t) 1));
 		msg->discard();
@@ -1039,13 +1085,20 @@ NymphMessage* session_start(int session, NymphMessage* msg, void* data) {
 	NYMPH_LOG_INFORMATION("Starting new session for file with size: " +
 							Poco::NumberFormatter::format(it->second.filesize));
 	
-	DataBuffer::setFileSize(it->second.filesize);
-	DataBuffer::setSessionHandle(session);
+	std::shared_ptr<DataBuffer> db = SessionRegistry::create(session, it->second.filesize, playing);
+	if (!db) {
+		NYMPH_LOG_ERROR("Failed to create session buffer. Abort.");
+		returnMsg->setResultValue(new NymphType((uint8_t) 1));
+		msg->discard();
+		
+		return returnMsg;
+	}
 	
 	// Start calling the client's read callback method to obtain data. Once the data buffer
 	// has been filled sufficiently, start the playback.
-	if (!DataBuffer::start()) {
+	if (!db->start()) {
 		NYMPH_LOG_ERROR("Failed to start buffering. Abort.");
+		SessionRegistry::remove(session);
 		returnMsg->setResultValue(new NymphType((uint8_t) 1));
 		msg->discard();
 		
@@ -1054,6 +1107,17 @@ NymphMessage* session_start(int session, NymphMessage* msg, void* data) {
 		
 	it->second.sessionActive = true;
 	
+	// A queued session prefetches its first data, and gets played once the current one ends.
+	if (!SessionRegistry::isActive(session)) {
+		NYMPH_LOG_INFORMATION("Queued session behind current playback.");
+		db->startPrefetch();
+		
+		returnMsg->setResultValue(new NymphType((uint8_t) 0));
+		msg->discard();
+		
+		return returnMsg;
+	}
+	
 	// Stop screensaver.
 	if (!video_disable) {
 		if (gui_enable) {
@@ -1108,8 +1172,13 @@ NymphMessage* session_add_slave(int session, NymphMessage* msg, void* data) {
 	
 	// Disconnect slaves and clear array.
 	// TODO: Maybe merge this with proper session management.
+	ClockSync::stop();
+	ClockSync::clear();
+	mcastSender.stop();
 	for (uint32_t i = 0; i < slave_remotes.size(); ++i) {
 		NymphCastSlaveRemote& rm = slave_remotes[i];
+		if (rm.queue) { rm.queue->stop(); }
+		
 		std::string result;
 		if (!NymphRemoteServer::disconnect(rm.handle, result)) {
 			// Failed to connect, error out. Disconnect from any already connected slaves.
@@ -1168,7 +1237,6 @@ NymphMessage* session_add_slave(int session, NymphMessage* msg, void* data) {
 		}
 		
 		// Attempt to start slave mode on the remote.
-		// Send the current timestamp to the slave remote as part of the latency determination.
 		Poco::Timestamp ts;
 		int64_t now = (int64_t) ts.epochMicroseconds();
 		std::vector<NymphType*> values;
@@ -1183,9 +1251,6 @@ NymphMessage* session_add_slave(int session, NymphMessage* msg, void* data) {
 			return returnMsg;
 		}
 		
-		// Get new time. This should be roughly twice the latency to the slave remote.
-		ts.update();
-		int64_t pong = ts.epochMicroseconds();
 		time_t theirs = returnValue->getInt64();
 		delete returnValue;
 		if (theirs == 0) {
@@ -1197,11 +1262,50 @@ NymphMessage* session_add_slave(int session, NymphMessage* msg, void* data) {
 			return returnMsg;
 		}
 		
-		// Use returned time stamp to calculate the delay.
-		// FIXME: using stopwatch-style local time to determine latency for now.
+		// Initial clock offset estimate. Further rounds run in the background to track drift.
+		ClockSync::addSlave(rm.handle);
+		ClockSyncState state;
+		if (!ClockSync::measure(rm.handle) || !ClockSync::getState(rm.handle, state)) {
+			NYMPH_LOG_ERROR("Clock synchronisation with slave failed.");
+			// TODO: disconnect from slave remotes.
+			returnMsg->setResultValue(new NymphType((uint8_t) 1));
+			msg->discard();
+			
+			return returnMsg;
+		}
+		
+		rm.delay = state.rtt;
+		
+		// With multicast enabled the slave joins the group, otherwise (or if that fails) the
+		// media data is sent through its own send queue.
+		rm.multicast = false;
+		if (multicastEnable && (mcastSender.isOpen() || 
+									mcastSender.start(multicastGroup, multicastPort))) {
+			values.clear();
+			values.push_back(new NymphType(&multicastGroup));
+			values.push_back(new NymphType(multicastPort));
+			returnValue = 0;
+			if (!NymphRemoteServer::callMethod(rm.handle, "slave_multicast", values, returnValue, 
+																					result)) {
+				NYMPH_LOG_ERROR("Calling slave_multicast failed: " + result);
+			}
+			else {
+				rm.multicast = (returnValue->getUint8() == 0);
+			}
+			
+			delete returnValue;
+		}
+		
+		if (!rm.multicast) {
+			if (multicastEnable) {
+				NYMPH_LOG_WARNING("Multicast not available, sending media data to slave " + 
+																		rm.name + " over RPC.");
+			}
+			
+			rm.queue = std::make_shared<SlaveQueue>(rm.handle, rm.name);
+			rm.queue->start();
+		}
 		
-		//rm.delay = theirs - now;
-		rm.delay = pong - now;
 		NYMPH_LOG_DEBUG("Slave delay: " + Poco::NumberFormatter::format(rm.delay) + 
 							" microseconds.");
 		NYMPH_LOG_DEBUG("Current max slave delay: " + 
@@ -1215,6 +1319,7 @@ NymphMessage* session_add_slave(int session, NymphMessage* msg, void* data) {
 	
 	NYMPH_LOG_INFORMATION("Switching to master server mode.");
 	serverMode = NCS_MODE_MASTER;
+	ClockSync::start(syncSlaveClock);
 	
 	returnMsg->setResultValue(new NymphType((uint8_t) 0));
 	msg->discard();
@@ -1242,71 +1347,52 @@ NymphMessage* session_data(int session, NymphMessage* msg, void* data) {
 	NymphType* mediaData = msg->parameters()[0];
 	bool done = msg->parameters()[1]->getBool();
 	
-	// Update EOF status.
-	DataBuffer::setEof(done);
+	std::shared_ptr<DataBuffer> db = SessionRegistry::get(session);
+	if (!db) {
+		returnMsg->setResultValue(new NymphType((uint8_t) 1));
+		msg->discard();
+		return returnMsg;
+	}
 	
 	// Write string into buffer.
-	DataBuffer::write(mediaData->getChar(), mediaData->string_length());
-	
-	// If passing the message through to slave remotes, add the timestamp to the message.
-	// This timestamp is the current time plus the largest master-slave latency times 2.
-	// Timing: 	Multiply the max slave latency by the number of slaves. After sending this delay
-	// 			to the first slave (minus half its recorded latency), 
-	// 			subtract the time it took to send to this slave from the
-	//			first delay, then send this new delay to the second slave, and so on.
-	int64_t then = 0;
+	db->write(mediaData->getChar(), mediaData->string_length());
+	
+	// Update EOF status. Only after the write, as this wakes the reader.
+	db->setEof(done);
+	
+	// Data for a queued session is only buffered until its turn.
+	if (!SessionRegistry::isActive(session)) {
+		returnMsg->setResultValue(new NymphType((uint8_t) 0));
+		msg->discard();
+		return returnMsg;
+	}
+	
+	// Pass the data on to the slave remotes. Slaves in the multicast group get it in one send.
+	// Other slaves have their own send queue, so that this returns without waiting for the
+	// slaves. The chunk is shared between the queues. Only if a queue is full do we wait, for
+	// all slaves at once, so that a slow slave holds up the client for SQ_PUSH_TIMEOUT at most.
+	// Playback start is scheduled separately, see startSlavePlayback().
 	if (serverMode == NCS_MODE_MASTER) {
-		Poco::Timestamp ts;
-		int64_t now = 0;
-		int64_t countdown = 0;
-		if (!ffplay.playbackActive()) {
-			now = (int64_t) ts.epochMicroseconds();
-			//then = now + (slaveLatencyMax * 2);
-			countdown = slaveLatencyMax * slave_remotes.size();
-		}
+		mcastSender.send(mediaData->getChar(), mediaData->string_length(), done);
 		
+		std::shared_ptr<std::string> chunk;
 		for (int i = 0; i < slave_remotes.size(); ++i) {
 			NymphCastSlaveRemote& rm = slave_remotes[i];
+			if (!rm.queue || rm.queue->isFailed()) { continue; }
 			
-			int64_t send = 0;
-			if (!ffplay.playbackActive()) {
-				//then = slaveLatencyMax - rm.delay;
-				then = countdown - (rm.delay / 2);
-				ts.update();
-				send = (int64_t) ts.epochMicroseconds();
-			}
-		
-			// Prepare data vector.
-			NymphType* media = new NymphType((char*) mediaData->getChar(), mediaData->string_length());
-			NymphType* doneBool = new NymphType(done);
-			std::vector<NymphType*> values;
-			values.push_back(media);
-			values.push_back(doneBool);
-			values.push_back(new NymphType(then));
-			
-			std::string result;
-			NymphType* returnValue = 0;
-			if (!NymphRemoteServer::callMethod(rm.handle, "receiveDataMaster", values, returnValue, result)) {
-				// TODO:
+			if (!chunk) {
+				chunk = std::make_shared<std::string>(mediaData->getChar(), 
+																mediaData->string_length());
 			}
 			
-			delete returnValue;
-			
-			if (!ffplay.playbackActive()) {
-				ts.update();
-				int64_t receive = (int64_t) ts.epochMicroseconds();
-			
-				countdown -= (receive - send);
-			}
+			rm.queue->push(chunk, done, 0);
 		}
 		
-		if (!ffplay.playbackActive()) {
-			// Wait out the countdown.
-			std::condition_variable cv;
-			std::mutex cv_m;
-			std::unique_lock<std::mutex> lk(cv_m);
-			std::chrono::microseconds dur(countdown);
-			while (cv.wait_for(lk, dur) != std::cv_status::timeout) { }
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now()
+											+ std::chrono::milliseconds(SQ_PUSH_TIMEOUT);
+		for (int i = 0; i < slave_remotes.size(); ++i) {
+			NymphCastSlaveRemote& rm = slave_remotes[i];
+			if (rm.queue) { rm.queue->waitSpace(deadline); }
 		}
 	}
 	
@@ -1375,13 +1461,21 @@ NymphMessage* session_end(int session, NymphMessage* msg, void* data) {
 
 // --- SLAVE BUFFER RESET ---
 // Called to reset the slave's local data buffer.
+// 'stream' is the master's new multicast stream, which follows the seek.
 // Returns: OK (0), ERROR (1).
-// int slave_buffer_reset()
+// int slave_buffer_reset(uint32 stream)
 NymphMessage* slave_buffer_reset(int session, NymphMessage* msg, void* data) {
 	NymphMessage* returnMsg = msg->getReplyMessage();
 	
-	// Call DataBuffer's reset function.
-	if (!DataBuffer::reset()) {
+	// The master's audio clock jumps with the seek, drop the reference until the next update.
+	AudioRenderer::clearMasterClock();
+	
+	// Drop multicast data from before the seek which is still on its way.
+	mcastReceiver.reset(msg->parameters()[0]->getUint32());
+	
+	// Call the reset function of the buffer the master streams into.
+	std::shared_ptr<DataBuffer> db = SessionRegistry::get(session);
+	if (!db || !db->reset()) {
 		NYMPH_LOG_ERROR("Resetting data buffer failed.");
 		returnMsg->setResultValue(new NymphType((uint8_t) 1));
 		msg->discard();
@@ -1422,7 +1516,7 @@ NymphMessage* volume_set(int session, NymphMessage* msg, void* data) {
 	ffplay.setVolume(volume);
 	
 	// Inform all clients of this update.
-	//sendGlobalStatusUpdate();
+	sendGlobalStatusUpdate();
 	
 	returnMsg->setResultValue(new NymphType((uint8_t) 0));
 	msg->discard();
@@ -1567,7 +1661,7 @@ NymphMessage* playback_start(int session, NymphMessage* msg, void* data) {
 	playerPaused = false;
 	
 	// Send status update to clients.
-	//sendGlobalStatusUpdate();
+	sendGlobalStatusUpdate();
 	
 	returnMsg->setResultValue(new NymphType((uint8_t) 0));
 	msg->discard();
@@ -1637,7 +1731,7 @@ NymphMessage* playback_pause(int session, NymphMessage* msg, void* data) {
 	playerPaused = !playerPaused;
 	
 	// Send status update to clients.
-	//sendGlobalStatusUpdate();
+	sendGlobalStatusUpdate();
 	
 	returnMsg->setResultValue(new NymphType((uint8_t) 0));
 	msg->discard();
@@ -1816,7 +1910,7 @@ NymphMessage* subtitles_set(int session, NymphMessage* msg, void* data) {
 	subtitle_disable = !stat; // Invert to match intent.
 	
 	// Send status update to clients.
-	//sendGlobalStatusUpdate();
+	sendGlobalStatusUpdate();
 	
 	returnMsg->setResultValue(new NymphType((uint8_t) 0));
 	msg->discard();
@@ -1855,7 +1949,7 @@ NymphMessage* playback_url(int session, NymphMessage* msg, void* data) {
 	}
 	
 	// Send status update to client.
-	sendStatusUpdate(DataBuffer::getSessionHandle());
+	sendStatusUpdate(SessionRegistry::getActiveSession());
 	
 	returnMsg->setResultValue(retval);
 	msg->discard();
@@ -1870,7 +1964,22 @@ NymphMessage* playback_url(int session, NymphMessage* msg, void* data) {
 NymphMessage* playback_status(int session, NymphMessage* msg, void* data) {
 	NymphMessage* returnMsg = msg->getReplyMessage();
 		
-	returnMsg->setResultValue(new NymphType(getPlaybackStatus(), true));
+	returnMsg->setResultValue(new NymphType(PlaybackStatus::getStatus(), true));
+	msg->discard();
+	
+	return returnMsg;
+}
+
+
+// --- PLAYBACK STATUS DELTA ---
+// uint8 playback_status_delta(bool enable)
+// Whether status updates pushed to this client only contain the fields which changed.
+NymphMessage* playback_status_delta(int session, NymphMessage* msg, void* data) {
+	NymphMessage* returnMsg = msg->getReplyMessage();
+	
+	PlaybackStatus::setDelta(session, msg->parameters()[0]->getBool());
+	
+	returnMsg->setResultValue(new NymphType((uint8_t) 0));
 	msg->discard();
 	
 	return returnMsg;
@@ -1946,92 +2055,96 @@ NymphMessage* app_send(int session, NymphMessage* msg, void* data) {
 }
 
 
+// --- RESOURCE PATH ---
+// Find the file of a resource in an app folder, or in the apps root folder for an empty app ID.
+bool resourcePath(const std::string &appId, const std::string &name, std::string &path) {
+	// Check that the name doesn't contain a '/' or '\' as this might be used to create
+	// a relative path that breaks security (hierarchy travel).
+	if (name.find('/') != std::string::npos || name.find('\\') != std::string::npos) {
+		NYMPH_LOG_ERROR("File name contained illegal directory separator character.");
+		return false;
+	}
+	
+	if (appId.empty()) {
+		// Use root folder.
+		path = appsFolder + name;
+		return true;
+	}
+	
+	// Use App folder.
+	// First check that the app really exists, as a safety feature. This should prevent
+	// relative path that lead up the hierarchy.
+	NymphCastApp app = nc_apps.findApp(appId);
+	if (app.id.empty()) {
+		NYMPH_LOG_ERROR("Failed to find a matching application for '" + appId + "'.");
+		return false;
+	}
+	
+	path = appsFolder + appId + "/" + name;
+	return true;
+}
+
+
+// --- LOAD RESOURCE ---
+// Get a resource from the resource cache. The status is RC_STATUS_NOT_FOUND on failure.
+ResourceResult loadResource(const std::string &appId, const std::string &name,
+												const std::string &token, uint8_t flags) {
+	std::string path;
+	if (!resourcePath(appId, name, path)) { return ResourceResult(); }
+	
+	ResourceResult res = ResourceCache::get(appId, name, path, token, flags);
+	if (res.status == RC_STATUS_NOT_FOUND) {
+		NYMPH_LOG_ERROR("Failed to find requested file '" + path + "'.");
+	}
+	
+	return res;
+}
+
+
 // --- APP LOAD RESOURCE ---
 NymphMessage* app_loadResource(int session, NymphMessage* msg, void* data) {
 	NymphMessage* returnMsg = msg->getReplyMessage();
 	
-	// Validate the application ID, try to find running instance, else launch new app instance.
 	std::string appId = msg->parameters()[0]->getString();
 	std::string name = msg->parameters()[1]->getString();
 	
-	// Find the application details.
-	std::string* result = new std::string();
+	// The reply gets its own copy of the data, as the cache may drop it before the reply is sent.
+	ResourceResult res = loadResource(appId, name, std::string(), 0);
+	if (res.data) {
+		returnMsg->setResultValue(new NymphType(new std::string(*res.data), true));
+	}
+	else {
+		returnMsg->setResultValue(new NymphType(new std::string(), true));
+	}
 	
-	if (appId.empty()) {
-		// Use root folder.
-		// First check that the name doesn't contain a '/' or '\' as this might be used to create
-		// a relative path that breaks security (hierarchy travel).
-		if (name.find('/') != std::string::npos || name.find('\\') != std::string::npos) {
-			NYMPH_LOG_ERROR("File name contained illegal directory separator character.");
-			returnMsg->setResultValue(new NymphType(result, true));
-			msg->discard();
-			
-			return returnMsg;
-		}
-		
-		fs::path f = appsFolder + name;
-		if (!fs::exists(f)) {
-			NYMPH_LOG_ERROR("Failed to find requested file '" + f.string() + "'.");
-			returnMsg->setResultValue(new NymphType(result, true));
-			msg->discard();
-			
-			return returnMsg;
-		}
-		
-		// Read in file data.
-		NYMPH_LOG_INFORMATION("Reading file: " + f.string());
-		std::ifstream fstr(f.string());
-		fstr.seekg(0, std::ios::end);
-		size_t size = fstr.tellg();
-		std::string buffer(size, ' ');
-		fstr.seekg(0);
-		fstr.read(&buffer[0], size);
-		result->swap(buffer);
+	msg->discard();
+	
+	return returnMsg;
+}
+
+
+// --- APP LOAD RESOURCE CACHED ---
+NymphMessage* app_loadResourceCached(int session, NymphMessage* msg, void* data) {
+	NymphMessage* returnMsg = msg->getReplyMessage();
+	
+	std::string appId = msg->parameters()[0]->getString();
+	std::string name = msg->parameters()[1]->getString();
+	std::string token = msg->parameters()[2]->getString();
+	uint8_t flags = msg->parameters()[3]->getUint8();
+	
+	ResourceResult res = loadResource(appId, name, token, flags);
+	std::map<std::string, NymphPair>* pairs = new std::map<std::string, NymphPair>;
+	addPair(pairs, "status", new NymphType(res.status));
+	addPair(pairs, "token", new NymphType(new std::string(res.token), true));
+	addPair(pairs, "encoding", new NymphType(new std::string(res.encoding), true));
+	if (res.data) {
+		addPair(pairs, "data", new NymphType(new std::string(*res.data), true));
 	}
 	else {
-		// Use App folder.
-		// First check that the app really exists, as a safety feature. This should prevent
-		// relative path that lead up the hierarchy.
-		NymphCastApp app = nc_apps.findApp(appId);
-		if (app.id.empty()) {
-			NYMPH_LOG_ERROR("Failed to find a matching application for '" + appId + "'.");
-			returnMsg->setResultValue(new NymphType(result, true));
-			msg->discard();
-			
-			return returnMsg;
-		}
-		
-		// Next check that the name doesn't contain a '/' or '\' as this might be used to create
-		// a relative path that breaks security (hierarchy travel).
-		if (name.find('/') != std::string::npos || name.find('\\') != std::string::npos) {
-			NYMPH_LOG_ERROR("File name contained illegal directory separator character.");
-			returnMsg->setResultValue(new NymphType(result, true));
-			msg->discard();
-			
-			return returnMsg;
-		}
-		
-		fs::path f = appsFolder + appId + "/" + name;
-		if (!fs::exists(f)) {
-			NYMPH_LOG_ERROR("Failed to find requested file '" + f.string() + "'.");
-			returnMsg->setResultValue(new NymphType(result, true));
-			msg->discard();
-			
-			return returnMsg;
-		}
-		
-		// Read in file data.
-		NYMPH_LOG_INFORMATION("Reading file: " + f.string());
-		std::ifstream fstr(f.string());
-		fstr.seekg(0, std::ios::end);
-		size_t size = fstr.tellg();
-		std::string buffer(size, ' ');
-		fstr.seekg(0);
-		fstr.read(&buffer[0], size);
-		result->swap(buffer);
-	}
-	
-	returnMsg->setResultValue(new NymphType(result));
+		addPair(pairs, "data", new NymphType(new std::string(), true));
+	}
+	
+	returnMsg->setResultValue(new NymphType(pairs, true));
 	msg->discard();
 	
 	return returnMsg;
@@ -2144,6 +2257,30 @@ int main(int argc, char** argv) {
 	display_disable = config.getValue<bool>("disable_video", false);
 	screensaver_enable = config.getValue<bool>("enable_screensaver", false);
 	
+	// Open the next queued track ahead of time, for a gapless transition.
+	gapless = config.getValue<bool>("gapless", true);
+	
+	// Hardware video decoding method, or 'none' to decode in software.
+	hwaccel = config.getValue<std::string>("hwaccel", "none");
+	
+	// Switch the display to a refresh rate matching the frame rate of videos, in full-screen mode.
+	refresh_rate_match = config.getValue<bool>("refresh_rate_match", false);
+	
+	// Send media data to slave receivers over multicast, when in master mode.
+	multicastEnable = config.getValue<bool>("multicast", false);
+	multicastGroup = config.getValue<std::string>("multicast_group", "239.255.78.67");
+	multicastPort = config.getValue<uint16_t>("multicast_port", 4005);
+	
+	// Key/value storage of apps: values cached per app, and whether to write them in batches.
+	nc_apps.setStoreOptions(config.getValue<uint32_t>("app_store_cache", 256),
+							config.getValue<bool>("app_store_write_back", false));
+	
+	// Maximum number of playback status updates per second sent to each client.
+	status_rate = config.getValue<uint32_t>("status_rate", 4);
+	
+	// Size of the cache of app resources, in MB.
+	app_resource_cache = config.getValue<uint32_t>("app_resource_cache", 16);
+	
 	// Check for 'enable_gui' boolean value. If 'true', use the GUI interface.
 	gui_enable = config.getValue<bool>("enable_gui", false);
 	
@@ -2161,8 +2298,7 @@ int main(int argc, char** argv) {
 		// TODO:
 		media_file = config.getValue<std::string>("media_file", "");
 		if (!media_file.empty()) {
-			// Obtain the list of directories to scan.
-			std::cout << "Scanning directories..." << std::endl;
+			// Obtain the list of directories to index.
 			INIReader folderList(media_file);
 			if (folderList.ParseError() != 0) {
 				std::cerr << "Failed to parse the '" << media_file << "' file." << std::endl;
@@ -2172,11 +2308,9 @@ int main(int argc, char** argv) {
 			std::set<std::string> sections = folderList.Sections();
 			std::cout << "Found " << sections.size() << " sections in the folder list." << std::endl;
 			
-			uint32_t index = 0;
 			std::set<std::string>::const_iterator it;
 			for (it = sections.cbegin(); it != sections.cend(); ++it) {
-				// Read out each 'path' string and add the files in the folder (if it exists) to the
-				// central list.
+				// Read out each 'path' string and add the folder to the media index.
 				std::cout << "Section: " << *it << std::endl;
 				std::string path = folderList.Get(*it, "path", "");
 				if (path.empty()) {
@@ -2184,38 +2318,21 @@ int main(int argc, char** argv) {
 					continue;
 				}
 				
-				// Check that path is a valid directory.
-				fs::path dir = path;
-				if (!fs::is_directory(dir)) {
-					std::cout << "Path is not a valid directory: " << path << ". Skipping." << std::endl;
-					continue;
-				}
-				
-				// Iterate through the directory to filter out the media files.
-				for (fs::recursive_directory_iterator next(dir); next != fs::end(next); next++) {
-					fs::path fe = next->path();
-					//std::cout << "Checking path: " << fe.string() << std::endl;
-					if (!fs::is_regular_file(fe)) {
-						continue; 
-					}
-					
-					std::string ext = fe.extension().string();
-					ext.erase(0, 1);	// Remove leading '.' character.
-					//std::cout << "Checking extension: " << ext << std::endl;
-					MediaFile mf;
-					uint8_t type;
-					if (MimeType::hasExtension(ext, type)) {
-						// Add to media file list.
-						std::cout << "Adding file: " << fe << std::endl;
-						
-						mf.path = fe;
-						mf.section = *it;
-						mf.filename = fs::absolute(fe).string(); // Absolute path.
-						mf.type = type;
-						mediaFiles.push_back(mf);
-					}
-				}
+				mediaIndex.addSection(*it, path);
+			}
+			
+			// Load the files found before, then scan the folders again in the background.
+			std::string media_index = config.getValue<std::string>("media_index", media_file + ".db");
+			if (!mediaIndex.open(media_index)) {
+				std::cerr << "Failed to open the media index '" << media_index << "'. Files found "
+							<< "won't be kept." << std::endl;
 			}
+			
+			mediaIndex.start();
+			
+			// Probe the files in the background while nothing is playing.
+			uint32_t media_probe_threads = config.getValue<uint32_t>("media_probe_threads", 1);
+			MediaProbe::start(&mediaIndex, [] { return ffplay.playbackActive(); }, media_probe_threads);
 		}
 		else {
 			std::cerr << "Local media file enabled, but empty path." << std::endl;
@@ -2263,21 +2380,49 @@ int main(int argc, char** argv) {
 	NymphRemoteClient::registerMethod("connectMaster", connectMasterFunction);
 	
 	// Receives data chunks for playback.
-	// uint8 receiveDataMaster(blob data, bool done, sint64)
+	// uint32 receiveDataMaster(blob data, bool done, sint64)
 	parameters.clear();
 	parameters.push_back(NYMPH_STRING);
 	parameters.push_back(NYMPH_BOOL);
 	parameters.push_back(NYMPH_SINT64);
-	NymphMethod receivedataMasterFunction("receiveDataMaster", parameters, NYMPH_UINT8, receiveDataMaster);
+	NymphMethod receivedataMasterFunction("receiveDataMaster", parameters, NYMPH_UINT32, receiveDataMaster);
 	NymphRemoteClient::registerMethod("receiveDataMaster", receivedataMasterFunction);
 	
-	// Receives data chunks for playback.
+	// Returns the free space in the slave's buffer.
+	// uint32 slave_buffer_free()
+	parameters.clear();
+	NymphMethod slaveBufferFreeFunction("slave_buffer_free", parameters, NYMPH_UINT32, slave_buffer_free);
+	NymphRemoteClient::registerMethod("slave_buffer_free", slaveBufferFreeFunction);
+	
+	// Sets the local time at which the slave starts playback.
 	// uint8 slave_start(sint64 when)
 	parameters.clear();
 	parameters.push_back(NYMPH_SINT64);
 	NymphMethod slaveStartFunction("slave_start", parameters, NYMPH_UINT8, slave_start);
 	NymphRemoteClient::registerMethod("slave_start", slaveStartFunction);
 	
+	// Returns the slave's local time, for the clock synchronisation.
+	// sint64 slave_time()
+	parameters.clear();
+	NymphMethod slaveTimeFunction("slave_time", parameters, NYMPH_SINT64, slave_time);
+	NymphRemoteClient::registerMethod("slave_time", slaveTimeFunction);
+	
+	// Master audio clock reference for the slave.
+	// uint8 slave_sync(sint64 when, sint64 pts)
+	parameters.clear();
+	parameters.push_back(NYMPH_SINT64);
+	parameters.push_back(NYMPH_SINT64);
+	NymphMethod slaveSyncFunction("slave_sync", parameters, NYMPH_UINT8, slave_sync);
+	NymphRemoteClient::registerMethod("slave_sync", slaveSyncFunction);
+	
+	// Starts receiving media data over multicast from the master.
+	// uint8 slave_multicast(string group, uint16 port)
+	parameters.clear();
+	parameters.push_back(NYMPH_STRING);
+	parameters.push_back(NYMPH_UINT16);
+	NymphMethod slaveMulticastFunction("slave_multicast", parameters, NYMPH_UINT8, slave_multicast);
+	NymphRemoteClient::registerMethod("slave_multicast", slaveMulticastFunction);
+	
 	// Client disconnects from server.
 	// bool disconnect()
 	parameters.clear();
@@ -2329,8 +2474,9 @@ int main(int argc, char** argv) {
 	
 	// Reset slave data buffer.
 	// Returns: OK (0), ERROR (1).
-	// int slave_buffer_reset()
+	// int slave_buffer_reset(uint32 stream)
 	parameters.clear();
+	parameters.push_back(NYMPH_UINT32);
 	NymphMethod slaveBufferResetFunction("slave_buffer_reset", parameters, NYMPH_UINT8, slave_buffer_reset);
 	NymphRemoteClient::registerMethod("slave_buffer_reset", slaveBufferResetFunction);
 	
@@ -2466,6 +2612,17 @@ int main(int argc, char** argv) {
 	parameters.clear();
 	NymphMethod playbackStatusFunction("playback_status", parameters, NYMPH_STRUCT, playback_status);
 	NymphRemoteClient::registerMethod("playback_status", playbackStatusFunction);
+	
+	// PlaybackStatusDelta
+	// uint8 playback_status_delta(bool enable)
+	// Opt in to status updates with only the fields which changed since the previous update.
+	// Each update has a 'version' field, delta updates also a 'delta' field set to true.
+	// Returns success or error number.
+	parameters.clear();
+	parameters.push_back(NYMPH_BOOL);
+	NymphMethod playbackStatusDeltaFunction("playback_status_delta", parameters, NYMPH_UINT8, 
+																			playback_status_delta);
+	NymphRemoteClient::registerMethod("playback_status_delta", playbackStatusDeltaFunction);
 		
 	// AppList
 	// string app_list()
@@ -2497,11 +2654,49 @@ int main(int argc, char** argv) {
 	NymphMethod appLoadResourceFunction("app_loadResource", parameters, NYMPH_STRING, app_loadResource);
 	NymphRemoteClient::registerMethod("app_loadResource", appLoadResourceFunction);
 	
+	// AppLoadResourceCached
+	// struct app_loadResourceCached(string appId, string resource, string token, uint8 flags)
+	// appID	: ID of the app, or blank for the root folder.
+	// resource	: Name of the resource file.
+	// token	: 'token' returned with the copy of the resource the client has, or empty.
+	// flags	: RC_FLAG_GZIP (0x01) if the client accepts gzip encoded data.
+	// Returns a struct with the 'status' (0: OK, 1: not modified, 2: not found), the 'token' of
+	// the current resource, the 'encoding' of the data ("gzip" or empty) and the 'data', which
+	// is empty unless the status is OK.
+	parameters.clear();
+	parameters.push_back(NYMPH_STRING);
+	parameters.push_back(NYMPH_STRING);
+	parameters.push_back(NYMPH_STRING);
+	parameters.push_back(NYMPH_UINT8);
+	NymphMethod appLoadResourceCachedFunction("app_loadResourceCached", parameters, NYMPH_STRUCT,
+																				app_loadResourceCached);
+	NymphRemoteClient::registerMethod("app_loadResourceCached", appLoadResourceCachedFunction);
+	
 	// array getFileList()
 	parameters.clear();
 	NymphMethod getFileListFunction("getFileList", parameters, NYMPH_ARRAY, getFileList);
 	NymphRemoteClient::registerMethod("getFileList", getFileListFunction);
 	
+	// struct getFileListPage(uint32 since, uint32 start, uint32 count, string filter)
+	// since	: 0 to list all files, or the generation of an earlier listing to only list the
+	//				files added, changed or removed since (with 'removed' set).
+	// start	: ID to start from, 0 for the first page, or 'next' from the previous page.
+	// count	: maximum number of files, 0 for the maximum page size.
+	// filter	: text to find in the section or filename, or empty.
+	parameters.clear();
+	parameters.push_back(NYMPH_UINT32);
+	parameters.push_back(NYMPH_UINT32);
+	parameters.push_back(NYMPH_UINT32);
+	parameters.push_back(NYMPH_STRING);
+	NymphMethod getFileListPageFunction("getFileListPage", parameters, NYMPH_STRUCT, getFileListPage);
+	NymphRemoteClient::registerMethod("getFileListPage", getFileListPageFunction);
+	
+	// string getFileThumbnail(uint32 id)
+	parameters.clear();
+	parameters.push_back(NYMPH_UINT32);
+	NymphMethod getFileThumbnailFunction("getFileThumbnail", parameters, NYMPH_STRING, getFileThumbnail);
+	NymphRemoteClient::registerMethod("getFileThumbnail", getFileThumbnailFunction);
+	
 	// uint8 playMedia(uint32 id)
 	parameters.clear();
 	parameters.push_back(NYMPH_UINT32);
@@ -2554,6 +2749,17 @@ int main(int argc, char** argv) {
 	receiveFromAppCallback.enableCallback();
 	NymphRemoteClient::registerCallback("ReceiveFromAppCallback", receiveFromAppCallback);
 	
+	// MasterNackCallback
+	// Sent by a slave to the master, for multicast packets which were lost.
+	// void MasterNackCallback(uint32 stream, uint32 seq, uint32 count)
+	parameters.clear();
+	parameters.push_back(NYMPH_UINT32);
+	parameters.push_back(NYMPH_UINT32);
+	parameters.push_back(NYMPH_UINT32);
+	NymphMethod masterNackCallback("MasterNackCallback", parameters, NYMPH_NULL);
+	masterNackCallback.enableCallback();
+	NymphRemoteClient::registerCallback("MasterNackCallback", masterNackCallback);
+	
 	// End client callback registration.
 	
 	// Master-Slave registrations.
@@ -2562,6 +2768,7 @@ int main(int argc, char** argv) {
 	NymphRemoteServer::registerCallback("MediaSeekCallback", MediaSeekCallback, 0);
 	NymphRemoteServer::registerCallback("MediaStopCallback", MediaStopCallback, 0);
 	NymphRemoteServer::registerCallback("MediaStatusCallback", MediaStatusCallback, 0);
+	NymphRemoteServer::registerCallback("MasterNackCallback", MasterNackCallback, 0);
 	
 	// Initialise buffer of the desired size.
 #ifdef __ANDROID__
@@ -2569,9 +2776,15 @@ int main(int argc, char** argv) {
 #else
 	uint32_t buffer_size = config.getValue<uint32_t>("buffer_size", 20971520); // Default 20 MB.
 #endif
-	DataBuffer::init(buffer_size);
-	DataBuffer::setSeekRequestCallback(seekingHandler);
-	DataBuffer::setDataRequestCallback(dataRequestHandler);
+	SessionRegistry::init(buffer_size);
+	SessionRegistry::setSeekRequestCallback(seekingHandler);
+	SessionRegistry::setDataRequestCallback(dataRequestHandler);
+	
+	// Playback status pushed to clients.
+	PlaybackStatus::init(readPlaybackStatus, status_rate);
+	
+	// Resources of apps, as loaded by clients.
+	ResourceCache::init((size_t) app_resource_cache * 1024 * 1024);
 	
 	NYMPH_LOG_INFORMATION("Set up new buffer with size: " + 
 							Poco::NumberFormatter::format(buffer_size) + " bytes.");
@@ -2713,7 +2926,16 @@ int main(int argc, char** argv) {
 	}
 	
 	// Clean-up
-	DataBuffer::cleanup();
+	ClockSync::stop();
+	mcastSender.stop();
+	mcastReceiver.stop();
+	PlaybackStatus::cleanup();
+	SessionRegistry::cleanup();
+	MediaProbe::stop();
+	mediaIndex.close();
+	nc_apps.stop();
+	nc_apps.closeStores();
+	HttpClient::cleanup();
 	running = false;
  
 	// Close window and clean up libSDL.
@@ -2725,6 +2947,7 @@ int main(int argc, char** argv) {
 	
 	NyanSD::stopListener();
 	NymphRemoteClient::shutdown();
+	ResourceCache::cleanup();
 	
 	// Wait before exiting, giving threads time to exit.
 	Thread::sleep(2000); // 2 seconds.
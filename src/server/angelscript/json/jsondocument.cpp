@@ -0,0 +1,404 @@
+/*
+	jsondocument.cpp - Implementation of the JSONDocument class.
+	
+	Revision 0.
+	
+	Notes:
+			- The parser is recursive, up to JSON_MAX_DEPTH levels of nested objects & arrays.
+			- The children of an object or array are collected per depth while it is parsed, and
+				appended to the children list when it is closed. This keeps them contiguous.
+	
+	2026/10/18, Maya Posch
+*/
+
+
+#include "jsondocument.h"
+#include "jsonvalue.h"
+
+#include <cstring>
+
+
+#define JSON_MAX_DEPTH 256
+
+
+// --- HEX VALUE ---
+static uint32_t hexValue(const char* hex) {
+	uint32_t value = 0;
+	for (int i = 0; i < 4; ++i) {
+		char c = hex[i];
+		value <<= 4;
+		if (c >= '0' && c <= '9') { value |= (uint32_t) (c - '0'); }
+		else if (c >= 'a' && c <= 'f') { value |= (uint32_t) (c - 'a' + 10); }
+		else if (c >= 'A' && c <= 'F') { value |= (uint32_t) (c - 'A' + 10); }
+	}
+	
+	return value;
+}
+
+
+// --- IS HEX ---
+static bool isHex(char c) {
+	return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+
+// --- APPEND UTF-8 ---
+static void appendUtf8(std::string &out, uint32_t cp) {
+	if (cp < 0x80) {
+		out += (char) cp;
+	}
+	else if (cp < 0x800) {
+		out += (char) (0xc0 | (cp >> 6));
+		out += (char) (0x80 | (cp & 0x3f));
+	}
+	else if (cp < 0x10000) {
+		out += (char) (0xe0 | (cp >> 12));
+		out += (char) (0x80 | ((cp >> 6) & 0x3f));
+		out += (char) (0x80 | (cp & 0x3f));
+	}
+	else {
+		out += (char) (0xf0 | (cp >> 18));
+		out += (char) (0x80 | ((cp >> 12) & 0x3f));
+		out += (char) (0x80 | ((cp >> 6) & 0x3f));
+		out += (char) (0x80 | (cp & 0x3f));
+	}
+}
+
+
+// --- PARSE ---
+// Parse a JSON text. Returns false if it is not valid JSON, with the reason in getError().
+bool JSONDocument::parse(const std::string &json) {
+	tokens.clear();
+	children.clear();
+	error.clear();
+	if (json.size() >= JSON_NOT_FOUND) { return fail(0, "Document too large"); }
+	
+	source = json;
+	
+	// Most JSON texts have a value every 8 or more characters.
+	tokens.reserve(source.size() / 8 + 1);
+	
+	size_t pos = 0;
+	skipSpace(pos);
+	if (!parseValue(pos, 0)) { return false; }
+	
+	skipSpace(pos);
+	if (pos != source.size()) { return fail(pos, "Unexpected data after the value"); }
+	
+	return true;
+}
+
+
+// --- FAIL ---
+bool JSONDocument::fail(size_t pos, const std::string &message) {
+	error = message + " at offset " + std::to_string(pos) + ".";
+	tokens.clear();
+	children.clear();
+	return false;
+}
+
+
+// --- SKIP SPACE ---
+void JSONDocument::skipSpace(size_t &pos) {
+	while (pos < source.size()) {
+		char c = source[pos];
+		if (c != ' ' && c != '\n' && c != '\r' && c != '\t') { break; }
+		pos++;
+	}
+}
+
+
+// --- PARSE VALUE ---
+bool JSONDocument::parseValue(size_t &pos, uint32_t depth) {
+	if (pos >= source.size()) { return fail(pos, "Unexpected end of the document"); }
+	
+	char c = source[pos];
+	switch (c) {
+		case '{': return parseContainer(pos, depth, true);
+		case '[': return parseContainer(pos, depth, false);
+		case '"': return parseString(pos);
+		case 't': return parseLiteral(pos, "true", JSON_BOOL);
+		case 'f': return parseLiteral(pos, "false", JSON_BOOL);
+		case 'n': return parseLiteral(pos, "null", JSON_NULL);
+		default: break;
+	}
+	
+	if (c == '-' || (c >= '0' && c <= '9')) { return parseNumber(pos); }
+	
+	return fail(pos, std::string("Unexpected character '") + c + "'");
+}
+
+
+// --- PARSE CONTAINER ---
+// Parse an object or an array.
+bool JSONDocument::parseContainer(size_t &pos, uint32_t depth, bool object) {
+	if (depth >= JSON_MAX_DEPTH) { return fail(pos, "Nesting too deep"); }
+	
+	uint32_t index = tokens.size();
+	JSONToken token = { (uint32_t) pos, 0, 0, 0, (uint8_t) (object ? JSON_OBJECT : JSON_ARRAY), false, false };
+	tokens.push_back(token);
+	
+	// Note: 'levels' may grow while parsing a child, so it is indexed each time.
+	if (levels.size() <= depth) { levels.resize(depth + 1); }
+	levels[depth].clear();
+	
+	char close = object ? '}' : ']';
+	pos++;
+	skipSpace(pos);
+	if (pos < source.size() && source[pos] == close) {
+		pos++;
+	}
+	else {
+		while (true) {
+			if (object) {
+				if (pos >= source.size() || source[pos] != '"') {
+					return fail(pos, "Expected a member name");
+				}
+				
+				if (!parseString(pos)) { return false; }
+				
+				skipSpace(pos);
+				if (pos >= source.size() || source[pos] != ':') { return fail(pos, "Expected ':'"); }
+				
+				pos++;
+				skipSpace(pos);
+			}
+			
+			levels[depth].push_back(tokens.size());
+			if (!parseValue(pos, depth + 1)) { return false; }
+			
+			skipSpace(pos);
+			if (pos >= source.size()) { return fail(pos, "Unexpected end of the document"); }
+			
+			if (source[pos] == ',') {
+				pos++;
+				skipSpace(pos);
+				continue;
+			}
+			
+			if (source[pos] == close) {
+				pos++;
+				break;
+			}
+			
+			return fail(pos, std::string("Expected ',' or '") + close + "'");
+		}
+	}
+	
+	JSONToken &t = tokens[index];
+	t.length = pos - t.start;
+	t.count = levels[depth].size();
+	t.children = children.size();
+	children.insert(children.end(), levels[depth].begin(), levels[depth].end());
+	
+	return true;
+}
+
+
+// --- PARSE STRING ---
+bool JSONDocument::parseString(size_t &pos) {
+	size_t start = ++pos;
+	bool escaped = false;
+	const char* data = source.data();
+	size_t size = source.size();
+	while (pos < size) {
+		// Skip plain characters first, this is most of the string.
+		unsigned char c = data[pos];
+		while (c != '"' && c != '\\' && c >= 0x20) {
+			if (++pos == size) { return fail(start - 1, "Unterminated string"); }
+			c = data[pos];
+		}
+		
+		if (c == '"') {
+			JSONToken token = { (uint32_t) start, (uint32_t) (pos - start), 0, 0, JSON_STRING, escaped, false };
+			tokens.push_back(token);
+			pos++;
+			return true;
+		}
+		else if (c == '\\') {
+			escaped = true;
+			if (pos + 1 >= size) { break; }
+			
+			char e = data[pos + 1];
+			if (e == 'u') {
+				if (pos + 5 >= size || !isHex(data[pos + 2]) || !isHex(data[pos + 3])
+						|| !isHex(data[pos + 4]) || !isHex(data[pos + 5])) {
+					return fail(pos, "Invalid unicode escape");
+				}
+				
+				pos += 6;
+			}
+			else if (e != 0 && strchr("\"\\/bfnrt", e)) {
+				pos += 2;
+			}
+			else {
+				return fail(pos, "Invalid escape sequence");
+			}
+		}
+		else {
+			return fail(pos, "Control character in string");
+		}
+	}
+	
+	return fail(start - 1, "Unterminated string");
+}
+
+
+// --- PARSE NUMBER ---
+bool JSONDocument::parseNumber(size_t &pos) {
+	size_t start = pos;
+	bool integer = true;
+	if (source[pos] == '-') { pos++; }
+	
+	if (pos < source.size() && source[pos] == '0') {
+		pos++;
+	}
+	else if (pos < source.size() && source[pos] >= '1' && source[pos] <= '9') {
+		while (pos < source.size() && source[pos] >= '0' && source[pos] <= '9') { pos++; }
+	}
+	else {
+		return fail(pos, "Invalid number");
+	}
+	
+	if (pos < source.size() && source[pos] == '.') {
+		integer = false;
+		pos++;
+		if (pos >= source.size() || source[pos] < '0' || source[pos] > '9') {
+			return fail(pos, "Invalid number");
+		}
+		
+		while (pos < source.size() && source[pos] >= '0' && source[pos] <= '9') { pos++; }
+	}
+	
+	if (pos < source.size() && (source[pos] == 'e' || source[pos] == 'E')) {
+		integer = false;
+		pos++;
+		if (pos < source.size() && (source[pos] == '+' || source[pos] == '-')) { pos++; }
+		if (pos >= source.size() || source[pos] < '0' || source[pos] > '9') {
+			return fail(pos, "Invalid number");
+		}
+		
+		while (pos < source.size() && source[pos] >= '0' && source[pos] <= '9') { pos++; }
+	}
+	
+	JSONToken token = { (uint32_t) start, (uint32_t) (pos - start), 0, 0, JSON_NUMBER, false, integer };
+	tokens.push_back(token);
+	
+	return true;
+}
+
+
+// --- PARSE LITERAL ---
+bool JSONDocument::parseLiteral(size_t &pos, const char* literal, uint8_t type) {
+	size_t length = strlen(literal);
+	if (source.compare(pos, length, literal) != 0) { return fail(pos, "Invalid literal"); }
+	
+	JSONToken token = { (uint32_t) pos, (uint32_t) length, 0, 0, type, false, false };
+	tokens.push_back(token);
+	pos += length;
+	
+	return true;
+}
+
+
+// --- CHILD ---
+// Return the token of the n-th element of an array, or the n-th value of an object.
+uint32_t JSONDocument::child(uint32_t index, uint32_t n) const {
+	const JSONToken &t = tokens[index];
+	if ((t.type != JSON_ARRAY && t.type != JSON_OBJECT) || n >= t.count) { return JSON_NOT_FOUND; }
+	
+	return children[t.children + n];
+}
+
+
+// --- FIND ---
+// Return the token of the value for a key in an object. Names without escape sequences are
+// compared with the source directly.
+uint32_t JSONDocument::find(uint32_t index, const std::string &key) const {
+	const JSONToken &t = tokens[index];
+	if (t.type != JSON_OBJECT) { return JSON_NOT_FOUND; }
+	
+	for (uint32_t i = 0; i < t.count; ++i) {
+		uint32_t value = children[t.children + i];
+		const JSONToken &name = tokens[value - 1];
+		if (!name.escaped) {
+			if (name.length == key.size() && memcmp(source.data() + name.start, key.data(), key.size()) == 0) {
+				return value;
+			}
+		}
+		else if (getString(value - 1) == key) {
+			return value;
+		}
+	}
+	
+	return JSON_NOT_FOUND;
+}
+
+
+// --- GET STRING ---
+// Return the unescaped value of a string.
+std::string JSONDocument::getString(uint32_t index) const {
+	const JSONToken &t = tokens[index];
+	if (t.type != JSON_STRING) { return std::string(); }
+	if (!t.escaped) { return source.substr(t.start, t.length); }
+	
+	std::string out;
+	out.reserve(t.length);
+	size_t end = t.start + t.length;
+	for (size_t i = t.start; i < end; ) {
+		char c = source[i];
+		if (c != '\\') {
+			out += c;
+			i++;
+			continue;
+		}
+		
+		char e = source[i + 1];
+		i += 2;
+		switch (e) {
+			case 'b': out += '\b'; break;
+			case 'f': out += '\f'; break;
+			case 'n': out += '\n'; break;
+			case 'r': out += '\r'; break;
+			case 't': out += '\t'; break;
+			case 'u': {
+				uint32_t cp = hexValue(source.data() + i);
+				i += 4;
+				if (cp >= 0xd800 && cp <= 0xdbff) {
+					// High surrogate, combine with the low surrogate which should follow it.
+					uint32_t low = 0;
+					if (i + 6 <= end && source[i] == '\\' && source[i + 1] == 'u') {
+						low = hexValue(source.data() + i + 2);
+					}
+					
+					if (low >= 0xdc00 && low <= 0xdfff) {
+						cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+						i += 6;
+					}
+					else {
+						cp = 0xfffd;
+					}
+				}
+				else if (cp >= 0xdc00 && cp <= 0xdfff) {
+					cp = 0xfffd;
+				}
+				
+				appendUtf8(out, cp);
+				break;
+			}
+			default: out += e; break;
+		}
+	}
+	
+	return out;
+}
+
+
+// --- GET TEXT ---
+// Return the JSON text of a value, as found in the source.
+std::string JSONDocument::getText(uint32_t index) const {
+	const JSONToken &t = tokens[index];
+	if (t.type == JSON_STRING) { return source.substr(t.start - 1, t.length + 2); }
+	
+	return source.substr(t.start, t.length);
+}
@@ -0,0 +1,71 @@
+/*
+	jsondocument.h - Header for the in-situ JSON reader used by the AngelScript JSON API.
+	
+	Revision 0
+	
+	Features:
+			- Parses a JSON text in a single pass into a flat list of tokens which point into the
+				source text. No values are copied or converted while parsing.
+			- Objects & arrays keep the indices of their members, so that an element or member is
+				found without walking the text again.
+			- Strings are only unescaped, and numbers only converted, when they are read.
+	
+	Notes:
+			- A document is not modified after parsing, and can be shared between threads.
+			- Strict JSON (RFC 8259): no comments or trailing commas.
+	
+	2026/10/18, Maya Posch
+*/
+
+
+#ifndef JSON_DOCUMENT_H
+#define JSON_DOCUMENT_H
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+#define JSON_NOT_FOUND 0xffffffff
+
+
+struct JSONToken {
+	uint32_t start;			// Offset in the source. Strings: first character after the quote.
+	uint32_t length;		// Length in the source. Strings: without the quotes.
+	uint32_t count;			// Objects & arrays: number of members or elements.
+	uint32_t children;		// Objects & arrays: offset of the first child in the children list.
+	uint8_t type;			// JSONValueType.
+	bool escaped;			// Strings: contains escape sequences.
+	bool integer;			// Numbers: no fraction or exponent.
+};
+
+
+class JSONDocument {
+	std::string source;
+	std::vector<JSONToken> tokens;
+	std::vector<uint32_t> children;		// Value tokens of each object & array. Keys precede values.
+	std::vector<std::vector<uint32_t> > levels;		// Children being collected, per depth.
+	std::string error;
+	
+	bool parseValue(size_t &pos, uint32_t depth);
+	bool parseContainer(size_t &pos, uint32_t depth, bool object);
+	bool parseString(size_t &pos);
+	bool parseNumber(size_t &pos);
+	bool parseLiteral(size_t &pos, const char* literal, uint8_t type);
+	void skipSpace(size_t &pos);
+	bool fail(size_t pos, const std::string &message);
+
+public:
+	bool parse(const std::string &json);
+	const std::string& getError() const { return error; }
+	
+	const JSONToken& token(uint32_t index) const { return tokens[index]; }
+	uint32_t child(uint32_t index, uint32_t n) const;
+	uint32_t find(uint32_t index, const std::string &key) const;
+	std::string getString(uint32_t index) const;
+	std::string getText(uint32_t index) const;
+	const char* getData(uint32_t index) const { return source.data() + tokens[index].start; }
+};
+
+#endif
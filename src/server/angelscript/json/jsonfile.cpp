@@ -41,6 +41,8 @@
 
 #include "jsonfile.h"
 
+#include <iostream>
+
 
 static void ConstructJSONFile(JSONFile* ptr) {
     new(ptr) JSONFile();
@@ -261,44 +263,20 @@ bool JSONFile::Save(Serializer& dest, const std::string& indendation) const {
 bool JSONFile::fromString(const std::string &json) {
     if (json.empty()) { return false; }
 	
-	Poco::JSON::Parser parser;
-	//Poco::Dynamic::Var result = parser.parse(json);
-	Poco::Dynamic::Var result = parser.parse(json);
-	
-	root_.setVariant(result);
-	
-	/* if (result.type() == typeid(Poco::JSON::Object::Ptr)) {
-		Poco::JSON::Object::Ptr object = result.extract<Poco::JSON::Object::Ptr>();
-		root_.SetType(JSON_OBJECT);
-		root_ = object;
-	}
-	else if (result.type() == typeid(Poco::JSON::Array::Ptr)) {
-		Poco::JSON::Array::Ptr object = result.extract<Poco::JSON::Array::Ptr>();
-		
-		root_.SetType(JSON_ARRAY);
-		root_ = object;
-	}
-	else {
+	// Parse into a new document, values already read from the previous one keep theirs.
+	std::shared_ptr<JSONDocument> document = std::make_shared<JSONDocument>();
+	if (!document->parse(json)) {
+		std::cerr << "JSONFile: failed to parse: " << document->getError() << std::endl;
+		root_ = JSONValue();
 		return false;
-	} */
-
-    /* MemoryBuffer buffer(source.CString(), source.Length());
-    return Load(buffer); */
+	}
+	
+	root_ = JSONValue(document, 0);
 	
 	return true;
 }
 
 
 std::string JSONFile::toString(const std::string& indentation) const {
-    /* rapidjson::Document document;
-    ToRapidjsonValue(document, root_, document.GetAllocator());
-
-    StringBuffer buffer;
-    PrettyWriter<StringBuffer> writer(buffer);
-    writer.SetIndent(!indendation.Empty() ? indendation.Front() : '\0', indendation.Length());
-
-    document.Accept(writer);
-    return buffer.GetString(); */
-	
-	return std::string();
+	return root_.ToString();
 }
@@ -31,8 +31,7 @@
 #include <angelscript.h>
 
 
-#include <Poco/JSON/Parser.h>
-#include <Poco/Dynamic/Var.h>
+#include <memory>
 
 
 template <class T> T* ConstructObject() {
@@ -70,9 +69,9 @@ public:
     /// Save resource with user-defined indentation, only the first character (if any) of the string is used and the length of the string defines the character count. Return true if successful.
     //bool Save(Serializer& dest, const std::string& indendation) const;
 
-    /// Deserialize from a string. Return true if successful.
+    /// Deserialize from a string. The values of the document are read from it on demand. Return true if successful.
     bool fromString(const std::string& source);
-    /// Save to a string.
+    /// Return the JSON text of the document. Indentation is not applied.
     std::string toString(const std::string& indentation = "\t") const;
 
     /// Return root value.
@@ -32,8 +32,8 @@
 
 #include "jsonvalue.h"
 
-
-#include <iostream>
+#include <cstdlib>
+#include <climits>
 
 
 static void ConstructJSONValue(JSONValue* ptr) {
@@ -72,25 +72,14 @@ static void DestructJSONValue(JSONValue* ptr) {
     ptr->~JSONValue();
 }
 
-static JSONValue JSONValueAtPosition(unsigned position, JSONValue& jsonValue) {
+static JSONValue JSONValueAtPosition(unsigned position, const JSONValue& jsonValue) {
     return jsonValue[position];
 }
 
-static JSONValue& JSONValueAtKey(const std::string& key, JSONValue& jsonValue) {
+static JSONValue JSONValueAtKey(const std::string& key, const JSONValue& jsonValue) {
     return jsonValue[key];
 }
 
-/* static CScriptArray* JSONValueGetKeys(const JSONValue& jsonValue) {
-    Vector<std::string> keys;
-    if (jsonValue.IsObject())
-    {
-        for (ConstJSONObjectIterator i = jsonValue.Begin(); i != jsonValue.End(); ++i)
-            keys.Push(i->first_);
-    }
-
-    return VectorToArray<std::string>(keys, "Array<String>");
-} */
-
 
 void RegisterJSONValue(asIScriptEngine* engine) {
     engine->RegisterEnum("JSONValueType");
@@ -125,8 +114,6 @@ void RegisterJSONValue(asIScriptEngine* engine) {
     engine->RegisterObjectMethod("JSONValue", "JSONValue& opAssign(double)", asMETHODPR(JSONValue, operator =, (double), JSONValue&), asCALL_THISCALL);
     engine->RegisterObjectMethod("JSONValue", "JSONValue& opAssign(const string&in)", asMETHODPR(JSONValue, operator =, (const std::string&), JSONValue&), asCALL_THISCALL);
     engine->RegisterObjectMethod("JSONValue", "JSONValue& opAssign(const JSONValue&in)", asMETHODPR(JSONValue, operator =, (const JSONValue&), JSONValue&), asCALL_THISCALL);
-    /* engine->RegisterObjectMethod("JSONValue", "void SetVariant(const Variant&in)", asFUNCTION(JSONValueSetVariant), asCALL_CDECL_OBJLAST);
-    engine->RegisterObjectMethod("JSONValue", "void SetVariantMap(const VariantMap&in)", asFUNCTION(JSONValueSetVariantMap), asCALL_CDECL_OBJLAST); */
 
     engine->RegisterObjectMethod("JSONValue", "JSONValueType get_valueType() const", asMETHOD(JSONValue, GetValueType), asCALL_THISCALL);
     engine->RegisterObjectMethod("JSONValue", "JSONNumberType get_numberType() const", asMETHOD(JSONValue, GetNumberType), asCALL_THISCALL);
@@ -145,11 +132,9 @@ void RegisterJSONValue(asIScriptEngine* engine) {
     engine->RegisterObjectMethod("JSONValue", "float getFloat(float defaultValue = 0) const", asMETHOD(JSONValue, GetFloat), asCALL_THISCALL);
     engine->RegisterObjectMethod("JSONValue", "double getDouble(double defaultValue = 0) const", asMETHOD(JSONValue, GetDouble), asCALL_THISCALL);
     engine->RegisterObjectMethod("JSONValue", "const string getString(const string&in defaultValue = string()) const", asMETHOD(JSONValue, GetString), asCALL_THISCALL);
-    //engine->RegisterObjectMethod("JSONValue", "Variant GetVariant(Variant defaultValue = Variant()) const", asMETHOD(JSONValue, GetVariant), asCALL_THISCALL);
-    //engine->RegisterObjectMethod("JSONValue", "VariantMap GetVariantMap(VariantMap defaultValue = VariantMap()) const", asMETHOD(JSONValue, GetVariantMap), asCALL_THISCALL);
+    engine->RegisterObjectMethod("JSONValue", "string toString() const", asMETHOD(JSONValue, ToString), asCALL_THISCALL);
 
-    engine->RegisterObjectMethod("JSONValue", "JSONValue opIndex(uint)", asFUNCTION(JSONValueAtPosition), asCALL_CDECL_OBJLAST);
-    engine->RegisterObjectMethod("JSONValue", "const JSONValue& opIndex(uint) const", asFUNCTION(JSONValueAtPosition), asCALL_CDECL_OBJLAST);
+    engine->RegisterObjectMethod("JSONValue", "JSONValue opIndex(uint) const", asFUNCTION(JSONValueAtPosition), asCALL_CDECL_OBJLAST);
     engine->RegisterObjectMethod("JSONValue", "void Push(const JSONValue&in)", asMETHOD(JSONValue, Push), asCALL_THISCALL);
     engine->RegisterObjectMethod("JSONValue", "void Pop()", asMETHOD(JSONValue, Pop), asCALL_THISCALL);
     engine->RegisterObjectMethod("JSONValue", "void Insert(uint, const JSONValue&in)", asMETHODPR(JSONValue, Insert, (unsigned, const JSONValue&), void), asCALL_THISCALL);
@@ -157,17 +142,13 @@ void RegisterJSONValue(asIScriptEngine* engine) {
     engine->RegisterObjectMethod("JSONValue", "void Resize(uint)", asMETHOD(JSONValue, Resize), asCALL_THISCALL);
     engine->RegisterObjectMethod("JSONValue", "uint get_size() const", asMETHOD(JSONValue, size), asCALL_THISCALL);
 
-    engine->RegisterObjectMethod("JSONValue", "JSONValue& opIndex(const string&in)", asFUNCTION(JSONValueAtKey), asCALL_CDECL_OBJLAST);
-    engine->RegisterObjectMethod("JSONValue", "const JSONValue& opIndex(const string&in) const", asFUNCTION(JSONValueAtKey), asCALL_CDECL_OBJLAST);
+    engine->RegisterObjectMethod("JSONValue", "JSONValue opIndex(const string&in) const", asFUNCTION(JSONValueAtKey), asCALL_CDECL_OBJLAST);
     engine->RegisterObjectMethod("JSONValue", "void Set(const string&in, const JSONValue&in)", asMETHOD(JSONValue, Set), asCALL_THISCALL);
-    engine->RegisterObjectMethod("JSONValue", "JSONValue get(string&in)", asMETHOD(JSONValue, get), asCALL_THISCALL);
+    engine->RegisterObjectMethod("JSONValue", "JSONValue get(const string&in) const", asMETHOD(JSONValue, get), asCALL_THISCALL);
+    engine->RegisterObjectMethod("JSONValue", "JSONValue getPath(const string&in) const", asMETHOD(JSONValue, getPath), asCALL_THISCALL);
     engine->RegisterObjectMethod("JSONValue", "void Erase(const string&in)", asMETHODPR(JSONValue, Erase, (const std::string&), bool), asCALL_THISCALL);
     engine->RegisterObjectMethod("JSONValue", "bool Contains(const string&in) const", asMETHOD(JSONValue, Contains), asCALL_THISCALL);
-
     engine->RegisterObjectMethod("JSONValue", "void Clear()", asMETHOD(JSONValue, Clear), asCALL_THISCALL);
-
-    //engine->RegisterObjectMethod("JSONValue", "Array<String>@ get_keys() const", asFUNCTION(JSONValueGetKeys), asCALL_CDECL_OBJLAST);
-    //engine->RegisterObjectMethod("JSONValue", "Array<JSONValue>@ get_values() const", asFUNCTION(JSONValueGetValues), asCALL_CDECL_OBJLAST);
 }
 
 
@@ -192,453 +173,254 @@ static const char* numberTypeNames[] =
 };
 
 const JSONValue JSONValue::EMPTY;
-JSONValue JSONValue::emptyValue;
-const JSONArray JSONValue::emptyArray { };
-const JSONObject JSONValue::emptyObject;
+
+
+JSONValue::JSONValue(const std::shared_ptr<const JSONDocument>& document, uint32_t index) :
+    document_(document),
+    index_(index)
+{
+}
 
 JSONValue& JSONValue::operator =(bool rhs) {
     SetType(JSON_BOOL);
     boolValue_ = rhs;
-
     return *this;
 }
 
 JSONValue& JSONValue::operator =(int rhs) {
-    //SetType(JSON_NUMBER, JSONNT_INT);
     SetType(JSON_NUMBER);
+    numberType_ = JSONNT_INT;
     numberValue_ = rhs;
-	
-	std::cout << "New JSON int: " << rhs << std::endl;
-
     return *this;
 }
 
 JSONValue& JSONValue::operator =(unsigned rhs) {
-    //SetType(JSON_NUMBER, JSONNT_UINT);
     SetType(JSON_NUMBER);
+    numberType_ = JSONNT_UINT;
     numberValue_ = rhs;
-	
-	std::cout << "New JSON uint: " << rhs << std::endl;
-
     return *this;
 }
 
 JSONValue& JSONValue::operator =(float rhs) {
-    //SetType(JSON_NUMBER, JSONNT_FLOAT_DOUBLE);
     SetType(JSON_NUMBER);
+    numberType_ = JSONNT_FLOAT_DOUBLE;
     numberValue_ = rhs;
-
     return *this;
 }
 
 JSONValue& JSONValue::operator =(double rhs) {
-    //SetType(JSON_NUMBER, JSONNT_FLOAT_DOUBLE);
     SetType(JSON_NUMBER);
+    numberType_ = JSONNT_FLOAT_DOUBLE;
     numberValue_ = rhs;
-
     return *this;
 }
 
 JSONValue& JSONValue::operator =(const std::string& rhs) {
     SetType(JSON_STRING);
-    *stringValue_ = rhs;
-	
-	std::cout << "New JSONString: " << rhs << std::endl;
-
+    stringValue_ = rhs;
     return *this;
 }
 
 JSONValue& JSONValue::operator =(const char* rhs) {
     SetType(JSON_STRING);
-    *stringValue_ = rhs;
-
+    stringValue_ = rhs;
     return *this;
 }
 
-JSONValue& JSONValue::operator =(const JSONArray& rhs) {
-    SetType(JSON_ARRAY);
-    *arrayValue_ = rhs;
-	
-	std::cout << "New JSON array." << std::endl;
-
-    return *this;
+JSONValueType JSONValue::GetValueType() const {
+    if (document_) { return (JSONValueType) token().type; }
+    return type_;
 }
 
-JSONValue& JSONValue::operator =(const JSONObject& rhs) {
-    SetType(JSON_OBJECT);
-    *objectValue_ = rhs;
-	
-	std::cout << "New JSON object." << std::endl;
-
-    return *this;
-}
+JSONNumberType JSONValue::GetNumberType() const {
+    if (!document_) { return numberType_; }
 
-JSONValue& JSONValue::operator =(const JSONValue& rhs) {
-    if (this == &rhs) { return *this; }
-	
-	value = rhs.value;
-	isArrayType = rhs.isArrayType;
-	isObjectType = rhs.isObjectType;
-	objectPtr = rhs.objectPtr;
-	arrayPtr = rhs.arrayPtr;
+    const JSONToken& t = token();
+    if (t.type != JSON_NUMBER) { return JSONNT_NAN; }
+    if (!t.integer) { return JSONNT_FLOAT_DOUBLE; }
 
-    //SetType(rhs.GetValueType(), rhs.GetNumberType());
-    //SetType(rhs.GetValueType());
+    const char* data = document_->getData(index_);
+    if (data[0] == '-') { return JSONNT_INT; }
 
-    /* switch (GetValueType()) {
-    case JSON_BOOL:
-        boolValue_ = rhs.boolValue_;
-        break;
+    return strtoull(data, nullptr, 10) > INT_MAX ? JSONNT_UINT : JSONNT_INT;
+}
 
-    case JSON_NUMBER:
-        numberValue_ = rhs.numberValue_;
-        break;
+std::string JSONValue::GetValueTypeName() const {
+    return GetValueTypeName(GetValueType());
+}
 
-    case JSON_STRING:
-        *stringValue_ = *rhs.stringValue_;
-        break;
+std::string JSONValue::GetNumberTypeName() const {
+    return GetNumberTypeName(GetNumberType());
+}
 
-    case JSON_ARRAY:
-        *arrayValue_ = *rhs.arrayValue_;
-        break;
+bool JSONValue::GetBool(bool defaultValue) const {
+    if (!IsBool()) { return defaultValue; }
+    if (document_) { return document_->getData(index_)[0] == 't'; }
+    return boolValue_;
+}
 
-    case JSON_OBJECT:
-        *objectValue_ = *rhs.objectValue_;
+int JSONValue::GetInt(int defaultValue) const {
+    if (!IsNumber()) { return defaultValue; }
+    if (!document_) { return (int) numberValue_; }
+    if (!token().integer) { return (int) GetDouble(); }
+    return (int) strtoll(document_->getData(index_), nullptr, 10);
+}
 
-    default:
-        break;
-    } */
+unsigned JSONValue::GetUInt(unsigned defaultValue) const {
+    if (!IsNumber()) { return defaultValue; }
+    if (!document_) { return (unsigned) numberValue_; }
+    if (!token().integer) { return (unsigned) GetDouble(); }
 
-    return *this;
+    // IDs above INT_MAX have to be read as unsigned, negative values wrap as before.
+    const char* data = document_->getData(index_);
+    if (data[0] == '-') { return (unsigned) strtoll(data, nullptr, 10); }
+    return (unsigned) strtoull(data, nullptr, 10);
 }
 
-JSONValueType JSONValue::GetValueType() const {
-    //return (JSONValueType)(type_ >> 16u);
-	return (JSONValueType) type_;
+double JSONValue::GetDouble(double defaultValue) const {
+    if (!IsNumber()) { return defaultValue; }
+    if (!document_) { return numberValue_; }
+    return strtod(document_->getData(index_), nullptr);
 }
 
-JSONNumberType JSONValue::GetNumberType() const {
-    //return (JSONNumberType)(type_ & 0xffffu);
-	return (JSONNumberType) type_;
+const std::string JSONValue::GetString(const std::string& defaultValue) const {
+    if (!IsString()) { return defaultValue; }
+    if (document_) { return document_->getString(index_); }
+    return stringValue_;
 }
 
-std::string JSONValue::GetValueTypeName() const {
-    return GetValueTypeName(GetValueType());
-}
+std::string JSONValue::ToString() const {
+    if (document_) { return document_->getText(index_); }
 
-std::string JSONValue::GetNumberTypeName() const {
-    return GetNumberTypeName(GetNumberType());
+    switch (type_) {
+    case JSON_BOOL:
+        return boolValue_ ? "true" : "false";
+    case JSON_NUMBER:
+        if (numberType_ == JSONNT_FLOAT_DOUBLE) { return std::to_string(numberValue_); }
+        return std::to_string((long long) numberValue_);
+    case JSON_STRING:
+        return "\"" + stringValue_ + "\"";
+    case JSON_ARRAY:
+        return "[]";
+    case JSON_OBJECT:
+        return "{}";
+    default:
+        return "null";
+    }
 }
 
-JSONValue JSONValue::operator [](unsigned index) {
-	if (!isArrayType) { return emptyValue; }
-	
-	std::cout << "Retrieving array index " << index << std::endl;
-
-    //return (*arrayValue_)[index];
-	// TODO: implement
-	Poco::Dynamic::Var value = arrayPtr->get(index);
-	if (value.isEmpty()) { 
-		std::cerr << "Failed to find index." << std::endl;
-		return emptyValue; 
-	}
-	
-	JSONValue val;
-	val.setVariant(value);
-	return val;
-	/* if (value.isNull()) {
-		val.SetType(JSON_NULL);
-	}
-	else *//*  if (value.isBoolean()) {
-		//val.SetType(JSON_BOOL);
-		val = value.convert<bool>();
-	}
-	else if (value.isNumeric()) {
-		//val.SetType(JSON_NUMBER);
-		val = value.convert<double>();
-		
-		std::cout << "Found double." << std::endl;
-	}
-	else if (value.isString()) {
-		//val.SetType(JSON_STRING);
-		val = value.convert<std::string>();
-		
-		std::cout << "Found string." << std::endl;
-	}
-	else if (value.type() == typeid(Poco::JSON::Object::Ptr)) {
-		val.SetType(JSON_OBJECT);
-		val = (JSONObject) value.extract<Poco::JSON::Object::Ptr>();
-		
-		std::cout << "Found object." << std::endl;
-	}
-	else if (value.type() == typeid(Poco::JSON::Array::Ptr)) {
-		val.SetType(JSON_ARRAY);
-		val = (JSONArray) value.extract<Poco::JSON::Array::Ptr>();
-		
-		std::cout << "Found double." << std::endl;
-	}
-	else {
-		return EMPTY;
-	} */
-	
-	return emptyValue;
-}
-
-const JSONValue& JSONValue::operator [](unsigned index) const {
-    if (!isArrayType) { return emptyValue; }
-	
-	std::cout << "Retrieving const array index " << index << std::endl;
-
-    //return (*arrayValue_)[index];
-	// TODO: implement
-	Poco::Dynamic::Var value = arrayPtr->get(index);
-	if (value.isEmpty()) { return emptyValue; }
-	
-	JSONValue val;
-	val.setVariant(value);
-	return val;
-	
-	return emptyValue;
+JSONValue JSONValue::operator [](unsigned index) const {
+    if (!document_) { return EMPTY; }
+
+    uint32_t child = document_->child(index_, index);
+    if (child == JSON_NOT_FOUND || token().type != JSON_ARRAY) { return EMPTY; }
+
+    return JSONValue(document_, child);
 }
 
 void JSONValue::Push(const JSONValue& value) {
     // Convert to array type
     SetType(JSON_ARRAY);
-
-    //arrayValue_->Push(value);
 }
 
 void JSONValue::Pop() {
     if (GetValueType() != JSON_ARRAY)
         return;
-
-    //arrayValue_->Pop();
 }
 
 void JSONValue::Insert(unsigned pos, const JSONValue& value) {
     if (GetValueType() != JSON_ARRAY)
         return;
-
-    //arrayValue_->Insert(pos, value);
 }
 
 void JSONValue::Erase(unsigned pos, unsigned length) {
     if (GetValueType() != JSON_ARRAY)
         return;
-
-    //arrayValue_->Erase(pos, length);
 }
 
 void JSONValue::Resize(unsigned newSize) {
     // Convert to array type
     SetType(JSON_ARRAY);
-
-    //arrayValue_->Resize(newSize);
 }
 
 unsigned JSONValue::size() const {
-	if (isArrayType) { 
-		std::cout << "Array size: " << arrayPtr->size() << std::endl;
-		return arrayPtr->size(); 
-	}
-	if (isObjectType) { 
-		std::cout << "Object size: " << objectPtr->size() << std::endl;
-		return objectPtr->size(); 
-	}
-	
-    /* if (GetValueType() == JSON_ARRAY) { return (*arrayValue_)->size(); }
-    else if (GetValueType() == JSON_OBJECT) { return (*objectValue_)->size(); } */
+    if (!document_) { return 0; }
 
+    const JSONToken& t = token();
+    if (t.type == JSON_ARRAY || t.type == JSON_OBJECT) { return t.count; }
     return 0;
 }
 
-JSONValue& JSONValue::operator [](const std::string& key) {
-    // Convert to object type
-    SetType(JSON_OBJECT);
-
-    //return (*objectValue_)[key];
-	return emptyValue;
-}
-
-const JSONValue& JSONValue::operator [](const std::string& key) const {
-    if (GetValueType() != JSON_OBJECT)
-        return emptyValue;
-
-    //return (*objectValue_)[key];
-	return emptyValue;
+JSONValue JSONValue::operator [](const std::string& key) const {
+    return get(key);
 }
 
 void JSONValue::Set(const std::string& key, const JSONValue& value) {
     // Convert to object type
     SetType(JSON_OBJECT);
-
-    //(*objectValue_)[key] = value;
-}
-
-JSONValue JSONValue::get(std::string& key) {
-	std::cout << "Checking for object... " << isObjectType << "/" << isArrayType << std::endl;
-	std::cout << "Searching for key: " << key << std::endl;
-	
-    //if (GetValueType() != JSON_OBJECT) { return EMPTY; }
-	if (!isObjectType) { return EMPTY; }
-	
-	std::cout << "Retrieving value from object. Key: " << key << std::endl;
-
-    Poco::Dynamic::Var value = objectPtr->get(key);
-	if (value.isEmpty()) {
-		std::cerr << "Key wasn't found." << std::endl;
-		return EMPTY; 
-	}
-	
-	JSONValue val;
-	val.setVariant(value);
-	
-	/* if (value.isNull()) {
-		val.SetType(JSON_NULL);
-	}
-	else */ /* if (value.isBoolean()) {
-		val.SetType(JSON_BOOL);
-		val = value.convert<bool>();
-	}
-	else if (value.isNumeric()) {
-		val.SetType(JSON_NUMBER);
-		val = value.convert<double>();
-		
-		std::cout << "Retrieved double." << std::endl;
-	}
-	else if (value.isString()) {
-		val.SetType(JSON_STRING);
-		val = value.convert<std::string>();
-		
-		std::cout << "Retrieved string." << std::endl;
-	}
-	else if (value.type() == typeid(Poco::JSON::Object::Ptr)) {
-		val.SetType(JSON_OBJECT);
-		val = (JSONObject) value.extract<Poco::JSON::Object::Ptr>();
-		
-		std::cout << "Retrieved object." << std::endl;
-	}
-	else if (value.type() == typeid(Poco::JSON::Array::Ptr)) {
-		val.SetType(JSON_ARRAY);
-		val = (JSONArray) value.extract<Poco::JSON::Array::Ptr>();
-		
-		std::cout << "Retrieved array." << std::endl;
-	}
-	else {
-		std::cout << "Default: empty value." << std::endl;
-		return EMPTY;*/
-	//}
-
-    return val;
 }
 
-bool JSONValue::Erase(const std::string& key) {
-    if (GetValueType() != JSON_OBJECT)
-        return false;
-
-    (*objectValue_)->remove(key);
-	return true;
-}
+JSONValue JSONValue::get(const std::string& key) const {
+    if (!document_) { return EMPTY; }
 
-bool JSONValue::Contains(const std::string& key) const {
-    if  (GetValueType() != JSON_OBJECT)
-        return false;
+    uint32_t value = document_->find(index_, key);
+    if (value == JSON_NOT_FOUND) { return EMPTY; }
 
-    return (*objectValue_)->has(key);
+    return JSONValue(document_, value);
 }
 
-JSONObjectIterator JSONValue::Begin() {
-    // Convert to object type.
-    SetType(JSON_OBJECT);
+JSONValue JSONValue::getPath(const std::string& path) const {
+    if (!document_) { return EMPTY; }
+    if (path.empty()) { return *this; }
 
-    return (*objectValue_)->begin();
-}
+    uint32_t index = index_;
+    size_t start = 0;
+    while (start <= path.size()) {
+        size_t end = path.find('.', start);
+        if (end == std::string::npos) { end = path.size(); }
 
-ConstJSONObjectIterator JSONValue::Begin() const {
-    if (GetValueType() != JSON_OBJECT)
-        return (emptyObject)->begin();
+        std::string part = path.substr(start, end - start);
+        if (document_->token(index).type == JSON_ARRAY) {
+            char* last = nullptr;
+            unsigned long n = strtoul(part.c_str(), &last, 10);
+            if (part.empty() || *last != 0) { return EMPTY; }
+            index = document_->child(index, n);
+        }
+        else {
+            index = document_->find(index, part);
+        }
 
-    return (*objectValue_)->begin();
-}
+        if (index == JSON_NOT_FOUND) { return EMPTY; }
 
-JSONObjectIterator JSONValue::End() {
-    // Convert to object type.
-    SetType(JSON_OBJECT);
+        start = end + 1;
+    }
 
-    return (*objectValue_)->end();
+    return JSONValue(document_, index);
 }
 
-ConstJSONObjectIterator JSONValue::End() const {
-    if (GetValueType() != JSON_OBJECT)
-        return emptyObject->end();
+bool JSONValue::Erase(const std::string& key) {
+    return false;
+}
 
-    return (*objectValue_)->end();
+bool JSONValue::Contains(const std::string& key) const {
+    if (!document_) { return false; }
+    return document_->find(index_, key) != JSON_NOT_FOUND;
 }
 
 void JSONValue::Clear() {
-    if (GetValueType() == JSON_ARRAY)
-        (*arrayValue_)->clear();
-    else if (GetValueType() == JSON_OBJECT)
-        (*objectValue_)->clear();
+    if (IsArray() || IsObject()) { SetType(GetValueType()); }
 }
 
-void JSONValue::SetType(JSONValueType valueType) { //, JSONNumberType numberType) {
-	std::cout << "SetType called." << std::endl;
-	
-    int type = valueType; // << 16u | numberType;
-    if (type == type_)
-        return;
-
-	std::cout << "Deleting existing values..." << std::endl;
-
-    switch (GetValueType()) {
-    case JSON_STRING:
-        delete stringValue_;
-        break;
-
-    case JSON_ARRAY:
-        delete arrayValue_;
-        break;
-
-    case JSON_OBJECT:
-        delete objectValue_;
-        break;
-
-    default:
-        break;
-    }
-
-    type_ = type;
-	
-	std::cout << "Type is now set to: " << type_ << std::endl;
-
-    switch (GetValueType()) {
-    case JSON_STRING:
-        stringValue_ = new std::string();
-		
-		std::cout << "New string created." << std::endl;
-		
-        break;
-
-    case JSON_ARRAY:
-        arrayValue_ = new JSONArray();
-		
-		std::cout << "New array created." << std::endl;
-		
-        break;
-
-    case JSON_OBJECT:
-        objectValue_ = new JSONObject();
-		
-		std::cout << "New object created." << std::endl;
-		
-        break;
-
-    default:
-        break;
-    }
+void JSONValue::SetType(JSONValueType valueType) {
+    // Detach from the document, the document itself is never modified.
+    document_.reset();
+    index_ = 0;
+    type_ = valueType;
+    numberType_ = JSONNT_NAN;
+    stringValue_.clear();
 }
 
+
 /* void JSONValue::SetVariant(const Variant& variant, Context* context) {
     if (!IsNull())
     {
@@ -879,41 +661,3 @@ std::string JSONValue::GetValueTypeName(JSONValueType type) {
 std::string JSONValue::GetNumberTypeName(JSONNumberType type) {
     return numberTypeNames[type];
 }
-
-JSONValueType JSONValue::GetValueTypeFromName(const std::string& typeName) {
-    return GetValueTypeFromName(typeName.c_str());
-}
-
-/* JSONValueType JSONValue::GetValueTypeFromName(const char* typeName) {
-    return (JSONValueType)GetStringListIndex(typeName, valueTypeNames, JSON_NULL);
-} */
-
-JSONNumberType JSONValue::GetNumberTypeFromName(const std::string& typeName) {
-    return GetNumberTypeFromName(typeName.c_str());
-}
-
-/* JSONNumberType JSONValue::GetNumberTypeFromName(const char* typeName) {
-    return (JSONNumberType)GetStringListIndex(typeName, numberTypeNames, JSONNT_NAN);
-} */
-
-
-void JSONValue::setVariant(Poco::Dynamic::Var var) {
-	std::cout << "setVariant called." << std::endl;
-	
-	value = var;
-	isObjectType = false;
-	isArrayType = false;
-	
-	if (var.type() == typeid(Poco::JSON::Object::Ptr)) {
-		std::cout << "Setting Object." << std::endl;
-		objectPtr = value.extract<Poco::JSON::Object::Ptr>();
-		isObjectType = true;
-		isArrayType = false;
-	}
-	else if (var.type() == typeid(Poco::JSON::Array::Ptr)) {
-		std::cout << "Setting Array." << std::endl;
-		arrayPtr = value.extract<Poco::JSON::Array::Ptr>();
-		isArrayType = true;
-		isObjectType = false;
-	}
-}
@@ -24,18 +24,11 @@
 
 #pragma once
 
-//#include "../Core/Variant.h"
+#include "jsondocument.h"
 
 
-//#include <vector>
-//#include <map>
 #include <string>
-#include <iostream>
-
-
-#include <Poco/Dynamic/Var.h>
-#include <Poco/JSON/JSON.h>
-#include <Poco/JSON/Object.h>
+#include <memory>
 
 
 #include <angelscript.h>
@@ -72,88 +65,29 @@ enum JSONNumberType {
     JSONNT_FLOAT_DOUBLE
 };
 
-class JSONValue;
-
-/// JSON array type.
-using JSONArray = Poco::JSON::Array::Ptr;
-/// JSON object type.
-using JSONObject = Poco::JSON::Object::Ptr;
-/// JSON object iterator.
-using JSONObjectIterator = Poco::JSON::Object::Iterator;
-/// Constant JSON object iterator.
-using ConstJSONObjectIterator = Poco::JSON::Object::ConstIterator;
-
-/// JSON value class.
+/// JSON value class. A value read from a JSONFile is a view: it refers to the parsed document and
+/// the value's token in it. Members, elements and paths are looked up when requested, and return
+/// new views without copying the document.
 class JSONValue {
 public:
     /// Construct null value.
-    JSONValue() :
-        type_(0)
-    {
-    }
+    JSONValue() = default;
     /// Construct with a boolean.
-    JSONValue(bool value) :         // NOLINT(google-explicit-constructor)
-        type_(0)
-    {
-        *this = value;
-    }
+    JSONValue(bool value) { *this = value; }            // NOLINT(google-explicit-constructor)
     /// Construct with a integer.
-    JSONValue(int value) :          // NOLINT(google-explicit-constructor)
-        type_(0)
-    {
-        *this = value;
-    }
+    JSONValue(int value) { *this = value; }             // NOLINT(google-explicit-constructor)
     /// Construct with a unsigned integer.
-    JSONValue(unsigned value) :     // NOLINT(google-explicit-constructor)
-        type_(0)
-    {
-        *this = value;
-    }
+    JSONValue(unsigned value) { *this = value; }        // NOLINT(google-explicit-constructor)
     /// Construct with a float.
-    JSONValue(float value) :        // NOLINT(google-explicit-constructor)
-        type_(0)
-    {
-        *this = value;
-    }
+    JSONValue(float value) { *this = value; }           // NOLINT(google-explicit-constructor)
     /// Construct with a double.
-    JSONValue(double value) :       // NOLINT(google-explicit-constructor)
-        type_(0)
-    {
-        *this = value;
-    }
+    JSONValue(double value) { *this = value; }          // NOLINT(google-explicit-constructor)
     /// Construct with a string.
-    JSONValue(const std::string& value) :    // NOLINT(google-explicit-constructor)
-        type_(0)
-    {
-        *this = value;
-    }
+    JSONValue(const std::string& value) { *this = value; }  // NOLINT(google-explicit-constructor)
     /// Construct with a C string.
-    JSONValue(const char* value) :      // NOLINT(google-explicit-constructor)
-        type_(0)
-    {
-        *this = value;
-    }
-    /// Construct with a JSON array.
-    JSONValue(const JSONArray& value) :     // NOLINT(google-explicit-constructor)
-        type_(0)
-    {
-        *this = value;
-    }
-    /// Construct with a JSON object.
-    JSONValue(const JSONObject& value) :    // NOLINT(google-explicit-constructor)
-        type_(0)
-    {
-        *this = value;
-    }
-    /// Copy-construct from another JSON value.
-    JSONValue(const JSONValue& value) : type_(0) {
-        *this = value;
-    }
-    /// Destruct.
-    ~JSONValue()
-    {
-        //SetType(JSON_NULL);
-    }
+    JSONValue(const char* value) { *this = value; }     // NOLINT(google-explicit-constructor)
+    /// Construct a view of a value in a parsed document.
+    JSONValue(const std::shared_ptr<const JSONDocument>& document, uint32_t index);
 
     /// Assign from a boolean.
     JSONValue& operator =(bool rhs);
@@ -169,12 +103,6 @@ public:
     JSONValue& operator =(const std::string& rhs);
     /// Assign from a C string.
     JSONValue& operator =(const char* rhs);
-    /// Assign from a JSON array.
-    JSONValue& operator =(const JSONArray& rhs);
-    /// Assign from a JSON object.
-    JSONValue& operator =(const JSONObject& rhs);
-    /// Assign from another JSON value.
-    JSONValue& operator =(const JSONValue& rhs);
 
     /// Return value type.
     JSONValueType GetValueType() const;
@@ -194,47 +122,28 @@ public:
     /// Check is string.
     bool IsString() const { return GetValueType() == JSON_STRING; }
     /// Check is array.
-    //bool IsArray() const { return GetValueType() == JSON_ARRAY; }
-    bool IsArray() const { return isArrayType; }
+    bool IsArray() const { return GetValueType() == JSON_ARRAY; }
     /// Check is object.
-    //bool IsObject() const { return GetValueType() == JSON_OBJECT; }
-    bool IsObject() const { return isObjectType; }
+    bool IsObject() const { return GetValueType() == JSON_OBJECT; }
 
     /// Return boolean value.
-    bool GetBool(bool defaultValue = false) const { return value.isBoolean() ? value.convert<bool>() : defaultValue;}
+    bool GetBool(bool defaultValue = false) const;
     /// Return integer value.
-    //int GetInt(int defaultValue = 0) const { return IsNumber() ? (int)numberValue_ : defaultValue; }
-	int GetInt(int defaultValue = 0) const { return value.isNumeric() ? value.convert<int>() : defaultValue; }
+    int GetInt(int defaultValue = 0) const;
     /// Return unsigned integer value.
-    unsigned GetUInt(unsigned defaultValue = 0) const {
-		std::cout << "getUInt() called." << std::endl;
-		if (value.isNumeric()) { std::cout << "Is numberic." << std::endl; }
-		else { std::cout << "NaN." << std::endl; }
-		return value.isNumeric() ? value.convert<unsigned int>() : defaultValue;
-	}
+    unsigned GetUInt(unsigned defaultValue = 0) const;
     /// Return float value.
-    float GetFloat(float defaultValue = 0.0f) const { return IsNumber() ? (float)numberValue_ : defaultValue; }
+    float GetFloat(float defaultValue = 0.0f) const { return IsNumber() ? (float) GetDouble() : defaultValue; }
     /// Return double value.
-    double GetDouble(double defaultValue = 0.0) const { return IsNumber() ? numberValue_ : defaultValue; }
-    /// Return string value. The 'defaultValue' may potentially be returned as is, so it is the responsibility of the caller to ensure the 'defaultValue' remains valid while the return value is being referenced.
-    const std::string GetString(const std::string& defaultValue = std::string()) const { 
-		std::cout << "getString() called." << std::endl;
-		if (value.isString()) { std::cout << "Is string." << std::endl; }
-		else { std::cout << "NaS." << std::endl; }
-		return value.isString() ? value.convert<std::string>() : defaultValue;
-	}
-    /// Return C string value. Default to empty string literal.
-    const char* GetCString(const char* defaultValue = "") const { return IsString() ? stringValue_->c_str() : defaultValue;}
-    /// Return JSON array value.
-    const JSONArray& GetArray() const { return IsArray() ? *arrayValue_ : emptyArray; }
-    /// Return JSON object value.
-    const JSONObject& GetObject() const { return IsObject() ? *objectValue_ : emptyObject; }
+    double GetDouble(double defaultValue = 0.0) const;
+    /// Return string value, unescaped.
+    const std::string GetString(const std::string& defaultValue = std::string()) const;
+    /// Return the JSON text of the value.
+    std::string ToString() const;
 
     // JSON array functions
-    /// Return JSON value at index.
-    JSONValue operator [](unsigned index);
-    /// Return JSON value at index.
-    const JSONValue& operator [](unsigned index) const;
+    /// Return JSON value at index, or null.
+    JSONValue operator [](unsigned index) const;
     /// Add JSON value at end.
     void Push(const JSONValue& value);
     /// Remove the last JSON value.
@@ -249,92 +158,49 @@ public:
     unsigned size() const;
 
     // JSON object functions
-    /// Return JSON value with key.
-    JSONValue& operator [](const std::string& key);
-    /// Return JSON value with key.
-    const JSONValue& operator [](const std::string& key) const;
+    /// Return JSON value with key, or null.
+    JSONValue operator [](const std::string& key) const;
     /// Set JSON value with key.
     void Set(const std::string& key, const JSONValue& value);
-    /// Return JSON value with key.
-    JSONValue get(std::string& key);
+    /// Return JSON value with key, or null.
+    JSONValue get(const std::string& key) const;
+    /// Return JSON value at a path of keys & array indices separated by dots (e.g. "media.transcodings.1.url"), or null.
+    JSONValue getPath(const std::string& path) const;
     /// Erase a pair by key.
     bool Erase(const std::string& key);
     /// Return whether contains a pair with key.
     bool Contains(const std::string& key) const;
-    /// Return iterator to the beginning.
-    JSONObjectIterator Begin();
-    /// Return iterator to the beginning.
-    ConstJSONObjectIterator Begin() const;
-    /// Return iterator to the end.
-    JSONObjectIterator End();
-    /// Return iterator to the beginning.
-    ConstJSONObjectIterator End() const;
 
     /// Clear array or object.
     void Clear();
 
-    /// Set value type and number type, internal function.
-    void SetType(JSONValueType valueType); //, JSONNumberType numberType = JSONNT_NAN);
-
-    /// Set variant, context must provide for resource ref.
-   /*  void SetVariant(const Variant& variant, Context* context = nullptr);
-    /// Return a variant.
-    Variant GetVariant() const;
-    /// Set variant value, context must provide for resource ref.
-    void SetVariantValue(const Variant& variant, Context* context = nullptr);
-    /// Return a variant with type.
-    Variant GetVariantValue(VariantType type) const;
-    /// Set variant map, context must provide for resource ref.
-    void SetVariantMap(const VariantMap& variantMap, Context* context = nullptr);
-    /// Return a variant map.
-    VariantMap GetVariantMap() const;
-    /// Set variant vector, context must provide for resource ref.
-    void SetVariantVector(const VariantVector& variantVector, Context* context = nullptr);
-    /// Return a variant vector.
-    VariantVector GetVariantVector() const; */
+    /// Set value type, internal function.
+    void SetType(JSONValueType valueType);
 
     /// Empty JSON value.
     static const JSONValue EMPTY;
-	static JSONValue emptyValue;
-    /// Empty JSON array.
-    static const JSONArray emptyArray;
-    /// Empty JSON object.
-    static const JSONObject emptyObject;
 
     /// Return name corresponding to a value type.
     static std::string GetValueTypeName(JSONValueType type);
     /// Return name corresponding to a number type.
     static std::string GetNumberTypeName(JSONNumberType type);
-    /// Return a value type from name; null if unrecognized.
-    static JSONValueType GetValueTypeFromName(const std::string& typeName);
-    /// Return a value type from name; null if unrecognized.
-    //static JSONValueType GetValueTypeFromName(const char* typeName);
-    /// Return a number type from name; NaN if unrecognized.
-    static JSONNumberType GetNumberTypeFromName(const std::string& typeName);
-    /// Return a value type from name; NaN if unrecognized.
-    //static JSONNumberType GetNumberTypeFromName(const char* typeName);
-	
-	void setVariant(Poco::Dynamic::Var var);
 
 private:
-	Poco::Dynamic::Var value;
-	bool isArrayType;
-	bool isObjectType;
-	Poco::JSON::Object::Ptr objectPtr;
-	Poco::JSON::Array::Ptr arrayPtr;
-	
-    /// type.
-    unsigned type_;
-    union {
-        /// Boolean value.
-        bool boolValue_;
-        /// Number value.
-        double numberValue_;
-        /// String value.
-        std::string* stringValue_;
-        /// Array value.
-        JSONArray* arrayValue_;
-        /// Object value.
-        JSONObject* objectValue_;
-    };
+    /// Return the token of the value in the document.
+    const JSONToken& token() const { return document_->token(index_); }
+
+    /// Parsed document, for a view.
+    std::shared_ptr<const JSONDocument> document_;
+    /// Token of the value in the document.
+    uint32_t index_ = 0;
+    /// Type, when not a view.
+    JSONValueType type_ = JSON_NULL;
+    /// Number type, when not a view.
+    JSONNumberType numberType_ = JSONNT_NAN;
+    /// Boolean value.
+    bool boolValue_ = false;
+    /// Number value.
+    double numberValue_ = 0.0;
+    /// String value.
+    std::string stringValue_;
 };
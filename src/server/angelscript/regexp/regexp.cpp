@@ -1,6 +1,11 @@
 /*
 	regexp.cpp - Implementation of the NymphCast regular expression API for AngelScript.
 	
+	Notes:
+			- Poco::RegularExpression is not modified by matching, so a compiled expression can be
+				used by multiple apps at the same time.
+			- The cache is emptied when it reaches REGEXP_CACHE_SIZE patterns.
+	
 	2020/04/29, Maya Posch
 */
 
@@ -12,6 +17,14 @@
 #include <Poco/Exception.h>
 
 
+#define REGEXP_CACHE_SIZE 64
+
+
+// Static variables.
+std::map<std::string, std::shared_ptr<const Poco::RegularExpression> > RegExp::cache;
+std::mutex RegExp::cacheMutex;
+
+
 static void ConstructRegExp(RegExp* ptr) {
     new(ptr) RegExp();
 }
@@ -58,64 +71,82 @@ void initRegExp(asIScriptEngine* engine) {
 
 // --- CONSTRUCTOR ---
 RegExp::RegExp() {
-	regexp = 0;
+	//
 }
 
 
 // --- DESTRUCTOR ---
 RegExp::~RegExp() {
-	if (regexp) {
-		delete regexp;
-	}
+	//
 }
 
 
 // --- SET REG EXP ---
 void RegExp::createRegExp(std::string re) {
-	if (regexp) { delete regexp; regexp = 0; }
+	regexp.reset();
+	
+	std::lock_guard<std::mutex> lk(cacheMutex);
+	std::map<std::string, std::shared_ptr<const Poco::RegularExpression> >::iterator it;
+	it = cache.find(re);
+	if (it != cache.end()) {
+		regexp = it->second;
+		return;
+	}
 	
 	try {
-		regexp = new Poco::RegularExpression(re);
+		regexp = std::make_shared<const Poco::RegularExpression>(re);
 	}
 	catch (Poco::RegularExpressionException &exc) {
 		std::cerr << "Couldn't parse regular expression: " << re << std::endl;
+		return;
 	}
+	
+	if (cache.size() >= REGEXP_CACHE_SIZE) { cache.clear(); }
+	cache.insert(std::make_pair(re, regexp));
 }
 
 
 // --- EXTRACT ---
 int RegExp::extract(const std::string &subject, std::string &str, int options) {
 	if (!regexp) { return 0; }
-	int n = regexp->extract(subject, str, options);
-	std::cout << "Found " << n << " matches." << std::endl;
-	return n;
+	return regexp->extract(subject, str, options);
 }
 
 
 // --- EXTRACT ---
 int RegExp::extract(const std::string &subject, int offset, std::string &str, int options) {
 	if (!regexp) { return 0; }
-	int n = regexp->extract(subject, offset, str, options);
-	std::cout << "Found " << n << " matches." << std::endl;
-	return n;
+	return regexp->extract(subject, offset, str, options);
 }
 
 
 // --- FIND ALL ---
+// Find all matches, and add the first capture group (or the whole match without groups) of each
+// to the 'matches' array.
 int RegExp::findall(const std::string &subject, CScriptArray* matches) {
 	if (!regexp) { return 0; }
 	
 	Poco::RegularExpression::MatchVec matchesVector;
 	std::string::size_type offset = 0;
 	int n = 0;
-	while (regexp->match(subject, offset, matchesVector)) {
-		std::string substr = subject.substr(matchesVector[1].offset, matchesVector[1].length);
-		if (matches) { matches->InsertLast(&substr); }
+	while (offset <= subject.size() && regexp->match(subject, offset, matchesVector)) {
+		if (matches) {
+			// Copy the match into the new array element directly.
+			Poco::RegularExpression::Match &group = matchesVector[matchesVector.size() > 1 ? 1 : 0];
+			matches->Resize(matches->GetSize() + 1);
+			std::string* str = static_cast<std::string*>(matches->At(matches->GetSize() - 1));
+			if (group.offset != std::string::npos) {
+				str->assign(subject, group.offset, group.length);
+			}
+		}
+		
 		n++;
+		
+		// Step past empty matches, or this would find the same match again.
 		offset = matchesVector[0].offset + matchesVector[0].length;
+		if (matchesVector[0].length == 0) { offset++; }
 	}
 	
-	std::cout << "RegExp::findall(): Found " << n << " matches." << std::endl;
 	return n;
 }
 
@@ -129,7 +160,9 @@ int RegExp::findfirst(const std::string &subject, std::string &str) {
 	int n = regexp->match(subject, offset, matchesVector);
 	if (n == 0) { return 0; }
 	
-	str = subject.substr(matchesVector[1].offset, matchesVector[1].length);
-	std::cout << "RegExp::findfirst(): Found " << n << " match." << std::endl;
+	Poco::RegularExpression::Match &group = matchesVector[matchesVector.size() > 1 ? 1 : 0];
+	if (group.offset == std::string::npos) { str.clear(); }
+	else { str.assign(subject, group.offset, group.length); }
+	
 	return n;
 }
@@ -1,6 +1,10 @@
 /*
 	regexp.h - Header for the NymphCast regular expression AngelScript API.
 	
+	Features:
+			- Compiled expressions are cached by their pattern, and shared between all RegExp
+				instances & apps. Creating the same expression again does not compile it again.
+	
 	2020/04/29, Maya Posch
 */
 
@@ -15,13 +19,19 @@
 #include <Poco/RegularExpression.h>
 
 #include <string>
+#include <map>
+#include <memory>
+#include <mutex>
 
 
 void initRegExp(asIScriptEngine* engine);
 
 
 class RegExp {
-	Poco::RegularExpression* regexp;
+	std::shared_ptr<const Poco::RegularExpression> regexp;
+	
+	static std::map<std::string, std::shared_ptr<const Poco::RegularExpression> > cache;
+	static std::mutex cacheMutex;
 	
 public:
 	explicit RegExp();
@@ -0,0 +1,341 @@
+/*
+	app_store.cpp - Implementation of the AppStore class.
+	
+	Revision 0.
+	
+	Notes:
+			- Keys are looked up in this order: cache, values waiting for write-back, database.
+			- A lookup in the database holds dbMutex until its result is cached, so that a store
+				or write-back can not be overtaken by an older value from the database.
+	
+	2026/10/18, Maya Posch
+*/
+
+
+#include "app_store.h"
+
+#include <Poco/Data/SQLite/SQLiteException.h>
+#include <Poco/Timestamp.h>
+
+#include <nymph/nymph.h>
+
+
+#define APP_STORE_CACHE_TTL 600		// Time an entry stays cached, in seconds.
+#define APP_STORE_FLUSH 500			// Write-back interval, in milliseconds.
+#define APP_STORE_BATCH 64			// Pending values which trigger a write-back right away.
+
+
+using namespace Poco::Data::Keywords;
+
+
+// Static variables.
+std::string AppStore::loggerName = "AppStore";
+
+
+// --- CONSTRUCTOR ---
+AppStore::AppStore(std::string path, uint32_t cacheSize, bool writeBack) {
+	this->path = path;
+	this->cacheSize = cacheSize;
+	this->writeBack = writeBack;
+}
+
+
+// --- DESTRUCTOR ---
+AppStore::~AppStore() {
+	close();
+}
+
+
+// --- OPEN ---
+// Open the database, create the table and prepare the statements.
+bool AppStore::open() {
+	std::lock_guard<std::mutex> lk(dbMutex);
+	if (session) { return true; }
+	
+	try {
+		session.reset(new Poco::Data::Session("SQLite", path));
+		
+		// WAL mode lets reads continue during writes, and needs fewer syncs per transaction.
+		std::string mode;
+		*session << "PRAGMA journal_mode=WAL", into(mode), now;
+		*session << "PRAGMA synchronous=NORMAL", now;
+		if (mode != "wal") {
+			NYMPH_LOG_WARNING("WAL mode not available for " + path + ", using " + mode + ".");
+		}
+		
+		*session << "CREATE TABLE IF NOT EXISTS data (id TEXT PRIMARY KEY NOT NULL, value TEXT NOT NULL, updated INTEGER)",
+			now;
+		
+		insertStatement.reset(new Poco::Data::Statement(*session));
+		*insertStatement << "INSERT OR REPLACE INTO data (id, value, updated) VALUES (?, ?, ?)",
+			use(insertKey), use(insertValue), use(insertUpdated);
+		
+		selectStatement.reset(new Poco::Data::Statement(*session));
+		*selectStatement << "SELECT value, updated FROM data WHERE id=?",
+			use(selectKey), into(selectValue), into(selectUpdated);
+	}
+	catch (Poco::Exception &exc) {
+		NYMPH_LOG_ERROR("Failed to open " + path + ": " + exc.displayText());
+		insertStatement.reset();
+		selectStatement.reset();
+		session.reset();
+		return false;
+	}
+	
+	if (writeBack) {
+		std::lock_guard<std::mutex> clk(cacheMutex);
+		running = true;
+		writer = std::thread(&AppStore::run, this);
+	}
+	
+	return true;
+}
+
+
+// --- CLOSE ---
+// Write pending values and close the database.
+void AppStore::close() {
+	{
+		std::lock_guard<std::mutex> lk(cacheMutex);
+		running = false;
+	}
+	
+	writerCv.notify_all();
+	if (writer.joinable()) { writer.join(); }
+	
+	flush();
+	
+	std::lock_guard<std::mutex> lk(dbMutex);
+	insertStatement.reset();
+	selectStatement.reset();
+	session.reset();
+}
+
+
+// --- CACHE ---
+// Add or update an entry in the LRU cache. Call with cacheMutex locked.
+void AppStore::cache(const AppStoreEntry &entry) {
+	if (cacheSize == 0) { return; }
+	
+	std::unordered_map<std::string, std::list<AppStoreEntry>::iterator>::iterator it;
+	it = index.find(entry.key);
+	if (it != index.end()) {
+		*(it->second) = entry;
+		lru.splice(lru.begin(), lru, it->second);
+		return;
+	}
+	
+	lru.push_front(entry);
+	index[entry.key] = lru.begin();
+	while (lru.size() > cacheSize) {
+		index.erase(lru.back().key);
+		lru.pop_back();
+	}
+}
+
+
+// --- LOOKUP ---
+// Find a key in the cache or the pending values. Call with cacheMutex locked.
+bool AppStore::lookup(const std::string &key, AppStoreEntry &entry) {
+	std::map<std::string, AppStoreEntry>::iterator pit = pending.find(key);
+	if (pit != pending.end()) {
+		entry = pit->second;
+		return true;
+	}
+	
+	std::unordered_map<std::string, std::list<AppStoreEntry>::iterator>::iterator it;
+	it = index.find(key);
+	if (it == index.end()) { return false; }
+	
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (now - it->second->cached > std::chrono::seconds(APP_STORE_CACHE_TTL)) {
+		lru.erase(it->second);
+		index.erase(it);
+		return false;
+	}
+	
+	lru.splice(lru.begin(), lru, it->second);
+	entry = *(it->second);
+	
+	return true;
+}
+
+
+// --- WRITE ---
+// Write a single value into the database. Call with dbMutex locked.
+bool AppStore::write(const std::string &key, const std::string &value, int64_t updated) {
+	if (!insertStatement) { return false; }
+	
+	insertKey = key;
+	insertValue = value;
+	insertUpdated = updated;
+	try {
+		insertStatement->execute();
+	}
+	catch (Poco::Exception &exc) {
+		NYMPH_LOG_ERROR("Failed to store '" + key + "' in " + path + ": " + exc.displayText());
+		return false;
+	}
+	
+	return true;
+}
+
+
+// --- WRITE BATCH ---
+// Write all pending values in a single transaction. Call with dbMutex locked.
+// If the transaction fails, the values stay pending.
+void AppStore::writeBatch() {
+	if (!session) { return; }
+	
+	std::map<std::string, AppStoreEntry> batch;
+	{
+		std::lock_guard<std::mutex> lk(cacheMutex);
+		batch.swap(pending);
+		
+		// Keep the values readable from the cache until the next lookup in the database.
+		std::map<std::string, AppStoreEntry>::iterator it;
+		for (it = batch.begin(); it != batch.end(); ++it) {
+			cache(it->second);
+		}
+	}
+	
+	if (batch.empty()) { return; }
+	
+	try {
+		session->begin();
+		std::map<std::string, AppStoreEntry>::iterator it;
+		for (it = batch.begin(); it != batch.end(); ++it) {
+			insertKey = it->first;
+			insertValue = it->second.value;
+			insertUpdated = it->second.updated;
+			insertStatement->execute();
+		}
+		
+		session->commit();
+	}
+	catch (Poco::Exception &exc) {
+		NYMPH_LOG_ERROR("Failed to write " + std::to_string(batch.size()) + " values to " + path
+							+ ": " + exc.displayText());
+		try { session->rollback(); } catch (...) { }
+		
+		// Queue the values again, to be retried with the next batch. Values stored since
+		// replace them.
+		std::lock_guard<std::mutex> lk(cacheMutex);
+		std::map<std::string, AppStoreEntry>::iterator it;
+		for (it = batch.begin(); it != batch.end(); ++it) {
+			pending.insert(*it);
+		}
+	}
+}
+
+
+// --- RUN ---
+// Write-back thread.
+void AppStore::run() {
+	std::unique_lock<std::mutex> lk(cacheMutex);
+	while (running) {
+		writerCv.wait_for(lk, std::chrono::milliseconds(APP_STORE_FLUSH), [this] {
+			return !running || pending.size() >= APP_STORE_BATCH;
+		});
+		
+		if (pending.empty()) { continue; }
+		
+		lk.unlock();
+		flush();
+		lk.lock();
+	}
+}
+
+
+// --- FLUSH ---
+// Write the pending values to the database.
+void AppStore::flush() {
+	std::lock_guard<std::mutex> lk(dbMutex);
+	writeBatch();
+}
+
+
+// --- STORE ---
+bool AppStore::store(const std::string &key, const std::string &value) {
+	AppStoreEntry entry;
+	entry.key = key;
+	entry.value = value;
+	entry.updated = (int64_t) Poco::Timestamp().epochMicroseconds();
+	entry.found = true;
+	entry.cached = std::chrono::steady_clock::now();
+	
+	if (writeBack) {
+		std::lock_guard<std::mutex> lk(cacheMutex);
+		if (!running) { return false; }
+		
+		pending[key] = entry;
+		if (pending.size() >= APP_STORE_BATCH) { writerCv.notify_one(); }
+		
+		return true;
+	}
+	
+	std::lock_guard<std::mutex> lk(dbMutex);
+	if (!write(key, value, entry.updated)) { return false; }
+	
+	std::lock_guard<std::mutex> clk(cacheMutex);
+	cache(entry);
+	
+	return true;
+}
+
+
+// --- READ ---
+// Read the value for a key. The 'age' parameter (in microseconds) sets the maximum allowed age of
+// the value since its last update, 0 means that any age is acceptable.
+bool AppStore::read(const std::string &key, std::string &value, uint64_t age) {
+	AppStoreEntry entry;
+	bool cached;
+	{
+		std::lock_guard<std::mutex> lk(cacheMutex);
+		cached = lookup(key, entry);
+	}
+	
+	if (!cached) {
+		std::lock_guard<std::mutex> lk(dbMutex);
+		if (!selectStatement) { return false; }
+		
+		entry.key = key;
+		entry.value.clear();
+		entry.updated = 0;
+		selectKey = key;
+		try {
+			entry.found = selectStatement->execute() > 0;
+		}
+		catch (Poco::Exception &exc) {
+			NYMPH_LOG_ERROR("Failed to read '" + key + "' from " + path + ": " + exc.displayText());
+			return false;
+		}
+		
+		if (entry.found) {
+			entry.value = selectValue;
+			entry.updated = selectUpdated;
+		}
+		
+		// A value stored in the meantime takes precedence over the one from the database.
+		std::lock_guard<std::mutex> clk(cacheMutex);
+		AppStoreEntry newer;
+		if (lookup(key, newer)) {
+			entry = newer;
+		}
+		else {
+			entry.cached = std::chrono::steady_clock::now();
+			cache(entry);
+		}
+	}
+	
+	if (!entry.found || entry.updated == 0) { return false; }
+	
+	value = entry.value;
+	
+	// If 'age' parameter has been set, check whether value has expired.
+	if (age > 0 && entry.updated + (int64_t) age < (int64_t) Poco::Timestamp().epochMicroseconds()) {
+		return false;
+	}
+	
+	return true;
+}
@@ -0,0 +1,97 @@
+/*
+	app_store.h - Header for the key/value store of NymphCast apps.
+	
+	Revision 0
+	
+	Features:
+			- One SQLite database per app, kept open in WAL mode for the lifetime of the server.
+			- Inserts & lookups use prepared statements.
+			- Recently used values are kept in an LRU cache, so that most reads don't touch the
+				database. Keys which are not in the database are cached as well.
+			- Optional write-back: values are written to the database in batches by a worker
+				thread, instead of by each store call.
+	
+	Notes:
+			- Cached entries are dropped after APP_STORE_CACHE_TTL, or when the cache is full.
+			- With write-back, values stored less than APP_STORE_FLUSH ago are lost if the
+				server does not shut down cleanly.
+	
+	2026/10/18, Maya Posch
+*/
+
+
+#ifndef APP_STORE_H
+#define APP_STORE_H
+
+
+#include <cstdint>
+#include <string>
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+
+#include <Poco/Data/Session.h>
+#include <Poco/Data/Statement.h>
+
+
+struct AppStoreEntry {
+	std::string key;
+	std::string value;
+	int64_t updated;		// Time of the last store, in microseconds since the epoch.
+	bool found;				// False if the key is not in the database.
+	std::chrono::steady_clock::time_point cached;
+};
+
+
+class AppStore {
+	std::string path;
+	uint32_t cacheSize;
+	bool writeBack;
+	
+	std::unique_ptr<Poco::Data::Session> session;
+	std::unique_ptr<Poco::Data::Statement> insertStatement;
+	std::unique_ptr<Poco::Data::Statement> selectStatement;
+	std::string insertKey;			// Bound to the prepared statements.
+	std::string insertValue;
+	int64_t insertUpdated = 0;
+	std::string selectKey;
+	std::string selectValue;
+	int64_t selectUpdated = 0;
+	std::mutex dbMutex;				// Lock before cacheMutex when both are needed.
+	
+	std::list<AppStoreEntry> lru;	// Most recently used first.
+	std::unordered_map<std::string, std::list<AppStoreEntry>::iterator> index;
+	std::map<std::string, AppStoreEntry> pending;	// Values not yet written, with write-back.
+	std::mutex cacheMutex;
+	
+	std::thread writer;
+	std::condition_variable writerCv;
+	bool running = false;
+	
+	static std::string loggerName;
+	
+	void cache(const AppStoreEntry &entry);
+	bool lookup(const std::string &key, AppStoreEntry &entry);
+	bool write(const std::string &key, const std::string &value, int64_t updated);
+	void writeBatch();
+	void run();
+
+public:
+	AppStore(std::string path, uint32_t cacheSize, bool writeBack);
+	~AppStore();
+	AppStore(const AppStore&) = delete;
+	AppStore& operator=(const AppStore&) = delete;
+	
+	bool open();
+	void close();
+	bool store(const std::string &key, const std::string &value);
+	bool read(const std::string &key, std::string &value, uint64_t age);
+	void flush();
+};
+
+#endif
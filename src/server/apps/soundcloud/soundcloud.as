@@ -302,8 +302,7 @@ bool playTrack(int id) {
 	}
 	
 	JSONValue root = json.getRoot();
-	JSONValue transcodings = root.get("media").get("transcodings");
-	string url = transcodings[1].get("url").getString();
+	string url = root.getPath("media.transcodings.1.url").getString();
 	
 	query = url + "?client_id=" + clientId;
 	if (!performHttpsQuery(query, response)) {
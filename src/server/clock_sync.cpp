@@ -0,0 +1,296 @@
+/*
+	clock_sync.cpp - Implementation of the ClockSync class.
+	
+	Revision 0.
+	
+	Notes:
+			- An exchange asks the slave for its current time. With the request sent at t1 and
+				the reply received at t4, the slave clock read 'theirs' at about (t1 + t4) / 2.
+				The error of this is at most half the RTT, hence the lowest RTT sample is used.
+			- Rounds with an RTT well above the lowest one in the history are dropped, as those
+				were delayed by e.g. network or scheduling congestion.
+	
+	2026/10/18, Maya Posch
+*/
+
+
+#include "clock_sync.h"
+
+#include <vector>
+#include <chrono>
+
+#include <nymph/nymph.h>
+
+#include <Poco/NumberFormatter.h>
+
+
+#define SYNC_SAMPLES 8				// Exchanges per round.
+#define SYNC_HISTORY 32				// Rounds used for the drift estimate.
+#define SYNC_DRIFT_MIN 4			// Rounds needed before estimating drift.
+#define SYNC_DRIFT_SPAN 2000000		// Time span needed before estimating drift, in microseconds.
+#define SYNC_RTT_REJECT 3			// Drop rounds with an RTT above this multiple of the lowest.
+#define SYNC_RTT_SLACK 200			// Allowed RTT jitter on top of that, in microseconds.
+#define SYNC_INTERVAL 1000			// Time between rounds, in milliseconds.
+#define SYNC_SPIN_TIME 2000			// Time waitUntil() yields instead of sleeping, in microseconds.
+
+
+// Static variables.
+std::mutex ClockSync::syncMutex;
+std::map<uint32_t, ClockSyncState> ClockSync::slaves;
+std::thread ClockSync::syncThread;
+std::atomic<bool> ClockSync::running = { false };
+std::mutex ClockSync::runMutex;
+std::condition_variable ClockSync::runCv;
+SyncCallback ClockSync::syncCallback = 0;
+std::string ClockSync::loggerName = "ClockSync";
+
+
+// --- NOW ---
+// Current wall clock time in microseconds since the epoch.
+int64_t ClockSync::now() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+						std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+
+// --- WAIT UNTIL ---
+// Block until the local clock reaches 'time'. Sleeps for most of the wait, then yields for the
+// last part, as sleeps can overshoot by a scheduler tick.
+void ClockSync::waitUntil(int64_t time) {
+	int64_t left = time - now();
+	if (left > SYNC_SPIN_TIME) {
+		std::this_thread::sleep_for(std::chrono::microseconds(left - SYNC_SPIN_TIME));
+	}
+	
+	while (now() < time) {
+		std::this_thread::yield();
+	}
+}
+
+
+// --- ADD SLAVE ---
+void ClockSync::addSlave(uint32_t handle) {
+	std::lock_guard<std::mutex> lk(syncMutex);
+	slaves[handle] = ClockSyncState();
+}
+
+
+// --- REMOVE SLAVE ---
+void ClockSync::removeSlave(uint32_t handle) {
+	std::lock_guard<std::mutex> lk(syncMutex);
+	slaves.erase(handle);
+}
+
+
+// --- CLEAR ---
+void ClockSync::clear() {
+	std::lock_guard<std::mutex> lk(syncMutex);
+	slaves.clear();
+}
+
+
+// --- EXCHANGE ---
+// Single time request to the slave.
+bool ClockSync::exchange(uint32_t handle, ClockSyncSample &sample) {
+	std::vector<NymphType*> values;
+	std::string result;
+	NymphType* returnValue = 0;
+	int64_t t1 = now();
+	if (!NymphRemoteServer::callMethod(handle, "slave_time", values, returnValue, result)) {
+		NYMPH_LOG_ERROR("Calling slave_time failed: " + result);
+		return false;
+	}
+	
+	int64_t t4 = now();
+	int64_t theirs = returnValue->getInt64();
+	delete returnValue;
+	
+	sample.rtt = t4 - t1;
+	sample.time = t1 + (sample.rtt / 2);
+	sample.offset = theirs - sample.time;
+	
+	return true;
+}
+
+
+// --- UPDATE ---
+// Add the best sample of a round to the state of a slave and update the estimates.
+void ClockSync::update(ClockSyncState &state, ClockSyncSample &sample) {
+	if (!state.history.empty()) {
+		int64_t rttMin = sample.rtt;
+		for (size_t i = 0; i < state.history.size(); ++i) {
+			if (state.history[i].rtt < rttMin) { rttMin = state.history[i].rtt; }
+		}
+		
+		if (sample.rtt > (rttMin * SYNC_RTT_REJECT) + SYNC_RTT_SLACK) {
+			NYMPH_LOG_DEBUG("Dropped sync round with RTT " + 
+								Poco::NumberFormatter::format(sample.rtt) + " microseconds.");
+			return;
+		}
+	}
+	
+	state.history.push_back(sample);
+	if (state.history.size() > SYNC_HISTORY) { state.history.pop_front(); }
+	
+	state.refTime = sample.time;
+	state.rtt = sample.rtt;
+	state.valid = true;
+	
+	int64_t span = state.history.back().time - state.history.front().time;
+	if (state.history.size() < SYNC_DRIFT_MIN || span < SYNC_DRIFT_SPAN) {
+		state.offset = sample.offset;
+		return;
+	}
+	
+	// Least-squares fit of offset over time. Relative to the first sample to keep precision.
+	const ClockSyncSample& first = state.history.front();
+	double n = (double) state.history.size();
+	double meanX = 0.0;
+	double meanY = 0.0;
+	for (size_t i = 0; i < state.history.size(); ++i) {
+		meanX += (double) (state.history[i].time - first.time);
+		meanY += (double) (state.history[i].offset - first.offset);
+	}
+	
+	meanX /= n;
+	meanY /= n;
+	
+	double sxy = 0.0;
+	double sxx = 0.0;
+	for (size_t i = 0; i < state.history.size(); ++i) {
+		double dx = (double) (state.history[i].time - first.time) - meanX;
+		double dy = (double) (state.history[i].offset - first.offset) - meanY;
+		sxy += dx * dy;
+		sxx += dx * dx;
+	}
+	
+	state.drift = sxy / sxx;
+	
+	// Offset at the newest sample according to the fit, which averages out the sample noise.
+	double x = (double) (sample.time - first.time);
+	state.offset = first.offset + (int64_t) (meanY + (state.drift * (x - meanX)));
+}
+
+
+// --- MEASURE ---
+// Run an exchange round with the slave and update its estimates.
+// Returns false if the slave could not be reached.
+bool ClockSync::measure(uint32_t handle) {
+	ClockSyncSample best;
+	bool have = false;
+	for (int i = 0; i < SYNC_SAMPLES; ++i) {
+		ClockSyncSample sample;
+		if (!exchange(handle, sample)) { return false; }
+		if (!have || sample.rtt < best.rtt) {
+			best = sample;
+			have = true;
+		}
+	}
+	
+	std::lock_guard<std::mutex> lk(syncMutex);
+	std::map<uint32_t, ClockSyncState>::iterator it = slaves.find(handle);
+	if (it == slaves.end()) { return false; }
+	
+	update(it->second, best);
+	
+	NYMPH_LOG_DEBUG("Slave " + Poco::NumberFormatter::format(handle) + ": offset " + 
+					Poco::NumberFormatter::format(it->second.offset) + " us, RTT " + 
+					Poco::NumberFormatter::format(best.rtt) + " us, drift " + 
+					Poco::NumberFormatter::format(it->second.drift * 1e6, 2) + " ppm.");
+	
+	return true;
+}
+
+
+// --- GET STATE ---
+// Copy of the current estimates of a slave, without the history.
+bool ClockSync::getState(uint32_t handle, ClockSyncState &state) {
+	std::lock_guard<std::mutex> lk(syncMutex);
+	std::map<uint32_t, ClockSyncState>::iterator it = slaves.find(handle);
+	if (it == slaves.end()) { return false; }
+	
+	state.offset = it->second.offset;
+	state.refTime = it->second.refTime;
+	state.drift = it->second.drift;
+	state.rtt = it->second.rtt;
+	state.valid = it->second.valid;
+	
+	return true;
+}
+
+
+// --- TO SLAVE ---
+// Convert a master timestamp into the local time of the slave.
+int64_t ClockSync::toSlave(uint32_t handle, int64_t masterTime) {
+	std::lock_guard<std::mutex> lk(syncMutex);
+	std::map<uint32_t, ClockSyncState>::iterator it = slaves.find(handle);
+	if (it == slaves.end() || !it->second.valid) { return masterTime; }
+	
+	const ClockSyncState& state = it->second;
+	return masterTime + state.offset + (int64_t) (state.drift * (masterTime - state.refTime));
+}
+
+
+// --- MAX RTT ---
+// Highest RTT among the slaves, in microseconds.
+int64_t ClockSync::maxRtt() {
+	std::lock_guard<std::mutex> lk(syncMutex);
+	int64_t rtt = 0;
+	std::map<uint32_t, ClockSyncState>::iterator it;
+	for (it = slaves.begin(); it != slaves.end(); ++it) {
+		if (it->second.rtt > rtt) { rtt = it->second.rtt; }
+	}
+	
+	return rtt;
+}
+
+
+// --- SYNC LOOP ---
+void ClockSync::syncLoop() {
+	while (running) {
+		{
+			std::unique_lock<std::mutex> lk(runMutex);
+			runCv.wait_for(lk, std::chrono::milliseconds(SYNC_INTERVAL), [] { return !running; });
+		}
+		
+		if (!running) { break; }
+		
+		std::vector<uint32_t> handles;
+		{
+			std::lock_guard<std::mutex> lk(syncMutex);
+			std::map<uint32_t, ClockSyncState>::iterator it;
+			for (it = slaves.begin(); it != slaves.end(); ++it) {
+				handles.push_back(it->first);
+			}
+		}
+		
+		for (size_t i = 0; i < handles.size() && running; ++i) {
+			if (!measure(handles[i])) { continue; }
+			if (syncCallback) { syncCallback(handles[i]); }
+		}
+	}
+}
+
+
+// --- START ---
+// Start the periodic exchanges with the slaves. The callback is called for each slave after
+// its estimates have been updated.
+void ClockSync::start(SyncCallback cb) {
+	stop();
+	
+	syncCallback = cb;
+	running = true;
+	syncThread = std::thread(syncLoop);
+}
+
+
+// --- STOP ---
+void ClockSync::stop() {
+	{
+		std::lock_guard<std::mutex> lk(runMutex);
+		running = false;
+	}
+	
+	runCv.notify_all();
+	if (syncThread.joinable()) { syncThread.join(); }
+}
@@ -0,0 +1,88 @@
+/*
+	clock_sync.h - Header for the master/slave clock synchronisation.
+	
+	Revision 0
+	
+	Features:
+			- Estimates the offset & drift of the system clock of each slave receiver relative to
+				the master, using NTP-style exchanges over the slave's RPC connection.
+			- Each exchange round takes multiple samples and keeps the one with the lowest RTT.
+			- Drift is the least-squares slope over the offsets of recent rounds.
+			- Converts master timestamps into the local time of a slave, so that events can be
+				scheduled on an absolute, shared time.
+			- A background thread repeats the exchange while in master mode.
+	
+	Notes:
+			- Times are wall clock time in microseconds since the epoch, as av_gettime() and
+				Poco::Timestamp::epochMicroseconds().
+	
+	2026/10/18, Maya Posch
+*/
+
+
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <map>
+#include <deque>
+#include <string>
+#include <functional>
+
+
+typedef std::function<void(uint32_t)> SyncCallback;
+
+
+struct ClockSyncSample {
+	int64_t time;		// Master time at the middle of the exchange.
+	int64_t offset;		// Slave clock minus master clock.
+	int64_t rtt;		// Round-trip time of the exchange.
+};
+
+
+struct ClockSyncState {
+	int64_t offset = 0;		// Slave clock minus master clock at 'refTime', in microseconds.
+	int64_t refTime = 0;	// Master time of the offset estimate.
+	double drift = 0.0;		// Slave clock rate minus master clock rate (e.g. 1e-5 = 10 ppm).
+	int64_t rtt = 0;		// RTT of the last accepted sample, in microseconds.
+	bool valid = false;
+	std::deque<ClockSyncSample> history;	// Accepted samples, oldest first.
+};
+
+
+class ClockSync {
+	static std::mutex syncMutex;
+	static std::map<uint32_t, ClockSyncState> slaves;	// Keyed on the slave's RPC handle.
+	static std::thread syncThread;
+	static std::atomic<bool> running;
+	static std::mutex runMutex;
+	static std::condition_variable runCv;
+	static SyncCallback syncCallback;
+	static std::string loggerName;
+	
+	static bool exchange(uint32_t handle, ClockSyncSample &sample);
+	static void update(ClockSyncState &state, ClockSyncSample &sample);
+	static void syncLoop();
+
+public:
+	static int64_t now();
+	static void waitUntil(int64_t time);
+	
+	static void addSlave(uint32_t handle);
+	static void removeSlave(uint32_t handle);
+	static void clear();
+	static bool measure(uint32_t handle);
+	static bool getState(uint32_t handle, ClockSyncState &state);
+	static int64_t toSlave(uint32_t handle, int64_t masterTime);
+	static int64_t maxRtt();
+	
+	static void start(SyncCallback cb);
+	static void stop();
+};
+
+#endif
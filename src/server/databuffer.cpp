@@ -1,10 +1,18 @@
 /*
 	databuffer.cpp - Implementation of the DataBufer class.
 	
-	Revision 0.
+	Revision 4.
 	
 	Notes:
-			- 
+			- Single producer (write), single consumer (read) ring buffer. Head and tail are
+				monotonic byte counters, the offset into the buffer is counter % capacity.
+			- On Linux the buffer memory is mapped twice back-to-back (memfd), so that any
+				contiguous range of up to 'capacity' bytes can be accessed without wrapping.
+			- Read-ahead keeps up to DB_MAX_IN_FLIGHT data requests outstanding. The block size
+				of each request tracks throughput x minimum RTT (bandwidth-delay product).
+			- A quarter of the buffer behind the read position is retained for seeking back.
+				Data received while the player probes the container is pinned separately.
+			- Each cast session has its own instance, owned by the SessionRegistry.
 			
 	2020/11/19, Maya Posch
 */
@@ -21,6 +29,12 @@
 #include <iostream>
 #endif
 
+#if defined(__linux__) && !defined(__ANDROID__)
+#define DB_MIRRORED_RING 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 // Enable profiling.
 //#define PROFILING_DB 1
 #ifdef PROFILING_DB
@@ -28,6 +42,8 @@
 #include <fstream>
 std::ofstream db_debugfile;
 uint32_t profcount = 0;
+uint64_t db_blockedTotal = 0;	// Total time the reader was blocked waiting for data, in µs.
+uint32_t db_blockedCount = 0;	// Number of times the reader was blocked.
 
 //#include <cstdio>
 std::ofstream db_readsfile;
@@ -35,77 +51,133 @@ std::ofstream db_readsfile;
 #endif
 
 
-// Static initialisations.
-uint8_t* DataBuffer::buffer = 0;
-uint8_t* DataBuffer::end = 0;
-uint8_t* DataBuffer::front = 0;
-uint8_t* DataBuffer::back = 0;
-uint8_t* DataBuffer::index = 0;
-uint32_t DataBuffer::capacity = 0;
-uint32_t DataBuffer::size = 0;
-int64_t DataBuffer::filesize = 0;
-std::atomic<uint32_t> DataBuffer::unread = { 0 };
-std::atomic<uint32_t> DataBuffer::free = { 0 };
-uint32_t DataBuffer::byteIndex = 0;
-uint32_t DataBuffer::byteIndexLow = 0;
-uint32_t DataBuffer::byteIndexHigh = 0;
-std::atomic<bool> DataBuffer::eof = { false };
-std::atomic<DataBuffer::BufferState> DataBuffer::state;
-std::mutex DataBuffer::bufferMutex;
-SeekRequestCallback DataBuffer::seekRequestCallback = 0;
-DataRequestCallback DataBuffer::dataRequestCallback = 0;
-std::mutex DataBuffer::dataReadMutex;
-std::condition_variable DataBuffer::dataReadCV;
-std::mutex DataBuffer::dataWaitMutex;
-std::condition_variable DataBuffer::dataWaitCV;
-std::atomic<bool> DataBuffer::dataRequestPending = { false };
-std::mutex DataBuffer::seekRequestMutex;
-std::condition_variable DataBuffer::seekRequestCV;
-std::atomic<bool> DataBuffer::seekRequestPending = { false };
-std::atomic<bool> DataBuffer::resetRequest = { false };
-std::atomic<bool> DataBuffer::writeStarted = { false };
-std::atomic<bool> DataBuffer::bufferAhead = { false };
-std::atomic<bool> DataBuffer::buffering = { false };
-uint32_t DataBuffer::sessionHandle = 0;
-
-std::mutex DataBuffer::streamTrackQueueMutex;
-std::queue<std::string> DataBuffer::streamTrackQueue;
+// Read-ahead tuning. Block sizes are in kB.
+const uint32_t DB_BLOCK_DEFAULT = 200;
+const uint32_t DB_BLOCK_MIN = 64;
+const uint32_t DB_BLOCK_MAX = 4096;
+const uint32_t DB_MAX_IN_FLIGHT = 4;
 
+// Maximum size of the pinned container header & index data, in bytes.
+const uint32_t DB_PIN_MAX = 4 * 1024 * 1024;
 
-// --- INIT ---
-// Initialises new data buffer. Capacity is provided in bytes.
-// Returns false on error, otherwise true.
-bool DataBuffer::init(uint32_t capacity) {
-	if (buffer != 0) {
-		// An existing buffer exists. Erase it first.
-		delete[] buffer;
+
+// --- CONSTRUCTOR ---
+DataBuffer::DataBuffer() {
+	blockSize = DB_BLOCK_DEFAULT;
+	lastArrival = std::chrono::steady_clock::now();
+}
+
+
+// --- DESTRUCTOR ---
+DataBuffer::~DataBuffer() {
+	release();
+}
+
+
+// --- ALLOCATE ---
+// Allocate the buffer memory. Tries to set up the mirrored mapping first, falling back to a
+// plain heap allocation. The capacity gets rounded up to the page size when mirrored.
+bool DataBuffer::allocate(uint32_t capacity) {
+	mirrored = false;
+	
+#ifdef DB_MIRRORED_RING
+	uint32_t page = (uint32_t) sysconf(_SC_PAGESIZE);
+	uint32_t mapsize = ((capacity + page - 1) / page) * page;
+	int fd = memfd_create("nymphcast_databuffer", MFD_CLOEXEC);
+	if (fd >= 0) {
+		if (ftruncate(fd, mapsize) == 0) {
+			// Reserve twice the range, then map the same pages into both halves.
+			uint8_t* base = (uint8_t*) mmap(0, 2 * (size_t) mapsize, PROT_NONE,
+											MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (base != MAP_FAILED) {
+				void* low = mmap(base, mapsize, PROT_READ | PROT_WRITE,
+											MAP_SHARED | MAP_FIXED, fd, 0);
+				void* high = mmap(base + mapsize, mapsize, PROT_READ | PROT_WRITE,
+											MAP_SHARED | MAP_FIXED, fd, 0);
+				if (low == base && high == base + mapsize) {
+					buffer = base;
+					DataBuffer::capacity = mapsize;
+					mirrored = true;
+				}
+				else {
+					munmap(base, 2 * (size_t) mapsize);
+				}
+			}
+		}
+		
+		close(fd);
 	}
 	
-	// Allocate new buffer and return result.
+	if (mirrored) { return true; }
+#ifdef DEBUG
+	std::cerr << "DataBuffer: mirrored mapping failed, using single mapping." << std::endl;
+#endif
+#endif
+	
 	buffer = new uint8_t[capacity];
 	DataBuffer::capacity = capacity;
 	
-	end = buffer + capacity;
-	front = buffer;
-	back = buffer;
-	index = buffer;
+	return true;
+}
+
+
+// --- FREE BUFFER ---
+// Free buffer memory as allocated by allocate().
+static void freeBuffer(uint8_t* buffer, uint32_t capacity, bool mirrored) {
+	if (buffer == 0) { return; }
+	
+#ifdef DB_MIRRORED_RING
+	if (mirrored) {
+		munmap(buffer, 2 * (size_t) capacity);
+		return;
+	}
+#endif
+	
+	delete[] buffer;
+}
+
+
+// --- RELEASE ---
+// Free the buffer memory, if allocated.
+void DataBuffer::release() {
+	freeBuffer(buffer, capacity, mirrored);
+	buffer = 0;
+	mirrored = false;
+}
+
+
+// --- INIT ---
+// Initialises new data buffer. Capacity is provided in bytes.
+// Returns false on error, otherwise true.
+bool DataBuffer::init(uint32_t capacity) {
+	// If an existing buffer exists, erase it first.
+	release();
+	if (!allocate(capacity)) { return false; }
 	
-	size = 0;
-	unread = 0;
-	free = capacity;
+	head = 0;
+	tail = 0;
+	fileBase = 0;
 	
 	byteIndex = 0;
 	byteIndexLow = 0;
 	byteIndexHigh = 0;
 	
+	pinnedMutex.lock();
+	pinned.clear();
+	pinnedSize = 0;
+	pinnedMutex.unlock();
+	
 	eof = false;
+	resync = false;
 	dataRequestPending = false;
 	seekRequestPending = false;
 	resetRequest = false;
 	writeStarted = false;
 	bufferAhead = false;
+	prefetching = false;
 	buffering = false;
 	state = DBS_IDLE;
+	resetStats();
 	
 #ifdef PROFILING_DB
 	if (!db_debugfile.is_open()) {
@@ -125,13 +197,17 @@ bool DataBuffer::init(uint32_t capacity) {
 // --- CLEAN UP ---
 // Clean up resources, delete the buffer.
 bool DataBuffer::cleanup() {
-	if (buffer != 0) {
-		delete[] buffer;
-		buffer = 0;
-	}
+	release();
+	
+	pinnedMutex.lock();
+	pinned.clear();
+	pinnedSize = 0;
+	pinnedMutex.unlock();
 	
 #ifdef PROFILING_DB
 	if (db_debugfile.is_open()) {
+		db_debugfile << "Blocked on data: " << db_blockedCount << " times, total "
+						<< db_blockedTotal << "µs.\n";
 		db_debugfile.flush();
 		db_debugfile.close();
 	}
@@ -147,6 +223,72 @@ bool DataBuffer::cleanup() {
 }
 
 
+// --- RESIZE ---
+// Change the capacity of the buffer, keeping the unread data. Any retained data behind the read
+// position is dropped. Locks out the reader, stops new data requests and waits for the outstanding
+// ones to complete, then locks out the writer while the buffers are swapped.
+// Returns false if the unread data does not fit, the allocation failed or a request timed out.
+bool DataBuffer::resize(uint32_t capacity) {
+	if (buffer == 0) { return init(capacity); }
+	
+	std::lock_guard<std::mutex> lk(bufferMutex);
+	{
+		// Under the request lock, so that no request is counted after waitRequests() returned.
+		std::lock_guard<std::mutex> rlk(requestMutex);
+		resizing = true;
+	}
+	
+	bool ret = false;
+	if (waitRequests()) {
+		std::lock_guard<std::mutex> wlk(writeMutex);
+		ret = rebuffer(capacity);
+	}
+	
+	resizing = false;
+	
+	return ret;
+}
+
+
+// --- REBUFFER ---
+// Move the unread data into a newly allocated buffer of 'capacity' bytes. The caller has to hold
+// both the reader and the writer off.
+bool DataBuffer::rebuffer(uint32_t capacity) {
+	uint64_t locHead = head.load(std::memory_order_acquire);
+	uint64_t locTail = tail.load(std::memory_order_relaxed);
+	uint32_t unread = (uint32_t) (locHead - locTail);
+	if (unread > capacity) { return false; }
+	
+	uint8_t* oldBuffer = buffer;
+	uint32_t oldCapacity = DataBuffer::capacity;
+	bool oldMirrored = mirrored;
+	buffer = 0;
+	if (!allocate(capacity)) {
+		buffer = oldBuffer;
+		DataBuffer::capacity = oldCapacity;
+		mirrored = oldMirrored;
+		return false;
+	}
+	
+	// Copy the unread data to the start of the new buffer and rebase the counters on it.
+	for (uint64_t i = locTail; i < locHead; ) {
+		uint32_t offset = (uint32_t) (i % oldCapacity);
+		uint32_t len = (uint32_t) (locHead - i);
+		if (!oldMirrored && len > oldCapacity - offset) { len = oldCapacity - offset; }
+		memcpy(buffer + (i - locTail), oldBuffer + offset, len);
+		i += len;
+	}
+	
+	freeBuffer(oldBuffer, oldCapacity, oldMirrored);
+	
+	fileBase = fileBase + (int64_t) locTail;
+	tail = 0;
+	head = unread;
+	
+	return true;
+}
+
+
 // --- SET SEEK REQUEST CALLBACK ---
 void DataBuffer::setSeekRequestCallback(SeekRequestCallback cb) {
 	seekRequestCallback = cb;
@@ -189,61 +331,416 @@ bool DataBuffer::start() {
 	bufferAhead = false;
 	buffering = false;
 	writeStarted = true;
+	resync = false;
+	resetStats();
 	
-	if (!dataRequestCallback) { return false; }
-	bool ret = dataRequestCallback(sessionHandle);
+	// New file, drop the pinned data of the previous one.
+	pinnedMutex.lock();
+	pinned.clear();
+	pinnedSize = 0;
+	pinnedMutex.unlock();
 	
-	return ret;
+	return issueRequest(false);
 }
 
 
 // --- REQUEST DATA ---
 bool DataBuffer::requestData() {
 	// Trigger a data request from the client.
-	if (!dataRequestCallback) { return false; }
-	bool ret = dataRequestCallback(sessionHandle);
+	uint64_t locHead = head;
+	if (!issueRequest(false)) { return false; }
 	
-	// Wait until we have received data or time out.
+	// Wait until we have received data or time out. write() signals us when data arrives.
 	std::unique_lock<std::mutex> lk(dataWaitMutex);
-	using namespace std::chrono_literals;
-	uint32_t timeout = 5000;
-	while (1) {
-		if (!dataRequestPending) { break; }
-		dataWaitCV.wait_for(lk, 100us);
-		if (--timeout == 0) {
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now()
+														+ std::chrono::milliseconds(500);
+	if (!dataWaitCV.wait_until(lk, deadline, [this, locHead] { 
+				return head != locHead || eof || requestsInFlight == 0; })) {
+#ifdef DEBUG
+		std::cerr << "RequestData timeout after 500 ms." << std::endl;
+#endif
+		return false;
+	}
+	
+	return true;
+}
+
+
+// --- SIGNAL DATA ---
+// Wake up any thread waiting for data. The mutex is briefly taken so that a waiter which has
+// just checked its predicate cannot miss the notification.
+void DataBuffer::signalData() {
+	{
+		std::lock_guard<std::mutex> lk(dataWaitMutex);
+	}
+	
+	dataWaitCV.notify_all();
+}
+
+
+// --- RESET STATS ---
+// Reset the read-ahead controller to its initial state, for a new session.
+void DataBuffer::resetStats() {
+	std::lock_guard<std::mutex> lk(requestMutex);
+	requests.clear();
+	bytesRequested = 0;
+	requestsInFlight = 0;
+	blockSize = DB_BLOCK_DEFAULT;
+	rttAvg = 0.0;
+	rttMin = 0.0;
+	throughputAvg = 0.0;
+	bytesReceived = 0;
+	lastArrival = std::chrono::steady_clock::now();
+}
+
+
+// --- WAIT REQUESTS ---
+// Wait until all outstanding data requests have been answered, or time out after a second.
+// Returns false on time-out.
+bool DataBuffer::waitRequests() {
+#ifdef PROFILING_DB
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+#endif
+	std::unique_lock<std::mutex> lk(dataWaitMutex);
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now()
+														+ std::chrono::seconds(1);
+	bool ret = dataWaitCV.wait_until(lk, deadline, [this] { return requestsInFlight == 0; });
+	if (!ret) {
+#ifdef DEBUG
+		std::cerr << "Time-out waiting for pending data request." << std::endl;
+#endif
+		dataRequestPending = false;
+	}
+	
+#ifdef PROFILING_DB
+	uint64_t blocked = std::chrono::duration_cast<std::chrono::microseconds>(
+									std::chrono::steady_clock::now() - begin).count();
+	db_debugfile << "Waited " << blocked << "µs for pending data requests.\n";
+#endif
+	
+	return ret;
+}
+
+
+// --- ISSUE REQUEST ---
+// Send a single data request to the client for the current block size. If 'ahead' is true,
+// this is a read-ahead request, which is only sent if there is room in the buffer for it on top
+// of all outstanding requests, and the in-flight limit has not been reached. None are sent while
+// the buffer is being resized.
+// Returns true if a request was sent.
+bool DataBuffer::issueRequest(bool ahead) {
+	if (!dataRequestCallback) { return false; }
+	
+	// The client is asked for exactly the size accounted for here, even if the block size changes.
+	uint32_t block = blockSize;
+	DataRequest req;
+	req.size = block * 1024;
+	req.time = std::chrono::steady_clock::now();
+	
+	requestMutex.lock();
+	if (resizing || (ahead && (requestsInFlight >= DB_MAX_IN_FLIGHT 
+					|| bytesFree() < bytesRequested + req.size))) {
+		requestMutex.unlock();
+		return false;
+	}
+	
+	requests.push_back(req);
+	bytesRequested += req.size;
+	requestsInFlight++;
+	dataRequestPending = true;
+	requestMutex.unlock();
+	
+	if (!dataRequestCallback(sessionHandle, block)) {
 #ifdef DEBUG
-			std::cerr << "RequestData timeout after 500 ms." << std::endl;
+		std::cerr << "DataBuffer::issueRequest: requesting data failed." << std::endl;
 #endif
-			return false;
+		// Remove the request again. Only the most recent one can be ours, as responses
+		// are handled in order.
+		requestMutex.lock();
+		if (!requests.empty()) {
+			bytesRequested -= requests.back().size;
+			requests.pop_back();
+			requestsInFlight--;
 		}
+		
+		dataRequestPending = (requestsInFlight > 0);
+		requestMutex.unlock();
+		signalData();
+		
+		return false;
 	}
 	
 	return true;
 }
 
 
+// --- START PREFETCH ---
+// Fill the buffer for a session that is waiting to be played. The data received is pinned, as
+// the player has not probed the container yet.
+void DataBuffer::startPrefetch() {
+	prefetching = true;
+	requestAhead();
+}
+
+
+// --- REQUEST AHEAD ---
+// Fill the pipeline of read-ahead requests, as far as buffer space and the in-flight limit allow.
+// Returns true if at least one request was sent.
+bool DataBuffer::requestAhead() {
+	bool sent = false;
+	while (!eof && (bufferAhead || prefetching) && !resync && state != DBS_SEEKING) {
+		if (!issueRequest(true)) { break; }
+		sent = true;
+	}
+	
+	return sent;
+}
+
+
+// --- UPDATE RATE ---
+// Update the round-trip time & throughput estimates with a response of 'bytes' bytes, and adapt
+// the block size to match. Called for each response to a data request.
+void DataBuffer::updateRate(uint32_t bytes) {
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	std::lock_guard<std::mutex> lk(requestMutex);
+	bytesReceived += bytes;
+	if (requests.empty()) {
+		// Unsolicited or stale data, e.g. after a reset.
+		lastArrival = now;
+		return;
+	}
+	
+	DataRequest req = requests.front();
+	requests.pop_front();
+	bytesRequested -= req.size;
+	requestsInFlight--;
+	
+	// Round-trip time. The minimum decays slowly upwards so that it can follow network changes.
+	double rtt = std::chrono::duration<double, std::milli>(now - req.time).count();
+	rttAvg = (rttAvg == 0.0) ? rtt : (rttAvg * 0.8) + (rtt * 0.2);
+	if (rttMin == 0.0 || rtt < rttMin) 	{ rttMin = rtt; }
+	else								{ rttMin += (rtt - rttMin) * 0.01; }
+	
+	// Throughput, over the time since the later of the previous arrival and the request.
+	// With requests pipelined this measures the link, not the client's response time.
+	std::chrono::steady_clock::time_point start = (lastArrival > req.time) ? lastArrival : req.time;
+	double interval = std::chrono::duration<double>(now - start).count();
+	lastArrival = now;
+	if (bytes > 0 && interval > 0.0001) {
+		double rate = (bytes / 1024.0) / interval;
+		throughputAvg = (throughputAvg == 0.0) ? rate : (throughputAvg * 0.8) + (rate * 0.2);
+	}
+	
+	if (throughputAvg == 0.0 || rttMin == 0.0) { return; }
+	
+	// Size the blocks so that a single block covers the bandwidth-delay product, giving
+	// DB_MAX_IN_FLIGHT times that in flight. Grow fast, shrink slowly.
+	uint32_t target = (uint32_t) (throughputAvg * (rttMin / 1000.0));
+	uint32_t bs = blockSize;
+	if (target > bs) 			{ bs = (target < bs * 2) ? target : bs * 2; }
+	else if (target < bs / 2) 	{ bs = (bs * 3) / 4; }
+	
+	// Never request more than fits in the buffer with all requests in flight.
+	uint32_t bsMax = (capacity / 1024) / (DB_MAX_IN_FLIGHT * 2);
+	if (bsMax > DB_BLOCK_MAX) 	{ bsMax = DB_BLOCK_MAX; }
+	if (bs > bsMax) 			{ bs = bsMax; }
+	if (bs < DB_BLOCK_MIN) 		{ bs = DB_BLOCK_MIN; }
+	
+#ifdef PROFILING_DB
+	if (bs != blockSize) {
+		db_debugfile << "Block size: " << blockSize << " -> " << bs << " kB. RTT: " << rttAvg
+						<< " ms (min " << rttMin << "), throughput: " << throughputAvg << " kB/s.\n";
+	}
+#endif
+	
+	blockSize = bs;
+}
+
+
+// --- GET STATS ---
+// Fill in the provided structure with the current read-ahead statistics.
+void DataBuffer::getStats(DataBufferStats &stats) {
+	std::lock_guard<std::mutex> lk(requestMutex);
+	stats.blockSize = blockSize;
+	stats.requestsInFlight = requestsInFlight;
+	stats.rtt = rttAvg;
+	stats.throughput = throughputAvg;
+	stats.bytesReceived = bytesReceived;
+	stats.unread = (buffer == 0) ? 0 : bytesUnread();
+}
+
+
+// --- BYTES FREE ---
+// Returns the number of bytes the writer can add. Space is only released once it has also left
+// the retained window behind the read position.
+uint32_t DataBuffer::bytesFree() {
+	uint64_t used = head - retainLow(tail.load(std::memory_order_acquire));
+	return (used >= capacity) ? 0 : capacity - (uint32_t) used;
+}
+
+
+// --- STORE ---
+// Copy data into the buffer at the head and publish it to the reader. With the mirrored buffer
+// this is always a single copy, otherwise the part past the end of the buffer goes into the front.
+// Returns the number of bytes stored.
+uint32_t DataBuffer::store(const char* data, uint32_t length) {
+	uint64_t locHead = head.load(std::memory_order_relaxed);
+	uint32_t locfree = bytesFree();
+	uint32_t bytesWritten = (length < locfree) ? length : locfree;
+	uint32_t offset = (uint32_t) (locHead % capacity);
+	
+	if (mirrored || bytesWritten <= (capacity - offset)) {
+		memcpy(buffer + offset, data, bytesWritten);
+	}
+	else {
+		uint32_t bytesSingleWrite = capacity - offset;
+		memcpy(buffer + offset, data, bytesSingleWrite);
+		memcpy(buffer, data + bytesSingleWrite, bytesWritten - bytesSingleWrite);
+	}
+	
+	// Publish the new data to the reader.
+	head.store(locHead + bytesWritten, std::memory_order_release);
+	
+	return bytesWritten;
+}
+
+
+// --- PIN ---
+// Keep a copy of data at 'offset' in the file, for seeks back into it later on.
+void DataBuffer::pin(int64_t offset, const char* data, uint32_t length) {
+	std::lock_guard<std::mutex> lk(pinnedMutex);
+	if (length == 0 || pinnedSize + length > DB_PIN_MAX) { return; }
+	if (pinned.find(offset) != pinned.end()) { return; }
+	
+	pinned[offset] = std::string(data, length);
+	pinnedSize += length;
+}
+
+
 // --- RESET ---
 // Reset the buffer to the initialised state. This leaves the existing allocated buffer intact, 
 // but erases its contents.
 bool DataBuffer::reset() {
-	front = buffer;
-	back = buffer;
-	size = 0;
-	index = buffer;
-	
-	unread = 0;
-	free = capacity;
+	head = 0;
+	tail = 0;
+	fileBase = 0;
+	resync = false;
 	
 	byteIndex = 0;
 	byteIndexLow = 0;
 	byteIndexHigh = 0;
 	
 	//eof = false;
+	requestMutex.lock();
+	requests.clear();
+	bytesRequested = 0;
+	requestsInFlight = 0;
+	requestMutex.unlock();
+	
 	dataRequestPending = false;
 	seekRequestPending = false;
 	resetRequest = false;
 	state = DBS_IDLE;
 	
+	signalData();
+	
+	return true;
+}
+
+
+// --- SEEK LOCAL ---
+// Try to serve a seek from the data in the buffer. Valid are the unread data and the already
+// read data retained behind it, as far as the writer cannot have reused that space.
+// Returns true if the read position was moved to 'offset'.
+bool DataBuffer::seekLocal(int64_t offset) {
+	if (state == DBS_SEEKING) { return false; }
+	
+	uint64_t locHead = head.load(std::memory_order_acquire);
+	uint64_t low = retainLow(tail.load(std::memory_order_relaxed));
+	if (locHead > capacity && (locHead - capacity) > low) { low = locHead - capacity; }
+	
+	byteIndexLow = (uint32_t) (fileBase + low);
+	byteIndexHigh = (uint32_t) (fileBase + locHead);
+	if (offset < fileBase + (int64_t) low || offset > fileBase + (int64_t) locHead) {
+		return false;
+	}
+	
+	// Seeking back shrinks the free space. It must still hold the data requests in flight.
+	uint64_t newTail = (uint64_t) (offset - fileBase);
+	std::lock_guard<std::mutex> lk(requestMutex);
+	if (head - retainLow(newTail) + bytesRequested > capacity) { return false; }
+	
+#ifdef DEBUG
+	std::cout << "Seek: serving from buffer (" << byteIndexLow << " - " << byteIndexHigh 
+				<< ")." << std::endl;
+#endif
+	
+	tail.store(newTail, std::memory_order_release);
+	
+	return true;
+}
+
+
+// --- SEEK PINNED ---
+// Try to serve a seek from the pinned data. The buffer is reset and filled with the pinned data
+// from 'offset' onwards. The client is moved to the end of this data before the next request.
+// Returns true if the pinned data contained 'offset'.
+bool DataBuffer::seekPinned(int64_t offset) {
+	std::lock_guard<std::mutex> lk(pinnedMutex);
+	std::map<int64_t, std::string>::iterator it = pinned.upper_bound(offset);
+	if (it == pinned.begin()) { return false; }
+	--it;
+	if (offset >= it->first + (int64_t) it->second.size()) { return false; }
+	
+	// Only called after waitRequests() succeeded, so there is no writer active.
+	reset();
+	fileBase = offset;
+	uint32_t skip = (uint32_t) (offset - it->first);
+	while (it != pinned.end() && it->first == fileBase + (int64_t) head) {
+		uint32_t len = (uint32_t) it->second.size() - skip;
+		if (store(it->second.data() + skip, len) < len) { break; }
+		skip = 0;
+		++it;
+	}
+	
+	byteIndexLow = (uint32_t) offset;
+	byteIndexHigh = (uint32_t) (fileBase + head);
+	eof = (fileBase + (int64_t) head >= filesize);
+	resync = !eof;
+	
+#ifdef DEBUG
+	std::cout << "Seek: serving from pinned data (" << byteIndexLow << " - " << byteIndexHigh 
+				<< ")." << std::endl;
+#endif
+	
+	return true;
+}
+
+
+// --- REQUEST SEEK ---
+// Ask the client to seek to 'offset' and wait for the data it sends from there. This data is
+// written at the current head of the buffer.
+// Returns false on failure or time-out.
+bool DataBuffer::requestSeek(int64_t offset) {
+	if (seekRequestCallback == 0) { return false; }
+	seekRequestPending = true;
+	state = DBS_SEEKING;
+	seekRequestCallback(sessionHandle, offset);
+	
+	// Wait for response.
+	std::unique_lock<std::mutex> lk(seekRequestMutex);
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now()
+														+ std::chrono::seconds(1);
+	if (!seekRequestCV.wait_until(lk, deadline, [this] { return !seekRequestPending; })) {
+#ifdef DEBUG
+		std::cout << "Time-out on seek request." << std::endl;
+#endif
+		return false; 
+	}
+	
+	state = DBS_IDLE;
+	resync = false;
+	
 	return true;
 }
 
@@ -256,6 +753,8 @@ int64_t DataBuffer::seek(DataBufferSeek mode, int64_t offset) {
 	std::cout << "DataBuffer::seek: mode " << mode << ", offset: " << offset << std::endl;
 #endif
 	
+	std::lock_guard<std::mutex> lk(bufferMutex);
+	
 	// Calculate absolute byte index.
 	int64_t new_offset = -1;
 	if 		(mode == DB_SEEK_START)		{ new_offset = offset; }
@@ -275,12 +774,17 @@ int64_t DataBuffer::seek(DataBufferSeek mode, int64_t offset) {
 		return -1;
 	}
 	
-	// Ensure we're not in the midst of a data request action.
-	while (dataRequestPending) {
-		// Sleep in 1 ms segments until the data request is done.
-		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	// Check whether we have the requested data in the buffer. This does not affect any data
+	// requests in flight, as those add data at the head.
+	if (seekLocal(new_offset)) {
+		byteIndex = (uint32_t) new_offset;
+		return new_offset;
 	}
 	
+	// Ensure we're not in the midst of a data request action. A request still outstanding would
+	// write into the buffer after the reset below, so fail the seek instead.
+	if (!waitRequests()) { return -1; }
+	
 #ifdef PROFILING_DB
 	// Truncate file.
 	if (db_readsfile.is_open()) {
@@ -291,57 +795,15 @@ int64_t DataBuffer::seek(DataBufferSeek mode, int64_t offset) {
 	//db_readsfile = fopen("db_reads.txt", "wb");
 #endif
 	
-	// TODO: removing local check. We just assume the local data isn't in the buffer and reload.
-	// In testing, the local data check has offered little benefits (not enough data in buffer).
-	// Check that this feature can be fully removed, or maybe reimplemented.
-	
-	// Check whether we have the requested data in the buffer.
-	//if (new_offset < byteIndexLow || new_offset > byteIndexHigh) {
+	// Check whether the requested data is in the pinned header & index data.
+	if (!seekPinned(new_offset)) {
 		// Data is not in buffer. Reset buffer and send seek request to client.
-		/* if (writeStarted) {
-			resetRequest = true;
-			while (resetRequest) {
-				// Wait for the write thread to acknowledge the request.
-				std::this_thread::sleep_for(std::chrono::milliseconds(1));
-			}
-		} */
-		
 		reset();
+		fileBase = new_offset;
 		byteIndexLow = (uint32_t) new_offset;
 		byteIndexHigh = (uint32_t) new_offset;
-		if (seekRequestCallback == 0) { return -1; }
-		seekRequestPending = true;
-		state = DBS_SEEKING;
-		seekRequestCallback(sessionHandle, new_offset);
-		
-		// Wait for response.
-		std::unique_lock<std::mutex> lk(seekRequestMutex);
-		using namespace std::chrono_literals;
-		while (seekRequestPending) {
-			std::cv_status stat = seekRequestCV.wait_for(lk, 1s);
-			if (stat == std::cv_status::timeout) {
-#ifdef DEBUG
-				std::cout << "Time-out on seek request. Returning -1." << std::endl;
-#endif
-				return -1; 
-			}
-		}
-		
-		state = DBS_IDLE;
-	/* }
-	else {	
-#ifdef DEBUG
-		std::cout << "Setting new buffer position." << std::endl;
-#endif
-
-		// Set the new position in the buffer.
-		uint32_t oldUnread = unread;
-		//byteIndex = new_offset;							// Absolute byte index.
-		index = front + (new_offset - byteIndexLow);	// Index into buffer translation.
-		unread = byteIndexHigh - new_offset;
-		//unreadLow += new_offset - byteIndexLow;
-		//unreadHigh -= unread - oldUnread;
-	} */
+		if (!requestSeek(new_offset)) { return -1; }
+	}
 	
 	byteIndex = (uint32_t) new_offset;
 	
@@ -355,21 +817,21 @@ bool DataBuffer::seeking() {
 }
 
 
-// --- READ ---
-// Try to read 'len' bytes from the buffer, into the provided buffer.
-// Returns the number of bytes read, or 0 in case of an error.
-uint32_t DataBuffer::read(uint32_t len, uint8_t* bytes) {
-#ifdef DEBUG
-	std::cout << "DataBuffer::read: len " << len << ". EOF: " << eof << std::endl;
-#endif
-		
+// --- FILL ---
+// Ensure that 'len' bytes are available for reading, requesting more data from the client if
+// needed and the End-Of-File condition has not been reached.
+// Returns false if a data request failed.
+bool DataBuffer::fill(uint32_t len) {
+	if (eof || len <= bytesUnread()) { return true; }
+	
 #ifdef PROFILING_DB
-	std::chrono::high_resolution_clock::time_point begin = std::chrono::high_resolution_clock::now();
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
 #endif
-
+	
 	// Request more data if the buffer does not have enough unread data left, and EOF condition
 	// has not been reached.
-	while (!eof && len > unread) {
+	bool success = true;
+	while (success && !eof && len > bytesUnread()) {
 		// More data should be available on the client, try to request it.
 #ifdef DEBUG
 		std::cout << "Requesting more data... buffering: " << buffering
@@ -377,231 +839,175 @@ uint32_t DataBuffer::read(uint32_t len, uint8_t* bytes) {
 #endif
 
 #ifdef PROFILING_DB
-		db_debugfile << "Requesting more data... Unread: " << unread << ".\n";
+		db_debugfile << "Requesting more data... Unread: " << bytesUnread() << ".\n";
 #endif
-		if (buffering) {
-			// If we're buffering, a write should be coming soon, so give it a few ms.
-			// If we time-out, assume something went wrong and override.
-			std::unique_lock<std::mutex> lk(dataReadMutex);
-			using namespace std::chrono_literals;
-			uint32_t timeout = 1000;
-			bool success = true;
-			while (1) {
-				dataReadCV.wait_for(lk, 100us);
-				if (!dataRequestPending) { break; }
-				if (--timeout == 0) {
+		if (resync) {
+			// The buffer was filled from the pinned data. Move the client to where it ends.
+			success = requestSeek(fileBase + (int64_t) head);
 #ifdef DEBUG
-					std::cerr << "Buffering Read: RequestData timeout after 100 ms." << std::endl;
+			if (!success) {
+				std::cerr << "Resync Read: seek request failed. Aborting read." << std::endl;
+			}
 #endif
-					dataRequestPending = false;
-					success = requestData();
-					break;
-				}
-				
-				if (!success) {
+		}
+		else if (buffering) {
+			// If we're buffering, a write should be coming soon, so wait for it to signal us.
+			// If we time-out, assume something went wrong and override.
+			uint64_t locHead = head;
+			std::unique_lock<std::mutex> lk(dataWaitMutex);
+			std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now()
+															+ std::chrono::milliseconds(100);
+			bool signalled = dataWaitCV.wait_until(lk, deadline, [this, locHead] {
+				return head != locHead || eof || requestsInFlight == 0;
+			});
+			
+			lk.unlock();
+			
+			if (!signalled) {
 #ifdef DEBUG
-					std::cerr << "Buffering Read: data request failed. Aborting read." << std::endl;
+				std::cerr << "Buffering Read: RequestData timeout after 100 ms." << std::endl;
 #endif
-					return 0;
-				}
+				success = requestData();
 			}
-			
-			// Sanity check to see whether we're good now.
-			if (!eof && len > unread) {
+			else if (!eof && len > bytesUnread() && requestsInFlight == 0) {
+				// Sanity check to see whether we're good now.
 				success = requestData();
-				if (!success) {
+			}
+			
 #ifdef DEBUG
-					std::cerr << "Buffering Read: buffer check failed. Aborting read." << std::endl;
-#endif
-					return 0;
-				}
+			if (!success) {
+				std::cerr << "Buffering Read: data request failed. Aborting read." << std::endl;
 			}
+#endif
 		}
-		else if (!buffering) {
+		else {
 			// If we're not buffering ahead, we're still in the hunt-the-container-header phase.
-			bool success = true;
 			success = requestData();
-			if (!success) {
 #ifdef DEBUG
+			if (!success) {
 				std::cerr << "Slow Read: data request failed. Aborting read." << std::endl;
-#endif
-				return 0;
 			}
-			
-#ifdef DEBUG
-			std::cout << "Slow Read: read bytes." << std::endl;
-#endif
-		}
-		else {
-			// If we're here, something likely went wrong. Try to recover by forcing a data read
-			// request.
-#ifdef DEBUG
-			std::cerr << "Panic Read: Force read." << std::endl;
+			else {
+				std::cout << "Slow Read: read bytes." << std::endl;
+			}
 #endif
-			dataRequestPending = false;
-			requestData();
 		}
 	}
 	
-	if (unread == 0) {
-		if (eof) {
-#ifdef DEBUG
-			std::cout << "Reached EOF." << std::endl;
+#ifdef PROFILING_DB
+	uint64_t blocked = std::chrono::duration_cast<std::chrono::microseconds>(
+										std::chrono::steady_clock::now() - begin).count();
+	db_blockedTotal += blocked;
+	db_blockedCount++;
+	db_debugfile << "Blocked on data for " << blocked << "µs. Total: " << db_blockedTotal
+					<< "µs in " << db_blockedCount << " stalls.\n";
 #endif
-			return 0;
-		}
-		else {
+	
+	return success;
+}
+
+
+// --- PEEK ---
+// Obtain a pointer to up to 'len' unread bytes in the buffer, without consuming them. The bytes
+// stay valid until commit() is called. With the mirrored buffer the returned range never stops
+// short at the wrap point.
+// If bytes are returned, the buffer stays locked against resize() until commit() is called.
+// Returns the number of bytes available at 'data', or 0 in case of an error or EOF.
+uint32_t DataBuffer::peek(uint32_t len, const uint8_t* &data) {
 #ifdef DEBUG
-			std::cout << "Read failed due to empty buffer." << std::endl;
+	std::cout << "DataBuffer::peek: len " << len << ". EOF: " << eof << std::endl;
 #endif
-			return 0;
-		}
-	}
 	
-	uint32_t bytesRead = 0;
-	
-	// Determine the number of bytes we can read in one copy operation.
-	// This depends on the location of the write pointer ('back') compared to the 
-	// read pointer ('index'). If the write pointer is ahead of the read pointer, we can read up 
-	// till there, otherwise to the end of the buffer.
-	uint32_t locunread = unread;
-	uint32_t bytesSingleRead = locunread;
-	if ((end - index) < bytesSingleRead) { bytesSingleRead = end - index; } // Unread section wraps around.
+	bufferMutex.lock();
+	if (!fill(len)) {
+		bufferMutex.unlock();
+		return 0;
+	}
 	
+	uint32_t locunread = bytesUnread();
+	if (locunread == 0) {
 #ifdef DEBUG
-	std::cout << "bytesSingleRead: " << bytesSingleRead << std::endl;
+		if (eof) 	{ std::cout << "Reached EOF." << std::endl; }
+		else 		{ std::cout << "Read failed due to empty buffer." << std::endl; }
 #endif
+		bufferMutex.unlock();
+		return 0;
+	}
 	
-	if (len <= bytesSingleRead) {
-		// Can read requested data in single chunk.
-#ifdef DEBUG
-		std::cout << "Read whole block." << std::endl;
-		std::cout << "Index: " << index - buffer << ", Back: " << back - buffer << std::endl;
-#endif
-		memcpy(bytes, index, len);
-		index += len;		// Advance read pointer.
-		bytesRead += len;
-		byteIndex += len;
-		unread -= len;		// Unread bytes decreases by read byte count.
-		free += len;		// Read bytes become free for overwriting.
-		
-		if (index >= end) {
-			index = buffer;	// Read pointer went past the buffer end. Reset to buffer begin.
-		}
-
-#ifdef PROFILING_DB
-		std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
-		db_debugfile << "SR. Duration: " << std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() << "µs. ";
-#endif
+	uint32_t offset = (uint32_t) (tail.load(std::memory_order_relaxed) % capacity);
+	uint32_t bytesSingleRead = (len < locunread) ? len : locunread;
+	if (!mirrored && (capacity - offset) < bytesSingleRead) {
+		bytesSingleRead = capacity - offset; // Unread section wraps around.
 	}
-	else if (bytesSingleRead > 0 && locunread == bytesSingleRead) {
-		// Less data in buffer than needed & nothing at the front.
-		// Read what we can from the back, then return.
-#ifdef DEBUG
-		std::cout << "Read partial data from back." << std::endl;
-		std::cout << "Index: " << index - buffer << ", Back: " << back - buffer << std::endl;
-#endif
-		memcpy(bytes, index, bytesSingleRead);
-		index += bytesSingleRead;		// Advance read pointer.
-		bytesRead += bytesSingleRead;
-		byteIndex += bytesSingleRead;
-		unread -= bytesSingleRead;		// Unread bytes decreases by read byte count.
-		free += bytesSingleRead;		// Read bytes become free for overwriting.
-		
-		if (index >= end) {
-			index = buffer;	// Read pointer went past the buffer end. Reset to buffer begin.
-		}
+	
+	data = buffer + offset;
+	
+	return bytesSingleRead;
+}
 
-#ifdef PROFILING_DB
-		std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
-		db_debugfile << "PR. Duration: " << std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() << "µs.";
-#endif
-	}
-	else if (bytesSingleRead > 0 && locunread > bytesSingleRead) {
-		// Read part from the end of the buffer, then read rest from the front.
-#ifdef DEBUG
-		std::cout << "Read back, then front." << std::endl;
-		std::cout << "Index: " << index - buffer << ", Back: " << back - buffer << std::endl;
-#endif
-		memcpy(bytes, index, bytesSingleRead);
-		index += bytesSingleRead;		// Advance read pointer.
-		bytesRead += bytesSingleRead;
-		byteIndex += bytesSingleRead;
-		unread -= bytesSingleRead;		// Unread bytes decreases by read byte count.
-		free += bytesSingleRead;		// Read bytes become free for overwriting.
-		
-		index = buffer;	// Switch read pointer to front of the buffer.
-		
-		// Read remainder from front.
-		uint32_t bytesToRead = len - bytesRead;
-#ifdef DEBUG
-		std::cout << "bytesRead: " << bytesRead << ", bytesToRead: " << bytesToRead << std::endl;
-#endif
-		if (bytesToRead <= locunread) {
-			// Read the remaining bytes we need.
-			memcpy(bytes + bytesRead, index, bytesToRead);
-			index += bytesToRead;
-			bytesRead += bytesToRead;
-			byteIndex += bytesToRead;
-			unread -= bytesToRead;
-			free += bytesToRead;
-		}
-		else {
-			// Read the unread bytes still available in the buffer.
-			memcpy(bytes + bytesRead, index, locunread);
-			index += locunread;
-			bytesRead += locunread;
-			byteIndex += locunread;
-			unread -= locunread;
-			free += locunread;
-		}
 
-#ifdef PROFILING_DB
-		std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
-		db_debugfile << "FB. Duration: " << std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() << "µs.";
-#endif
-	}
-	else {
-		// Default case.
+// --- COMMIT ---
+// Consume 'len' bytes previously obtained with peek(), making the space available to the writer.
+// Unlocks the buffer.
+void DataBuffer::commit(uint32_t len) {
+	tail.store(tail.load(std::memory_order_relaxed) + len, std::memory_order_release);
+	byteIndex += len;
+	
+	// Top up the read-ahead requests now that we have freed up space. There's data left to be
+	// read in the file.
+	if (!eof && bufferAhead && requestAhead()) {
 #ifdef DEBUG
-		std::cout << "FIXME: Default case." << std::endl;
+		std::cout << "DataBuffer::commit: requested more data." << std::endl;
 #endif
-		// FIXME: This shouldn't happen.
-		
+		buffering = true;
 	}
 	
-	// Trigger a data request from the client if we have space.
-	if (eof) {
-		// Do nothing.
-	}
-	else if (bufferAhead && !dataRequestPending && !buffering && unread < (2 * 204799)) {
-		// Single block is 200 kB (204,800 bytes). We're not buffering and there's data left 
-		// to be read in the file. Restart ahead buffering.
-		if (dataRequestCallback) {
+	bufferMutex.unlock();
+	
 #ifdef DEBUG
-		std::cout << "DataBuffer::read: requesting more data." << std::endl;
+	std::cout << "unread " << bytesUnread() << ", free " << bytesFree() << std::endl;
 #endif
-			dataRequestPending = false;
-			bool ret = dataRequestCallback(sessionHandle);
+}
+
+
+// --- READ ---
+// Try to read 'len' bytes from the buffer, into the provided buffer.
+// Returns the number of bytes read, or 0 in case of an error.
+uint32_t DataBuffer::read(uint32_t len, uint8_t* bytes) {
 #ifdef DEBUG
-			if (!ret) {
-				std::cerr << "DataBuffer::read: requesting data failed." << std::endl;
-			}
+	std::cout << "DataBuffer::read: len " << len << ". EOF: " << eof << std::endl;
 #endif
-		}
-	}
 
+#ifdef PROFILING_DB
+	std::chrono::high_resolution_clock::time_point begin = std::chrono::high_resolution_clock::now();
+#endif
+	
+	const uint8_t* data = 0;
+	uint32_t bytesRead = peek(len, data);
+	if (bytesRead == 0) { return 0; }
+	
+	memcpy(bytes, data, bytesRead);
+	
+	// Without the mirrored mapping the unread section may continue at the front of the buffer.
+	if (!mirrored && bytesRead < len) {
+		uint32_t bytesToRead = bytesUnread() - bytesRead;
+		if (bytesToRead > (len - bytesRead)) { bytesToRead = len - bytesRead; }
+		memcpy(bytes + bytesRead, buffer, bytesToRead);
+		bytesRead += bytesToRead;
+	}
+	
+	commit(bytesRead);
+	
 #ifdef PROFILING_DB
 		std::chrono::high_resolution_clock::time_point end2 = std::chrono::high_resolution_clock::now();
-		db_debugfile << "\t\tDuration2: " << std::chrono::duration_cast<std::chrono::microseconds>(end2 - begin).count() << "µs.\n";
+		db_debugfile << "Read. Duration: " << std::chrono::duration_cast<std::chrono::microseconds>(end2 - begin).count() << "µs.\n";
 		
 		// Write read bytes to file.
 		db_readsfile.write((char*) bytes, bytesRead);
 		//fwrite(bytes, sizeof(uint8_t), bytesRead, db_readsfile);
 #endif
-	
+
 #ifdef DEBUG
-	std::cout << "unread " << unread << ", free " << free << std::endl;
 	std::cout << "bytesRead: " << bytesRead << std::endl;
 #endif
 	
@@ -619,100 +1025,24 @@ uint32_t DataBuffer::write(std::string &data) {
 uint32_t DataBuffer::write(const char* data, uint32_t length) {
 #ifdef DEBUG
 	std::cout << "DataBuffer::write: len " << length << std::endl;
-	std::cout << "Index: " << index - buffer << ", Back: " << back - buffer << std::endl;
+	std::cout << "Head: " << head << ", Tail: " << tail << std::endl;
 #endif
-
-	// First check whether we can perform a straight copy. For this we need enough available bytes
-	// at the end of the buffer. Else we have to attempt to write the remainder into the front of
-	// the buffer.
-	// The bytesFreeLow and bytesFreeHigh counters are for keeping track of the number of free bytes
-	// at the low (beginning) and high (end) side respectively.
-	uint32_t bytesWritten = 0;
-	
-	// Determine the number of bytes we can write in one copy operation.
-	// This depends on the number of 'free' bytes, and the location of the read pointer ('index') 
-	// compared to the  write pointer ('back'). If the read pointer is ahead of the write pointer, 
-	// we can write up till there, otherwise to the end of the buffer.
-	uint32_t locfree = free;
-	uint32_t bytesSingleWrite = locfree;
-	if ((end - back) < bytesSingleWrite) { bytesSingleWrite = end - back; }
 	
-	if (length <= bytesSingleWrite) {
-#ifdef DEBUG
-		std::cout << "Write whole chunk at back. Single write: " << bytesSingleWrite << std::endl;
-#endif
-		// Enough space to write the data in one go.
-		memcpy(back, data, length);
-		bytesWritten = length;
-		back += bytesWritten;
-		unread += bytesWritten;
-		free -= bytesWritten;
-		
-		if (back >= end) {
-			back = buffer;
-		}
-	}
-	else if (bytesSingleWrite > 0 && locfree == bytesSingleWrite) {
-#ifdef DEBUG
-		std::cout << "Partial write at back. Single write: " << bytesSingleWrite << std::endl;
-#endif
-		// Only enough space in buffer to write to the back. Write what we can, then return.
-		memcpy(back, data, bytesSingleWrite);
-		bytesWritten = bytesSingleWrite;
-		back += bytesWritten;
-		unread += bytesWritten;
-		free -= bytesWritten;
-		
-		if (back >= end) {
-			back = buffer;
-		}
-	}
-	else if (bytesSingleWrite > 0 && locfree > bytesSingleWrite) {
-#ifdef DEBUG
-		std::cout << "Partial write at back, rest at front. Single write: " << bytesSingleWrite << std::endl;
-#endif
-		// Write to the back, then the rest at the front.
-		memcpy(back, data, bytesSingleWrite);
-		bytesWritten = bytesSingleWrite;
-		unread += bytesWritten;
-		free -= bytesWritten;
-		locfree -= bytesWritten;
-		
-		back = buffer;
-		
-		// Write remainder at the front.
-		uint32_t bytesToWrite = length - bytesWritten;
-#ifdef DEBUG
-	std::cout << "Write remainder: " << bytesToWrite << std::endl;
-	std::cout << "Index: " << index - buffer << ", Back: " << back - buffer << std::endl;
-#endif
-		if (bytesToWrite <= locfree) {
-			// Write the remaining bytes we have.
-			memcpy(back, data + bytesWritten, bytesToWrite);
-			bytesWritten += bytesToWrite;
-			unread += bytesToWrite;
-			free -= bytesToWrite;
-			back += bytesToWrite;
-		}
-		else {
-			// Write the unread bytes still available in the buffer.
-			memcpy(back, data + bytesWritten, locfree);
-			bytesWritten += locfree;
-			unread += locfree;
-			free -= locfree;
-			back += locfree;
-		}
-	}
-	else {
-		// FIXME: shouldn't happen.
-#ifdef DEBUG
-		std::cout << "FIXME: Default case." << std::endl;
-#endif
+	int64_t fileOffset;
+	uint32_t bytesWritten;
+	{
+		// Keep resize() from swapping the buffer while copying into it.
+		std::lock_guard<std::mutex> lk(writeMutex);
+		fileOffset = fileBase + (int64_t) head.load(std::memory_order_relaxed);
+		bytesWritten = store(data, length);
 	}
 	
+	// While the player is still probing the container (header, index), keep a copy of the data.
+	if (!bufferAhead) { pin(fileOffset, data, bytesWritten); }
+	
 #ifdef DEBUG
-		std::cout << "unread: " << unread << ", free: " 
-					<< free << ", bytesWritten: " << bytesWritten << std::endl;
+		std::cout << "unread: " << bytesUnread() << ", free: "
+					<< bytesFree() << ", bytesWritten: " << bytesWritten << std::endl;
 #endif
 	
 	// If we're in seeking mode, signal that we're done.
@@ -720,20 +1050,30 @@ uint32_t DataBuffer::write(const char* data, uint32_t length) {
 #ifdef DEBUG
 		std::cout << "In seeking mode. Notifying seeking routine." << std::endl;
 #endif
-		seekRequestPending = false;
-		dataRequestPending = false;
+		{
+			std::lock_guard<std::mutex> lk(seekRequestMutex);
+			seekRequestPending = false;
+			dataRequestPending = false;
+		}
+		
 		seekRequestCV.notify_one();
+		signalData();
 		
 		return bytesWritten;
 	}
 	
-	dataRequestPending = false;
+	// Account for the response and adapt the block size.
+	updateRate(bytesWritten);
+	dataRequestPending = (requestsInFlight > 0);
+	
+	// Wake up a reader waiting on this data.
+	signalData();
 	
 	// Trigger a data request from the client if we have space.
 	if (eof) {
 		// Do nothing.
 		buffering = false;
-	}/* 
+	}/*
 	else if (resetRequest) {
 		// Reset request is pending. Ensure no data requests are pending before we signal okay.
 		while (dataRequestPending) {
@@ -743,23 +1083,13 @@ uint32_t DataBuffer::write(const char* data, uint32_t length) {
 		
 		resetRequest = false;
 	} */
-	else if (bufferAhead && !dataRequestPending && free > (2 * 204799)) {
-		// Single block is 200 kB (204,800 bytes). We have space, so request another block.
-		// TODO: make it possible to request a specific block size from client.
-		if (dataRequestCallback) {
+	else if (bufferAhead || prefetching) {
+		// We have space, so keep the pipeline of read-ahead requests full.
 #ifdef DEBUG
 		std::cout << "DataBuffer::write: requesting more data." << std::endl;
 #endif
-			bool ret = dataRequestCallback(sessionHandle);
-			if (!ret) {
-#ifdef DEBUG
-				std::cerr << "DataBuffer::write: requesting data failed." << std::endl;
-#endif
-			}
-			else {
-				buffering = true;
-			}
-		}
+		requestAhead();
+		buffering = (requestsInFlight > 0);
 	}
 	else {
 		buffering = false;
@@ -773,6 +1103,7 @@ uint32_t DataBuffer::write(const char* data, uint32_t length) {
 // Set the End-Of-File status of the file being streamed.
 void DataBuffer::setEof(bool eof) {
 	DataBuffer::eof = eof;
+	if (eof) { signalData(); }
 }
 
 
@@ -780,31 +1111,3 @@ void DataBuffer::setEof(bool eof) {
 bool DataBuffer::isEof() {
 	return DataBuffer::eof;
 }
-
-
-// --- ADD STREAM TRACK ---
-// Add a streaming track to the queue.
-void DataBuffer::addStreamTrack(std::string track) {
-	streamTrackQueueMutex.lock();
-	streamTrackQueue.push(track);
-	streamTrackQueueMutex.unlock();
-}
-
-
-// --- HAS STREAM TRACK ---
-bool DataBuffer::hasStreamTrack() {
-	return !streamTrackQueue.empty();
-}
-
-
-// --- GET STREAM TRACK ---
-// Returns the next stream string in the queue, or an empty string if queue is empty.
-std::string DataBuffer::getStreamTrack() {
-	streamTrackQueueMutex.lock();
-	if (streamTrackQueue.empty()) { return std::string(); }
-	std::string tStr = streamTrackQueue.front();
-	streamTrackQueue.pop();
-	streamTrackQueueMutex.unlock();
-	
-	return tStr;
-}
@@ -1,10 +1,18 @@
 /*
 	databuffer.h - Data Buffer header.
 	
-	Revision 0
+	Revision 4
 	
 	Features:
 			- Provides API for a ring buffer implementation.
+			- Single-producer, single-consumer: one writer thread (RPC), one reader (demuxer).
+			- Where supported, the buffer pages are mapped twice back-to-back, so that any
+				read or write of up to 'capacity' bytes is a single contiguous range.
+			- Adaptive read-ahead: the size of data requests follows the measured throughput
+				and round-trip time, with multiple requests in flight.
+			- Seeks into data still held in the buffer, or into the pinned container header &
+				index data, are served locally.
+			- One instance per cast session. See SessionRegistry.
 			
 	2020/11/19, Maya Posch
 */
@@ -19,11 +27,14 @@
 #include <functional>
 #include <condition_variable>
 #include <queue>
+#include <deque>
+#include <map>
 #include <string>
+#include <chrono>
 
 
 typedef std::function<void(uint32_t, int64_t)> SeekRequestCallback;
-typedef std::function<bool(uint32_t)> DataRequestCallback;
+typedef std::function<bool(uint32_t, uint32_t)> DataRequestCallback;	// Session, block size in kB.
 
 enum DataBufferSeek {
 	DB_SEEK_START = 0,
@@ -32,6 +43,22 @@ enum DataBufferSeek {
 };
 
 
+struct DataBufferStats {
+	uint32_t blockSize;			// Current data request size, in kB.
+	uint32_t requestsInFlight;	// Data requests not yet answered by the client.
+	double rtt;					// Smoothed data request round-trip time, in ms.
+	double throughput;			// Smoothed receive rate, in kB/s.
+	uint64_t bytesReceived;		// Total bytes received since the session started.
+	uint32_t unread;			// Bytes buffered ahead of the reader.
+};
+
+
+struct DataRequest {
+	std::chrono::steady_clock::time_point time;
+	uint32_t size;				// Requested size, in bytes.
+};
+
+
 class DataBuffer {
 	enum BufferState {
 		DBS_IDLE = 0,
@@ -39,68 +66,107 @@ class DataBuffer {
 		DBS_SEEKING
 	};
 	
-	static uint8_t* buffer;		// Pointer to buffer.
-	static uint8_t* end;		// Pointer to buffer end (idx Nsize).
-	static uint8_t* front;		// Pointer to front of data in buffer (low).
-	static uint8_t* back;		// Pointer to back of data in buffer (last byte + 1).
-	static uint8_t* index;		// Pointer to first unread byte or buffer start.
-	static uint32_t capacity;	// Total capacity of buffer in bytes.
-	static uint32_t size;		// Total size of data in buffer in bytes.
-	static int64_t filesize;	// Size of the media file being streamed, in bytes.
-	static std::atomic<uint32_t> unread;		// Number of unread bytes in the buffer.
-	static std::atomic<uint32_t> free;		// Number of free bytes in the buffer.
-	static uint32_t byteIndex;		// First unread byte index into the media file data.
-	static uint32_t byteIndexLow;	// Lowest media file byte index present in the buffer.
-	static uint32_t byteIndexHigh;	// Highest media file byte index present in the buffer.
-	static std::mutex bufferMutex;
-	static std::atomic<bool> eof;
-	static std::atomic<BufferState> state;
-	static SeekRequestCallback seekRequestCallback;
-	static DataRequestCallback dataRequestCallback;
-	static std::mutex dataWaitMutex;
-	static std::condition_variable dataWaitCV;
-	static std::mutex dataReadMutex;
-	static std::condition_variable dataReadCV;
-	static std::mutex seekRequestMutex;
-	static std::condition_variable seekRequestCV;
-	static std::atomic<bool> seekRequestPending;
-	static std::atomic<bool> resetRequest;
-	static std::atomic<bool> writeStarted;
-	static std::atomic<bool> bufferAhead;
-	static std::atomic<bool> buffering;
-	static uint32_t sessionHandle;		// Active session this buffer is associated with.
+	uint8_t* buffer = 0;		// Pointer to buffer.
+	uint32_t capacity = 0;		// Total capacity of buffer in bytes.
+	bool mirrored = false;		// True if the buffer is mapped twice (no split at the wrap point).
+	int64_t filesize = 0;		// Size of the media file being streamed, in bytes.
+	std::atomic<uint64_t> head = { 0 };	// Total bytes written. Only advanced by the writer.
+	std::atomic<uint64_t> tail = { 0 };	// Total bytes read. Only advanced by the reader.
+	std::atomic<int64_t> fileBase = { 0 };	// Media file byte index at head/tail zero.
+	uint32_t byteIndex = 0;		// First unread byte index into the media file data.
+	uint32_t byteIndexLow = 0;	// Lowest media file byte index present in the buffer.
+	uint32_t byteIndexHigh = 0;	// Highest media file byte index present in the buffer.
+	std::mutex bufferMutex;	// Held by the reader from peek() to commit(), and by resize().
+	std::mutex writeMutex;	// Held by the writer while storing data, and by resize().
+	std::atomic<bool> resizing = { false };	// No new data requests while set.
+	std::atomic<bool> eof = { false };
+	std::atomic<BufferState> state = { DBS_IDLE };
+	SeekRequestCallback seekRequestCallback = 0;
+	DataRequestCallback dataRequestCallback = 0;
+	std::mutex dataWaitMutex;			// Guards waits on data arrival and requests.
+	std::condition_variable dataWaitCV;	// Signalled on write, EOF and reset.
+	std::mutex seekRequestMutex;
+	std::condition_variable seekRequestCV;
+	std::atomic<bool> seekRequestPending = { false };
+	std::atomic<bool> resetRequest = { false };
+	std::atomic<bool> writeStarted = { false };
+	std::atomic<bool> bufferAhead = { false };
+	std::atomic<bool> prefetching = { false };	// Read ahead while not (yet) playing.
+	std::atomic<bool> buffering = { false };
+	uint32_t sessionHandle = 0;		// Session this buffer is associated with.
+	
+	std::atomic<uint32_t> blockSize;				// Size of a data request, in kB.
+	std::atomic<uint32_t> requestsInFlight = { 0 };	// Data requests not yet answered.
+	std::mutex requestMutex;						// Guards the request queue & statistics.
+	std::deque<DataRequest> requests;				// Outstanding data requests, oldest first.
+	uint32_t bytesRequested = 0;					// Total size of outstanding requests.
+	std::chrono::steady_clock::time_point lastArrival;
+	double rttAvg = 0.0;			// Smoothed request round-trip time, in ms.
+	double rttMin = 0.0;			// Lowest recent round-trip time, in ms.
+	double throughputAvg = 0.0;		// Smoothed receive throughput, in kB/s.
+	uint64_t bytesReceived = 0;		// Total bytes received this session.
 	
-	static std::mutex streamTrackQueueMutex;
-	static std::queue<std::string> streamTrackQueue;
+	std::mutex pinnedMutex;
+	std::map<int64_t, std::string> pinned;	// Header & index data, by file offset.
+	uint32_t pinnedSize = 0;				// Total bytes in the pinned data.
+	std::atomic<bool> resync = { false };	// Client file position differs from buffer head.
+	
+	bool allocate(uint32_t capacity);
+	void release();
+	bool rebuffer(uint32_t capacity);
+	uint64_t retainLow(uint64_t t) { return (t > capacity / 4) ? t - (capacity / 4) : 0; }
+	uint32_t bytesUnread() { return (uint32_t) (head.load(std::memory_order_acquire) - tail); }
+	uint32_t bytesFree();
+	bool fill(uint32_t len);
+	void signalData();
+	void resetStats();
+	bool waitRequests();
+	bool issueRequest(bool ahead);
+	bool requestAhead();
+	void updateRate(uint32_t bytes);
+	uint32_t store(const char* data, uint32_t length);
+	void pin(int64_t offset, const char* data, uint32_t length);
+	bool seekLocal(int64_t offset);
+	bool seekPinned(int64_t offset);
+	bool requestSeek(int64_t offset);
 	
 public:
-	static bool init(uint32_t capacity);
-	static bool cleanup();
-	static void setSeekRequestCallback(SeekRequestCallback cb);
-	static void setDataRequestCallback(DataRequestCallback cb);
-	static void setSessionHandle(uint32_t handle);
-	static uint32_t getSessionHandle();
-	static void setFileSize(int64_t size);
-	static int64_t getFileSize();
-	static bool start();
-	static bool requestData();
-	static bool reset();
-	static int64_t seek(DataBufferSeek mode, int64_t offset);
-	static bool seeking();
-	static uint32_t read(uint32_t len, uint8_t* bytes);
-	static uint32_t write(std::string &data);
-	static uint32_t write(const char* data, uint32_t length);
-	static void setEof(bool eof);
-	static bool isEof();
-	static void startBufferAhead() { bufferAhead = true; }
+	DataBuffer();
+	~DataBuffer();
+	DataBuffer(const DataBuffer&) = delete;
+	DataBuffer& operator=(const DataBuffer&) = delete;
 	
-	static void addStreamTrack(std::string track);
-	static bool hasStreamTrack();
-	static std::string getStreamTrack();
+	bool init(uint32_t capacity);
+	bool cleanup();
+	bool resize(uint32_t capacity);
+	uint32_t getCapacity() { return capacity; }
+	uint32_t getFree() { return bytesFree(); }
+	void setSeekRequestCallback(SeekRequestCallback cb);
+	void setDataRequestCallback(DataRequestCallback cb);
+	void setSessionHandle(uint32_t handle);
+	uint32_t getSessionHandle();
+	void setFileSize(int64_t size);
+	int64_t getFileSize();
+	bool start();
+	bool requestData();
+	bool reset();
+	int64_t seek(DataBufferSeek mode, int64_t offset);
+	bool seeking();
+	uint32_t read(uint32_t len, uint8_t* bytes);
+	uint32_t peek(uint32_t len, const uint8_t* &data);
+	void commit(uint32_t len);
+	uint32_t write(std::string &data);
+	uint32_t write(const char* data, uint32_t length);
+	void setEof(bool eof);
+	bool isEof();
+	void startBufferAhead() { prefetching = false; bufferAhead = true; }
+	void startPrefetch();
+	void stopPrefetch() { prefetching = false; }
+	uint32_t getBlockSize() { return blockSize; }
+	void getStats(DataBufferStats &stats);
 	
-	static std::atomic<bool> dataRequestPending;
-	static std::atomic<bool> active;
+	std::atomic<bool> dataRequestPending = { false };
+	std::atomic<bool> active = { false };
 };
 
 #endif
-
@@ -9,6 +9,21 @@
 
 // Static initialisations.
 std::atomic<bool> AudioRenderer::run;
+bool AudioRenderer::deviceOpen = false;
+int AudioRenderer::deviceFreq = 0;
+int AudioRenderer::deviceChannels = 0;
+int AudioRenderer::deviceBufSize = 0;
+struct AudioParams AudioRenderer::deviceParams = {};
+
+// Stream the audio device callback reads from. Null while no stream is attached, e.g. between
+// tracks with the device kept open for a gapless transition.
+static std::atomic<VideoState*> audio_state = { 0 };
+
+// Slave mode: the audio clock of the master receiver read 'master_pts' at the local time
+// 'master_time', both in microseconds. No reference while 'master_time' is zero.
+static std::mutex master_clock_mutex;
+static int64_t master_pts = 0;
+static int64_t master_time = 0;
 
 
 /* static inline
@@ -76,6 +91,36 @@ static int synchronize_audio(VideoState *is, int nb_samples)
 }
 
 
+/* in slave mode, return the wanted number of samples to keep the audio clock
+ * on the audio clock of the master receiver */
+static int synchronize_audio_slave(VideoState *is, int nb_samples)
+{
+    int64_t pts, time, now;
+    double diff;
+    int max_diff, sample_diff;
+
+    {
+        std::lock_guard<std::mutex> lk(master_clock_mutex);
+        pts  = master_pts;
+        time = master_time;
+    }
+
+    now = av_gettime();
+    if (!time || now - time > SLAVE_SYNC_MAX_AGE)
+        return nb_samples;
+
+    diff = ClockC::get_clock(&is->audclk) - (pts + (now - time)) / 1000000.0;
+    if (isnan(diff) || fabs(diff) < SLAVE_SYNC_THRESHOLD || fabs(diff) > SLAVE_SYNC_MAX_DIFF)
+        return nb_samples;
+
+    /* small steps, which swr_set_compensation() spreads over the frame */
+    max_diff = FFMAX(1, nb_samples * SLAVE_CORRECTION_PERMILLE / 1000);
+    sample_diff = av_clip((int)(diff * is->audio_src.freq), -max_diff, max_diff);
+    av_log(NULL, AV_LOG_TRACE, "slave diff=%f sample_diff=%d\n", diff, sample_diff);
+    return nb_samples + sample_diff;
+}
+
+
 static int configure_filtergraph(AVFilterGraph *graph, const char *filtergraph,
                                  AVFilterContext *source_ctx, AVFilterContext *sink_ctx)
 {
@@ -258,11 +303,38 @@ static int audio_decode_frame(VideoState *is)
     do {
 #if defined(_WIN32)
         while (FrameQueueC::frame_queue_nb_remaining(&is->sampq) == 0) {
+			// At the end of the stream output silence instead of waiting for more frames. This
+			// is the point where the audio clock reaches the end of the track.
+			if (is->auddec.finished == is->audioq.serial) {
+				is->audio_drained = 1;
+				return -1;
+			}
+			
+			if (is->audioq.abort_request)
+				return -1;
             if ((av_gettime_relative() - audio_callback_time) > 1000000LL * is->audio_hw_buf_size / is->audio_tgt.bytes_per_sec / 2)
                 return -1;
             av_usleep (1000);
         }
+#else
+		// Wait for a frame without polling. The audio thread signals the queue when the decoder
+		// finishes, at which point silence is output instead: the audio clock reached the end of
+		// the track.
+		SDL_LockMutex(is->sampq.mutex);
+		while (FrameQueueC::frame_queue_nb_remaining(&is->sampq) == 0 &&
+					is->auddec.finished != is->audioq.serial && !is->audioq.abort_request) {
+			SDL_CondWait(is->sampq.cond, is->sampq.mutex);
+		}
+		
+		SDL_UnlockMutex(is->sampq.mutex);
+		if (FrameQueueC::frame_queue_nb_remaining(&is->sampq) == 0) {
+			if (is->auddec.finished == is->audioq.serial)
+				is->audio_drained = 1;
+			return -1;
+		}
 #endif
+		
+		is->audio_drained = 0;
         if (!(af = FrameQueueC::frame_queue_peek_readable(&is->sampq)))
             return -1;
         FrameQueueC::frame_queue_next(&is->sampq);
@@ -300,7 +372,10 @@ static int audio_decode_frame(VideoState *is)
         is->audio_src.fmt = (AVSampleFormat) af->frame->format;
     } */
 	
-	wanted_nb_samples = synchronize_audio(is, af->frame->nb_samples);
+	if (serverMode == NCS_MODE_SLAVE)
+		wanted_nb_samples = synchronize_audio_slave(is, af->frame->nb_samples);
+	else
+		wanted_nb_samples = synchronize_audio(is, af->frame->nb_samples);
 
     if (af->frame->format        != is->audio_src.fmt            ||
         av_channel_layout_compare(&af->frame->ch_layout, &is->audio_src.ch_layout) ||
@@ -407,10 +482,15 @@ static void update_sample_display(VideoState *is, short *samples, int samples_si
 /* prepare a new audio buffer */
 static void sdl_audio_callback(void *opaque, Uint8 *stream, int len)
 {
-    VideoState *is = (VideoState*) opaque;
+    VideoState *is = audio_state;
     int audio_size, len1;
 
     audio_callback_time = av_gettime_relative();
+	
+	if (!is) {
+		memset(stream, 0, len);
+		return;
+	}
 
     while (len > 0) {
         if (is->audio_buf_index >= is->audio_buf_size) {
@@ -490,6 +570,32 @@ int AudioRenderer::audio_open(void *opaque, AVChannelLayout* wanted_channel_layo
         av_log(NULL, AV_LOG_ERROR, "Invalid sample rate or channel count!\n");
         return -1;
     }
+	
+	// Reuse the device kept open by the previous track if it was opened for the same format.
+	if (deviceOpen) {
+		if (wanted_spec.freq == deviceFreq && wanted_spec.channels == deviceChannels) {
+			if (av_channel_layout_copy(&audio_hw_params->ch_layout, &deviceParams.ch_layout) < 0)
+				return -1;
+			
+			audio_hw_params->fmt = deviceParams.fmt;
+			audio_hw_params->freq = deviceParams.freq;
+			audio_hw_params->frame_size = deviceParams.frame_size;
+			audio_hw_params->bytes_per_sec = deviceParams.bytes_per_sec;
+			
+			SDL_LockAudioDevice(audio_dev);
+			audio_state = (VideoState*) opaque;
+			SDL_UnlockAudioDevice(audio_dev);
+			
+			av_log(NULL, AV_LOG_INFO, "Reusing open audio device (%d channels, %d Hz).\n",
+																deviceChannels, deviceFreq);
+			return deviceBufSize;
+		}
+		
+		audio_release();
+	}
+	
+	deviceFreq = wanted_spec.freq;
+	deviceChannels = wanted_spec.channels;
     while (next_sample_rate_idx && next_sample_rates[next_sample_rate_idx] >= wanted_spec.freq)
         next_sample_rate_idx--;
     wanted_spec.format = AUDIO_S16SYS;
@@ -555,10 +661,90 @@ int AudioRenderer::audio_open(void *opaque, AVChannelLayout* wanted_channel_layo
         av_log(NULL, AV_LOG_ERROR, "av_samples_get_buffer_size failed\n");
         return -1;
     }
+	
+	// Remember the device format, so that the next track can reuse the device.
+	av_channel_layout_uninit(&deviceParams.ch_layout);
+	if (av_channel_layout_copy(&deviceParams.ch_layout, &audio_hw_params->ch_layout) < 0)
+		return -1;
+	
+	deviceParams.fmt = audio_hw_params->fmt;
+	deviceParams.freq = audio_hw_params->freq;
+	deviceParams.frame_size = audio_hw_params->frame_size;
+	deviceParams.bytes_per_sec = audio_hw_params->bytes_per_sec;
+	deviceBufSize = spec.size;
+	deviceOpen = true;
+	audio_state = (VideoState*) opaque;
+	
     return spec.size;
 }
 
 
+// --- AUDIO CLOSE ---
+// Detach the stream from the audio device. With 'keep' set the device stays open, playing
+// silence, so that the next track can reuse it. Otherwise it is closed.
+void AudioRenderer::audio_close(bool keep) {
+	if (!deviceOpen) { return; }
+	
+	// Locking the device waits for a running callback to finish.
+	SDL_LockAudioDevice(audio_dev);
+	audio_state = 0;
+	SDL_UnlockAudioDevice(audio_dev);
+	clearMasterClock();
+	
+	if (!keep) { audio_release(); }
+}
+
+
+// --- AUDIO RELEASE ---
+// Close the audio device, if open.
+void AudioRenderer::audio_release() {
+	if (!deviceOpen) { return; }
+	
+	av_log(NULL, AV_LOG_INFO, "Closing audio device...\n");
+	audio_state = 0;
+	SDL_CloseAudioDevice(audio_dev);
+	deviceOpen = false;
+}
+
+
+// --- GET CLOCK ---
+// Sample the audio clock of the stream being played. Sets 'pts' to the clock in microseconds
+// and 'time' to the wall clock time it was read at.
+// Returns false if no stream is playing.
+bool AudioRenderer::getClock(int64_t &pts, int64_t &time) {
+	if (!deviceOpen) { return false; }
+	
+	// Holding the device lock keeps audio_close() from detaching the stream meanwhile.
+	SDL_LockAudioDevice(audio_dev);
+	VideoState* is = audio_state;
+	double clock = (is && !is->paused) ? ClockC::get_clock(&is->audclk) : NAN;
+	time = av_gettime();
+	SDL_UnlockAudioDevice(audio_dev);
+	
+	if (isnan(clock)) { return false; }
+	
+	pts = (int64_t) (clock * 1000000.0);
+	return true;
+}
+
+
+// --- SET MASTER CLOCK ---
+// Slave mode: the master's audio clock read 'pts' at local time 'time', in microseconds.
+void AudioRenderer::setMasterClock(int64_t pts, int64_t time) {
+	std::lock_guard<std::mutex> lk(master_clock_mutex);
+	master_pts = pts;
+	master_time = time;
+}
+
+
+// --- CLEAR MASTER CLOCK ---
+// Drop the master clock reference, e.g. after a seek.
+void AudioRenderer::clearMasterClock() {
+	std::lock_guard<std::mutex> lk(master_clock_mutex);
+	master_time = 0;
+}
+
+
 extern "C" {
 #include <libavfilter/buffersrc.h>
 #include <libavfilter/buffersink.h>
@@ -587,6 +773,10 @@ extern "C" {
 		
         if ((got_frame = DecoderC::decoder_decode_frame(&is->auddec, frame, NULL)) < 0)
             goto the_end;
+		
+		// Wake up the audio callback waiting for a frame, so that it sees the end of the stream.
+		if (!got_frame && is->auddec.finished == is->auddec.pkt_serial)
+			FrameQueueC::frame_queue_signal(&is->sampq);
 
         if (got_frame) {
                 tb = AVRational{1, frame->sample_rate};
@@ -668,8 +858,10 @@ extern "C" {
                 if (is->audioq.serial != is->auddec.pkt_serial)
                     break;
             }
-            if (ret == AVERROR_EOF)
+            if (ret == AVERROR_EOF) {
                 is->auddec.finished = is->auddec.pkt_serial;
+                FrameQueueC::frame_queue_signal(&is->sampq);
+            }
 #endif
         }
     } while (ret >= 0 || ret == AVERROR(EAGAIN) || ret == AVERROR_EOF);
@@ -699,6 +891,10 @@ int AudioRenderer::audio_thread(void *arg) {
     do {
         if ((got_frame = DecoderC::decoder_decode_frame(&is->auddec, frame, NULL)) < 0)
             goto the_end;
+		
+		// Wake up the audio callback waiting for a frame, so that it sees the end of the stream.
+		if (!got_frame && is->auddec.finished == is->auddec.pkt_serial)
+			FrameQueueC::frame_queue_signal(&is->sampq);
 
         if (got_frame) {
                 tb = {1, frame->sample_rate};
@@ -757,8 +953,10 @@ int AudioRenderer::audio_thread(void *arg) {
                 if (is->audioq.serial != is->auddec.pkt_serial)
                     break;
             }
-            if (ret == AVERROR_EOF)
+            if (ret == AVERROR_EOF) {
                 is->auddec.finished = is->auddec.pkt_serial;
+                FrameQueueC::frame_queue_signal(&is->sampq);
+            }
         }
     } while (ret >= 0 || ret == AVERROR(EAGAIN) || ret == AVERROR_EOF);
  the_end:
@@ -8,16 +8,28 @@
 
 
 #include <atomic>
+#include <mutex>
 
 
 class AudioRenderer {
 	static std::atomic<bool> run;
+	static bool deviceOpen;				// Audio device is open.
+	static int deviceFreq;				// Sample rate the device was opened for.
+	static int deviceChannels;			// Channel count the device was opened for.
+	static int deviceBufSize;			// Device buffer size, in bytes.
+	static struct AudioParams deviceParams;
 	
 public:
 	//static int audio_open(void *opaque, int64_t wanted_channel_layout, int wanted_nb_channels, int wanted_sample_rate, struct AudioParams *audio_hw_params);
 	static int audio_open(void *opaque, AVChannelLayout* wanted_channel_layout, int wanted_sample_rate, struct AudioParams *audio_hw_params);
 	static int audio_thread(void *arg);
 	static int configure_audio_filters(VideoState *is, const char *afilters, int force_output_format);
+	static void audio_close(bool keep);
+	static void audio_release();
+	
+	static bool getClock(int64_t &pts, int64_t &time);
+	static void setMasterClock(int64_t pts, int64_t time);
+	static void clearMasterClock();
 	
 	static void quit();
 };
@@ -4,7 +4,8 @@
 	Revision 0
 	
 	Notes:
-			- 
+			- With 'gapless' set, the next queued session or stream is opened & probed while the
+				current track nears its end, and the audio device is kept open between tracks.
 		
 	2019/10/15 - Maya Posch
 */
@@ -42,10 +43,15 @@ AVPacket flush_pkt;
 
 #include "types.h"
 #include "../databuffer.h"
+#include "../session_registry.h"
 
 #include "player.h"
 #include "stream_handler.h"
 #include "sdl_renderer.h"
+#include "audio_renderer.h"
+
+
+#define GAPLESS_PREPARE_TIME 15	// Seconds before the end of a track to open the next one.
 
 
 // Global objects.
@@ -84,19 +90,29 @@ const int program_birth_year = 2003;
 /**
  * Reads from a buffer into FFmpeg.
  *
- * @param ptr	   A pointer to the user-defined IO data structure.
+ * @param opaque   The DataBuffer of the session being played.
  * @param buf	   A buffer to read into.
  * @param buf_size  The size of the buffer buff.
  *
  * @return The number of bytes read into the buffer.
  */
 int Ffplay::media_read(void* opaque, uint8_t* buf, int buf_size) {
-	uint32_t bytesRead = DataBuffer::read(buf_size, buf);
+	// Copy straight out of the ring buffer into the AVIO buffer. This is the only copy left on
+	// the read path, as AVIO owns the buffer it passes us. A short read at the buffer's wrap
+	// point (non-mirrored buffer only) is fine, AVIO will just call us again.
+	DataBuffer* db = (DataBuffer*) opaque;
+	const uint8_t* data = 0;
+	uint32_t bytesRead = db->peek(buf_size, data);
+	if (bytesRead > 0) {
+		memcpy(buf, data, bytesRead);
+		db->commit(bytesRead);
+	}
+	
 	//std::cout << "Read " << bytesRead << " bytes." << std::endl;
 	NYMPH_LOG_DEBUG("Read " + Poco::NumberFormatter::format(bytesRead) + " bytes.");
 	if (bytesRead == 0) {
 		//std::cout << "EOF is " << DataBuffer::isEof() << std::endl;
-		if (DataBuffer::isEof()) { return AVERROR_EOF; }
+		if (db->isEof()) { return AVERROR_EOF; }
 		else { return AVERROR(EIO); }
 	}
 	
@@ -107,7 +123,7 @@ int Ffplay::media_read(void* opaque, uint8_t* buf, int buf_size) {
 /**
  * Seeks to a given position in the currently open file.
  * 
- * @param opaque  A pointer to the user-defined IO data structure.
+ * @param opaque  The DataBuffer of the session being played.
  * @param offset  The position to seek to.
  * @param whence  SEEK_SET, SEEK_CUR, SEEK_END (like fseek) and AVSEEK_SIZE.
  *
@@ -117,23 +133,24 @@ int64_t Ffplay::media_seek(void* opaque, int64_t offset, int whence) {
 	NYMPH_LOG_INFORMATION("media_seek: offset " + Poco::NumberFormatter::format(offset) + 
 							", whence " + Poco::NumberFormatter::format(whence));
 	
+	DataBuffer* db = (DataBuffer*) opaque;
 	int64_t new_offset = AVERROR(EIO);
 	switch (whence) {
 		case SEEK_SET:	// Seek from the beginning of the file.
 			NYMPH_LOG_INFORMATION("media_seek: SEEK_SET");
-			new_offset = DataBuffer::seek(DB_SEEK_START, offset);
+			new_offset = db->seek(DB_SEEK_START, offset);
 			break;
 		case SEEK_CUR:	// Seek from the current position.
 			NYMPH_LOG_INFORMATION("media_seek: SEEK_CUR");
-			new_offset = DataBuffer::seek(DB_SEEK_CURRENT, offset);
+			new_offset = db->seek(DB_SEEK_CURRENT, offset);
 			break;
 		case SEEK_END:	// Seek from the end of the file.
 			NYMPH_LOG_INFORMATION("media_seek: SEEK_END");
-			new_offset = DataBuffer::seek(DB_SEEK_END, offset);
+			new_offset = db->seek(DB_SEEK_END, offset);
 			break;
 		case AVSEEK_SIZE:
 			NYMPH_LOG_INFORMATION("media_seek: received AVSEEK_SIZE, returning file size.");
-			return DataBuffer::getFileSize();
+			return db->getFileSize();
 			break;
 		default:
 			NYMPH_LOG_ERROR("media_seek: default. The universe broke.");
@@ -176,9 +193,11 @@ void Ffplay::setVolume(uint8_t volume) {
 
 
 // --- STREAM TRACK ---
-bool Ffplay::streamTrack(std::string url) {
+// format	: name of the input format, if known. Skips probing for the format when opening.
+bool Ffplay::streamTrack(std::string url, std::string format) {
 	if (!playerStarted) {
 		castUrl = url;
+		castFormat = format;
 		castingUrl = true;
 		
 		playbackCv.notify_one();
@@ -216,6 +235,47 @@ bool Ffplay::playTrack(int64_t delay) {
 }
 
 
+// --- PREPARE NEXT ---
+// Open & probe the next queued session or stream in the background, so that it can start
+// playing as soon as the current track has ended.
+void Ffplay::prepareNext() {
+	nextDb = SessionRegistry::getNext();
+	if (nextDb) {
+		// Same custom IO set-up as for the active session.
+		size_t iBufSize = 32 * 1024; // 32 kB
+		uint8_t* pBuffer = (uint8_t*) av_malloc(iBufSize);
+		nextIo = avio_alloc_context(pBuffer, iBufSize, 0, nextDb.get(), media_read, 0, media_seek);
+		AVFormatContext* formatContext = avformat_alloc_context();
+		formatContext->pb = nextIo;
+		
+		nextPrepared = StreamHandler::stream_prepare("", formatContext);
+	}
+	else {
+		nextUrl = SessionRegistry::peekStreamTrack();
+		if (nextUrl.empty()) { return; }
+		
+		nextPrepared = StreamHandler::stream_prepare(nextUrl.c_str(), 0);
+	}
+	
+	if (!nextPrepared) { dropNext(); }
+}
+
+
+// --- DROP NEXT ---
+// Release any next track that was prepared, but isn't going to be played.
+void Ffplay::dropNext() {
+	StreamHandler::stream_prepare_cancel();
+	if (nextIo) {
+		av_freep(&nextIo->buffer);
+		av_freep(&nextIo);
+	}
+	
+	nextDb.reset();
+	nextUrl.clear();
+	nextPrepared = false;
+}
+
+
 void init_opts(void) {
     av_dict_set(&sws_dict, "flags", "bicubic", 0);
 }
@@ -229,6 +289,9 @@ void Ffplay::run() {
 	avformat_network_init();
 
 	init_opts();
+	
+	// The flush packet is recognised by its data pointer, which must differ from a null packet's.
+	flush_pkt.data = (uint8_t*) &flush_pkt;
 
 	//parse_options(NULL, argc, argv.data(), options, opt_input_file);
 	av_log_set_flags(AV_LOG_SKIP_REPEATED);
@@ -243,16 +306,17 @@ void Ffplay::run() {
 	playerStarted = false;
 	std::mutex playbackMtx;
 	while (running) {
-		// Check whether we have any queued URLs to stream next.
-		if (DataBuffer::hasStreamTrack()) {
-			castUrl = DataBuffer::getStreamTrack();
+		// Check whether we have any queued URLs to stream next. A queued session activated after
+		// the previous playback goes first.
+		if (!playingTrack && SessionRegistry::hasStreamTrack()) {
+			castUrl = SessionRegistry::getStreamTrack();
+			castFormat.clear();
 			castingUrl = true;
-		
-			return;
 		}
-		else {
+		else if (!playingTrack) {
 			// Wait in condition variable until triggered. Ensure an event is waiting to deal with
-			// spurious wake-ups.
+			// spurious wake-ups. A queued session activated after the previous playback is
+			// played straight away.
 			std::unique_lock<std::mutex> lk(playbackMtx);
 			using namespace std::chrono_literals;
 			playbackCv.wait(lk);
@@ -272,9 +336,35 @@ void Ffplay::run() {
 		// --- AVIOContext section ---
 		AVFormatContext* formatContext = 0;
 		AVIOContext* ioContext = 0;
+		std::shared_ptr<DataBuffer> db;	// Kept for the duration of the playback.
+		bool probed = false;			// Opened ahead of time as the next track.
 		if (!castingUrl) {
 			input_filename = "";
+			
+			db = SessionRegistry::getActive();
+			if (!db) {
+				av_log(NULL, AV_LOG_ERROR, "No active session to play. Aborting track playback.\n");
+				playerStarted = false;
+				playingTrack = false;
+				dropNext();
+				continue;
+			}
+			
+			if (nextPrepared && nextDb == db) {
+				formatContext = StreamHandler::stream_prepared("");
+				if (formatContext) {
+					ioContext = nextIo;
+					nextIo = 0;
+					probed = true;
+				}
+				else {
+					// Probing failed, start over from the beginning of the file.
+					db->seek(DB_SEEK_START, 0);
+				}
+			}
+		}
 		
+		if (!castingUrl && !probed) {
 			// Create internal buffer for FFmpeg.
 			size_t iBufSize = 32 * 1024; // 32 kB
 			uint8_t* pBuffer = (uint8_t*) av_malloc(iBufSize);
@@ -283,7 +373,7 @@ void Ffplay::run() {
 			// The fourth parameter (pStream) is a user parameter which will be passed to our callback functions
 			ioContext = avio_alloc_context(pBuffer, iBufSize,  // internal Buffer and its size
 													 0,				  // bWriteable (1=true,0=false) 
-													 0, //&media_buffer,	  // user data
+													 db.get(),		  // user data
 													 media_read, 
 													 0,				  // Write callback function. 
 													 media_seek);
@@ -308,13 +398,28 @@ void Ffplay::run() {
 			
 		// --- End AVIOContext section ---
 		}
-		else {
+		else if (castingUrl) {
 			input_filename = castUrl.c_str();
 			av_log(NULL, AV_LOG_INFO, "Opening URL: %s\n", input_filename);
+			
+			if (nextPrepared && nextUrl == castUrl) {
+				formatContext = StreamHandler::stream_prepared(input_filename);
+				probed = (formatContext != 0);
+			}
+		}
+		
+		// Drop a prepared next track which isn't the one we're about to play.
+		dropNext();
+		
+		// Use the input format found when the file was probed before, if any.
+		AVInputFormat* iformat = file_iformat;
+		if (castingUrl && !probed && !castFormat.empty()) {
+			iformat = (AVInputFormat*) av_find_input_format(castFormat.c_str());
+			if (!iformat) { iformat = file_iformat; }
 		}
 		
 		// Start player.
-		is = StreamHandler::stream_open(input_filename, file_iformat, formatContext);
+		is = StreamHandler::stream_open(input_filename, iformat, formatContext, probed);
 		if (!is) {
 			av_log(NULL, AV_LOG_FATAL, "Failed to initialize VideoState!\n");
 			do_exit(NULL);
@@ -331,9 +436,19 @@ void Ffplay::run() {
 		SdlRenderer::playerEvents(true);
 		
 		// Wait here until playback has finished.
-		// The read thread in StreamHandler will signal this condition variable.
+		// The read thread in StreamHandler will signal this condition variable. Meanwhile, open the
+		// next queued track once the end of this one comes near.
 		playerMutex.lock();
-		playerCon.wait(playerMutex);
+		while (!playerCon.tryWait(playerMutex, 500)) {
+			if (!gapless || nextPrepared || serverMode != NCS_MODE_STANDALONE) { continue; }
+			
+			uint64_t duration = file_meta.getDuration();
+			double position = file_meta.getPosition();
+			if (duration > 0 && position > 0.0 && (duration - position) < GAPLESS_PREPARE_TIME) {
+				prepareNext();
+			}
+		}
+		
 		playerMutex.unlock();
 		
 		// Ensure we disable player events since we're no longer processing them.
@@ -351,28 +466,43 @@ void Ffplay::run() {
 			av_freep(&ioContext);
 		}
 		
+		// The next session's buffer gets resized on activation, so let probing finish first.
+		StreamHandler::stream_prepare_wait();
+		
+		// With a next track ready, keep the audio device open for it.
+		bool keepAudio = nextPrepared;
 		if (!StreamHandler::get_fault()) {
 			if (is != 0) {
-				StreamHandler::stream_close(is);
+				StreamHandler::stream_close(is, keepAudio);
 				is = 0;
 			}
 		}
 		else {
 			// Clear fault flag.
 			StreamHandler::clear_fault();
+			AudioRenderer::audio_release();
 			is = 0;
 		}
 		
-		SDL_Delay(500); // wait 500 ms.
+		if (!keepAudio) {
+			SDL_Delay(500); // wait 500 ms.
+		}
 		
 		av_log(NULL, AV_LOG_INFO, "Terminating player...\n");
 		
-		DataBuffer::reset();	// Clears the data buffer (file data buffer).
+		db.reset();				// Release the session's data buffer.
 		finishPlayback();		// Calls handler for post-playback steps.
 		playerStarted = false;
-		playingTrack = false;
 		castingUrl = false;
 		
+		// Hand over to the next queued session, if any. Its buffer already holds prefetched data.
+		playingTrack = SessionRegistry::activateNext();
+		if (keepAudio && !playingTrack && !SessionRegistry::hasStreamTrack()) {
+			// Nothing left to play after all.
+			dropNext();
+			AudioRenderer::audio_release();
+		}
+		
 		// Update clients with status update.
 		sendGlobalStatusUpdate();
 	}
@@ -383,6 +513,7 @@ void Ffplay::run() {
 void Ffplay::quit() {
 	// Stop player.
 	Player::quit();
+	StreamHandler::stream_prepare_cancel();
 	
 	// End loop.
 	running = false;
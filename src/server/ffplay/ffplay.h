@@ -18,6 +18,8 @@
 #include <atomic>
 #include <queue>
 #include <cmath>
+#include <memory>
+#include <string>
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_mutex.h>
@@ -28,6 +30,7 @@
 #include <Poco/Runnable.h>
 
 #include "types.h"
+#include "../databuffer.h"
 
 #include <nymph/nymph.h>
 
@@ -119,18 +122,27 @@ class Ffplay : public Poco::Runnable {
 	std::atomic<bool> running = { false };
 	std::atomic<bool> playerStarted = { false };
 	std::string castUrl;
+	std::string castFormat;			// Input format of castUrl if known, e.g. from the media index.
 	std::atomic<bool> castingUrl = { false };
 	std::atomic<bool> playingTrack = { false };
 	
+	// Next track, opened ahead of time for a gapless transition.
+	std::shared_ptr<DataBuffer> nextDb;
+	AVIOContext* nextIo = 0;
+	std::string nextUrl;
+	bool nextPrepared = false;
+	
 	static int media_read(void* opaque, uint8_t* buf, int buf_size);
 	static int64_t media_seek(void* opaque, int64_t pos, int whence);
+	void prepareNext();
+	void dropNext();
 	
 public:
 	virtual void run();
 	uint8_t getVolume();
 	void setVolume(uint8_t volume);
 	bool playbackActive() { return playerStarted.load(); }
-	bool streamTrack(std::string url);
+	bool streamTrack(std::string url, std::string format = std::string());
 	bool playTrack(int64_t delay = 0);
 	void quit();
 };
@@ -0,0 +1,177 @@
+/*
+	frame_pacer.cpp - Implementation of the FramePacer class.
+	
+	Revision 0.
+	
+	Notes:
+			- A frame is due when the next refresh is the one closest to its target time. The
+				scheduler wakes up FP_MARGIN of a refresh after the refresh before that one.
+			- Presents are counted as repeats or drops against the refreshes a frame's duration
+				asks for, with FP_TOLERANCE of a refresh to spare.
+	
+	2026/10/18, Maya Posch
+*/
+
+
+#include "frame_pacer.h"
+
+#include <cmath>
+#include <cstdlib>
+
+
+#define FP_SMOOTHING 16			// Weight of the current period against a new measurement.
+#define FP_MAX_INTERVAL 4		// Maximum refreshes between presents used to refine the period.
+#define FP_TOLERANCE 0.1		// Part of a refresh a frame may exceed its duration by.
+#define FP_MARGIN 0.125			// Part of a refresh to wait after the one before a frame is due.
+
+
+// Static variables.
+double FramePacer::period = 0.0;
+int64_t FramePacer::lastVsync = 0;
+int64_t FramePacer::frameVsync = 0;
+int64_t FramePacer::frameDuration = 0;
+int64_t FramePacer::pendingDuration = 0;
+bool FramePacer::continuous = false;
+uint64_t FramePacer::presented = 0;
+uint64_t FramePacer::repeated = 0;
+std::atomic<uint64_t> FramePacer::droppedCount = { 0 };
+
+
+// --- RESET ---
+// Start pacing a new stream, on a display with the given refresh rate (0 if unknown).
+void FramePacer::reset(double refreshRate) {
+	period = (refreshRate > 0.0) ? 1000000.0 / refreshRate : 0.0;
+	lastVsync = 0;
+	frameVsync = 0;
+	frameDuration = 0;
+	pendingDuration = 0;
+	continuous = false;
+	presented = 0;
+	repeated = 0;
+	droppedCount = 0;
+}
+
+
+// --- DISCONTINUITY ---
+// The next frame does not follow the current one in time (pause, seek), so the time the current
+// one stays on screen is not a repeat.
+void FramePacer::discontinuity() {
+	continuous = false;
+}
+
+
+// --- FRAME ---
+// The next present shows a new frame, which lasts 'duration'.
+void FramePacer::frame(int64_t duration) {
+	pendingDuration = (duration > 0) ? duration : 1;
+}
+
+
+// --- DROPPED ---
+// A frame was dropped before it was presented. May be called from any thread.
+void FramePacer::dropped() {
+	droppedCount++;
+}
+
+
+// --- PRESENT DONE ---
+// Called right after a present. 'vsync' is true if the present waited for the refresh, in which
+// case 'time' is taken as the time of that refresh.
+void FramePacer::presentDone(int64_t time, bool vsync) {
+	if (vsync) {
+		if (lastVsync > 0 && period > 0.0) {
+			double interval = (double) (time - lastVsync);
+			double n = std::floor(interval / period + 0.5);
+			if (n >= 1.0 && n <= FP_MAX_INTERVAL) {
+				double error = interval - n * period;
+				if (std::fabs(error) < period / 4) { period += error / (n * FP_SMOOTHING); }
+			}
+		}
+		
+		lastVsync = time;
+	}
+	
+	if (pendingDuration == 0) { return; } // Same frame shown again.
+	
+	presented++;
+	if (vsync && period > 0.0 && frameDuration > 0 && continuous) {
+		// Refreshes the previous frame was on screen, against the ones its duration asks for.
+		int64_t shown = (int64_t) std::floor((time - frameVsync) / period + 0.5);
+		int64_t expected = (int64_t) std::ceil(frameDuration / period - FP_TOLERANCE);
+		if (shown == 0) { droppedCount++; }
+		else if (shown > expected) { repeated += shown - expected; }
+	}
+	
+	frameVsync = time;
+	frameDuration = pendingDuration;
+	pendingDuration = 0;
+	continuous = true;
+}
+
+
+// --- NEXT VSYNC ---
+// Time of the first refresh after 'now', or -1 if the refreshes are unknown.
+int64_t FramePacer::nextVsync(int64_t now) {
+	if (period <= 0.0 || lastVsync == 0) { return -1; }
+	if (now < lastVsync) { return lastVsync; }
+	
+	double n = std::floor((now - lastVsync) / period) + 1.0;
+	return lastVsync + (int64_t) std::ceil(n * period);
+}
+
+
+// --- DUE ---
+// Whether a frame with the given target time should be presented now. A present now shows on the
+// next refresh, which has to be the refresh closest to the target.
+bool FramePacer::due(int64_t target, int64_t now) {
+	int64_t vsync = nextVsync(now);
+	if (vsync < 0) { return target <= now; }
+	
+	return target < vsync + (int64_t) (period / 2);
+}
+
+
+// --- WAIT TIME ---
+// Time until a frame with the given target time is due: shortly after the refresh before the
+// one closest to the target.
+int64_t FramePacer::waitTime(int64_t target, int64_t now) {
+	int64_t wait;
+	int64_t vsync = nextVsync(target - (int64_t) (period / 2));
+	if (vsync < 0) { wait = target - now; }
+	else { wait = vsync - (int64_t) (period * (1.0 - FP_MARGIN)) - now; }
+	
+	return (wait < 0) ? 0 : wait;
+}
+
+
+// --- STATS ---
+FramePacerStats FramePacer::stats() {
+	FramePacerStats s;
+	s.presented = presented;
+	s.dropped = droppedCount;
+	s.repeated = repeated;
+	return s;
+}
+
+
+// --- MATCH RATE ---
+// Pick the refresh rate for content at 'fps' frames per second: an integer multiple of it, from
+// the 'rates' the display supports. The current rate is kept if it matches, otherwise the closest
+// matching rate is used. Returns 0 if no rate matches.
+// Display modes have integer rates, which are rounded or truncated (23.976 as 23 or 24).
+int FramePacer::matchRate(double fps, const std::vector<int> &rates, int current) {
+	if (fps <= 0.0) { return 0; }
+	
+	int best = 0;
+	for (size_t i = 0; i < rates.size(); i++) {
+		int rate = rates[i];
+		if (rate <= 0) { continue; }
+		
+		double n = std::floor(rate / fps + 0.5);
+		if (n < 1.0 || std::fabs(rate - n * fps) >= 1.0) { continue; }
+		if (rate == current) { return current; }
+		if (best == 0 || std::abs(rate - current) < std::abs(best - current)) { best = rate; }
+	}
+	
+	return best;
+}
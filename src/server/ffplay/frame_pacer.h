@@ -0,0 +1,58 @@
+/*
+	frame_pacer.h - Presentation of video frames on display refreshes (vsync).
+	
+	Revision 0.
+	
+	Notes:
+			- Times are in microseconds (av_gettime_relative()).
+			- The refresh period starts out from the display mode, and is refined from the times
+				at which presents with vsync return. Those are taken as the vsync times.
+			- Only used from the thread which presents, except for dropped().
+	
+	2026/10/18, Maya Posch
+*/
+
+
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+
+#include <cstdint>
+#include <vector>
+#include <atomic>
+
+
+struct FramePacerStats {
+	uint64_t presented;		// Frames shown.
+	uint64_t dropped;		// Frames never shown: dropped before presenting, or replaced on the same refresh.
+	uint64_t repeated;		// Refreshes a frame stayed on screen beyond its duration.
+};
+
+
+class FramePacer {
+	static double period;			// Refresh period, 0 if unknown.
+	static int64_t lastVsync;		// Time of the last vsync, 0 if none yet.
+	static int64_t frameVsync;		// Vsync on which the current frame was first shown.
+	static int64_t frameDuration;	// Duration of the current frame, 0 if none.
+	static int64_t pendingDuration;	// Duration of the frame in the next present, 0 if none.
+	static bool continuous;			// Whether the current frame followed the previous one.
+	static uint64_t presented;
+	static uint64_t repeated;
+	static std::atomic<uint64_t> droppedCount;
+
+public:
+	static void reset(double refreshRate);
+	static void discontinuity();
+	static void frame(int64_t duration);
+	static void dropped();
+	static void presentDone(int64_t time, bool vsync);
+	static int64_t refreshPeriod() { return (int64_t) period; }
+	static int64_t nextVsync(int64_t now);
+	static bool due(int64_t target, int64_t now);
+	static int64_t waitTime(int64_t target, int64_t now);
+	static FramePacerStats stats();
+	static int matchRate(double fps, const std::vector<int> &rates, int current);
+};
+
+
+#endif
@@ -3,19 +3,62 @@
 #include "packet_queue.h"
 
 
+/* Nodes are taken from a per-queue pool and returned to it, so that no allocations happen
+   per packet once the pool has grown to the working size of the queue. Packet references
+   are moved in and out of the nodes, never copied. */
+
+
+static void packet_pool_free_chunk(MyAVPacketList *chunk) {
+    for (int i = 0; i < PACKET_POOL_CHUNK; i++)
+        av_packet_free(&chunk[i].pkt);
+    av_free(chunk);
+}
+
+
+/* add a chunk of nodes to the free list. Call with the queue locked, or before it's in use. */
+static int packet_pool_grow(PacketQueue *q) {
+    MyAVPacketList *chunk = (MyAVPacketList*) av_calloc(PACKET_POOL_CHUNK, sizeof(MyAVPacketList));
+    if (!chunk)
+        return AVERROR(ENOMEM);
+    for (int i = 0; i < PACKET_POOL_CHUNK; i++) {
+        chunk[i].pkt = av_packet_alloc();
+        if (!chunk[i].pkt) {
+            packet_pool_free_chunk(chunk);
+            return AVERROR(ENOMEM);
+        }
+    }
+
+    if (av_dynarray_add_nofree(&q->pool, &q->nb_pool, chunk) < 0) {
+        packet_pool_free_chunk(chunk);
+        return AVERROR(ENOMEM);
+    }
+
+    for (int i = 0; i < PACKET_POOL_CHUNK; i++) {
+        chunk[i].next = q->free_pkt;
+        q->free_pkt = &chunk[i];
+    }
+
+    return 0;
+}
+
+
+/* queue the packet, taking over its reference. A null 'pkt' queues a blank (null) packet. */
 int PacketQueueC::packet_queue_put_private(PacketQueue *q, AVPacket *pkt) {
     MyAVPacketList *pkt1;
 
     if (q->abort_request)
        return -1;
 
-    pkt1 = (MyAVPacketList*) av_malloc(sizeof(MyAVPacketList));
-    if (!pkt1)
+    if (!q->free_pkt && packet_pool_grow(q) < 0)
         return -1;
-    pkt1->pkt = *pkt;
+    pkt1 = q->free_pkt;
+    q->free_pkt = pkt1->next;
     pkt1->next = NULL;
-    if (pkt == &flush_pkt)
+    pkt1->flush = (pkt == &flush_pkt);
+    if (pkt1->flush)
         q->serial++;
+    else if (pkt)
+        av_packet_move_ref(pkt1->pkt, pkt);
     pkt1->serial = q->serial;
 
     if (!q->last_pkt)
@@ -24,8 +67,8 @@ int PacketQueueC::packet_queue_put_private(PacketQueue *q, AVPacket *pkt) {
         q->last_pkt->next = pkt1;
     q->last_pkt = pkt1;
     q->nb_packets++;
-    q->size += pkt1->pkt.size + sizeof(*pkt1);
-    q->duration += pkt1->pkt.duration;
+    q->size += pkt1->pkt->size + sizeof(*pkt1);
+    q->duration += pkt1->pkt->duration;
     /* XXX: should duplicate packet data in DV case */
     SDL_CondSignal(q->cond);
     return 0;
@@ -47,12 +90,15 @@ int PacketQueueC::packet_queue_put(PacketQueue *q, AVPacket *pkt) {
 
 
 int PacketQueueC::packet_queue_put_nullpacket(PacketQueue *q, int stream_index) {
-    AVPacket pkt1, *pkt = &pkt1;
-    av_init_packet(pkt);
-    pkt->data = NULL;
-    pkt->size = 0;
-    pkt->stream_index = stream_index;
-    return packet_queue_put(q, pkt);
+    int ret;
+
+    SDL_LockMutex(q->mutex);
+    ret = packet_queue_put_private(q, NULL);
+    if (ret == 0)
+        q->last_pkt->pkt->stream_index = stream_index;
+    SDL_UnlockMutex(q->mutex);
+
+    return ret;
 }
 
 
@@ -69,6 +115,10 @@ int PacketQueueC::packet_queue_init(PacketQueue *q) {
         av_log(NULL, AV_LOG_FATAL, "SDL_CreateCond(): %s\n", SDL_GetError());
         return AVERROR(ENOMEM);
     }
+    if (packet_pool_grow(q) < 0) {
+        av_log(NULL, AV_LOG_FATAL, "Failed to allocate packet queue pool.\n");
+        return AVERROR(ENOMEM);
+    }
     q->abort_request = 1;
     return 0;
 }
@@ -80,8 +130,9 @@ void PacketQueueC::packet_queue_flush(PacketQueue *q) {
     SDL_LockMutex(q->mutex);
     for (pkt = q->first_pkt; pkt; pkt = pkt1) {
         pkt1 = pkt->next;
-        av_packet_unref(&pkt->pkt);
-        av_freep(&pkt);
+        av_packet_unref(pkt->pkt);
+        pkt->next = q->free_pkt;
+        q->free_pkt = pkt;
     }
     q->last_pkt = NULL;
     q->first_pkt = NULL;
@@ -94,6 +145,11 @@ void PacketQueueC::packet_queue_flush(PacketQueue *q) {
 
 void PacketQueueC::packet_queue_destroy(PacketQueue *q) {
     packet_queue_flush(q);
+    for (int i = 0; i < q->nb_pool; i++)
+        packet_pool_free_chunk(q->pool[i]);
+    av_freep(&q->pool);
+    q->nb_pool = 0;
+    q->free_pkt = NULL;
     SDL_DestroyMutex(q->mutex);
     SDL_DestroyCond(q->cond);
 }
@@ -137,12 +193,15 @@ int PacketQueueC::packet_queue_get(PacketQueue *q, AVPacket *pkt, int block, int
             if (!q->first_pkt)
                 q->last_pkt = NULL;
             q->nb_packets--;
-            q->size -= pkt1->pkt.size + sizeof(*pkt1);
-            q->duration -= pkt1->pkt.duration;
-            *pkt = pkt1->pkt;
+            q->size -= pkt1->pkt->size + sizeof(*pkt1);
+            q->duration -= pkt1->pkt->duration;
+            av_packet_move_ref(pkt, pkt1->pkt);
+            if (pkt1->flush)
+                pkt->data = flush_pkt.data;
             if (serial)
                 *serial = pkt1->serial;
-            av_free(pkt1);
+            pkt1->next = q->free_pkt;
+            q->free_pkt = pkt1;
             ret = 1;
             break;
         } else if (!block) {
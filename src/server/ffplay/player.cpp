@@ -25,6 +25,7 @@ uint32_t profcount = 0;
 std::atomic_bool Player::run;
 VideoState* Player::cur_stream = 0;
 double Player::remaining_time = 0.0;
+int64_t Player::next_refresh = 0;
 
 
 // --- CONSTRUCTOR ---
@@ -404,17 +405,63 @@ void Player::event_loop(VideoState *cur_stream) {
 }
 
 
+// --- REFRESH NEEDED ---
+// Whether the display has to be refreshed periodically: for video, the audio visualisation and
+// the external clock. Audio-only playback without a display needs no refreshes.
+bool Player::refresh_needed() {
+	if (!cur_stream || StreamHandler::get_running() == false || StreamHandler::get_fault()) {
+		return false;
+	}
+	
+	if (cur_stream->show_mode == SHOW_MODE_NONE || (cur_stream->paused && !cur_stream->force_refresh)) {
+		return false;
+	}
+	
+	if (cur_stream->video_st || cur_stream->force_refresh) { return true; }
+	if (!display_disable && cur_stream->show_mode != SHOW_MODE_VIDEO && cur_stream->audio_st) {
+		return true;
+	}
+	
+	return !cur_stream->paused && cur_stream->realtime && 
+						StreamHandler::get_master_sync_type(cur_stream) == AV_SYNC_EXTERNAL_CLOCK;
+}
+
+
+// --- NEXT TIMEOUT ---
+// Milliseconds until run_updates() has work to do, or -1 if it only has to run after events.
+int Player::next_timeout() {
+	int64_t now = av_gettime_relative();
+	int64_t wait = -1;
+	if (!cursor_hidden) {
+		wait = FFMAX(0, cursor_last_shown + CURSOR_HIDE_DELAY - now);
+	}
+	
+	if (refresh_needed()) {
+		int64_t refresh = FFMAX(0, next_refresh - now);
+		wait = (wait < 0) ? refresh : FFMIN(wait, refresh);
+	}
+	
+	// Round up, so that the deadline has passed when the loop wakes up.
+	return (wait < 0) ? -1 : (int) ((wait + 999) / 1000);
+}
+
+
 // --- RUN UPDATES ---
+// Called by the event loop after events, or once the timeout from next_timeout() has passed.
 void Player::run_updates() {
 	if (!cursor_hidden && av_gettime_relative() - cursor_last_shown > CURSOR_HIDE_DELAY) {
 		SDL_ShowCursor(0);
 		cursor_hidden = 1;
 	}
 	
-	if (StreamHandler::get_running() == false || StreamHandler::get_fault()) {
-		return; // Playback finished or fault. Return immediately.
+	if (!refresh_needed()) {
+		return; // Playback finished, fault or nothing to display.
 	}
 	
+	// Woken up by an event before the refresh is due.
+	int64_t now = av_gettime_relative();
+	if (now < next_refresh && !cur_stream->force_refresh) { return; }
+	
 #ifdef PROFILING
 	if (!debugfile.is_open()) {
 		av_log(NULL, AV_LOG_WARNING, "Start profiling...\n");
@@ -425,23 +472,21 @@ void Player::run_updates() {
 	std::chrono::high_resolution_clock::time_point begin = std::chrono::high_resolution_clock::now();
 #endif
 	
-	if (remaining_time > 0.0) {
-		av_usleep((int64_t)(remaining_time * 1000000.0));
-	}
-	
-	// Check again after the wait.
-	if (StreamHandler::get_running() == false || StreamHandler::get_fault()) {
-		return; // Playback finished or fault. Return immediately.
-	}
-	
 	remaining_time = REFRESH_RATE;
-	if (cur_stream->show_mode != SHOW_MODE_NONE && (!cur_stream->paused || cur_stream->force_refresh)) {
-		VideoRenderer::video_refresh(cur_stream, &remaining_time);
-	}
+	VideoRenderer::video_refresh(cur_stream, &remaining_time);
+	next_refresh = now + (int64_t) (remaining_time * 1000000.0);
 
 #ifdef PROFILING
 	std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
-	debugfile << "Duration: " << std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() << "µs.\n";
+	debugfile << "Duration: " << std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() << "µs.";
+	
+	// Time spent uploading a new frame to the texture, if one got displayed.
+	int64_t upload = SdlRenderer::takeUploadTime();
+	if (upload >= 0) {
+		debugfile << "\tUpload: " << upload << "µs.";
+	}
+	
+	debugfile << "\n";
 #endif
 
 }
@@ -14,6 +14,9 @@ class Player {
 	
 	static std::atomic_bool run;
 	static double remaining_time;
+	static int64_t next_refresh;		// Time of the next video refresh (av_gettime_relative()).
+	
+	static bool refresh_needed();
 	
 public:
 	Player();
@@ -26,6 +29,7 @@ public:
 	static void refresh_loop(VideoState* is);
 	static bool process_event(SDL_Event &event);
 	static void run_updates();
+	static int next_timeout();
 };
 
 
@@ -9,6 +9,7 @@
 #include "frame_queue.h"
 #include "player.h"
 #include "types.h"
+#include "frame_pacer.h"
 #ifndef TESTING
 #include "../gui.h"
 #endif
@@ -16,6 +17,10 @@
 #include "SDL2/SDL_hints.h"
 #endif
 
+extern "C" {
+#include "libavutil/intreadwrite.h"
+}
+
 
 // Globals
 SDL_AudioDeviceID audio_dev;
@@ -36,6 +41,15 @@ std::atomic<bool> SdlRenderer::guiEventsActive = { false };
 std::atomic<bool> SdlRenderer::updateScreensaver = { false };
 std::atomic<bool> SdlRenderer::windowVisible = { false };
 std::atomic<bool> SdlRenderer::windowShouldBeVisible = { false };
+std::atomic<int64_t> SdlRenderer::uploadTime = { -1 };
+SDL_sem* SdlRenderer::wakeSem = 0;
+std::atomic<SDL_threadID> SdlRenderer::loopThread = { 0 };
+bool SdlRenderer::pacing = false;
+bool SdlRenderer::rateSwitched = false;
+
+
+#define SR_PUMP_INTERVAL 100	// ms between checks for window & input events while a window is shown.
+#define SR_IDLE_INTERVAL 1000	// ms between checks without a window (signals, device changes).
 
 
 bool SdlRenderer::init() {
@@ -65,6 +79,10 @@ bool SdlRenderer::init() {
 
 	SDL_EventState(SDL_SYSWMEVENT, SDL_IGNORE);
 	SDL_EventState(SDL_USEREVENT, SDL_IGNORE);
+	
+	// Wake the event loop when other threads push events.
+	wakeSem = SDL_CreateSemaphore(0);
+	SDL_AddEventWatch(eventWatch, 0);
 
 	if (!display_disable) {
 		// Set up SDL_Image.
@@ -162,6 +180,12 @@ void SdlRenderer::quit() {
 	
 	av_log(NULL, AV_LOG_FATAL, "Quitting...\n");
 	
+	SDL_DelEventWatch(eventWatch, 0);
+	if (wakeSem) {
+		SDL_DestroySemaphore(wakeSem);
+		wakeSem = 0;
+	}
+	
 	IMG_Quit();
 	SDL_Quit();
 }
@@ -320,6 +344,120 @@ static void get_sdl_pix_fmt_and_blendmode(int format, Uint32 *sdl_pix_fmt, SDL_B
 			return;
 		}
 	}
+	for (i = 0; i < FF_ARRAY_ELEMS(sdl_texture_format_conv_map) - 1; i++) {
+		if (format == sdl_texture_format_conv_map[i].format) {
+			*sdl_pix_fmt = sdl_texture_format_conv_map[i].texture_fmt;
+			return;
+		}
+	}
+}
+
+
+// --- TEXTURE PLANES ---
+// Plane pointers & pitches of a locked YUV texture, as SDL lays them out: the Y plane followed
+// by either the interleaved UV plane (NV12/NV21), or the U and V planes (IYUV).
+static void texture_planes(Uint32 format, uint8_t *pixels, int pitch, int height, 
+															uint8_t *planes[3], int pitches[3]) {
+	planes[0] = pixels;
+	pitches[0] = pitch;
+	planes[1] = pixels + pitch * height;
+	if (format == SDL_PIXELFORMAT_IYUV) {
+		pitches[1] = pitches[2] = (pitch + 1) / 2;
+		planes[2] = planes[1] + pitches[1] * ((height + 1) / 2);
+	}
+	else {
+		pitches[1] = 2 * ((pitch + 1) / 2);
+		planes[2] = 0;
+		pitches[2] = 0;
+	}
+}
+
+
+// --- COPY PLANE ---
+// Copy 'rows' rows of 'bytes' bytes into the texture. Planes with a negative linesize are
+// copied bottom-up, as with SDL_UpdateTexture(), and flipped when rendering.
+static void copy_plane(uint8_t *dst, int dst_pitch, const uint8_t *src, int linesize, int bytes, 
+																					int rows) {
+	if (linesize < 0) {
+		src += linesize * (rows - 1);
+		linesize = -linesize;
+	}
+	
+	av_image_copy_plane(dst, dst_pitch, src, linesize, bytes, rows);
+}
+
+
+// --- COPY PLANE 16 TO 8 ---
+// As copy_plane(), for 16-bit little-endian samples, which are shifted right by 'shift' bits
+// to get an 8-bit sample.
+static void copy_plane_16to8(uint8_t *dst, int dst_pitch, const uint8_t *src, int linesize, 
+														int samples, int rows, int shift) {
+	if (linesize < 0) {
+		src += linesize * (rows - 1);
+		linesize = -linesize;
+	}
+	
+	for (int y = 0; y < rows; y++) {
+		const uint8_t *s = src + y * linesize;
+		uint8_t *d = dst + y * dst_pitch;
+		for (int x = 0; x < samples; x++) {
+			d[x] = (uint8_t) (AV_RL16(s + 2 * x) >> shift);
+		}
+	}
+}
+
+
+// --- WRITE TEXTURE PLANES ---
+// Write the planes of a YUV frame straight into the locked streaming texture. Used for NV12/NV21,
+// and for 10-bit formats, which get reduced to 8-bit on the way instead of converted to RGB.
+static int write_texture_planes(SDL_Texture *tex, AVFrame *frame, Uint32 sdl_pix_fmt) {
+	int nb_planes = (sdl_pix_fmt == SDL_PIXELFORMAT_IYUV) ? 3 : 2;
+	for (int i = 1; i < nb_planes; i++) {
+		if ((frame->linesize[i] < 0) != (frame->linesize[0] < 0)) {
+			av_log(NULL, AV_LOG_ERROR, "Mixed negative and positive linesizes are not supported.\n");
+			return -1;
+		}
+	}
+	
+	uint8_t *pixels;
+	int pitch;
+	if (SDL_LockTexture(tex, NULL, (void **) &pixels, &pitch) < 0) {
+		av_log(NULL, AV_LOG_ERROR, "Cannot lock SDL texture: %s\n", SDL_GetError());
+		return -1;
+	}
+	
+	uint8_t *planes[3];
+	int pitches[3];
+	texture_planes(sdl_pix_fmt, pixels, pitch, frame->height, planes, pitches);
+	int chroma_w = AV_CEIL_RSHIFT(frame->width, 1);
+	int chroma_h = AV_CEIL_RSHIFT(frame->height, 1);
+	switch (frame->format) {
+		case AV_PIX_FMT_P010LE:
+			// Samples in the upper 10 bits.
+			copy_plane_16to8(planes[0], pitches[0], frame->data[0], frame->linesize[0], 
+													frame->width, frame->height, 8);
+			copy_plane_16to8(planes[1], pitches[1], frame->data[1], frame->linesize[1], 
+													chroma_w * 2, chroma_h, 8);
+			break;
+		case AV_PIX_FMT_YUV420P10LE:
+			// Samples in the lower 10 bits.
+			copy_plane_16to8(planes[0], pitches[0], frame->data[0], frame->linesize[0], 
+													frame->width, frame->height, 2);
+			copy_plane_16to8(planes[1], pitches[1], frame->data[1], frame->linesize[1], 
+													chroma_w, chroma_h, 2);
+			copy_plane_16to8(planes[2], pitches[2], frame->data[2], frame->linesize[2], 
+													chroma_w, chroma_h, 2);
+			break;
+		default:
+			copy_plane(planes[0], pitches[0], frame->data[0], frame->linesize[0], 
+													frame->width, frame->height);
+			copy_plane(planes[1], pitches[1], frame->data[1], frame->linesize[1], 
+													chroma_w * 2, chroma_h);
+			break;
+	}
+	
+	SDL_UnlockTexture(tex);
+	return 0;
 }
 
 int SdlRenderer::upload_texture(SDL_Texture **tex, AVFrame *frame, struct SwsContext **img_convert_ctx) {
@@ -349,8 +487,14 @@ int SdlRenderer::upload_texture(SDL_Texture **tex, AVFrame *frame, struct SwsCon
 				ret = -1;
 			}
 			break;
+		case SDL_PIXELFORMAT_NV12:
+		case SDL_PIXELFORMAT_NV21:
+			ret = write_texture_planes(*tex, frame, sdl_pix_fmt);
+			break;
 		case SDL_PIXELFORMAT_IYUV:
-			if (frame->linesize[0] > 0 && frame->linesize[1] > 0 && frame->linesize[2] > 0) {
+			if (frame->format != AV_PIX_FMT_YUV420P) {
+				ret = write_texture_planes(*tex, frame, sdl_pix_fmt);
+			} else if (frame->linesize[0] > 0 && frame->linesize[1] > 0 && frame->linesize[2] > 0) {
 				ret = SDL_UpdateYUVTexture(*tex, NULL, frame->data[0], frame->linesize[0],
 													   frame->data[1], frame->linesize[1],
 													   frame->data[2], frame->linesize[2]);
@@ -380,7 +524,9 @@ static void set_sdl_yuv_conversion_mode(AVFrame *frame)
 {
 #if SDL_VERSION_ATLEAST(2,0,8)
 	SDL_YUV_CONVERSION_MODE mode = SDL_YUV_CONVERSION_AUTOMATIC;
-	if (frame && (frame->format == AV_PIX_FMT_YUV420P || frame->format == AV_PIX_FMT_YUYV422 || frame->format == AV_PIX_FMT_UYVY422)) {
+	if (frame && (frame->format == AV_PIX_FMT_YUV420P || frame->format == AV_PIX_FMT_YUYV422 || frame->format == AV_PIX_FMT_UYVY422 ||
+				  frame->format == AV_PIX_FMT_NV12 || frame->format == AV_PIX_FMT_NV21 ||
+				  frame->format == AV_PIX_FMT_P010LE || frame->format == AV_PIX_FMT_YUV420P10LE)) {
 		if (frame->color_range == AVCOL_RANGE_JPEG)
 			mode = SDL_YUV_CONVERSION_JPEG;
 		else if (frame->colorspace == AVCOL_SPC_BT709)
@@ -405,6 +551,76 @@ void SdlRenderer::video_display(VideoState *is) {
 	}
 	
     SDL_RenderPresent(renderer);
+	
+	// With vsync the present returns on the refresh which shows the frame.
+	FramePacer::presentDone(av_gettime_relative(), (renderer_info.flags & SDL_RENDERER_PRESENTVSYNC) != 0);
+}
+
+
+// --- START PACING ---
+// Set up frame pacing for a new video stream. With refresh_rate_match and a full-screen window, the
+// display is switched to a mode with the same size and a refresh rate which is a multiple of the
+// frame rate (0 if unknown), where the display has one.
+void SdlRenderer::start_pacing(double fps) {
+	if (pacing) { stop_pacing(false); }
+	
+	int rate = 0;
+	int displayIndex = window ? SDL_GetWindowDisplayIndex(window) : -1;
+	SDL_DisplayMode current;
+	if (displayIndex >= 0 && SDL_GetCurrentDisplayMode(displayIndex, &current) == 0) {
+		rate = current.refresh_rate;
+		if (refresh_rate_match && is_full_screen && fps > 0.0) {
+			std::vector<SDL_DisplayMode> modes;
+			std::vector<int> rates;
+			int count = SDL_GetNumDisplayModes(displayIndex);
+			for (int i = 0; i < count; i++) {
+				SDL_DisplayMode mode;
+				if (SDL_GetDisplayMode(displayIndex, i, &mode) != 0) { continue; }
+				if (mode.w != current.w || mode.h != current.h) { continue; }
+				
+				modes.push_back(mode);
+				rates.push_back(mode.refresh_rate);
+			}
+			
+			int match = FramePacer::matchRate(fps, rates, current.refresh_rate);
+			for (size_t i = 0; i < modes.size() && match != 0 && match != current.refresh_rate; i++) {
+				if (modes[i].refresh_rate != match) { continue; }
+				
+				// The display mode only applies to exclusive full-screen windows.
+				if (SDL_SetWindowDisplayMode(window, &modes[i]) == 0 && 
+									SDL_SetWindowFullscreen(window, SDL_WINDOW_FULLSCREEN) == 0) {
+					av_log(NULL, AV_LOG_INFO, "Switched display to %d Hz for %.3f fps.\n", match, fps);
+					rate = match;
+					rateSwitched = true;
+				}
+				else {
+					av_log(NULL, AV_LOG_WARNING, "Failed to switch display to %d Hz: %s\n", match, 
+																				SDL_GetError());
+				}
+				
+				break;
+			}
+		}
+	}
+	
+	FramePacer::reset(rate);
+	pacing = true;
+}
+
+
+// --- STOP PACING ---
+// Report the frame statistics of the stream, and restore the display mode if 'restore' is set.
+void SdlRenderer::stop_pacing(bool restore) {
+	FramePacerStats stats = FramePacer::stats();
+	av_log(NULL, AV_LOG_INFO, "Video frames presented: %" PRIu64 ", dropped: %" PRIu64 
+							", repeated: %" PRIu64 ".\n", stats.presented, stats.dropped, stats.repeated);
+	
+	if (restore && rateSwitched) {
+		SDL_SetWindowFullscreen(window, is_full_screen ? SDL_WINDOW_FULLSCREEN_DESKTOP : 0);
+		rateSwitched = false;
+	}
+	
+	pacing = false;
 }
 
 
@@ -448,11 +664,79 @@ void SdlRenderer::image_display(std::string image) {
 }
 
 
+// --- EVENT WATCH ---
+// Called for each event which is added to the queue, before it is added.
+int SdlRenderer::eventWatch(void* userdata, SDL_Event* event) {
+	// Events from pumping happen on the loop thread itself.
+	if (SDL_ThreadID() != loopThread) { wake(); }
+	return 0;
+}
+
+
+// --- WAKE ---
+// Have the event loop run. Also used from the SIGINT handler, via stop_event_loop(): posting
+// uses sem_post() on POSIX platforms.
+void SdlRenderer::wake() {
+	if (wakeSem) { SDL_SemPost(wakeSem); }
+}
+
+
+// --- NEXT TIMEOUT ---
+// Milliseconds until the loop has updates to run without new events, or -1 if there are none.
+int SdlRenderer::next_timeout() {
+	if (updateScreensaver) { return 0; }
+	if (playerEventsActive) { return Player::next_timeout(); }
+#ifndef TESTING
+	if (guiEventsActive) { return Gui::next_timeout(); }
+#endif
+	
+	return -1;
+}
+
+
+// --- WAIT EVENT ---
+// Wait for an event for up to 'timeout' ms, or without limit if negative. Returns false if no
+// event arrived.
+// SDL_WaitEventTimeout() is not used: it only blocks in the OS with SDL 2.0.16+ and a video
+// backend which supports it. Otherwise (no video on audio-only receivers, KMSDRM) it polls
+// every millisecond. Instead the loop sleeps on a semaphore which is posted when other threads
+// push events, and pumps window & input events at SR_PUMP_INTERVAL while a window is shown.
+bool SdlRenderer::wait_event(SDL_Event* event, int timeout) {
+	uint32_t start = SDL_GetTicks();
+	bool woken = false;
+	while (run_events) {
+		if (SDL_PollEvent(event)) { return true; }
+		
+		int wait = (window && windowVisible) ? SR_PUMP_INTERVAL : SR_IDLE_INTERVAL;
+		if (woken) {
+			// The watch runs just before the event is queued. Check again shortly.
+			wait = 1;
+		}
+		
+		if (timeout >= 0) {
+			int left = timeout - (int) (SDL_GetTicks() - start);
+			if (left <= 0) { return false; }
+			if (left < wait) { wait = left; }
+		}
+		
+		if (wakeSem) { woken = SDL_SemWaitTimeout(wakeSem, wait) == 0; }
+		else { SDL_Delay(wait); }
+	}
+	
+	return false;
+}
+
+
+// --- RUN EVENT LOOP ---
+// Runs on the main thread. Sleeps until an event arrives, or the player, GUI or screensaver
+// has an update due.
 void SdlRenderer::run_event_loop() {
 	run_events = true;
+	loopThread = SDL_ThreadID();
 	SDL_Event event;
 	while (run_events) {
-		while (SDL_PollEvent(&event)) {
+		bool pending = wait_event(&event, next_timeout());
+		while (pending) {
 			// Check for quit events.
 			switch (event.type) {
 				case SDL_WINDOWEVENT:  {
@@ -509,37 +793,28 @@ void SdlRenderer::run_event_loop() {
 			}
 #endif
 			
+			pending = SDL_PollEvent(&event);
 		}
 		
-		// Update player, UI, etc.
+		// Playback ended: restore the display mode.
+		if (pacing && !playerEventsActive) { stop_pacing(true); }
+		
+		// Update player, UI, etc. These return right away if nothing is due yet.
 		if (updateScreensaver) {
 			// Load the new screensaver image from the updated path.
-			image_display(screensaverPath);
 			updateScreensaver = false;
-			continue;
+			image_display(screensaverPath);
 		}
-		
-		if (playerEventsActive) {
+		else if (playerEventsActive) {
 			// Trigger player refresh.
 			Player::run_updates();
-			continue;
 		}
-		
 #ifndef TESTING
-		// Update GUI if active.
-		if (guiEventsActive) {
+		else if (guiEventsActive) {
+			// Update GUI if active.
 			Gui::run_updates();
 		}
 #endif
-		
-		// Pause for a bit to ease off on the CPU load.
-		if (playerEventsActive) {
-			// No delay.
-			continue;
-		}
-		else {
-			SDL_Delay(10);
-		}
 	}
 
 	// Final check in case playback is still running.
@@ -552,6 +827,7 @@ void SdlRenderer::run_event_loop() {
 
 void SdlRenderer::stop_event_loop() {
 	run_events = false;
+	wake();
 }
 
 
@@ -559,19 +835,22 @@ void SdlRenderer::stop_event_loop() {
 void SdlRenderer::playerEvents(bool active) {
 	//av_log(NULL, AV_LOG_WARNING, "Toggling playerEvents: %d.\n", active);
 	playerEventsActive = active;
+	wake();
 }
 
 
 // --- GUI EVENTS ---
 void SdlRenderer::guiEvents(bool active) {
 	guiEventsActive = active;
+	wake();
 }
 
 
 // --- SCREENSAVER UPDATE ---
 void SdlRenderer::screensaverUpdate(std::string path) {
-	updateScreensaver = true;
 	screensaverPath = path;
+	updateScreensaver = true;
+	wake();
 }
 
 
@@ -631,8 +910,10 @@ void SdlRenderer::video_image_display(VideoState *is) {
 
 	if (!vp->uploaded) {
 		// FIXME: if upload_texture fails, we cannot just continue.
+		int64_t upload_start = av_gettime_relative();
 		if (upload_texture(&is->vid_texture, vp->frame, &is->img_convert_ctx) < 0)
 			return;
+		uploadTime = av_gettime_relative() - upload_start;
 		vp->uploaded = 1;
 		vp->flip_v = vp->frame->linesize[0] < 0;
 	}
@@ -25,7 +25,17 @@ class SdlRenderer {
 	static std::atomic<bool> updateScreensaver;
 	static std::atomic<bool> windowVisible;
 	static std::atomic<bool> windowShouldBeVisible;
+	static std::atomic<int64_t> uploadTime;	// Duration of the last texture upload, in us.
+	static SDL_sem* wakeSem;				// Posted when the event loop has to run.
+	static std::atomic<SDL_threadID> loopThread;
+	static bool pacing;						// Whether a video stream is being paced.
+	static bool rateSwitched;				// Whether the display mode was switched for a stream.
 	
+	static int eventWatch(void* userdata, SDL_Event* event);
+	static void wake();
+	static int next_timeout();
+	static bool wait_event(SDL_Event* event, int timeout);
+	static void stop_pacing(bool restore);
 	static void fill_rectangle(int x, int y, int w, int h);
 	static int realloc_texture(SDL_Texture **texture, Uint32 new_format, int new_width, 
 								int new_height, SDL_BlendMode blendmode, int init_texture);
@@ -42,6 +52,7 @@ public:
 	static void set_fullscreen(bool fullscreen);
 	static SDL_Window* getSdlWindow() { return window; }
 	static void video_display(VideoState *is);
+	static void start_pacing(double fps);
 	static void image_display(std::string image);
 	static void run_event_loop();
 	static void stop_event_loop();
@@ -50,6 +61,7 @@ public:
 	static void screensaverUpdate(std::string path);
 	static void video_audio_display(VideoState *s);
 	static void video_image_display(VideoState *is);
+	static int64_t takeUploadTime() { return uploadTime.exchange(-1); }
 };
 
 
@@ -10,7 +10,8 @@
 #include "sdl_renderer.h"
 #include "player.h"
 #include "ffplay.h"
-#include "../databuffer.h"
+#include "../session_registry.h"
+#include "../clock_sync.h"
 
 #include "stream_handler.h"
 
@@ -31,6 +32,12 @@ std::atomic<bool> StreamHandler::eof;
 std::atomic<bool> StreamHandler::fault = { false };
 std::atomic<bool> StreamHandler::running = { false };
 
+AVFormatContext* StreamHandler::prepared_ic = 0;
+std::string StreamHandler::prepared_name;
+SDL_Thread* StreamHandler::prepare_tid = 0;
+std::atomic<bool> StreamHandler::prepare_abort = { false };
+std::atomic<int> StreamHandler::prepare_ret = { -1 };
+
 AVDictionary *sws_dict;
 AVDictionary *swr_opts;
 AVDictionary *format_opts, *codec_opts, *resample_opts;
@@ -207,6 +214,92 @@ extern "C" {
 }
 
 
+static AVBufferRef *hw_device_ref = NULL;	// Hardware device, kept open between streams.
+static enum AVHWDeviceType hw_device_type = AV_HWDEVICE_TYPE_NONE;
+static enum AVPixelFormat hw_pix_fmt = AV_PIX_FMT_NONE;
+
+
+static enum AVPixelFormat get_hw_format(AVCodecContext *avctx, const enum AVPixelFormat *pix_fmts) {
+	for (const enum AVPixelFormat *p = pix_fmts; *p != AV_PIX_FMT_NONE; p++) {
+		if (*p == hw_pix_fmt) { return *p; }
+	}
+	
+	av_log(avctx, AV_LOG_WARNING, "Hardware surface format not offered, decoding in software.\n");
+	return avcodec_default_get_format(avctx, pix_fmts);
+}
+
+
+// --- HW DECODER INIT ---
+// Set up hardware decoding of a video stream, using the method set with 'hwaccel'. With
+// 'v4l2m2m' the codec gets replaced by the V4L2 M2M decoder for the same codec ID.
+// Returns true if hardware decoding was set up, false if the stream is to be decoded in software.
+static bool hw_decoder_init(AVCodecContext *avctx, AVCodec **codec) {
+	if (hwaccel.empty() || hwaccel == "none") { return false; }
+	
+	if (hwaccel == "v4l2m2m") {
+		void *it = NULL;
+		const AVCodec *c;
+		while ((c = av_codec_iterate(&it))) {
+			if (c->id == avctx->codec_id && av_codec_is_decoder(c) && strstr(c->name, "_v4l2m2m")) {
+				av_log(NULL, AV_LOG_INFO, "Using V4L2 M2M decoder %s.\n", c->name);
+				*codec = (AVCodec*) c;
+				return true;
+			}
+		}
+		
+		av_log(NULL, AV_LOG_INFO, "No V4L2 M2M decoder for %s, decoding in software.\n",
+																avcodec_get_name(avctx->codec_id));
+		return false;
+	}
+	
+	// With 'auto' any device type the codec supports will do, in the codec's order of preference.
+	enum AVHWDeviceType type = AV_HWDEVICE_TYPE_NONE;
+	if (hwaccel != "auto") {
+		type = av_hwdevice_find_type_by_name(hwaccel.c_str());
+		if (type == AV_HWDEVICE_TYPE_NONE) {
+			av_log(NULL, AV_LOG_ERROR, "Unknown hwaccel '%s', decoding in software.\n", hwaccel.c_str());
+			return false;
+		}
+	}
+	
+	for (int i = 0; ; i++) {
+		const AVCodecHWConfig *config = avcodec_get_hw_config(*codec, i);
+		if (!config) { break; }
+		if (!(config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX)) { continue; }
+		if (type != AV_HWDEVICE_TYPE_NONE && config->device_type != type) { continue; }
+		
+		// Reuse the device opened for an earlier stream. It is only replaced once the new one
+		// opened, so that a failure keeps the working device.
+		if (!hw_device_ref || hw_device_type != config->device_type) {
+			AVBufferRef* device = NULL;
+			if (av_hwdevice_ctx_create(&device, config->device_type, NULL, NULL, 0) < 0) {
+				av_log(NULL, AV_LOG_WARNING, "Failed to open %s device.\n",
+													av_hwdevice_get_type_name(config->device_type));
+				continue;
+			}
+			
+			av_buffer_unref(&hw_device_ref);
+			hw_device_ref = device;
+			hw_device_type = config->device_type;
+		}
+		
+		avctx->hw_device_ctx = av_buffer_ref(hw_device_ref);
+		if (!avctx->hw_device_ctx) { return false; }
+		
+		hw_pix_fmt = config->pix_fmt;
+		avctx->get_format = get_hw_format;
+		
+		av_log(NULL, AV_LOG_INFO, "Using %s hardware decoding for %s.\n",
+						av_hwdevice_get_type_name(config->device_type), avcodec_get_name(avctx->codec_id));
+		return true;
+	}
+	
+	av_log(NULL, AV_LOG_INFO, "No hardware decoding for %s, decoding in software.\n",
+																avcodec_get_name(avctx->codec_id));
+	return false;
+}
+
+
 /* open a given stream. Return 0 if OK */
 int StreamHandler::stream_component_open(VideoState *is, int stream_index) {
     AVFormatContext *ic = is->ic;
@@ -220,12 +313,15 @@ int StreamHandler::stream_component_open(VideoState *is, int stream_index) {
     //int64_t channel_layout;
     int ret = 0;
     int stream_lowres = lowres;
+    bool hw_decode = false;
+    bool hw_failed = false;
 
     if (stream_index < 0 || stream_index >= ic->nb_streams) {
 		av_log(NULL, AV_LOG_ERROR, "stream_index: %d, ic->nb_streams: %d.\n", stream_index, ic->nb_streams);
         return -1;
 	}
 
+retry:
     avctx = avcodec_alloc_context3(NULL);
     if (!avctx) {
 		av_log(NULL, AV_LOG_ERROR, "avcodec_alloc_context3() failed.\n");
@@ -289,13 +385,20 @@ int StreamHandler::stream_component_open(VideoState *is, int stream_index) {
 	
 	av_dict_set(&opts, "flags", "+copy_opaque", AV_DICT_MULTIKEY);
 
-    /* if (avctx->codec_type == AVMEDIA_TYPE_VIDEO) {
-        ret = create_hwaccel(&avctx->hw_device_ctx);
-        if (ret < 0)
-            goto fail;
-    } */
+    if (avctx->codec_type == AVMEDIA_TYPE_VIDEO && !forced_codec_name && !hw_failed)
+        hw_decode = hw_decoder_init(avctx, &codec);
 	
     if ((ret = avcodec_open2(avctx, codec, &opts)) < 0) {
+		if (hw_decode) {
+			// Fall back to software decoding for this stream.
+			av_log(NULL, AV_LOG_WARNING, "Opening hardware decoder failed, decoding in software.\n");
+			avcodec_free_context(&avctx);
+			av_dict_free(&opts);
+			hw_decode = false;
+			hw_failed = true;
+			goto retry;
+		}
+		
 		av_log(NULL, AV_LOG_ERROR, "avcodec_open2() failed.\n");
         goto fail;
     }
@@ -396,6 +499,9 @@ int StreamHandler::stream_component_open(VideoState *is, int stream_index) {
     default:
         break;
     }
+	
+	// Have the event loop pick up the new stream for its refresh timeout.
+	SdlRenderer::wake();
     goto out;
 
 fail:
@@ -407,7 +513,7 @@ out:
     return ret;
 }
 
-static void stream_component_close(VideoState *is, int stream_index)
+static void stream_component_close(VideoState *is, int stream_index, bool keepAudio = false)
 {
     AVFormatContext *ic = is->ic;
     AVCodecParameters *codecpar;
@@ -419,8 +525,7 @@ static void stream_component_close(VideoState *is, int stream_index)
     switch (codecpar->codec_type) {
     case AVMEDIA_TYPE_AUDIO:
         DecoderC::decoder_abort(&is->auddec, &is->sampq);
-		av_log(NULL, AV_LOG_INFO, "Closing audio device...\n");
-        SDL_CloseAudioDevice(audio_dev);
+        AudioRenderer::audio_close(keepAudio);
         DecoderC::decoder_destroy(&is->auddec);
         swr_free(&is->swr_ctx);
         av_freep(&is->audio_buf1);
@@ -466,7 +571,7 @@ static void stream_component_close(VideoState *is, int stream_index)
     }
 }
 
-void StreamHandler::stream_close(VideoState *is) {
+void StreamHandler::stream_close(VideoState *is, bool keepAudio) {
     /* XXX: use a special url_shutdown call to abort parse cleanly */
     is->abort_request = 1;
     SDL_WaitThread(is->read_tid, NULL);
@@ -474,7 +579,7 @@ void StreamHandler::stream_close(VideoState *is) {
     /* close each stream */
     if (is->audio_stream >= 0)
 		av_log(NULL, AV_LOG_INFO, "Closing audio stream component...\n");
-        stream_component_close(is, is->audio_stream);
+        stream_component_close(is, is->audio_stream, keepAudio);
     if (is->video_stream >= 0)
         stream_component_close(is, is->video_stream);
     if (is->subtitle_stream >= 0)
@@ -590,53 +695,15 @@ static double vp_duration(VideoState *is, Frame *vp, Frame *nextvp) {
 } */
 
 
-/* this thread gets the stream from the disk or the network */
-int StreamHandler::read_thread(void *arg) {
-#ifdef PROFILING_SH
-	if (!debugfile.is_open()) {
-		debugfile.open("profiling_read_thread.txt");
-	}
-#endif
-
-    VideoState *is = (VideoState*) arg;
-	AVFormatContext* ic = is->ic;
-	
-    int err, i, ret;
-    int st_index[AVMEDIA_TYPE_NB];
-    AVPacket pkt1, *pkt = &pkt1;
-    int64_t stream_start_time;
-    int pkt_in_play_range = 0;
+// --- OPEN INPUT ---
+// Open the input and probe its streams. Used by the read thread, and ahead of time by the
+// prepare thread for a gapless transition.
+// Returns 0 on success, or a negative value on error.
+static int open_input(AVFormatContext** pic, const char* filename, AVInputFormat* iformat) {
+	AVFormatContext* ic = *pic;
+    int err, i;
     AVDictionaryEntry *t;
-    SDL_mutex *wait_mutex = SDL_CreateMutex();
     int scan_all_pmts_set = 0;
-    int64_t pkt_ts;
-	
-	std::atomic<double> last_position = { 0 };
-
-    if (!wait_mutex) {
-        av_log(NULL, AV_LOG_FATAL, "SDL_CreateMutex(): %s\n", SDL_GetError());
-        ret = AVERROR(ENOMEM);
-        goto fail;
-    }
-
-    memset(st_index, -1, sizeof(st_index));
-    is->last_video_stream = is->video_stream = -1;
-    is->last_audio_stream = is->audio_stream = -1;
-    is->last_subtitle_stream = is->subtitle_stream = -1;
-    is->eof = 0;
-
-    if (ic == 0) {
-		ic = avformat_alloc_context();
-		if (!ic) {
-			av_log(NULL, AV_LOG_FATAL, "Could not allocate context.\n");
-			ret = AVERROR(ENOMEM);
-			goto fail;
-		}
-		
-		ic->interrupt_callback.callback = decode_interrupt_cb;
-		ic->interrupt_callback.opaque = is;
-		is->ic = ic;
-	}
 	
     if (!av_dict_get(format_opts, "scan_all_pmts", NULL, AV_DICT_MATCH_CASE)) {
         av_dict_set(&format_opts, "scan_all_pmts", "1", AV_DICT_DONT_OVERWRITE);
@@ -646,16 +713,14 @@ int StreamHandler::read_thread(void *arg) {
 	// Open the input file or stream.
 	// If in slave mode, ignore any errors here.
 #ifdef __ANDROID__
-    err = avformat_open_input(&ic, is->filename, is->iformat, NULL);
+    err = avformat_open_input(&ic, filename, iformat, NULL);
 #else
-    err = avformat_open_input(&ic, is->filename, is->iformat, &format_opts);
+    err = avformat_open_input(&ic, filename, iformat, &format_opts);
 #endif
+	*pic = ic;	// Freed & set to null on failure.
     if (err < 0) {
-        print_error(is->filename, err);
-		if (serverMode != NCS_MODE_SLAVE) {
-			ret = -1;
-			goto fail;
-		}
+        print_error(filename, err);
+		if (serverMode != NCS_MODE_SLAVE) { return -1; }
     }
 	
 	// Log stream info.
@@ -670,8 +735,7 @@ int StreamHandler::read_thread(void *arg) {
 
     if ((t = av_dict_get(format_opts, "", NULL, AV_DICT_IGNORE_SUFFIX))) {
         av_log(NULL, AV_LOG_ERROR, "Option %s not found.\n", t->key);
-        ret = AVERROR_OPTION_NOT_FOUND;
-        goto fail;
+        return AVERROR_OPTION_NOT_FOUND;
     }
 
     if (genpts)
@@ -697,11 +761,70 @@ int StreamHandler::read_thread(void *arg) {
 #endif
 
         if (err < 0) {
-            av_log(NULL, AV_LOG_WARNING, "%s: could not find codec parameters\n", is->filename);
-            ret = -1;
-            goto fail;
+            av_log(NULL, AV_LOG_WARNING, "%s: could not find codec parameters\n", filename);
+            return -1;
         }
     }
+	
+	return 0;
+}
+
+
+/* this thread gets the stream from the disk or the network */
+int StreamHandler::read_thread(void *arg) {
+#ifdef PROFILING_SH
+	if (!debugfile.is_open()) {
+		debugfile.open("profiling_read_thread.txt");
+	}
+#endif
+
+    VideoState *is = (VideoState*) arg;
+	AVFormatContext* ic = is->ic;
+	
+    int i, ret;
+    int st_index[AVMEDIA_TYPE_NB];
+    AVPacket pkt1, *pkt = &pkt1;
+    int64_t stream_start_time;
+    int pkt_in_play_range = 0;
+    AVDictionaryEntry *t;
+    SDL_mutex *wait_mutex = SDL_CreateMutex();
+    int64_t pkt_ts;
+	
+	std::atomic<double> last_position = { 0 };
+
+    if (!wait_mutex) {
+        av_log(NULL, AV_LOG_FATAL, "SDL_CreateMutex(): %s\n", SDL_GetError());
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    memset(st_index, -1, sizeof(st_index));
+    is->last_video_stream = is->video_stream = -1;
+    is->last_audio_stream = is->audio_stream = -1;
+    is->last_subtitle_stream = is->subtitle_stream = -1;
+    is->eof = 0;
+
+    if (ic == 0) {
+		ic = avformat_alloc_context();
+		if (!ic) {
+			av_log(NULL, AV_LOG_FATAL, "Could not allocate context.\n");
+			ret = AVERROR(ENOMEM);
+			goto fail;
+		}
+		
+		ic->interrupt_callback.callback = decode_interrupt_cb;
+		ic->interrupt_callback.opaque = is;
+		is->ic = ic;
+	}
+	
+    if (is->probed) {
+		// Opened & probed ahead of time for a gapless transition. Take over the interrupts.
+		ic->interrupt_callback.callback = decode_interrupt_cb;
+		ic->interrupt_callback.opaque = is;
+	}
+	else if ((ret = open_input(&ic, is->filename, is->iformat)) < 0) {
+		goto fail;
+	}
 
     if (ic->pb) {
         ic->pb->eof_reached = 0; // FIXME hack, ffplay maybe should not use avio_feof() to test for the end
@@ -858,16 +981,22 @@ int StreamHandler::read_thread(void *arg) {
 	sendGlobalStatusUpdate();
 	
 	// Buffering ahead can now commence as all headers etc. should have been seeked to.
-	DataBuffer::startBufferAhead();
+	{
+		std::shared_ptr<DataBuffer> db = SessionRegistry::getActive();
+		if (db) { db->startBufferAhead(); }
+	}
 	
-	// TODO: Start slave playback here if we're in master mode. In slave mode wait here.
+	// In slave mode wait for the start time from the master, then start on that time. In master
+	// mode schedule the start of the slaves, which returns at the shared start time.
 	if (serverMode == NCS_MODE_SLAVE) {
 		slavePlayMutex.lock();
-		slavePlayCon.wait(slavePlayMutex);
+		while (slaveStartTime == 0) { slavePlayCon.wait(slavePlayMutex); }
+		int64_t start = slaveStartTime.exchange(0);
 		slavePlayMutex.unlock();
+		
+		ClockSync::waitUntil(start);
 	}
 	else if (serverMode == NCS_MODE_MASTER) {
-		//
 		startSlavePlayback();
 	}
 
@@ -875,6 +1004,9 @@ int StreamHandler::read_thread(void *arg) {
 	run = true;
 	eof = false;
 	running = true;
+	
+	// Player::next_timeout() only schedules refreshes once running, so let the loop recompute it.
+	SdlRenderer::wake();
 	while (run) {
         if (is->abort_request) { break; }
         if (is->paused != is->last_paused) {
@@ -961,7 +1093,8 @@ int StreamHandler::read_thread(void *arg) {
         }
 		
         if (!is->paused &&
-            (!is->audio_st || (is->auddec.finished == is->audioq.serial && FrameQueueC::frame_queue_nb_remaining(&is->sampq) == 0)) &&
+            (!is->audio_st || (is->auddec.finished == is->audioq.serial && FrameQueueC::frame_queue_nb_remaining(&is->sampq) == 0 &&
+														is->audio_drained)) &&
             (!is->video_st || (is->viddec.finished == is->videoq.serial && FrameQueueC::frame_queue_nb_remaining(&is->pictq) == 0))) {
             if (loop != 1 && (!loop || --loop)) {
                 StreamHandler::stream_seek(is, start_time != AV_NOPTS_VALUE ? start_time : 0, 0, 0);
@@ -1094,8 +1227,10 @@ fail:
 	AudioRenderer::quit();
 	VideoRenderer::quit();
 	
-	// Signal the player thread that the playback has ended.
+	// Signal the player thread that the playback has ended. It holds the mutex while not waiting.
+	playerMutex.lock();
 	playerCon.signal();
+	playerMutex.unlock();
 	
 	SDL_DestroyMutex(wait_mutex);
 	
@@ -1110,7 +1245,7 @@ fail:
 }
 
 VideoState* StreamHandler::stream_open(const char *filename, AVInputFormat *iformat, 	
-																AVFormatContext* context) {
+																AVFormatContext* context, bool probed) {
     VideoState *is;
 
     is = (VideoState*) av_mallocz(sizeof(VideoState));
@@ -1174,6 +1309,7 @@ VideoState* StreamHandler::stream_open(const char *filename, AVInputFormat *ifor
     is->muted = 0;
     is->av_sync_type = av_sync_type;
 	is->ic = context;
+	is->probed = probed;
     is->read_tid     = SDL_CreateThread(read_thread, "read_thread", is);
     if (!is->read_tid) {
         av_log(NULL, AV_LOG_FATAL, "SDL_CreateThread(): %s\n", SDL_GetError());
@@ -1183,6 +1319,94 @@ VideoState* StreamHandler::stream_open(const char *filename, AVInputFormat *ifor
     return is;
 }
 
+static int prepare_interrupt_cb(void *ctx) {
+	return ((std::atomic<bool>*) ctx)->load();
+}
+
+
+// --- PREPARE THREAD ---
+int StreamHandler::prepare_thread(void *arg) {
+	prepare_ret = open_input(&prepared_ic, prepared_name.c_str(), file_iformat);
+	
+	av_log(NULL, AV_LOG_INFO, "Prepared next stream '%s': %d.\n", prepared_name.c_str(),
+																			prepare_ret.load());
+	
+	return 0;
+}
+
+
+// --- STREAM PREPARE ---
+// Open and probe the next stream in the background while the current one plays. Either a URL,
+// or an empty filename with a context using custom IO. Ownership of the context passes to the
+// StreamHandler, its IO context stays with the caller.
+// Returns false if the prepare thread could not be started.
+bool StreamHandler::stream_prepare(const char *filename, AVFormatContext* context) {
+	stream_prepare_cancel();
+	
+	AVFormatContext* ic = context;
+	if (!ic) {
+		ic = avformat_alloc_context();
+		if (!ic) { return false; }
+	}
+	
+	ic->interrupt_callback.callback = prepare_interrupt_cb;
+	ic->interrupt_callback.opaque = &prepare_abort;
+	prepared_ic = ic;
+	prepared_name = filename;
+	prepare_abort = false;
+	prepare_ret = -1;
+	prepare_tid = SDL_CreateThread(prepare_thread, "prepare_thread", 0);
+	if (!prepare_tid) {
+		av_log(NULL, AV_LOG_ERROR, "SDL_CreateThread(): %s\n", SDL_GetError());
+		avformat_free_context(prepared_ic);
+		prepared_ic = 0;
+		return false;
+	}
+	
+	return true;
+}
+
+
+// --- STREAM PREPARE WAIT ---
+// Wait for the prepare thread to finish, if running.
+void StreamHandler::stream_prepare_wait() {
+	if (prepare_tid) {
+		SDL_WaitThread(prepare_tid, NULL);
+		prepare_tid = 0;
+	}
+}
+
+
+// --- STREAM PREPARED ---
+// Take the prepared context for 'filename'. Pass it to stream_open() with 'probed' set.
+// Returns the context, or null if none was prepared for this stream or probing failed.
+AVFormatContext* StreamHandler::stream_prepared(const char *filename) {
+	stream_prepare_wait();
+	
+	AVFormatContext* ic = prepared_ic;
+	prepared_ic = 0;
+	if (!ic) { return 0; }
+	if (prepare_ret < 0 || prepared_name != filename) {
+		avformat_close_input(&ic);
+		return 0;
+	}
+	
+	return ic;
+}
+
+
+// --- STREAM PREPARE CANCEL ---
+// Abort preparing and drop any prepared context.
+void StreamHandler::stream_prepare_cancel() {
+	prepare_abort = true;
+	stream_prepare_wait();
+	
+	if (prepared_ic) {
+		avformat_close_input(&prepared_ic);
+	}
+}
+
+
 void StreamHandler::stream_cycle_channel(VideoState *is, int codec_type) {
     AVFormatContext *ic = is->ic;
     int start_index, stream_index;
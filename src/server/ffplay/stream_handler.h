@@ -7,6 +7,7 @@
 #include "types.h"
 
 #include <atomic>
+#include <string>
 
 
 class StreamHandler {
@@ -17,12 +18,24 @@ class StreamHandler {
 	static std::atomic<bool> fault;
 	static std::atomic<bool> running;
 	
+	static AVFormatContext* prepared_ic;	// Next stream, opened & probed ahead of time.
+	static std::string prepared_name;
+	static SDL_Thread* prepare_tid;
+	static std::atomic<bool> prepare_abort;
+	static std::atomic<int> prepare_ret;
+	
 	static int read_thread(void *arg);
+	static int prepare_thread(void *arg);
 	
 public:
-	static VideoState *stream_open(const char *filename, AVInputFormat *iformat, AVFormatContext* context);
+	static VideoState *stream_open(const char *filename, AVInputFormat *iformat, AVFormatContext* context,
+																			bool probed = false);
 	static int stream_component_open(VideoState *is, int stream_index);
-	static void stream_close(VideoState *is);
+	static void stream_close(VideoState *is, bool keepAudio = false);
+	static bool stream_prepare(const char *filename, AVFormatContext* context);
+	static void stream_prepare_wait();
+	static AVFormatContext* stream_prepared(const char *filename);
+	static void stream_prepare_cancel();
 	static int get_master_sync_type(VideoState *is);
 	static void stream_toggle_pause(VideoState *is);
 	static void stream_seek(VideoState *is, int64_t pos, int64_t rel, int seek_by_bytes);
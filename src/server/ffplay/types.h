@@ -29,6 +29,7 @@ extern "C" {
 #include "libavutil/samplefmt.h"
 #include "libavutil/avassert.h"
 #include "libavutil/time.h"
+#include "libavutil/hwcontext.h"
 #include "libavformat/avformat.h"
 #include "libavdevice/avdevice.h"
 #include "libswscale/swscale.h"
@@ -72,6 +73,15 @@ extern "C" {
 /* maximum audio speed change to get correct sync */
 #define SAMPLE_CORRECTION_PERCENT_MAX 10
 
+/* slave receivers: no correction below this difference to the master audio clock */
+#define SLAVE_SYNC_THRESHOLD 0.0005
+/* slave receivers: larger differences are not corrected (seek, track change) */
+#define SLAVE_SYNC_MAX_DIFF 0.1
+/* slave receivers: master audio clock references older than this are ignored, in us */
+#define SLAVE_SYNC_MAX_AGE 3000000
+/* slave receivers: maximum audio speed change to follow the master, in per mille */
+#define SLAVE_CORRECTION_PERMILLE 5
+
 /* external clock speed adjustment constants for realtime sources based on buffer fullness */
 #define EXTERNAL_CLOCK_SPEED_MIN  0.900
 #define EXTERNAL_CLOCK_SPEED_MAX  1.010
@@ -92,14 +102,21 @@ extern "C" {
 #define USE_ONEPASS_SUBTITLE_RENDER 1
 
 
+/* packet queue nodes come from a per-queue pool, which grows by this many nodes at a time */
+#define PACKET_POOL_CHUNK 128
+
 typedef struct MyAVPacketList {
-	AVPacket pkt;
+	AVPacket *pkt;		// Owned by the node. Blank while the node is on the free list.
 	struct MyAVPacketList *next;
 	int serial;
+	int flush;			// Marks a flush_pkt.
 } MyAVPacketList;
 
 typedef struct PacketQueue {
 	MyAVPacketList *first_pkt, *last_pkt;
+	MyAVPacketList *free_pkt;	// Free list of the node pool.
+	MyAVPacketList **pool;		// Allocated node chunks.
+	int nb_pool;
 	std::atomic<int> nb_packets;
 	std::atomic<int> size;
 	int64_t duration;
@@ -203,6 +220,7 @@ struct VideoState {
 	SDL_Thread *read_tid;
 	AVInputFormat *iformat;
 	int abort_request;
+	int probed;		// Input was opened & probed ahead of time (gapless transition).
 	std::atomic<int> force_refresh;
 	std::atomic<int> paused;
 	int last_paused;
@@ -246,6 +264,7 @@ struct VideoState {
 	unsigned int audio_buf1_size;
 	int audio_buf_index; /* in bytes */
 	int audio_write_buf_size;
+	std::atomic<int> audio_drained;		// All decoded audio has been handed to the device.
 	int audio_volume;
 	int muted;
 	struct AudioParams audio_src;
@@ -277,6 +296,7 @@ struct VideoState {
 	PacketQueue subtitleq;
 
 	double frame_timer;
+	int pacing_started;			// Whether the display has been set up for the frame rate.
 	double frame_last_returned_time;
 	double frame_last_filter_delay;
 	int video_stream;
@@ -335,6 +355,16 @@ static const TextureFormatEntry sdl_texture_format_map[] = {
 	{ AV_PIX_FMT_YUV420P,		SDL_PIXELFORMAT_IYUV },
 	{ AV_PIX_FMT_YUYV422,		SDL_PIXELFORMAT_YUY2 },
 	{ AV_PIX_FMT_UYVY422,		SDL_PIXELFORMAT_UYVY },
+	{ AV_PIX_FMT_NV12,		   SDL_PIXELFORMAT_NV12 },
+	{ AV_PIX_FMT_NV21,		   SDL_PIXELFORMAT_NV21 },
+	{ AV_PIX_FMT_NONE,		   SDL_PIXELFORMAT_UNKNOWN }
+};
+
+// Formats without a matching SDL texture format. These are written straight into a texture of
+// the 8-bit equivalent format, instead of being converted to RGB by swscale.
+static const TextureFormatEntry sdl_texture_format_conv_map[] = {
+	{ AV_PIX_FMT_P010LE,		 SDL_PIXELFORMAT_NV12 },
+	{ AV_PIX_FMT_YUV420P10LE,	SDL_PIXELFORMAT_IYUV },
 	{ AV_PIX_FMT_NONE,		   SDL_PIXELFORMAT_UNKNOWN }
 };
 
@@ -447,6 +477,9 @@ extern char *afilters;
 extern int autorotate;
 extern int find_stream_info;
 extern int filter_nbthreads;
+extern bool gapless;
+extern bool refresh_rate_match;
+extern std::string hwaccel;
 
 /* current context */
 extern int is_full_screen;
@@ -480,6 +513,7 @@ extern Poco::Condition playerCon;
 extern Poco::Mutex playerMutex;
 extern Poco::Condition slavePlayCon;
 extern Poco::Mutex slavePlayMutex;
+extern std::atomic<int64_t> slaveStartTime;	// Local start time set by the master, or 0.
 
 
 enum NcsMode {
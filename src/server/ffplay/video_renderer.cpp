@@ -8,6 +8,7 @@
 #include "frame_queue.h"
 #include "sdl_renderer.h"
 #include "decoder.h"
+#include "frame_pacer.h"
 
 extern "C" {
 #include "libavutil/display.h"
@@ -81,6 +82,13 @@ void VideoRenderer::video_refresh(void *opaque, double *remaining_time) {
     }
 
     if (is->video_st) {
+        int64_t new_frame = 0;
+        if (!is->pacing_started) {
+            // Set up the display for the frame rate of the stream.
+            AVRational fr = av_guess_frame_rate(is->ic, is->video_st, NULL);
+            SdlRenderer::start_pacing((fr.num && fr.den) ? av_q2d(fr) : 0.0);
+            is->pacing_started = 1;
+        }
 retry:
         if (FrameQueueC::frame_queue_nb_remaining(&is->pictq) == 0) {
             // nothing to do, no picture to display in the queue
@@ -97,19 +105,27 @@ retry:
                 goto retry;
             }
 
-            if (lastvp->serial != vp->serial)
+            if (lastvp->serial != vp->serial) {
                 is->frame_timer = av_gettime_relative() / 1000000.0;
+                FramePacer::discontinuity();
+            }
 
-            if (is->paused)
+            if (is->paused) {
+                FramePacer::discontinuity();
                 goto display;
+            }
 
             /* compute nominal last_duration */
             last_duration = vp_duration(is, lastvp, vp);
             delay = ClockC::compute_target_delay(last_duration, is);
-
-            time= av_gettime_relative()/1000000.0;
-            if (time < is->frame_timer + delay) {
-                *remaining_time = FFMIN(is->frame_timer + delay - time, *remaining_time);
+            duration = last_duration;
+
+            /* present on the display refresh closest to the target time */
+            int64_t now = av_gettime_relative();
+            int64_t target = (int64_t) ((is->frame_timer + delay) * 1000000.0);
+            time = now / 1000000.0;
+            if (!FramePacer::due(target, now)) {
+                *remaining_time = FFMIN(FramePacer::waitTime(target, now) / 1000000.0, *remaining_time);
                 goto display;
             }
 
@@ -127,6 +143,7 @@ retry:
                 duration = vp_duration(is, vp, nextvp);
                 if(!is->step && (framedrop>0 || (framedrop && StreamHandler::get_master_sync_type(is) != AV_SYNC_VIDEO_MASTER)) && time > is->frame_timer + duration){
                     is->frame_drops_late++;
+                    FramePacer::dropped();
                     FrameQueueC::frame_queue_next(&is->pictq);
                     goto retry;
                 }
@@ -168,14 +185,18 @@ retry:
 
             FrameQueueC::frame_queue_next(&is->pictq);
             is->force_refresh = 1;
+            new_frame = (int64_t) (duration * 1000000.0);
+            if (new_frame <= 0) { new_frame = 1; }
 
             if (is->step && !is->paused)
                 StreamHandler::stream_toggle_pause(is);
         }
 display:
         /* display picture */
-        if (!display_disable && is->force_refresh && is->show_mode == SHOW_MODE_VIDEO && is->pictq.rindex_shown)
+        if (!display_disable && is->force_refresh && is->show_mode == SHOW_MODE_VIDEO && is->pictq.rindex_shown) {
+            if (new_frame) { FramePacer::frame(new_frame); }
             video_display(is);
+        }
     }
     is->force_refresh = 0;
     if (show_status) {
@@ -298,7 +319,7 @@ double get_rotation(const int32_t *displaymatrix) {
 
 static int configure_video_filters(AVFilterGraph *graph, VideoState *is, const char *vfilters, AVFrame *frame)
 {
-    enum AVPixelFormat pix_fmts[FF_ARRAY_ELEMS(sdl_texture_format_map)];
+    enum AVPixelFormat pix_fmts[FF_ARRAY_ELEMS(sdl_texture_format_map) + FF_ARRAY_ELEMS(sdl_texture_format_conv_map)];
     char sws_flags_str[512] = "";
 #if LIBAVCODEC_VERSION_MAJOR <= 61
 	// FFmpeg version < 8.
@@ -324,6 +345,14 @@ static int configure_video_filters(AVFilterGraph *graph, VideoState *is, const c
             }
         }
     }
+	
+	// 10-bit formats get uploaded without conversion if their 8-bit texture format is supported.
+    for (i = 0; i < renderer_info.num_texture_formats; i++) {
+        for (j = 0; j < FF_ARRAY_ELEMS(sdl_texture_format_conv_map) - 1; j++) {
+            if (renderer_info.texture_formats[i] == sdl_texture_format_conv_map[j].texture_fmt)
+                pix_fmts[nb_pix_fmts++] = sdl_texture_format_conv_map[j].format;
+        }
+    }
 #if LIBAVCODEC_VERSION_MAJOR <= 61
     pix_fmts[nb_pix_fmts] = AV_PIX_FMT_NONE;
 #endif
@@ -515,6 +544,27 @@ static int queue_picture(VideoState *is, AVFrame *src_frame, double pts, double
     return 0;
 }
 
+// --- HW FRAME DOWNLOAD ---
+// Replace a decoded hardware surface by a copy in system memory, in the surface's own layout
+// (NV12, P010). Those go into the texture as-is, without conversion by swscale.
+static int hw_frame_download(AVFrame *frame) {
+	AVFrame *sw_frame = av_frame_alloc();
+	if (!sw_frame) { return AVERROR(ENOMEM); }
+	
+	int ret = av_hwframe_transfer_data(sw_frame, frame, 0);
+	if (ret >= 0) { ret = av_frame_copy_props(sw_frame, frame); }
+	if (ret < 0) {
+		av_frame_free(&sw_frame);
+		return ret;
+	}
+	
+	av_frame_unref(frame);
+	av_frame_move_ref(frame, sw_frame);
+	av_frame_free(&sw_frame);
+	return 0;
+}
+
+
 static int get_video_frame(VideoState *is, AVFrame *frame)
 {
     int got_picture;
@@ -522,6 +572,14 @@ static int get_video_frame(VideoState *is, AVFrame *frame)
     if ((got_picture = DecoderC::decoder_decode_frame(&is->viddec, frame, NULL)) < 0)
         return -1;
 
+    if (got_picture && frame->hw_frames_ctx) {
+        if (hw_frame_download(frame) < 0) {
+            av_log(NULL, AV_LOG_WARNING, "Failed to download hardware frame.\n");
+            av_frame_unref(frame);
+            got_picture = 0;
+        }
+    }
+
     if (got_picture) {
         double dpts = NAN;
 
@@ -538,6 +596,7 @@ static int get_video_frame(VideoState *is, AVFrame *frame)
                     is->viddec.pkt_serial == is->vidclk.serial &&
                     is->videoq.nb_packets) {
                     is->frame_drops_early++;
+                    FramePacer::dropped();
                     av_frame_unref(frame);
                     got_picture = 0;
                 }
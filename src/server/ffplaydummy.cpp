@@ -35,6 +35,7 @@ uint32_t start_size = 27 * 1024; 	// Initial size of a request.
 uint32_t step_size = 1 * 1014;		// Request 1 kB more each cycle until buf_size is reached.
 uint32_t read_size = 0;
 dummyReadCallback FfplayDummy::verifycb = 0;
+std::shared_ptr<DataBuffer> FfplayDummy::db;
 
 
 // Global objects.
@@ -56,6 +57,7 @@ std::condition_variable dumbplaybackCv;
 
 #include "ffplay/types.h"
 #include "databuffer.h"
+#include "session_registry.h"
 
 
 /**
@@ -68,15 +70,16 @@ std::condition_variable dumbplaybackCv;
  * @return The number of bytes read into the buffer.
  */
 int FfplayDummy::media_read(void* opaque, uint8_t* buf, int buf_size) {
-	uint32_t bytesRead = DataBuffer::read(buf_size, buf);
+	DataBuffer* db = (DataBuffer*) opaque;
+	uint32_t bytesRead = db->read(buf_size, buf);
 #ifndef NO_NYMPH_LOGGER
 	NYMPH_LOG_INFORMATION("Read " + Poco::NumberFormatter::format(bytesRead) + " bytes.");
 #else
 	//std::cout << "Read " << bytesRead << " bytes." << std::endl;;
 #endif
 	if (bytesRead == 0) {
-		std::cout << "EOF is " << DataBuffer::isEof() << std::endl;
-		if (DataBuffer::isEof()) { return -1; }
+		std::cout << "EOF is " << db->isEof() << std::endl;
+		if (db->isEof()) { return -1; }
 		else { return -1; }
 	}
 	
@@ -102,6 +105,7 @@ int64_t FfplayDummy::media_seek(void* opaque, int64_t offset, int whence) {
 #endif
 							
 	
+	DataBuffer* db = (DataBuffer*) opaque;
 	int64_t new_offset = -1;
 	switch (whence) {
 		case SEEK_SET:	// Seek from the beginning of the file.
@@ -109,7 +113,7 @@ int64_t FfplayDummy::media_seek(void* opaque, int64_t offset, int whence) {
 			NYMPH_LOG_INFORMATION("media_seek: SEEK_SET");
 #else
 			std::cout << "media_seek: SEEK_SET" << std::endl;
-			new_offset = DataBuffer::seek(DB_SEEK_START, offset);
+			new_offset = db->seek(DB_SEEK_START, offset);
 #endif
 			break;
 		case SEEK_CUR:	// Seek from the current position.
@@ -118,7 +122,7 @@ int64_t FfplayDummy::media_seek(void* opaque, int64_t offset, int whence) {
 #else
 			std::cout << "media_seek: SEEK_CUR" << std::endl;;
 #endif
-			new_offset = DataBuffer::seek(DB_SEEK_CURRENT, offset);
+			new_offset = db->seek(DB_SEEK_CURRENT, offset);
 			break;
 		case SEEK_END:	// Seek from the end of the file.
 #ifndef NO_NYMPH_LOGGER
@@ -126,7 +130,7 @@ int64_t FfplayDummy::media_seek(void* opaque, int64_t offset, int whence) {
 #else
 			std::cout << "media_seek: SEEK_END" << std::endl;
 #endif
-			new_offset = DataBuffer::seek(DB_SEEK_END, offset);
+			new_offset = db->seek(DB_SEEK_END, offset);
 			break;
 		case AVSEEK_SIZE:
 #ifndef NO_NYMPH_LOGGER
@@ -134,7 +138,7 @@ int64_t FfplayDummy::media_seek(void* opaque, int64_t offset, int whence) {
 #else
 			std::cout << "media_seek: received AVSEEK_SIZE, returning file size." << std::endl;
 #endif
-			return DataBuffer::getFileSize();
+			return db->getFileSize();
 			break;
 		default:
 #ifndef NO_NYMPH_LOGGER
@@ -183,7 +187,7 @@ void FfplayDummy::setVerifyCallback(dummyReadCallback cb) {
 
 
 // --- STREAM TRACK ---
-bool FfplayDummy::streamTrack(std::string url) {
+bool FfplayDummy::streamTrack(std::string url, std::string format) {
 	if (!playerStarted) {
 		castUrl = url;
 		castingUrl = true;
@@ -223,13 +227,13 @@ void FfplayDummy::triggerRead(int) {
 	// If second read, seek to beginning.
 	if (count == 0) {
 		// Seek to end - 10 kB.
-		media_seek(0, DataBuffer::getFileSize() - (10 * 1024), SEEK_SET);
+		media_seek(db.get(), db->getFileSize() - (10 * 1024), SEEK_SET);
 		count++;
 		return;
 	}
 	else if (count == 1) {
 		// Seek to beginning.
-		media_seek(0, 0, SEEK_SET);
+		media_seek(db.get(), 0, SEEK_SET);
 		count++;
 		return;
 	}
@@ -241,7 +245,7 @@ void FfplayDummy::triggerRead(int) {
 		read_size = start_size;
 	}
 	
-	if (media_read(0, buf, read_size) == -1) {
+	if (media_read(db.get(), buf, read_size) == -1) {
 		// Signal the player thread that the playback has ended.
 		dummyCon.signal();
 	}
@@ -281,10 +285,13 @@ void FfplayDummy::run() {
 	std::mutex playbackMtx;
 	while (running) {
 		// Wait in condition variable until triggered. Ensure an event is waiting to deal with
-		// spurious wake-ups.
-		std::unique_lock<std::mutex> lk(playbackMtx);
-		using namespace std::chrono_literals;
-		dumbplaybackCv.wait(lk);
+		// spurious wake-ups. A queued session activated after the previous playback is played
+		// straight away.
+		if (!playingTrack) {
+			std::unique_lock<std::mutex> lk(playbackMtx);
+			using namespace std::chrono_literals;
+			dumbplaybackCv.wait(lk);
+		}
 		
 		if (!running) {
 			std::cout << "Terminating AV thread..." << std::endl;
@@ -295,6 +302,13 @@ void FfplayDummy::run() {
 		if (!playingTrack && !castingUrl) { continue; }
 		
 		// Start playback.
+		db = SessionRegistry::getActive();
+		if (!castingUrl && !db) {
+			std::cerr << "No active session to play. Aborting track playback." << std::endl;
+			playingTrack = false;
+			continue;
+		}
+		
 		playerStarted = true;
 		
 		// Update clients with status update.
@@ -315,16 +329,18 @@ void FfplayDummy::run() {
 		
 		ct.stop();
 		
-		DataBuffer::reset();	// Clears the data buffer (file data buffer).
+		db.reset();				// Release the session's data buffer.
 		finishPlayback();		// Calls handler for post-playback steps.
 		
 		// Clean up.
 		free(buf);
 	
 		playerStarted = false;
-		playingTrack = false;
 		castingUrl = false;
 		
+		// Hand over to the next queued session, if any.
+		playingTrack = SessionRegistry::activateNext();
+		
 		// Update clients with status update.
 		sendGlobalStatusUpdate();
 	}
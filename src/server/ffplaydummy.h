@@ -18,6 +18,7 @@
 #include <atomic>
 #include <queue>
 #include <functional>
+#include <memory>
 
 #include <cmath>
 
@@ -31,6 +32,7 @@
 
 #include "ffplay/types.h"
 #include "chronotrigger.h"
+#include "databuffer.h"
 
 
 struct FileMetaInfo {
@@ -95,6 +97,7 @@ class FfplayDummy : public Poco::Runnable {
 	static uint8_t* buf;
 	static uint8_t count;
 	static dummyReadCallback verifycb;
+	static std::shared_ptr<DataBuffer> db;	// Buffer of the session being played.
 	
 	static void triggerRead(int);
 	static void cleanUp();
@@ -107,7 +110,7 @@ public:
 	void setVolume(uint8_t volume);
 	void setVerifyCallback(dummyReadCallback cb);
 	bool playbackActive() { return playerStarted.load(); }
-	bool streamTrack(std::string url);
+	bool streamTrack(std::string url, std::string format = std::string());
 	bool playTrack();
 	void quit();
 };
@@ -32,6 +32,9 @@
 #include <chrono>
 
 
+#define GUI_FRAME_TIME 16		// Milliseconds between frames while the GUI is awake.
+
+
 // Static definitions.
 std::thread* Gui::guiThread = 0;
 std::atomic<bool> Gui::running = { false };
@@ -325,6 +328,16 @@ void Gui::handleEvent(SDL_Event &event) {
 }
 
 
+// --- NEXT TIMEOUT ---
+// Milliseconds until the next frame is due, or -1 while the window sleeps.
+int Gui::next_timeout() {
+	if (!window || window->isSleeping()) { return -1; }
+	
+	int wait = lastTime + GUI_FRAME_TIME - (int) SDL_GetTicks();
+	return (wait < 0) ? 0 : wait;
+}
+
+
 // --- RUN UPDATES ---
 void Gui::run_updates() {
 	// TODO: handle power saving feature in a more global manner.
@@ -332,6 +345,11 @@ void Gui::run_updates() {
 	bool ps_standby = false;
 	
 	int curTime = SDL_GetTicks();
+	if (window->isSleeping()) {
+		lastTime = curTime;
+		return;
+	}
+	
 	int deltaTime = curTime - lastTime;
 	lastTime = curTime;
 
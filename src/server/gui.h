@@ -47,6 +47,7 @@ public:
 	static bool start();
 	static void handleEvent(SDL_Event &event);
 	static void run_updates();
+	static int next_timeout();
 	static bool stop();
 	static bool quit();
 };
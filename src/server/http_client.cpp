@@ -0,0 +1,451 @@
+/*
+	http_client.cpp - Implementation of the HttpClient class.
+	
+	Revision 0.
+	
+	Notes:
+			- A kept-alive connection may have been closed by the server in the meantime. If a
+				request on a reused connection fails, it is tried once more on a new connection.
+			- Worker threads are started with the first batch.
+	
+	2026/10/18, Maya Posch
+*/
+
+
+#include "http_client.h"
+
+#include <algorithm>
+#include <cctype>
+
+#include <Poco/URI.h>
+#include <Poco/Exception.h>
+#include <Poco/StreamCopier.h>
+#include <Poco/Timespan.h>
+#include <Poco/Net/HTTPRequest.h>
+#include <Poco/Net/HTTPResponse.h>
+#include <Poco/Net/HTTPSClientSession.h>
+#include <Poco/Net/SSLManager.h>
+#include <Poco/Net/Context.h>
+
+#include <nymph/nymph.h>
+
+
+#define HC_TIMEOUT 30				// Connection & receive time-out, in seconds.
+#define HC_IDLE_TIMEOUT 15			// Time an unused connection is kept open, in seconds.
+#define HC_MAX_IDLE 4				// Unused connections kept open per host.
+#define HC_USER_AGENT "Mozilla/5.0 (Windows NT 6.1; WOW64; rv:39.0) Gecko/20100101 Firefox/75.0"
+
+
+// Static variables.
+std::mutex HttpClient::poolMutex;
+std::map<std::string, std::vector<HttpPooledSession> > HttpClient::idle;
+std::map<std::string, Poco::Net::Session::Ptr> HttpClient::tlsSessions;
+HttpStats HttpClient::stats;
+std::mutex HttpClient::cacheMutex;
+std::list<HttpCacheEntry> HttpClient::cache;
+std::unordered_map<std::string, std::list<HttpCacheEntry>::iterator> HttpClient::cacheIndex;
+size_t HttpClient::cacheBytes = 0;
+size_t HttpClient::cacheMax = 8 * 1024 * 1024;
+std::mutex HttpClient::jobsMutex;
+std::condition_variable HttpClient::jobsCv;
+std::deque<std::function<void()> > HttpClient::jobs;
+std::vector<std::thread> HttpClient::workers;
+uint32_t HttpClient::workerCount = 4;
+bool HttpClient::running = false;
+std::string HttpClient::loggerName = "HttpClient";
+
+
+// --- PARSE CACHE CONTROL ---
+// Determine whether a response may be cached, and for how long it is fresh (seconds).
+static bool parseCacheControl(Poco::Net::HTTPResponse &response, int64_t &maxAge) {
+	maxAge = 0;
+	if (response.has("Vary") && response.get("Vary").find('*') != std::string::npos) {
+		return false;
+	}
+	
+	if (!response.has("Cache-Control")) { return true; }
+	
+	std::string value = response.get("Cache-Control");
+	std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+	std::string::size_type start = 0;
+	while (start < value.size()) {
+		std::string::size_type end = value.find(',', start);
+		if (end == std::string::npos) { end = value.size(); }
+		
+		std::string token = value.substr(start, end - start);
+		token.erase(0, token.find_first_not_of(" \t"));
+		token.erase(token.find_last_not_of(" \t") + 1);
+		start = end + 1;
+		
+		if (token == "no-store") { return false; }
+		else if (token == "no-cache") { maxAge = 0; break; }
+		else if (token.compare(0, 8, "max-age=") == 0) {
+			maxAge = std::max(0LL, std::atoll(token.c_str() + 8));
+		}
+	}
+	
+	return true;
+}
+
+
+// --- INIT ---
+// Set the number of worker threads for batches & the cache size in bytes. Optional.
+void HttpClient::init(uint32_t workers, size_t cacheSize) {
+	std::lock_guard<std::mutex> lk(jobsMutex);
+	workerCount = std::max(workers, (uint32_t) 1);
+	
+	std::lock_guard<std::mutex> clk(cacheMutex);
+	cacheMax = cacheSize;
+}
+
+
+// --- CLEANUP ---
+// Stop the workers, close the connections and empty the cache.
+void HttpClient::cleanup() {
+	{
+		std::lock_guard<std::mutex> lk(jobsMutex);
+		running = false;
+	}
+	
+	jobsCv.notify_all();
+	for (size_t i = 0; i < workers.size(); ++i) {
+		workers[i].join();
+	}
+	
+	workers.clear();
+	
+	{
+		std::lock_guard<std::mutex> lk(poolMutex);
+		idle.clear();
+		tlsSessions.clear();
+	}
+	
+	clearCache();
+}
+
+
+// --- ACQUIRE ---
+// Returns an idle connection to the host, or a new one.
+std::unique_ptr<Poco::Net::HTTPClientSession> HttpClient::acquire(const std::string &key,
+											const std::string &scheme, const std::string &host,
+											uint16_t port, bool &reused) {
+	std::unique_ptr<Poco::Net::HTTPClientSession> session;
+	std::vector<HttpPooledSession> expired;
+	std::lock_guard<std::mutex> lk(poolMutex);
+	std::vector<HttpPooledSession> &sessions = idle[key];
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	while (!sessions.empty()) {
+		HttpPooledSession pooled = std::move(sessions.back());
+		sessions.pop_back();
+		if (now - pooled.lastUsed < std::chrono::seconds(HC_IDLE_TIMEOUT)) {
+			session = std::move(pooled.session);
+			break;
+		}
+		
+		expired.push_back(std::move(pooled));
+	}
+	
+	reused = (session != nullptr);
+	if (reused) {
+		stats.reused++;
+		return session;
+	}
+	
+	if (scheme == "https") {
+		// Resume the TLS session of an earlier connection, if any.
+		Poco::Net::Context::Ptr context = Poco::Net::SSLManager::instance().defaultClientContext();
+		context->enableSessionCache(true);
+		session.reset(new Poco::Net::HTTPSClientSession(host, port, context, tlsSessions[key]));
+	}
+	else {
+		session.reset(new Poco::Net::HTTPClientSession(host, port));
+	}
+	
+	session->setKeepAlive(true);
+	session->setKeepAliveTimeout(Poco::Timespan(HC_IDLE_TIMEOUT, 0));
+	session->setTimeout(Poco::Timespan(HC_TIMEOUT, 0));
+	stats.connections++;
+	
+	return session;
+}
+
+
+// --- RELEASE ---
+// Return a connection to the pool after a request.
+void HttpClient::release(const std::string &key,
+									std::unique_ptr<Poco::Net::HTTPClientSession> session) {
+	std::lock_guard<std::mutex> lk(poolMutex);
+	Poco::Net::HTTPSClientSession* tls = dynamic_cast<Poco::Net::HTTPSClientSession*>(session.get());
+	if (tls && tls->sslSession()) {
+		tlsSessions[key] = tls->sslSession();
+	}
+	
+	std::vector<HttpPooledSession> &sessions = idle[key];
+	if (sessions.size() >= HC_MAX_IDLE) { return; }
+	
+	HttpPooledSession pooled;
+	pooled.session = std::move(session);
+	pooled.lastUsed = std::chrono::steady_clock::now();
+	sessions.push_back(std::move(pooled));
+}
+
+
+// --- CACHE LOOKUP ---
+bool HttpClient::cacheLookup(const std::string &url, HttpCacheEntry &entry) {
+	std::lock_guard<std::mutex> lk(cacheMutex);
+	std::unordered_map<std::string, std::list<HttpCacheEntry>::iterator>::iterator it;
+	it = cacheIndex.find(url);
+	if (it == cacheIndex.end()) { return false; }
+	
+	cache.splice(cache.begin(), cache, it->second);
+	entry = *(it->second);
+	
+	return true;
+}
+
+
+// --- CACHE STORE ---
+// Add or replace a cached response, dropping the least recently used ones beyond the cache size.
+void HttpClient::cacheStore(HttpCacheEntry &entry) {
+	std::lock_guard<std::mutex> lk(cacheMutex);
+	size_t size = entry.url.size() + entry.body.size();
+	if (size > cacheMax / 4) { return; }
+	
+	std::unordered_map<std::string, std::list<HttpCacheEntry>::iterator>::iterator it;
+	it = cacheIndex.find(entry.url);
+	if (it != cacheIndex.end()) {
+		cacheBytes -= it->second->url.size() + it->second->body.size();
+		cache.erase(it->second);
+		cacheIndex.erase(it);
+	}
+	
+	cache.push_front(entry);
+	cacheIndex[entry.url] = cache.begin();
+	cacheBytes += size;
+	while (cacheBytes > cacheMax) {
+		cacheBytes -= cache.back().url.size() + cache.back().body.size();
+		cacheIndex.erase(cache.back().url);
+		cache.pop_back();
+	}
+}
+
+
+// --- CACHE REMOVE ---
+void HttpClient::cacheRemove(const std::string &url) {
+	std::lock_guard<std::mutex> lk(cacheMutex);
+	std::unordered_map<std::string, std::list<HttpCacheEntry>::iterator>::iterator it;
+	it = cacheIndex.find(url);
+	if (it == cacheIndex.end()) { return; }
+	
+	cacheBytes -= it->second->url.size() + it->second->body.size();
+	cache.erase(it->second);
+	cacheIndex.erase(it);
+}
+
+
+// --- CLEAR CACHE ---
+void HttpClient::clearCache() {
+	std::lock_guard<std::mutex> lk(cacheMutex);
+	cache.clear();
+	cacheIndex.clear();
+	cacheBytes = 0;
+}
+
+
+// --- GET STATS ---
+HttpStats HttpClient::getStats() {
+	std::lock_guard<std::mutex> lk(poolMutex);
+	return stats;
+}
+
+
+// --- GET ---
+// Perform a GET request, or answer it from the cache.
+HttpResult HttpClient::get(const std::string &url) {
+	HttpResult result;
+	std::string scheme;
+	std::string host;
+	std::string path;
+	uint16_t port;
+	try {
+		Poco::URI uri(url);
+		scheme = uri.getScheme();
+		host = uri.getHost();
+		port = uri.getPort();
+		path = uri.getPathAndQuery();
+	}
+	catch (Poco::Exception &exc) {
+		NYMPH_LOG_ERROR("Invalid URL " + url + ": " + exc.displayText());
+		return result;
+	}
+	
+	if (scheme != "http" && scheme != "https") {
+		NYMPH_LOG_ERROR("Unsupported URL scheme: " + url);
+		return result;
+	}
+	
+	if (path.empty()) { path = "/"; }
+	
+	HttpCacheEntry entry;
+	bool cached = cacheLookup(url, entry);
+	{
+		std::lock_guard<std::mutex> lk(poolMutex);
+		stats.requests++;
+		if (cached && std::chrono::steady_clock::now() < entry.expires) {
+			stats.cacheHits++;
+			result.success = true;
+			result.status = Poco::Net::HTTPResponse::HTTP_OK;
+			result.body = entry.body;
+			return result;
+		}
+	}
+	
+	std::string key = scheme + "://" + host + ":" + std::to_string(port);
+	std::unique_ptr<Poco::Net::HTTPResponse> response;
+	for (int attempt = 0; ; ++attempt) {
+		Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_GET, path,
+												Poco::Net::HTTPMessage::HTTP_1_1);
+		request.set("user-agent", HC_USER_AGENT);
+		if (cached && !entry.etag.empty()) { request.set("If-None-Match", entry.etag); }
+		if (cached && !entry.lastModified.empty()) {
+			request.set("If-Modified-Since", entry.lastModified);
+		}
+		
+		bool reused = false;
+		std::unique_ptr<Poco::Net::HTTPClientSession> session;
+		try {
+			session = acquire(key, scheme, host, port, reused);
+			session->sendRequest(request);
+			response.reset(new Poco::Net::HTTPResponse());
+			std::istream& rs = session->receiveResponse(*response);
+			
+			// Read the whole body, so that the connection can be used again.
+			result.body.clear();
+			if (response->getContentLength() > 0) {
+				result.body.reserve((size_t) response->getContentLength());
+			}
+			
+			Poco::StreamCopier::copyToString(rs, result.body);
+		}
+		catch (Poco::Exception &exc) {
+			if (reused && attempt == 0) { continue; }
+			
+			NYMPH_LOG_ERROR("Request for " + url + " failed: " + exc.displayText());
+			return result;
+		}
+		
+		if (response->getKeepAlive()) { release(key, std::move(session)); }
+		break;
+	}
+	
+	result.status = response->getStatus();
+	int64_t maxAge;
+	bool cacheable = parseCacheControl(*response, maxAge);
+	if (result.status == Poco::Net::HTTPResponse::HTTP_NOT_MODIFIED && cached) {
+		// The cached response is still valid.
+		{
+			std::lock_guard<std::mutex> lk(poolMutex);
+			stats.revalidated++;
+		}
+		
+		result.success = true;
+		result.status = Poco::Net::HTTPResponse::HTTP_OK;
+		result.body = entry.body;
+		if (!cacheable) {
+			cacheRemove(url);
+			return result;
+		}
+		
+		// Headers missing from the 304 response keep their earlier value.
+		if (response->has("ETag")) { entry.etag = response->get("ETag"); }
+		if (response->has("Cache-Control")) { entry.maxAge = maxAge; }
+		entry.expires = std::chrono::steady_clock::now() + std::chrono::seconds(entry.maxAge);
+		cacheStore(entry);
+		
+		return result;
+	}
+	
+	if (result.status != Poco::Net::HTTPResponse::HTTP_OK) {
+		if (cached) { cacheRemove(url); }
+		return result;
+	}
+	
+	result.success = true;
+	entry = HttpCacheEntry();
+	entry.etag = response->has("ETag") ? response->get("ETag") : std::string();
+	entry.lastModified = response->has("Last-Modified") ? response->get("Last-Modified") 
+																			: std::string();
+	if (cacheable && (maxAge > 0 || !entry.etag.empty() || !entry.lastModified.empty())) {
+		entry.url = url;
+		entry.body = result.body;
+		entry.maxAge = maxAge;
+		entry.expires = std::chrono::steady_clock::now() + std::chrono::seconds(maxAge);
+		cacheStore(entry);
+	}
+	else if (cached) {
+		cacheRemove(url);
+	}
+	
+	return result;
+}
+
+
+// --- RUN WORKER ---
+void HttpClient::runWorker() {
+	std::unique_lock<std::mutex> lk(jobsMutex);
+	while (true) {
+		// Finish queued requests before stopping, as callers are waiting for them.
+		jobsCv.wait(lk, [] { return !running || !jobs.empty(); });
+		if (jobs.empty()) { return; }
+		
+		std::function<void()> job = std::move(jobs.front());
+		jobs.pop_front();
+		lk.unlock();
+		job();
+		lk.lock();
+	}
+}
+
+
+// --- GET ALL ---
+// Perform the requests in parallel and wait for all of them. Results are in the order of the URLs.
+std::vector<HttpResult> HttpClient::getAll(const std::vector<std::string> &urls) {
+	struct Batch {
+		std::mutex mutex;
+		std::condition_variable cv;
+		size_t remaining;
+		std::vector<HttpResult> results;
+	};
+	
+	if (urls.size() == 1) { return std::vector<HttpResult>(1, get(urls[0])); }
+	
+	std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+	batch->remaining = urls.size();
+	batch->results.resize(urls.size());
+	{
+		std::lock_guard<std::mutex> lk(jobsMutex);
+		if (!running) {
+			running = true;
+			for (uint32_t i = 0; i < workerCount; ++i) {
+				workers.push_back(std::thread(&HttpClient::runWorker));
+			}
+		}
+		
+		for (size_t i = 0; i < urls.size(); ++i) {
+			std::string url = urls[i];
+			jobs.push_back([batch, i, url] {
+				HttpResult result = get(url);
+				std::lock_guard<std::mutex> blk(batch->mutex);
+				batch->results[i] = std::move(result);
+				if (--batch->remaining == 0) { batch->cv.notify_all(); }
+			});
+		}
+	}
+	
+	jobsCv.notify_all();
+	
+	std::unique_lock<std::mutex> blk(batch->mutex);
+	batch->cv.wait(blk, [&batch] { return batch->remaining == 0; });
+	
+	return batch->results;
+}
@@ -0,0 +1,116 @@
+/*
+	http_client.h - Header for the shared HTTP(S) client of NymphCast apps.
+	
+	Revision 0
+	
+	Features:
+			- Keeps connections open after a request & reuses them for the next request to the
+				same host (keep-alive). TLS sessions are resumed when a new connection is needed.
+			- Caches responses in memory as allowed by their Cache-Control header. Stale
+				responses with an ETag or Last-Modified header are revalidated with the server.
+			- Batches: requests are performed in parallel by a small pool of worker threads, and
+				the caller waits for all of them.
+	
+	Notes:
+			- Only GET requests are supported, as used by the apps.
+			- Responses which vary (Vary header) or lack both a max-age & a validator are not
+				cached.
+	
+	2026/10/18, Maya Posch
+*/
+
+
+#ifndef HTTP_CLIENT_H
+#define HTTP_CLIENT_H
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <functional>
+
+#include <Poco/Net/HTTPClientSession.h>
+#include <Poco/Net/Session.h>
+
+
+struct HttpResult {
+	bool success = false;		// True for a 200 status, fresh from the server or the cache.
+	int status = 0;
+	std::string body;
+};
+
+
+struct HttpStats {
+	uint64_t requests = 0;
+	uint64_t connections = 0;	// New connections made.
+	uint64_t reused = 0;		// Requests on a kept-alive connection.
+	uint64_t cacheHits = 0;		// Requests answered from the cache, without the server.
+	uint64_t revalidated = 0;	// Cached responses confirmed by the server (304).
+};
+
+
+struct HttpCacheEntry {
+	std::string url;
+	std::string body;
+	std::string etag;
+	std::string lastModified;
+	int64_t maxAge = 0;			// Freshness from the Cache-Control header, in seconds.
+	std::chrono::steady_clock::time_point expires;	// Revalidate after this time.
+};
+
+
+struct HttpPooledSession {
+	std::unique_ptr<Poco::Net::HTTPClientSession> session;
+	std::chrono::steady_clock::time_point lastUsed;
+};
+
+
+class HttpClient {
+	static std::mutex poolMutex;
+	static std::map<std::string, std::vector<HttpPooledSession> > idle;		// By scheme://host:port.
+	static std::map<std::string, Poco::Net::Session::Ptr> tlsSessions;
+	static HttpStats stats;
+	
+	static std::mutex cacheMutex;
+	static std::list<HttpCacheEntry> cache;		// Most recently used first.
+	static std::unordered_map<std::string, std::list<HttpCacheEntry>::iterator> cacheIndex;
+	static size_t cacheBytes;
+	static size_t cacheMax;
+	
+	static std::mutex jobsMutex;
+	static std::condition_variable jobsCv;
+	static std::deque<std::function<void()> > jobs;
+	static std::vector<std::thread> workers;
+	static uint32_t workerCount;
+	static bool running;
+	
+	static std::string loggerName;
+	
+	static std::unique_ptr<Poco::Net::HTTPClientSession> acquire(const std::string &key,
+											const std::string &scheme, const std::string &host,
+											uint16_t port, bool &reused);
+	static void release(const std::string &key, std::unique_ptr<Poco::Net::HTTPClientSession> session);
+	static bool cacheLookup(const std::string &url, HttpCacheEntry &entry);
+	static void cacheStore(HttpCacheEntry &entry);
+	static void cacheRemove(const std::string &url);
+	static void runWorker();
+
+public:
+	static void init(uint32_t workers, size_t cacheSize);
+	static void cleanup();
+	static HttpResult get(const std::string &url);
+	static std::vector<HttpResult> getAll(const std::vector<std::string> &urls);
+	static void clearCache();
+	static HttpStats getStats();
+};
+
+#endif
@@ -0,0 +1,857 @@
+/*
+	media_index.cpp - Implementation of the MediaIndex class.
+	
+	Revision 0.
+	
+	Notes:
+			- The whole index is kept in memory as well. Lookups & listings don't use the database.
+			- A scan hands out folders to MI_SCAN_THREADS threads. Each thread lists a single
+				folder at a time, and queues the folders it finds in it.
+			- inotify events are collected until the folders have been quiet for MI_WATCH_QUIET,
+				or for at most MI_WATCH_DELAY, and the changed folders are then listed again.
+			- Details are stored in the 'info' table by file ID, and stay there when the file is
+				removed. They are used again if the file comes back unchanged.
+	
+	2026/10/18, Maya Posch
+*/
+
+
+#include "media_index.h"
+
+#include "mimetype.h"
+
+#include <algorithm>
+#include <functional>
+#include <cctype>
+#include <cstring>
+#include <chrono>
+
+#include <Poco/Data/SQLite/SQLiteException.h>
+#include <Poco/NumberFormatter.h>
+
+#include <nymph/nymph.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+
+#define MI_SCAN_THREADS 4			// Threads listing folders during a scan.
+#define MI_WATCH_QUIET 500			// Time without events before changes are applied, in ms.
+#define MI_WATCH_DELAY 2000			// Maximum time changes wait to be applied, in ms.
+
+
+namespace fs = std::filesystem;
+using namespace Poco::Data::Keywords;
+
+
+// State of a scan, shared by the scan threads.
+struct MediaScan {
+	std::vector<MediaScanDir> queue;	// Folders still to be listed.
+	std::vector<MediaFile> files;
+	std::vector<MediaScanDir> dirs;		// Folders which were listed.
+	uint32_t busy = 0;					// Threads listing a folder.
+	bool complete = true;				// All folders could be listed.
+	std::mutex mutex;
+	std::condition_variable cv;
+};
+
+
+// Static variables.
+std::string MediaIndex::loggerName = "MediaIndex";
+
+
+// --- DESTRUCTOR ---
+MediaIndex::~MediaIndex() {
+	close();
+}
+
+
+// --- OPEN ---
+// Open the database and load the index from it.
+bool MediaIndex::open(std::string path) {
+	std::lock_guard<std::mutex> lk(dbMutex);
+	if (session) { return true; }
+	
+	this->path = path;
+	std::vector<uint32_t> ids;
+	std::vector<std::string> fileSections;
+	std::vector<std::string> filenames;
+	std::vector<uint32_t> types;
+	std::vector<int64_t> sizes;
+	std::vector<int64_t> mtimes;
+	std::vector<uint32_t> generations;
+	std::vector<uint32_t> removed;
+	try {
+		session.reset(new Poco::Data::Session("SQLite", path));
+		
+		std::string mode;
+		*session << "PRAGMA journal_mode=WAL", into(mode), now;
+		*session << "PRAGMA synchronous=NORMAL", now;
+		*session << "CREATE TABLE IF NOT EXISTS files (id INTEGER PRIMARY KEY NOT NULL, section TEXT NOT NULL, filename TEXT UNIQUE NOT NULL, type INTEGER, size INTEGER, mtime INTEGER, generation INTEGER, removed INTEGER)",
+			now;
+		*session << "CREATE TABLE IF NOT EXISTS info (id INTEGER PRIMARY KEY NOT NULL, size INTEGER, mtime INTEGER, valid INTEGER, format TEXT, duration REAL, video_codec TEXT, audio_codec TEXT, width INTEGER, height INTEGER, title TEXT, artist TEXT, album TEXT, thumbnail BLOB)",
+			now;
+		
+		*session << "SELECT id, section, filename, type, size, mtime, generation, removed FROM files",
+			into(ids), into(fileSections), into(filenames), into(types), into(sizes), into(mtimes),
+			into(generations), into(removed), now;
+		
+		writeStatement.reset(new Poco::Data::Statement(*session));
+		*writeStatement << "INSERT OR REPLACE INTO files (id, section, filename, type, size, mtime, generation, removed) VALUES (?, ?, ?, ?, ?, ?, ?, ?)",
+			use(writeFile.id), use(writeFile.section), use(writeFile.filename), use(writeType),
+			use(writeFile.size), use(writeFile.mtime), use(writeFile.generation), use(writeRemoved);
+		
+		infoStatement.reset(new Poco::Data::Statement(*session));
+		*infoStatement << "INSERT OR REPLACE INTO info (id, size, mtime, valid, format, duration, video_codec, audio_codec, width, height, title, artist, album, thumbnail) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)",
+			use(infoId), use(writeInfo.size), use(writeInfo.mtime), use(writeValid), use(writeInfo.format),
+			use(writeInfo.duration), use(writeInfo.videoCodec), use(writeInfo.audioCodec),
+			use(writeInfo.width), use(writeInfo.height), use(writeInfo.title), use(writeInfo.artist),
+			use(writeInfo.album), use(writeThumbnail);
+	}
+	catch (Poco::Exception &exc) {
+		NYMPH_LOG_ERROR("Failed to open " + path + ": " + exc.displayText());
+		infoStatement.reset();
+		writeStatement.reset();
+		session.reset();
+		return false;
+	}
+	
+	std::lock_guard<std::mutex> flk(filesMutex);
+	for (uint32_t i = 0; i < ids.size(); ++i) {
+		MediaFile mf;
+		mf.id = ids[i];
+		mf.section = fileSections[i];
+		mf.filename = filenames[i];
+		mf.type = (uint8_t) types[i];
+		mf.size = sizes[i];
+		mf.mtime = mtimes[i];
+		mf.generation = generations[i];
+		mf.removed = removed[i] != 0;
+		files[mf.id] = mf;
+		names[mf.filename] = mf.id;
+		
+		if (mf.generation > generation) { generation = mf.generation; }
+		if (mf.id >= nextId) { nextId = mf.id + 1; }
+	}
+	
+	NYMPH_LOG_INFORMATION("Loaded " + Poco::NumberFormatter::format(files.size()) +
+							" media files, generation " + Poco::NumberFormatter::format(generation) + ".");
+	
+	loadInfo();
+	
+	return true;
+}
+
+
+// --- LOAD INFO ---
+// Load the details of probed files, without the thumbnails. Call with dbMutex & filesMutex locked.
+void MediaIndex::loadInfo() {
+	std::vector<uint32_t> ids;
+	std::vector<int64_t> sizes;
+	std::vector<int64_t> mtimes;
+	std::vector<uint32_t> valid;
+	std::vector<std::string> formats;
+	std::vector<double> durations;
+	std::vector<std::string> videoCodecs;
+	std::vector<std::string> audioCodecs;
+	std::vector<uint32_t> widths;
+	std::vector<uint32_t> heights;
+	std::vector<std::string> titles;
+	std::vector<std::string> artists;
+	std::vector<std::string> albums;
+	std::vector<uint32_t> thumbnails;
+	try {
+		*session << "SELECT id, size, mtime, valid, format, duration, video_codec, audio_codec, width, height, title, artist, album, length(thumbnail) FROM info",
+			into(ids), into(sizes), into(mtimes), into(valid), into(formats), into(durations),
+			into(videoCodecs), into(audioCodecs), into(widths), into(heights), into(titles),
+			into(artists), into(albums), into(thumbnails), now;
+	}
+	catch (Poco::Exception &exc) {
+		NYMPH_LOG_ERROR("Failed to load media details from " + path + ": " + exc.displayText());
+		return;
+	}
+	
+	for (uint32_t i = 0; i < ids.size(); ++i) {
+		MediaInfo info;
+		info.size = sizes[i];
+		info.mtime = mtimes[i];
+		info.valid = valid[i] != 0;
+		info.format = formats[i];
+		info.duration = durations[i];
+		info.videoCodec = videoCodecs[i];
+		info.audioCodec = audioCodecs[i];
+		info.width = widths[i];
+		info.height = heights[i];
+		info.title = titles[i];
+		info.artist = artists[i];
+		info.album = albums[i];
+		info.thumbnail = thumbnails[i] > 0;
+		infos[ids[i]] = info;
+	}
+}
+
+
+// --- CLOSE ---
+// Stop scanning & watching, and close the database.
+void MediaIndex::close() {
+	running = false;
+	if (scanner.joinable()) { scanner.join(); }
+	if (watcher.joinable()) { watcher.join(); }
+	
+#ifdef __linux__
+	if (inotifyFd >= 0) {
+		::close(inotifyFd);
+		inotifyFd = -1;
+	}
+#endif
+	
+	std::lock_guard<std::mutex> lk(dbMutex);
+	infoStatement.reset();
+	writeStatement.reset();
+	session.reset();
+}
+
+
+// --- ADD SECTION ---
+// Add a folder to index, with the name of its section. Call before start().
+void MediaIndex::addSection(std::string name, std::string folder) {
+	sections[name] = folder;
+}
+
+
+// --- START ---
+// Scan the folders again in the background, and watch them for changes afterwards.
+void MediaIndex::start() {
+	if (running) { return; }
+	running = true;
+	
+#ifdef __linux__
+	inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotifyFd < 0) {
+		NYMPH_LOG_WARNING("Failed to set up inotify, changes to media folders won't be seen.");
+	}
+	else {
+		watcher = std::thread(&MediaIndex::runWatcher, this);
+	}
+#endif
+	
+	scanner = std::thread(&MediaIndex::rescan, this);
+}
+
+
+// --- READ FILE ---
+// Fill in the entry for a file, if it's a media file.
+bool MediaIndex::readFile(const fs::path &file, const std::string &section, MediaFile &mf) {
+	std::string ext = file.extension().string();
+	if (ext.empty()) { return false; }
+	ext.erase(0, 1);	// Remove leading '.' character.
+	
+	uint8_t type;
+	if (!MimeType::hasExtension(ext, type)) { return false; }
+	
+	std::error_code ec;
+	mf.size = (int64_t) fs::file_size(file, ec);
+	if (ec) { return false; }
+	
+	fs::file_time_type time = fs::last_write_time(file, ec);
+	if (ec) { return false; }
+	
+	mf.id = 0;
+	mf.section = section;
+	mf.filename = fs::absolute(file).string();
+	mf.type = type;
+	mf.mtime = std::chrono::duration_cast<std::chrono::seconds>(time.time_since_epoch()).count();
+	mf.generation = 0;
+	mf.removed = false;
+	
+	return true;
+}
+
+
+// --- SCAN WORKER ---
+// List folders from the queue until all folders have been listed.
+void MediaIndex::scanWorker(MediaScan &state) {
+	std::unique_lock<std::mutex> lk(state.mutex);
+	while (running) {
+		state.cv.wait(lk, [&state] { return !state.queue.empty() || state.busy == 0; });
+		if (state.queue.empty()) { break; }
+		
+		MediaScanDir dir = state.queue.back();
+		state.queue.pop_back();
+		state.busy++;
+		lk.unlock();
+		
+		// Symbolic links to folders are not followed, as with a recursive directory iterator.
+		std::vector<MediaScanDir> subdirs;
+		std::vector<MediaFile> found;
+		std::error_code ec;
+		fs::directory_iterator it(dir.path, ec);
+		for (; !ec && it != fs::directory_iterator(); it.increment(ec)) {
+			std::error_code fec;
+			if (it->is_directory(fec) && !it->is_symlink(fec)) {
+				MediaScanDir sub;
+				sub.section = dir.section;
+				sub.path = it->path();
+				subdirs.push_back(sub);
+				continue;
+			}
+			
+			MediaFile mf;
+			if (it->is_regular_file(fec) && readFile(it->path(), dir.section, mf)) {
+				found.push_back(mf);
+			}
+		}
+		
+		if (ec) {
+			NYMPH_LOG_WARNING("Failed to list " + dir.path.string() + ": " + ec.message());
+		}
+		
+		lk.lock();
+		if (ec) { state.complete = false; }
+		state.busy--;
+		state.dirs.push_back(dir);
+		state.queue.insert(state.queue.end(), subdirs.begin(), subdirs.end());
+		state.files.insert(state.files.end(), found.begin(), found.end());
+		state.cv.notify_all();
+	}
+	
+	// Wake up the other threads when stopping.
+	state.cv.notify_all();
+}
+
+
+// --- SCAN ---
+// Find the media files in & below the folders. Returns false if stopped before the end.
+// 'complete' is set to false if a folder could not be listed.
+bool MediaIndex::scan(const std::vector<MediaScanDir> &roots, std::vector<MediaFile> &found,
+												std::vector<MediaScanDir> &dirs, bool &complete) {
+	MediaScan state;
+	state.queue = roots;
+	
+	std::vector<std::thread> threads;
+	for (int i = 0; i < MI_SCAN_THREADS; ++i) {
+		threads.push_back(std::thread(&MediaIndex::scanWorker, this, std::ref(state)));
+	}
+	
+	for (uint32_t i = 0; i < threads.size(); ++i) {
+		threads[i].join();
+	}
+	
+	found.swap(state.files);
+	dirs.swap(state.dirs);
+	complete = state.complete;
+	
+	return running;
+}
+
+
+// --- COMMIT ---
+// Write the changed entries with the next generation, and update the index in memory.
+// Call with dbMutex locked.
+void MediaIndex::commit(std::vector<MediaFile> &changes) {
+	if (changes.empty()) { return; }
+	
+	uint32_t next = generation + 1;
+	for (uint32_t i = 0; i < changes.size(); ++i) {
+		if (changes[i].id == 0) { changes[i].id = nextId++; }
+		changes[i].generation = next;
+	}
+	
+	// The index in memory is updated regardless, so that a failing database only costs persistence.
+	if (writeStatement) {
+		try {
+			session->begin();
+			for (uint32_t i = 0; i < changes.size(); ++i) {
+				writeFile = changes[i];
+				writeType = changes[i].type;
+				writeRemoved = changes[i].removed ? 1 : 0;
+				writeStatement->execute();
+			}
+			
+			session->commit();
+		}
+		catch (Poco::Exception &exc) {
+			NYMPH_LOG_ERROR("Failed to write " + Poco::NumberFormatter::format(changes.size()) +
+								" media files to " + path + ": " + exc.displayText());
+			try { session->rollback(); } catch (...) { }
+		}
+	}
+	
+	std::lock_guard<std::mutex> lk(filesMutex);
+	for (uint32_t i = 0; i < changes.size(); ++i) {
+		files[changes[i].id] = changes[i];
+		names[changes[i].filename] = changes[i].id;
+	}
+	
+	generation = next;
+}
+
+
+// --- UPDATE ---
+// Compare the files found in a folder (and below it, if recursive) with the index, and commit the
+// differences. Entries of the scanned sections in that folder which were not found are removed.
+// An empty folder path covers all folders.
+void MediaIndex::update(const std::vector<MediaFile> &found, const std::set<std::string> &scanned,
+													const fs::path &dir, bool recursive) {
+	std::lock_guard<std::mutex> lk(dbMutex);
+	std::vector<MediaFile> changes;
+	{
+		std::lock_guard<std::mutex> flk(filesMutex);
+		std::set<std::string> seen;
+		for (uint32_t i = 0; i < found.size(); ++i) {
+			const MediaFile &mf = found[i];
+			if (!seen.insert(mf.filename).second) { continue; }	// In more than one section.
+			
+			std::unordered_map<std::string, uint32_t>::const_iterator nit = names.find(mf.filename);
+			if (nit == names.end()) {
+				changes.push_back(mf);
+				continue;
+			}
+			
+			const MediaFile &old = files[nit->second];
+			if (!old.removed && old.section == mf.section && old.type == mf.type &&
+					old.size == mf.size && old.mtime == mf.mtime) {
+				continue;
+			}
+			
+			changes.push_back(mf);
+			changes.back().id = old.id;
+		}
+		
+		std::string prefix = dir.empty() ? std::string() : (dir / "").string();
+		std::map<uint32_t, MediaFile>::const_iterator it;
+		for (it = files.begin(); it != files.end(); ++it) {
+			const MediaFile &mf = it->second;
+			if (mf.removed || scanned.find(mf.section) == scanned.end()) { continue; }
+			if (seen.find(mf.filename) != seen.end()) { continue; }
+			if (mf.filename.compare(0, prefix.size(), prefix) != 0) { continue; }
+			if (!recursive && fs::path(mf.filename).parent_path() != dir) { continue; }
+			
+			changes.push_back(mf);
+			changes.back().removed = true;
+		}
+	}
+	
+	commit(changes);
+}
+
+
+// --- RESCAN ---
+// Scan all folders, and start watching them.
+void MediaIndex::rescan() {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<MediaScanDir> roots;
+	std::set<std::string> scanned;
+	std::map<std::string, std::string>::const_iterator it;
+	for (it = sections.begin(); it != sections.end(); ++it) {
+		std::error_code ec;
+		if (!fs::is_directory(it->second, ec)) {
+			NYMPH_LOG_WARNING("Path is not a valid directory: " + it->second + ". Keeping the indexed files of " +
+								it->first + ".");
+			continue;
+		}
+		
+		MediaScanDir root;
+		root.section = it->first;
+		root.path = fs::absolute(it->second).lexically_normal();
+		if (!root.path.has_filename()) { root.path = root.path.parent_path(); }
+		roots.push_back(root);
+		scanned.insert(it->first);
+	}
+	
+	// Sections which are no longer configured get all their files removed.
+	{
+		std::lock_guard<std::mutex> lk(filesMutex);
+		std::map<uint32_t, MediaFile>::const_iterator fit;
+		for (fit = files.begin(); fit != files.end(); ++fit) {
+			if (sections.find(fit->second.section) == sections.end()) {
+				scanned.insert(fit->second.section);
+			}
+		}
+	}
+	
+	std::vector<MediaFile> found;
+	std::vector<MediaScanDir> dirs;
+	bool complete;
+	if (!scan(roots, found, dirs, complete)) { return; }
+	
+	// Files in folders which could not be listed would look removed. Only add & update then.
+	if (!complete) {
+		NYMPH_LOG_WARNING("Not all media folders could be listed, keeping files which weren't found.");
+		scanned.clear();
+	}
+	
+	update(found, scanned, fs::path(), true);
+	
+	int64_t elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+												std::chrono::steady_clock::now() - start).count();
+	NYMPH_LOG_INFORMATION("Scanned " + Poco::NumberFormatter::format(dirs.size()) + " folders with " +
+							Poco::NumberFormatter::format(found.size()) + " media files in " +
+							Poco::NumberFormatter::format(elapsed) + " ms, generation " +
+							Poco::NumberFormatter::format(getGeneration()) + ".");
+	
+	watch(dirs);
+}
+
+
+// --- RESCAN DIR ---
+// List a single folder again, or scan it and the folders below it if recursive.
+void MediaIndex::rescanDir(const MediaScanDir &dir, bool recursive) {
+	std::vector<MediaFile> found;
+	std::vector<MediaScanDir> dirs;
+	bool complete = true;
+	if (recursive) {
+		std::vector<MediaScanDir> roots;
+		roots.push_back(dir);
+		if (!scan(roots, found, dirs, complete)) { return; }
+	}
+	else {
+		std::error_code ec;
+		fs::directory_iterator it(dir.path, ec);
+		for (; !ec && it != fs::directory_iterator(); it.increment(ec)) {
+			std::error_code fec;
+			MediaFile mf;
+			if (it->is_regular_file(fec) && readFile(it->path(), dir.section, mf)) {
+				found.push_back(mf);
+			}
+		}
+		
+		complete = !ec;
+	}
+	
+	std::set<std::string> scanned;
+	if (complete) { scanned.insert(dir.section); }
+	update(found, scanned, dir.path, recursive);
+	
+	watch(dirs);
+}
+
+
+// --- REMOVE DIR ---
+// Remove the files in & below a folder which was removed or moved away, and stop watching it.
+void MediaIndex::removeDir(const MediaScanDir &dir) {
+	std::set<std::string> scanned;
+	scanned.insert(dir.section);
+	update(std::vector<MediaFile>(), scanned, dir.path, true);
+	
+#ifdef __linux__
+	std::string prefix = (dir.path / "").string();
+	std::lock_guard<std::mutex> lk(watchMutex);
+	std::map<int, MediaScanDir>::iterator it;
+	for (it = watches.begin(); it != watches.end();) {
+		std::string p = it->second.path.string();
+		if (it->second.path == dir.path || p.compare(0, prefix.size(), prefix) == 0) {
+			inotify_rm_watch(inotifyFd, it->first);
+			it = watches.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+#endif
+}
+
+
+// --- WATCH ---
+// Watch folders for added, changed & removed files.
+void MediaIndex::watch(const std::vector<MediaScanDir> &dirs) {
+#ifdef __linux__
+	if (inotifyFd < 0) { return; }
+	
+	std::lock_guard<std::mutex> lk(watchMutex);
+	for (uint32_t i = 0; i < dirs.size(); ++i) {
+		int wd = inotify_add_watch(inotifyFd, dirs[i].path.c_str(), IN_CREATE | IN_DELETE |
+									IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR);
+		if (wd < 0) {
+			// Usually the limit set by fs.inotify.max_user_watches.
+			NYMPH_LOG_WARNING("Failed to watch " + dirs[i].path.string() + ": " +
+								std::string(strerror(errno)) + ". Further folders are not watched.");
+			return;
+		}
+		
+		watches[wd] = dirs[i];
+	}
+#endif
+}
+
+
+// --- RUN WATCHER ---
+// Collect inotify events, and apply the changes once the folders are quiet.
+void MediaIndex::runWatcher() {
+#ifdef __linux__
+	std::map<fs::path, MediaScanDir> changed;		// Folders to list again.
+	std::map<fs::path, MediaScanDir> added;			// Folders to scan.
+	std::map<fs::path, MediaScanDir> removed;		// Folders which are gone.
+	bool overflow = false;							// Events were lost, scan all folders.
+	std::chrono::steady_clock::time_point first;
+	alignas(struct inotify_event) char buffer[8192];
+	while (running) {
+		struct pollfd pfd;
+		pfd.fd = inotifyFd;
+		pfd.events = POLLIN;
+		int ret = poll(&pfd, 1, MI_WATCH_QUIET);
+		
+		if (ret > 0) {
+			ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+			std::lock_guard<std::mutex> lk(watchMutex);
+			for (ssize_t i = 0; i < length;) {
+				struct inotify_event* event = (struct inotify_event*) (buffer + i);
+				i += sizeof(struct inotify_event) + event->len;
+				
+				if (!overflow && changed.empty() && added.empty() && removed.empty()) {
+					first = std::chrono::steady_clock::now();
+				}
+				
+				if (event->mask & IN_Q_OVERFLOW) {
+					overflow = true;
+					continue;
+				}
+				
+				std::map<int, MediaScanDir>::const_iterator it = watches.find(event->wd);
+				if (it == watches.end() || event->len == 0) { continue; }
+				
+				MediaScanDir dir;
+				dir.section = it->second.section;
+				dir.path = it->second.path / event->name;
+				if (!(event->mask & IN_ISDIR)) {
+					changed[it->second.path] = it->second;
+				}
+				else if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+					removed.erase(dir.path);
+					added[dir.path] = dir;
+				}
+				else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+					added.erase(dir.path);
+					removed[dir.path] = dir;
+				}
+			}
+			
+			// Keep collecting until quiet, up to the maximum delay.
+			if (std::chrono::steady_clock::now() - first < std::chrono::milliseconds(MI_WATCH_DELAY)) {
+				continue;
+			}
+		}
+		else if (ret < 0 && errno != EINTR) {
+			NYMPH_LOG_ERROR("Failed to wait for inotify events: " + std::string(strerror(errno)));
+			return;
+		}
+		
+		if (overflow) {
+			NYMPH_LOG_WARNING("Missed changes to media folders, scanning all folders.");
+			rescan();
+		}
+		
+		if (overflow || (changed.empty() && added.empty() && removed.empty())) {
+			overflow = false;
+			changed.clear();
+			added.clear();
+			removed.clear();
+			continue;
+		}
+		
+		std::map<fs::path, MediaScanDir>::const_iterator it;
+		for (it = removed.begin(); it != removed.end(); ++it) {
+			removeDir(it->second);
+		}
+		
+		for (it = added.begin(); it != added.end(); ++it) {
+			rescanDir(it->second, true);
+		}
+		
+		for (it = changed.begin(); it != changed.end(); ++it) {
+			rescanDir(it->second, false);
+		}
+		
+		NYMPH_LOG_DEBUG("Applied changes in " + Poco::NumberFormatter::format(changed.size() +
+							added.size() + removed.size()) + " folders, generation " +
+							Poco::NumberFormatter::format(getGeneration()) + ".");
+		
+		changed.clear();
+		added.clear();
+		removed.clear();
+	}
+#endif
+}
+
+
+// --- GET GENERATION ---
+uint32_t MediaIndex::getGeneration() {
+	std::lock_guard<std::mutex> lk(filesMutex);
+	return generation;
+}
+
+
+// --- GET ---
+// Find a media file which exists by its ID.
+bool MediaIndex::get(uint32_t id, MediaFile &file) {
+	std::lock_guard<std::mutex> lk(filesMutex);
+	std::map<uint32_t, MediaFile>::const_iterator it = files.find(id);
+	if (it == files.end() || it->second.removed) { return false; }
+	
+	file = it->second;
+	return true;
+}
+
+
+// --- LIST ---
+// List media files, ordered by ID, starting at the 'start' ID.
+// since	: 0 for all current files, or a generation to only list files added, changed or
+//				removed after it, including removed files.
+// count	: maximum number of files, or 0 for all.
+// filter	: if not empty, only files with this text in their section or filename, in any case.
+// next		: set to the ID to continue from if more files are left, 0 otherwise.
+std::vector<MediaFile> MediaIndex::list(uint32_t since, uint32_t start, uint32_t count,
+																std::string filter, uint32_t &next) {
+	std::transform(filter.begin(), filter.end(), filter.begin(), ::tolower);
+	std::vector<MediaFile> out;
+	next = 0;
+	
+	std::lock_guard<std::mutex> lk(filesMutex);
+	std::map<uint32_t, MediaFile>::const_iterator it;
+	for (it = files.lower_bound(start); it != files.end(); ++it) {
+		const MediaFile &mf = it->second;
+		if (since == 0 ? mf.removed : mf.generation <= since) { continue; }
+		if (!filter.empty()) {
+			std::string text = mf.section + " " + mf.filename;
+			std::transform(text.begin(), text.end(), text.begin(), ::tolower);
+			if (text.find(filter) == std::string::npos) { continue; }
+		}
+		
+		if (count > 0 && out.size() == count) {
+			next = mf.id;
+			break;
+		}
+		
+		out.push_back(mf);
+	}
+	
+	return out;
+}
+
+
+// --- UNPROBED ---
+// Find audio & video files which have not been probed since they last changed, ordered by ID,
+// starting at the 'start' ID.
+// count	: maximum number of files.
+// skip		: IDs of files to leave out, e.g. those being probed.
+// next		: set to the ID to continue from if more files are left, 0 otherwise.
+std::vector<MediaFile> MediaIndex::unprobed(uint32_t start, uint32_t count,
+											const std::set<uint32_t> &skip, uint32_t &next) {
+	std::vector<MediaFile> out;
+	next = 0;
+	
+	std::lock_guard<std::mutex> lk(filesMutex);
+	std::map<uint32_t, MediaFile>::const_iterator it;
+	for (it = files.lower_bound(start); it != files.end(); ++it) {
+		const MediaFile &mf = it->second;
+		if (mf.removed || mf.type > 1 || skip.find(mf.id) != skip.end()) { continue; }
+		
+		std::unordered_map<uint32_t, MediaInfo>::const_iterator iit = infos.find(mf.id);
+		if (iit != infos.end() && iit->second.size == mf.size && iit->second.mtime == mf.mtime) {
+			continue;
+		}
+		
+		if (out.size() == count) {
+			next = mf.id;
+			break;
+		}
+		
+		out.push_back(mf);
+	}
+	
+	return out;
+}
+
+
+// --- SET INFO ---
+// Store the details of probed files & their thumbnails, in a single transaction. The files get
+// the next generation, so that clients fetching the changes see the new details.
+void MediaIndex::setInfo(const std::vector<MediaProbeResult> &results) {
+	if (results.empty()) { return; }
+	
+	std::lock_guard<std::mutex> lk(dbMutex);
+	if (infoStatement) {
+		try {
+			session->begin();
+			for (uint32_t i = 0; i < results.size(); ++i) {
+				const std::string &thumbnail = results[i].thumbnail;
+				infoId = results[i].id;
+				writeInfo = results[i].info;
+				writeInfo.thumbnail = !thumbnail.empty();
+				writeValid = writeInfo.valid ? 1 : 0;
+				writeThumbnail.assignRaw(reinterpret_cast<const unsigned char*>(thumbnail.data()),
+																				thumbnail.size());
+				infoStatement->execute();
+			}
+			
+			session->commit();
+		}
+		catch (Poco::Exception &exc) {
+			NYMPH_LOG_ERROR("Failed to write the details of " + 
+								Poco::NumberFormatter::format(results.size()) + " media files to " +
+								path + ": " + exc.displayText());
+			try { session->rollback(); } catch (...) { }
+		}
+		
+		writeThumbnail.clear();
+	}
+	
+	std::vector<MediaFile> changes;
+	{
+		std::lock_guard<std::mutex> flk(filesMutex);
+		for (uint32_t i = 0; i < results.size(); ++i) {
+			MediaInfo stored = results[i].info;
+			stored.thumbnail = !results[i].thumbnail.empty();
+			infos[results[i].id] = stored;
+			
+			std::map<uint32_t, MediaFile>::const_iterator it = files.find(results[i].id);
+			if (it != files.end() && !it->second.removed) { changes.push_back(it->second); }
+		}
+	}
+	
+	commit(changes);
+}
+
+
+// --- GET INFO ---
+// Get the details of a media file, if it was probed since it last changed.
+bool MediaIndex::getInfo(uint32_t id, MediaInfo &info) {
+	std::lock_guard<std::mutex> lk(filesMutex);
+	std::map<uint32_t, MediaFile>::const_iterator it = files.find(id);
+	std::unordered_map<uint32_t, MediaInfo>::const_iterator iit = infos.find(id);
+	if (it == files.end() || it->second.removed || iit == infos.end()) { return false; }
+	if (iit->second.size != it->second.size || iit->second.mtime != it->second.mtime) { return false; }
+	
+	info = iit->second;
+	return true;
+}
+
+
+// --- GET THUMBNAIL ---
+// Read the JPEG thumbnail of a media file from the database.
+bool MediaIndex::getThumbnail(uint32_t id, std::string &jpeg) {
+	MediaInfo info;
+	if (!getInfo(id, info) || !info.thumbnail) { return false; }
+	
+	std::lock_guard<std::mutex> lk(dbMutex);
+	if (!session) { return false; }
+	
+	std::vector<Poco::Data::BLOB> blobs;
+	try {
+		*session << "SELECT thumbnail FROM info WHERE id = ?", into(blobs), use(id), now;
+	}
+	catch (Poco::Exception &exc) {
+		NYMPH_LOG_ERROR("Failed to read the thumbnail of media file " + Poco::NumberFormatter::format(id) +
+							" from " + path + ": " + exc.displayText());
+		return false;
+	}
+	
+	if (blobs.empty() || blobs[0].size() == 0) { return false; }
+	
+	jpeg.assign(reinterpret_cast<const char*>(blobs[0].rawContent()), blobs[0].size());
+	return true;
+}
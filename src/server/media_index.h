@@ -0,0 +1,175 @@
+/*
+	media_index.h - Header for the index of local media files.
+	
+	Revision 0
+	
+	Features:
+			- Keeps the media files found in the local media folders in an SQLite database, so
+				that the list is available right away when the server starts.
+			- Folders are scanned again in the background by a number of threads, and only the
+				files which were added, changed or removed are written to the database.
+			- On Linux, folders are watched with inotify and changes are applied as they happen.
+			- Each set of changes increases the generation of the index. Files carry the
+				generation in which they last changed, so that clients can fetch only the changes.
+			- Stores the details found by probing a file (MediaInfo) and its thumbnail.
+	
+	Notes:
+			- The ID of a file stays the same while it exists, and when it reappears at the same path.
+			- Removed files are kept as removed entries, for clients fetching the changes.
+			- The files of a folder which is not available (e.g. an unmounted share) are kept.
+			- inotify does not report changes made on another host to network shares. Those are
+				picked up by the scan on the next start.
+			- Details are kept in memory, thumbnails are read from the database when requested.
+				A file is probed again once its size or modification time changes.
+	
+	2026/10/18, Maya Posch
+*/
+
+
+#ifndef MEDIA_INDEX_H
+#define MEDIA_INDEX_H
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <filesystem>
+
+#include <Poco/Data/Session.h>
+#include <Poco/Data/Statement.h>
+#include <Poco/Data/LOB.h>
+
+
+#define MI_PAGE_MAX 1000		// Maximum number of files in a page of the file list.
+
+
+// Types:
+// 0	Audio
+// 1	Video
+// 2	Image
+// 3	Playlist
+struct MediaFile {
+	uint32_t id;
+	std::string section;
+	std::string filename;		// Absolute path.
+	uint8_t type;
+	int64_t size;
+	int64_t mtime;				// Last modification, in seconds of the file system clock.
+	uint32_t generation;		// Generation in which the file was last added, changed or removed.
+	bool removed;
+};
+
+
+struct MediaInfo {
+	int64_t size;				// Size & modification time of the file when probed.
+	int64_t mtime;
+	bool valid;					// False if the file could not be probed.
+	std::string format;			// Name of the input format, as used by av_find_input_format().
+	double duration;			// In seconds.
+	std::string videoCodec;
+	std::string audioCodec;
+	uint32_t width;
+	uint32_t height;
+	std::string title;
+	std::string artist;
+	std::string album;
+	bool thumbnail;				// A thumbnail is stored.
+};
+
+
+struct MediaProbeResult {
+	uint32_t id;
+	MediaInfo info;
+	std::string thumbnail;		// JPEG, empty if none.
+};
+
+
+struct MediaScan;
+
+
+struct MediaScanDir {
+	std::string section;
+	std::filesystem::path path;
+};
+
+
+class MediaIndex {
+	std::string path;
+	std::map<std::string, std::string> sections;	// Section name, folder.
+	
+	std::unique_ptr<Poco::Data::Session> session;
+	std::unique_ptr<Poco::Data::Statement> writeStatement;
+	MediaFile writeFile;							// Bound to the write statement.
+	uint32_t writeType = 0;
+	uint32_t writeRemoved = 0;
+	std::unique_ptr<Poco::Data::Statement> infoStatement;
+	uint32_t infoId = 0;							// Bound to the info statement.
+	MediaInfo writeInfo;
+	uint32_t writeValid = 0;
+	Poco::Data::BLOB writeThumbnail;
+	std::mutex dbMutex;								// Lock before filesMutex when both are needed.
+	
+	std::map<uint32_t, MediaFile> files;			// All entries, including removed ones, by ID.
+	std::unordered_map<std::string, uint32_t> names;	// Filename, ID.
+	std::unordered_map<uint32_t, MediaInfo> infos;		// Details of probed files, by ID.
+	uint32_t generation = 0;
+	uint32_t nextId = 1;
+	std::mutex filesMutex;
+	
+	std::thread scanner;
+	std::atomic<bool> running = { false };
+	
+	// Watch.
+	int inotifyFd = -1;
+	std::map<int, MediaScanDir> watches;			// Watch descriptor, folder.
+	std::mutex watchMutex;
+	std::thread watcher;
+	
+	static std::string loggerName;
+	
+	void loadInfo();
+	bool readFile(const std::filesystem::path &file, const std::string &section, MediaFile &mf);
+	void scanWorker(MediaScan &state);
+	bool scan(const std::vector<MediaScanDir> &roots, std::vector<MediaFile> &found,
+											std::vector<MediaScanDir> &dirs, bool &complete);
+	void commit(std::vector<MediaFile> &changes);
+	void update(const std::vector<MediaFile> &found, const std::set<std::string> &scanned,
+												const std::filesystem::path &dir, bool recursive);
+	void rescan();
+	void rescanDir(const MediaScanDir &dir, bool recursive);
+	void removeDir(const MediaScanDir &dir);
+	void watch(const std::vector<MediaScanDir> &dirs);
+	void runWatcher();
+
+public:
+	MediaIndex() { }
+	~MediaIndex();
+	MediaIndex(const MediaIndex&) = delete;
+	MediaIndex& operator=(const MediaIndex&) = delete;
+	
+	bool open(std::string path);
+	void close();
+	void addSection(std::string name, std::string folder);
+	void start();
+	
+	uint32_t getGeneration();
+	bool get(uint32_t id, MediaFile &file);
+	std::vector<MediaFile> list(uint32_t since, uint32_t start, uint32_t count, std::string filter,
+																			uint32_t &next);
+	
+	std::vector<MediaFile> unprobed(uint32_t start, uint32_t count, const std::set<uint32_t> &skip,
+																			uint32_t &next);
+	void setInfo(const std::vector<MediaProbeResult> &results);
+	bool getInfo(uint32_t id, MediaInfo &info);
+	bool getThumbnail(uint32_t id, std::string &jpeg);
+};
+
+#endif
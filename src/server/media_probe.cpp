@@ -0,0 +1,426 @@
+/*
+	media_probe.cpp - Implementation of the MediaProbe class.
+	
+	Revision 0.
+	
+	Notes:
+			- On Linux the probe threads run at the lowest CPU priority (nice 19), and with the idle
+				I/O priority where supported.
+			- Decoders use a single thread, and the libav interrupt callback aborts a probe as soon
+				as playback starts.
+			- Files to probe are fetched from the index in batches of MP_BATCH, by ID.
+			- Results are stored once MP_BATCH of them are waiting or the oldest is MP_STORE_WAIT
+				old, or when probing pauses or runs out of files.
+	
+	2026/10/18, Maya Posch
+*/
+
+
+#include "media_probe.h"
+
+#include <chrono>
+
+#include <Poco/NumberFormatter.h>
+
+#include <nymph/nymph.h>
+
+extern "C" {
+#include "libavformat/avformat.h"
+#include "libavcodec/avcodec.h"
+#include "libavutil/dict.h"
+#include "libavutil/frame.h"
+#include "libswscale/swscale.h"
+}
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+#define MP_BATCH 32				// Files fetched from the index at a time.
+#define MP_BUSY_WAIT 2000		// Time between checks for the end of playback, in ms.
+#define MP_IDLE_WAIT 5000		// Time between checks for new files, in ms.
+#define MP_STORE_WAIT 5000		// Maximum time results wait to be stored, in ms.
+#define MP_THUMB_SIZE 160		// Maximum width & height of a thumbnail.
+#define MP_MAX_PACKETS 500		// Maximum number of packets read to find a key frame.
+
+
+// Static variables.
+MediaIndex* MediaProbe::index = 0;
+ProbeBusyCallback MediaProbe::busyCallback;
+std::vector<std::thread> MediaProbe::workers;
+std::deque<MediaFile> MediaProbe::queue;
+std::set<uint32_t> MediaProbe::active;
+std::vector<MediaProbeResult> MediaProbe::results;
+std::chrono::steady_clock::time_point MediaProbe::resultsTime;
+uint32_t MediaProbe::cursor = 0;
+int64_t MediaProbe::idleGeneration = -1;
+bool MediaProbe::filling = false;
+std::mutex MediaProbe::mutex;
+std::condition_variable MediaProbe::cv;
+std::atomic<bool> MediaProbe::running = { false };
+std::string MediaProbe::loggerName = "MediaProbe";
+
+
+// --- START ---
+// Start probing the files in the index.
+// cb		: returns true while probing should pause, e.g. during playback.
+// threads	: number of probe threads, 0 to not probe.
+void MediaProbe::start(MediaIndex* index, ProbeBusyCallback cb, uint32_t threads) {
+	if (running || threads == 0) { return; }
+	if (threads > MP_MAX_THREADS) { threads = MP_MAX_THREADS; }
+	
+	MediaProbe::index = index;
+	busyCallback = cb;
+	running = true;
+	for (uint32_t i = 0; i < threads; ++i) {
+		workers.push_back(std::thread(&MediaProbe::run));
+	}
+	
+	NYMPH_LOG_INFORMATION("Probing media files with " + Poco::NumberFormatter::format(threads) +
+							" threads.");
+}
+
+
+// --- STOP ---
+void MediaProbe::stop() {
+	{
+		std::lock_guard<std::mutex> lk(mutex);
+		if (!running) { return; }
+		running = false;
+	}
+	
+	cv.notify_all();
+	for (uint32_t i = 0; i < workers.size(); ++i) {
+		workers[i].join();
+	}
+	
+	workers.clear();
+	queue.clear();
+	
+	std::unique_lock<std::mutex> lk(mutex);
+	store(lk);
+}
+
+
+// --- PAUSED ---
+// Whether probing should stop for now.
+bool MediaProbe::paused() {
+	return !running || (busyCallback && busyCallback());
+}
+
+
+// --- INTERRUPT ---
+// libav interrupt callback. Aborts blocking calls while paused.
+int MediaProbe::interrupt(void* opaque) {
+	return paused() ? 1 : 0;
+}
+
+
+// --- THUMBNAIL ---
+// Decode a key frame of a video stream (about 10% in, or its attached picture), and encode it as
+// a JPEG of at most MP_THUMB_SIZE pixels wide & high.
+bool MediaProbe::thumbnail(AVFormatContext* ctx, int stream, std::string &jpeg) {
+	AVStream* st = ctx->streams[stream];
+	bool attached = (st->disposition & AV_DISPOSITION_ATTACHED_PIC) != 0;
+	const AVCodec* codec = avcodec_find_decoder(st->codecpar->codec_id);
+	if (!codec) { return false; }
+	
+	AVCodecContext* dec = avcodec_alloc_context3(codec);
+	AVPacket* pkt = av_packet_alloc();
+	AVFrame* frame = av_frame_alloc();
+	AVFrame* scaled = 0;
+	AVCodecContext* enc = 0;
+	struct SwsContext* sws = 0;
+	bool success = false;
+	if (!dec || !pkt || !frame || avcodec_parameters_to_context(dec, st->codecpar) < 0) {
+		goto cleanup;
+	}
+	
+	dec->thread_count = 1;
+	dec->skip_frame = AVDISCARD_NONKEY;
+	if (avcodec_open2(dec, codec, 0) < 0) { goto cleanup; }
+	
+	if (!attached && ctx->duration > 0) {
+		int64_t ts = ctx->duration / 10;
+		if (ctx->start_time != AV_NOPTS_VALUE) { ts += ctx->start_time; }
+		av_seek_frame(ctx, -1, ts, AVSEEK_FLAG_BACKWARD);
+	}
+	
+	// Feed packets of the stream to the decoder until it returns a frame.
+	{
+		bool decoded = false;
+		for (int i = 0; i < MP_MAX_PACKETS && !decoded && !paused(); ++i) {
+			int ret = attached ? av_packet_ref(pkt, &st->attached_pic) : av_read_frame(ctx, pkt);
+			if (ret < 0 || (attached && i > 0)) {
+				// End of the stream, flush the decoder.
+				av_packet_unref(pkt);
+				avcodec_send_packet(dec, 0);
+				decoded = avcodec_receive_frame(dec, frame) == 0;
+				break;
+			}
+			
+			if (pkt->stream_index == stream || attached) {
+				avcodec_send_packet(dec, pkt);
+				decoded = avcodec_receive_frame(dec, frame) == 0;
+			}
+			
+			av_packet_unref(pkt);
+		}
+		
+		if (!decoded || frame->width <= 0 || frame->height <= 0) { goto cleanup; }
+	}
+	
+	// Scale to the thumbnail size, keeping the aspect ratio, and encode.
+	{
+		int width = frame->width;
+		int height = frame->height;
+		if (width > MP_THUMB_SIZE || height > MP_THUMB_SIZE) {
+			if (width >= height) {
+				height = height * MP_THUMB_SIZE / width;
+				width = MP_THUMB_SIZE;
+			}
+			else {
+				width = width * MP_THUMB_SIZE / height;
+				height = MP_THUMB_SIZE;
+			}
+		}
+		
+		width = (width + 1) & ~1;
+		height = (height + 1) & ~1;
+		if (width < 2) { width = 2; }
+		if (height < 2) { height = 2; }
+		
+		sws = sws_getContext(frame->width, frame->height, (AVPixelFormat) frame->format, width, height,
+											AV_PIX_FMT_YUVJ420P, SWS_BILINEAR, 0, 0, 0);
+		scaled = av_frame_alloc();
+		if (!sws || !scaled) { goto cleanup; }
+		
+		scaled->format = AV_PIX_FMT_YUVJ420P;
+		scaled->width = width;
+		scaled->height = height;
+		if (av_frame_get_buffer(scaled, 0) < 0) { goto cleanup; }
+		
+		sws_scale(sws, frame->data, frame->linesize, 0, frame->height, scaled->data, scaled->linesize);
+		
+		const AVCodec* mjpeg = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+		if (!mjpeg) { goto cleanup; }
+		
+		enc = avcodec_alloc_context3(mjpeg);
+		if (!enc) { goto cleanup; }
+		
+		enc->width = width;
+		enc->height = height;
+		enc->pix_fmt = AV_PIX_FMT_YUVJ420P;
+		enc->time_base.num = 1;
+		enc->time_base.den = 25;
+		enc->thread_count = 1;
+		enc->flags |= AV_CODEC_FLAG_QSCALE;
+		enc->global_quality = FF_QP2LAMBDA * 5;
+		if (avcodec_open2(enc, mjpeg, 0) < 0) { goto cleanup; }
+		
+		scaled->pts = 0;
+		scaled->quality = enc->global_quality;
+		if (avcodec_send_frame(enc, scaled) < 0) { goto cleanup; }
+		if (avcodec_receive_packet(enc, pkt) < 0) { goto cleanup; }
+		
+		jpeg.assign((const char*) pkt->data, pkt->size);
+		av_packet_unref(pkt);
+		success = true;
+	}
+
+cleanup:
+	if (enc) { avcodec_free_context(&enc); }
+	if (sws) { sws_freeContext(sws); }
+	if (scaled) { av_frame_free(&scaled); }
+	if (frame) { av_frame_free(&frame); }
+	if (pkt) { av_packet_free(&pkt); }
+	if (dec) { avcodec_free_context(&dec); }
+	
+	return success;
+}
+
+
+// --- PROBE ---
+// Read the details & thumbnail of a file. Returns false if interrupted, in which case the file
+// should be probed again later. Sets info.valid to false if the file could not be read.
+bool MediaProbe::probe(const MediaFile &mf, MediaInfo &info, std::string &jpeg) {
+	info.size = mf.size;
+	info.mtime = mf.mtime;
+	info.valid = false;
+	info.duration = 0.0;
+	info.width = 0;
+	info.height = 0;
+	info.thumbnail = false;
+	
+	AVFormatContext* ctx = avformat_alloc_context();
+	if (!ctx) { return false; }
+	
+	ctx->interrupt_callback.callback = &MediaProbe::interrupt;
+	ctx->interrupt_callback.opaque = 0;
+	if (avformat_open_input(&ctx, mf.filename.c_str(), 0, 0) < 0) {
+		// The context is freed on failure.
+		return !paused();
+	}
+	
+	if (avformat_find_stream_info(ctx, 0) < 0) {
+		avformat_close_input(&ctx);
+		return !paused();
+	}
+	
+	// The name of the format can be a list of names. The first one finds the demuxer.
+	std::string format = ctx->iformat->name;
+	info.format = format.substr(0, format.find(','));
+	if (ctx->duration != AV_NOPTS_VALUE && ctx->duration > 0) {
+		info.duration = ctx->duration / (double) AV_TIME_BASE;
+	}
+	
+	int video = av_find_best_stream(ctx, AVMEDIA_TYPE_VIDEO, -1, -1, 0, 0);
+	int audio = av_find_best_stream(ctx, AVMEDIA_TYPE_AUDIO, -1, -1, 0, 0);
+	if (video >= 0) {
+		AVCodecParameters* par = ctx->streams[video]->codecpar;
+		info.videoCodec = avcodec_get_name(par->codec_id);
+		if (!(ctx->streams[video]->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
+			info.width = par->width;
+			info.height = par->height;
+		}
+	}
+	
+	if (audio >= 0) {
+		info.audioCodec = avcodec_get_name(ctx->streams[audio]->codecpar->codec_id);
+	}
+	
+	AVDictionaryEntry* tag = av_dict_get(ctx->metadata, "title", 0, 0);
+	if (tag) { info.title = tag->value; }
+	tag = av_dict_get(ctx->metadata, "artist", 0, 0);
+	if (!tag) { tag = av_dict_get(ctx->metadata, "author", 0, 0); }
+	if (tag) { info.artist = tag->value; }
+	tag = av_dict_get(ctx->metadata, "album", 0, 0);
+	if (tag) { info.album = tag->value; }
+	
+	if (video >= 0 && !thumbnail(ctx, video, jpeg)) {
+		jpeg.clear();
+	}
+	
+	avformat_close_input(&ctx);
+	if (paused()) { return false; }
+	
+	info.valid = true;
+	return true;
+}
+
+
+// --- FILL ---
+// Fetch the next batch of files to probe from the index. Call with the mutex locked, which is
+// released during the query. Only one thread fetches at a time, the others return right away.
+void MediaProbe::fill(std::unique_lock<std::mutex> &lk) {
+	if (filling) { return; }
+	
+	int64_t generation = index->getGeneration();
+	if (cursor == 0 && generation == idleGeneration) { return; }
+	
+	filling = true;
+	uint32_t from = cursor;
+	std::set<uint32_t> skip = active;
+	lk.unlock();
+	
+	uint32_t next;
+	std::vector<MediaFile> found = index->unprobed(from, MP_BATCH, skip, next);
+	if (found.empty() && from != 0) {
+		// Start over from the first file, for files which changed in the meantime.
+		found = index->unprobed(0, MP_BATCH, skip, next);
+	}
+	
+	lk.lock();
+	filling = false;
+	if (found.empty()) { idleGeneration = generation; }
+	
+	// Skip files which got picked up meanwhile, or put back after an interrupted probe.
+	std::set<uint32_t> queued;
+	for (uint32_t i = 0; i < queue.size(); ++i) { queued.insert(queue[i].id); }
+	for (uint32_t i = 0; i < found.size(); ++i) {
+		if (active.count(found[i].id) || queued.count(found[i].id)) { continue; }
+		queue.push_back(found[i]);
+	}
+	
+	cursor = next;
+	cv.notify_all();
+}
+
+
+// --- STORE ---
+// Store the waiting results in the index, as a single change. Call with the mutex locked, which
+// is released meanwhile.
+void MediaProbe::store(std::unique_lock<std::mutex> &lk) {
+	if (results.empty()) { return; }
+	
+	std::vector<MediaProbeResult> batch;
+	batch.swap(results);
+	lk.unlock();
+	
+	index->setInfo(batch);
+	
+	lk.lock();
+	for (uint32_t i = 0; i < batch.size(); ++i) {
+		active.erase(batch[i].id);
+	}
+}
+
+
+// --- RUN ---
+// Probe thread.
+void MediaProbe::run() {
+#ifdef __linux__
+	// Applies to this thread only on Linux.
+	setpriority(PRIO_PROCESS, (id_t) syscall(SYS_gettid), 19);
+#ifdef SYS_ioprio_set
+	syscall(SYS_ioprio_set, 1, (int) syscall(SYS_gettid), 3 << 13);	// Thread, idle class.
+#endif
+#endif
+	
+	std::unique_lock<std::mutex> lk(mutex);
+	while (running) {
+		if (busyCallback && busyCallback()) {
+			store(lk);
+			cv.wait_for(lk, std::chrono::milliseconds(MP_BUSY_WAIT));
+			continue;
+		}
+		
+		if (queue.empty()) { fill(lk); }
+		if (queue.empty()) {
+			store(lk);
+			cv.wait_for(lk, std::chrono::milliseconds(MP_IDLE_WAIT));
+			continue;
+		}
+		
+		MediaFile mf = queue.front();
+		queue.pop_front();
+		active.insert(mf.id);
+		lk.unlock();
+		
+		MediaProbeResult result;
+		result.id = mf.id;
+		bool done = probe(mf, result.info, result.thumbnail);
+		if (done && !result.info.valid) {
+			NYMPH_LOG_DEBUG("Failed to probe " + mf.filename + ".");
+		}
+		
+		lk.lock();
+		if (!done) {
+			active.erase(mf.id);
+			queue.push_front(mf);
+			continue;
+		}
+		
+		// The file stays in 'active' until stored, so that it is not fetched again meanwhile.
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (results.empty()) { resultsTime = now; }
+		results.push_back(result);
+		if (results.size() >= MP_BATCH ||
+					now - resultsTime >= std::chrono::milliseconds(MP_STORE_WAIT)) {
+			store(lk);
+		}
+	}
+}
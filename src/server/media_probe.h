@@ -0,0 +1,80 @@
+/*
+	media_probe.h - Header for the background probing of local media files.
+	
+	Revision 0
+	
+	Features:
+			- Probes the audio & video files in the media index with libavformat, and stores the
+				format, duration, codecs, tags & a small JPEG thumbnail with each file.
+			- Runs on a small number of low priority threads, which pause while media is playing.
+	
+	Notes:
+			- Only a single key frame is decoded per file, for the thumbnail.
+			- A probe which is interrupted by playback is started over later.
+			- Files which could not be probed are stored as such, and probed again once they change.
+			- Results are stored in the index in batches, each as a single change of the index.
+	
+	2026/10/18, Maya Posch
+*/
+
+
+#ifndef MEDIA_PROBE_H
+#define MEDIA_PROBE_H
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <set>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <chrono>
+
+#include "media_index.h"
+
+
+#define MP_MAX_THREADS 4		// Maximum number of probe threads.
+
+
+struct AVFormatContext;
+
+
+typedef std::function<bool()> ProbeBusyCallback;
+
+
+class MediaProbe {
+	static MediaIndex* index;
+	static ProbeBusyCallback busyCallback;
+	
+	static std::vector<std::thread> workers;
+	static std::deque<MediaFile> queue;			// Files to probe.
+	static std::set<uint32_t> active;			// IDs of the files being probed, or not yet stored.
+	static std::vector<MediaProbeResult> results;	// Probed files not yet stored in the index.
+	static std::chrono::steady_clock::time_point resultsTime;	// Time of the oldest result.
+	static uint32_t cursor;						// ID to continue finding files from.
+	static int64_t idleGeneration;				// Index generation in which no files were left.
+	static bool filling;						// A thread is fetching files from the index.
+	static std::mutex mutex;
+	static std::condition_variable cv;
+	static std::atomic<bool> running;
+	
+	static std::string loggerName;
+	
+	static bool paused();
+	static int interrupt(void* opaque);
+	static bool thumbnail(AVFormatContext* ctx, int stream, std::string &jpeg);
+	static bool probe(const MediaFile &mf, MediaInfo &info, std::string &jpeg);
+	static void fill(std::unique_lock<std::mutex> &lk);
+	static void store(std::unique_lock<std::mutex> &lk);
+	static void run();
+
+public:
+	static void start(MediaIndex* index, ProbeBusyCallback cb, uint32_t threads);
+	static void stop();
+};
+
+#endif
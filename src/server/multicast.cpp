@@ -0,0 +1,758 @@
+/*
+	multicast.cpp - Implementation of the multicast media transport.
+	
+	Revision 0.
+	
+	Notes:
+			- A group is closed after MC_GROUP_SIZE data packets, or at the end of each chunk, so
+				that the last packets of a chunk do not wait for parity.
+			- Recently delivered packets are kept (MC_KEEP), as they may be needed to restore
+				a later packet of the same group.
+			- A missing packet is requested after MC_NACK_DELAY, to allow for reordering, and
+				again every MC_NACK_INTERVAL. After MC_GAP_TIMEOUT it is given up on.
+	
+	2026/10/18, Maya Posch
+*/
+
+
+#include "multicast.h"
+
+#include <chrono>
+
+#include <nymph/nymph_logger.h>
+
+#include <Poco/Net/NetworkInterface.h>
+#include <Poco/NumberFormatter.h>
+#include <Poco/Exception.h>
+
+
+#define MC_MAGIC 0x4E434D43			// 'NCMC'
+#define MC_HISTORY 4096				// Data packets kept by the sender to send again.
+#define MC_KEEP 64					// Delivered data packets kept by the receiver.
+#define MC_WINDOW 4096				// Maximum data packets held back by a gap.
+#define MC_NACK_DELAY 20000			// Microseconds.
+#define MC_NACK_INTERVAL 100000		// Microseconds.
+#define MC_NACK_MAX 256				// Data packets requested per poll.
+#define MC_RESEND_HOLDOFF 50000		// Microseconds a packet is not sent again after a resend.
+#define MC_GAP_TIMEOUT 2000000		// Microseconds.
+#define MC_POLL_INTERVAL 10			// Receive timeout & gap check interval, in milliseconds.
+#define MC_STATUS_INTERVAL 50		// Idle time before a status packet, in milliseconds.
+#define MC_SOCKET_BUFFER 4194304	// Receive buffer size, in bytes.
+
+
+// Static variables.
+std::string McastSender::loggerName = "McastSender";
+std::string McastReceiver::loggerName = "McastReceiver";
+
+
+static void put16(std::string &s, size_t i, uint16_t v) {
+	s[i] = (char) (v >> 8);
+	s[i + 1] = (char) v;
+}
+
+
+static void put32(std::string &s, size_t i, uint32_t v) {
+	put16(s, i, (uint16_t) (v >> 16));
+	put16(s, i + 2, (uint16_t) v);
+}
+
+
+static uint16_t get16(const uint8_t* p) {
+	return (uint16_t) ((p[0] << 8) | p[1]);
+}
+
+
+static uint32_t get32(const uint8_t* p) {
+	return ((uint32_t) get16(p) << 16) | get16(p + 2);
+}
+
+
+// XOR 'src' into 'dst', growing 'dst' with zeroes as needed.
+static void xorInto(std::string &dst, const std::string &src) {
+	if (dst.size() < src.size()) { dst.resize(src.size(), 0); }
+	for (size_t i = 0; i < src.size(); ++i) {
+		dst[i] ^= src[i];
+	}
+}
+
+
+// Sequence number comparison which handles wrap-around.
+static bool seqBefore(uint32_t a, uint32_t b) {
+	return (int32_t) (a - b) < 0;
+}
+
+
+// --- SERIALIZE ---
+std::string McastPacket::serialize() const {
+	std::string out(MC_HEADER_SIZE, 0);
+	put32(out, 0, MC_MAGIC);
+	put32(out, 4, stream);
+	put32(out, 8, seq);
+	out[12] = (char) count;
+	out[13] = (char) type;
+	out[14] = (char) flags;
+	put16(out, 16, length);
+	out.append(payload);
+	
+	return out;
+}
+
+
+// --- PARSE ---
+// Returns false if this is not a valid packet.
+bool McastPacket::parse(const uint8_t* data, size_t size) {
+	if (size < MC_HEADER_SIZE || size > MC_HEADER_SIZE + MC_PAYLOAD_MAX) { return false; }
+	if (get32(data) != MC_MAGIC) { return false; }
+	
+	stream = get32(data + 4);
+	seq = get32(data + 8);
+	count = data[12];
+	type = data[13];
+	flags = data[14];
+	length = get16(data + 16);
+	payload.assign((const char*) data + MC_HEADER_SIZE, size - MC_HEADER_SIZE);
+	
+	if (type == MC_TYPE_DATA) { return length == payload.size(); }
+	if (type == MC_TYPE_PARITY) { return count > 0 && count <= MC_GROUP_SIZE; }
+	if (type == MC_TYPE_STATUS) { return payload.empty(); }
+	
+	return false;
+}
+
+
+// --- CONSTRUCTOR ---
+McastEncoder::McastEncoder(McastOutput output) {
+	this->output = output;
+	history.resize(MC_HISTORY);
+	resent.resize(MC_HISTORY);
+	reset();
+}
+
+
+// --- RESET ---
+// Start a new stream, e.g. after a seek. Packets of the old stream are no longer sent again.
+void McastEncoder::reset() {
+	stream++;
+	seq = 0;
+	parity = McastPacket();
+	parity.type = MC_TYPE_PARITY;
+	for (size_t i = 0; i < history.size(); ++i) {
+		history[i].clear();
+		resent[i] = 0;
+	}
+}
+
+
+// --- ADD DATA ---
+void McastEncoder::addData(const char* data, uint16_t length, uint8_t flags) {
+	McastPacket pkt;
+	pkt.stream = stream;
+	pkt.seq = seq++;
+	pkt.flags = flags;
+	pkt.length = length;
+	pkt.payload.assign(data, length);
+	
+	if (parity.count == 0) { parity.seq = pkt.seq; }
+	parity.count++;
+	parity.flags ^= flags;
+	parity.length ^= length;
+	xorInto(parity.payload, pkt.payload);
+	
+	std::string& out = history[pkt.seq % MC_HISTORY];
+	out = pkt.serialize();
+	resent[pkt.seq % MC_HISTORY] = 0;
+	output(out);
+	
+	if (parity.count == MC_GROUP_SIZE) { closeGroup(); }
+}
+
+
+// --- CLOSE GROUP ---
+// Send the parity of the current group.
+void McastEncoder::closeGroup() {
+	if (parity.count == 0) { return; }
+	
+	parity.stream = stream;
+	output(parity.serialize());
+	
+	parity = McastPacket();
+	parity.type = MC_TYPE_PARITY;
+}
+
+
+// --- WRITE ---
+// Split a chunk of media data into packets and send these, followed by the parity.
+void McastEncoder::write(const char* data, uint32_t length, bool done) {
+	uint32_t offset = 0;
+	do {
+		uint16_t size = (uint16_t) std::min<uint32_t>(length - offset, MC_PAYLOAD_MAX);
+		bool last = (offset + size == length);
+		addData(data + offset, size, (last && done) ? MC_FLAG_DONE : 0);
+		offset += size;
+	}
+	while (offset < length);
+	
+	closeGroup();
+}
+
+
+// --- STATUS ---
+// Send the sequence number of the next data packet.
+void McastEncoder::status() {
+	McastPacket pkt;
+	pkt.stream = stream;
+	pkt.seq = seq;
+	pkt.type = MC_TYPE_STATUS;
+	output(pkt.serialize());
+}
+
+
+// --- RESEND ---
+// Send a data packet of the current stream again. Requests from several receivers for the same
+// packet are answered once, as each resend reaches all receivers.
+// Returns false if it is no longer available.
+bool McastEncoder::resend(uint32_t stream, uint32_t seq, int64_t now) {
+	if (stream != this->stream || !seqBefore(seq, this->seq)) { return false; }
+	if (this->seq - seq > MC_HISTORY) { return false; }
+	
+	int64_t& last = resent[seq % MC_HISTORY];
+	if (last != 0 && now - last < MC_RESEND_HOLDOFF) { return true; }
+	
+	last = now;
+	output(history[seq % MC_HISTORY]);
+	
+	return true;
+}
+
+
+// --- CONSTRUCTOR ---
+McastDecoder::McastDecoder(McastDeliver deliver, McastNack nack) {
+	this->deliver = deliver;
+	this->nack = nack;
+}
+
+
+// --- CLEAR ---
+void McastDecoder::clear() {
+	data.clear();
+	parity.clear();
+	gaps.clear();
+	pending.clear();
+	pendingDone = false;
+	nextSeq = 0;
+	endSeq = 0;
+}
+
+
+// --- RESET ---
+// Drop all data and continue with 'stream', e.g. after a seek. Packets of earlier streams which
+// are still on their way are dropped.
+void McastDecoder::reset(uint32_t stream) {
+	clear();
+	this->stream = stream;
+	started = true;
+}
+
+
+// --- RESTART ---
+// Forget the current stream. The stream of the next packet received is picked up, e.g. when
+// joining a group.
+void McastDecoder::restart() {
+	clear();
+	started = false;
+}
+
+
+// --- START STREAM ---
+void McastDecoder::startStream(uint32_t stream) {
+	clear();
+	this->stream = stream;
+	started = true;
+}
+
+
+// --- EXTEND ---
+// A packet up to 'end' was sent. Register the data packets not received yet as missing.
+void McastDecoder::extend(uint32_t end, int64_t now) {
+	if (!seqBefore(endSeq, end)) { return; }
+	
+	// Anything further back than the window is given up on by poll().
+	uint32_t s = endSeq;
+	if (end - nextSeq > MC_WINDOW) { s = end - MC_WINDOW; }
+	if (seqBefore(s, endSeq)) { s = endSeq; }
+	
+	for (; s != end; ++s) {
+		McastGap gap;
+		gap.seen = now;
+		gap.nacked = 0;
+		gaps[s] = gap;
+	}
+	
+	endSeq = end;
+}
+
+
+// --- RECOVER ---
+// Restore a missing data packet from the parity of its group.
+// Returns true if the packet is now available.
+bool McastDecoder::recover(uint32_t seq) {
+	std::map<uint32_t, McastPacket>::iterator pit = parity.upper_bound(seq);
+	if (pit == parity.begin()) { return false; }
+	--pit;
+	
+	McastPacket& par = pit->second;
+	if (seq - par.seq >= par.count) { return false; }
+	
+	McastPacket pkt;
+	pkt.stream = stream;
+	pkt.seq = seq;
+	pkt.flags = par.flags;
+	pkt.length = par.length;
+	pkt.payload = par.payload;
+	for (uint32_t s = par.seq; s != par.seq + par.count; ++s) {
+		if (s == seq) { continue; }
+		
+		std::map<uint32_t, McastPacket>::iterator it = data.find(s);
+		if (it == data.end()) { return false; }		// More than one packet missing.
+		
+		pkt.flags ^= it->second.flags;
+		pkt.length ^= it->second.length;
+		xorInto(pkt.payload, it->second.payload);
+	}
+	
+	if (pkt.length > pkt.payload.size()) { return false; }
+	
+	pkt.payload.resize(pkt.length);
+	data[seq] = pkt;
+	gaps.erase(seq);
+	stats.recovered++;
+	
+	return true;
+}
+
+
+// --- RECOVER GROUP ---
+// Called when a packet of the group containing 'seq' came in. Restores the one missing packet of
+// the group, if there is one.
+void McastDecoder::recoverGroup(uint32_t seq) {
+	std::map<uint32_t, McastPacket>::iterator pit = parity.upper_bound(seq);
+	if (pit == parity.begin()) { return; }
+	--pit;
+	
+	McastPacket& par = pit->second;
+	if (seq - par.seq >= par.count) { return; }
+	
+	uint32_t missing = 0;
+	uint32_t missingSeq = 0;
+	for (uint32_t s = par.seq; s != par.seq + par.count; ++s) {
+		if (data.find(s) != data.end()) { continue; }
+		if (seqBefore(s, nextSeq) || ++missing > 1) { return; }
+		
+		missingSeq = s;
+	}
+	
+	if (missing == 1) { recover(missingSeq); }
+}
+
+
+// --- FLUSH READY ---
+// Deliver the data packets which are next in line.
+void McastDecoder::flushReady() {
+	while (true) {
+		if (!pending.empty() || pendingDone) {
+			uint32_t done = deliver(pending.data(), (uint32_t) pending.size(), pendingDone);
+			pending.erase(0, done);
+			if (!pending.empty()) { return; }
+			
+			pendingDone = false;
+		}
+		
+		if (!seqBefore(nextSeq, endSeq)) { break; }
+		if (data.find(nextSeq) == data.end() && !recover(nextSeq)) { break; }
+		
+		McastPacket& pkt = data[nextSeq];
+		nextSeq++;
+		gaps.erase(pkt.seq);
+		pending = pkt.payload;
+		pendingDone = (pkt.flags & MC_FLAG_DONE) != 0;
+	}
+	
+	// Drop what can no longer be needed.
+	while (!data.empty() && seqBefore(data.begin()->first + MC_KEEP, nextSeq)) {
+		data.erase(data.begin());
+	}
+	
+	while (!parity.empty() &&
+			!seqBefore(nextSeq, parity.begin()->second.seq + parity.begin()->second.count)) {
+		parity.erase(parity.begin());
+	}
+}
+
+
+// --- INPUT ---
+// Process a received packet.
+void McastDecoder::input(const uint8_t* bytes, size_t size, int64_t now) {
+	McastPacket pkt;
+	if (!pkt.parse(bytes, size)) { return; }
+	
+	if (!started || seqBefore(stream, pkt.stream)) {
+		startStream(pkt.stream);
+	}
+	else if (pkt.stream != stream) {
+		return;		// Earlier stream.
+	}
+	
+	if (pkt.type == MC_TYPE_STATUS) {
+		extend(pkt.seq, now);
+		return;
+	}
+	
+	stats.received++;
+	if (pkt.type == MC_TYPE_DATA) {
+		if (seqBefore(pkt.seq, nextSeq) || data.find(pkt.seq) != data.end()) {
+			stats.duplicates++;
+			return;
+		}
+		
+		extend(pkt.seq + 1, now);
+		data[pkt.seq] = pkt;
+		gaps.erase(pkt.seq);
+		recoverGroup(pkt.seq);
+	}
+	else {
+		uint32_t end = pkt.seq + pkt.count;
+		if (!seqBefore(nextSeq, end)) { return; }
+		extend(end, now);
+		parity[pkt.seq] = pkt;
+		recoverGroup(pkt.seq);
+	}
+	
+	flushReady();
+}
+
+
+// --- POLL ---
+// Give up on packets which are too far behind, request the other missing packets.
+void McastDecoder::poll(int64_t now) {
+	if (!started) { return; }
+	
+	flushReady();
+	
+	// Give up on a gap which is too old or holds back too much data.
+	while (seqBefore(nextSeq, endSeq)) {
+		if (data.find(nextSeq) != data.end()) { break; }	// Waiting for room, not a gap.
+		
+		std::map<uint32_t, McastGap>::iterator it = gaps.find(nextSeq);
+		bool expired = (it != gaps.end() && now - it->second.seen > MC_GAP_TIMEOUT);
+		if (!expired && endSeq - nextSeq <= MC_WINDOW) { break; }
+		
+		stats.lost++;
+		gaps.erase(nextSeq);
+		nextSeq++;
+		flushReady();
+	}
+	
+	// Request missing packets, as ranges. The oldest ones first, limited so that the packets
+	// sent again do not overflow the receive buffer.
+	uint32_t first = 0;
+	uint32_t count = 0;
+	uint32_t requested = 0;
+	std::map<uint32_t, McastGap>::iterator it;
+	for (it = gaps.begin(); it != gaps.end() && requested < MC_NACK_MAX; ++it) {
+		McastGap& gap = it->second;
+		bool due = (now - gap.seen >= MC_NACK_DELAY) &&
+							(gap.nacked == 0 || now - gap.nacked >= MC_NACK_INTERVAL);
+		if (due && count > 0 && it->first == first + count) {
+			count++;
+		}
+		else {
+			if (count > 0) { nack(stream, first, count); }
+			count = 0;
+			if (due) {
+				first = it->first;
+				count = 1;
+			}
+		}
+		
+		if (due) {
+			gap.nacked = now;
+			stats.nacked++;
+			requested++;
+		}
+	}
+	
+	if (count > 0) { nack(stream, first, count); }
+}
+
+
+// --- CONSTRUCTOR ---
+McastSender::McastSender() : encoder([this](const std::string &packet) { output(packet); }) {
+	//
+}
+
+
+// --- DESTRUCTOR ---
+McastSender::~McastSender() {
+	stop();
+}
+
+
+// --- START ---
+// Open the socket for sending to 'group':'port'. With 'iface' set, send through the network
+// interface of this name.
+bool McastSender::start(std::string group, uint16_t port, std::string iface) {
+	stop();
+	
+	std::lock_guard<std::mutex> lk(senderMutex);
+	try {
+		target = Poco::Net::SocketAddress(group, port);
+		socket = Poco::Net::MulticastSocket(target.family());
+		if (!iface.empty()) {
+			socket.setInterface(Poco::Net::NetworkInterface::forName(iface));
+		}
+		
+		socket.setLoopback(true);
+		socket.setTimeToLive(1);
+	}
+	catch (Poco::Exception &e) {
+		NYMPH_LOG_ERROR("Failed to open multicast socket: " + e.displayText());
+		return false;
+	}
+	
+	encoder.reset();
+	lastSend = std::chrono::steady_clock::now();
+	open = true;
+	statusThread = std::thread(&McastSender::sendStatus, this);
+	
+	NYMPH_LOG_INFORMATION("Sending media data to multicast group " + target.toString() + ".");
+	
+	return true;
+}
+
+
+// --- STOP ---
+void McastSender::stop() {
+	{
+		std::lock_guard<std::mutex> lk(senderMutex);
+		if (!open) { return; }
+		
+		open = false;
+	}
+	
+	statusCv.notify_one();
+	statusThread.join();
+	socket.close();
+}
+
+
+// --- SEND STATUS ---
+// Status thread. Sends the next sequence number while no data is being sent.
+void McastSender::sendStatus() {
+	std::chrono::milliseconds interval(MC_STATUS_INTERVAL);
+	std::unique_lock<std::mutex> lk(senderMutex);
+	while (open) {
+		statusCv.wait_until(lk, lastSend + interval);
+		if (!open) { break; }
+		if (std::chrono::steady_clock::now() - lastSend < interval) { continue; }
+		
+		encoder.status();
+	}
+}
+
+
+// --- OUTPUT ---
+// Called by the encoder, with the sender mutex held.
+void McastSender::output(const std::string &packet) {
+	lastSend = std::chrono::steady_clock::now();
+	if (lossHook) {
+		McastPacket pkt;
+		if (pkt.parse((const uint8_t*) packet.data(), packet.size()) && lossHook(pkt)) { return; }
+	}
+	
+	try {
+		socket.sendTo(packet.data(), (int) packet.size(), target);
+	}
+	catch (Poco::Exception &e) {
+		NYMPH_LOG_ERROR("Multicast send failed: " + e.displayText());
+	}
+}
+
+
+// --- SEND ---
+void McastSender::send(const char* data, uint32_t length, bool done) {
+	std::lock_guard<std::mutex> lk(senderMutex);
+	if (!open) { return; }
+	
+	encoder.write(data, length, done);
+}
+
+
+// --- RESET ---
+// Start a new stream, so that receivers drop what is left of the current one.
+void McastSender::reset() {
+	std::lock_guard<std::mutex> lk(senderMutex);
+	encoder.reset();
+}
+
+
+// --- GET STREAM ---
+// Returns the current stream number, to be passed to the receivers on a reset.
+uint32_t McastSender::getStream() {
+	std::lock_guard<std::mutex> lk(senderMutex);
+	return encoder.getStream();
+}
+
+
+// --- RESEND ---
+// Answer a NACK from a receiver.
+void McastSender::resend(uint32_t stream, uint32_t seq, uint32_t count) {
+	std::lock_guard<std::mutex> lk(senderMutex);
+	if (!open) { return; }
+	
+	int64_t now = std::chrono::duration_cast<std::chrono::microseconds>(
+								std::chrono::steady_clock::now().time_since_epoch()).count();
+	for (uint32_t i = 0; i < count; ++i) {
+		if (!encoder.resend(stream, seq + i, now)) {
+			NYMPH_LOG_WARNING("Requested packet " + Poco::NumberFormatter::format(seq + i) +
+															" is no longer available.");
+			return;
+		}
+	}
+}
+
+
+// --- SET LOSS HOOK ---
+// For testing: the hook is called for each outgoing packet, which is dropped if it returns true.
+void McastSender::setLossHook(McastLossHook hook) {
+	std::lock_guard<std::mutex> lk(senderMutex);
+	lossHook = hook;
+}
+
+
+// --- CONSTRUCTOR ---
+// NACKs are sent by the receiving thread after releasing the decoder, as sending these may take
+// a round trip.
+McastReceiver::McastReceiver(McastDeliver deliver, McastNack nack) : decoder(deliver,
+					[this](uint32_t stream, uint32_t seq, uint32_t count) {
+						McastNackRange range = { stream, seq, count };
+						nacks.push_back(range);
+					}) {
+	this->nack = nack;
+}
+
+
+// --- DESTRUCTOR ---
+McastReceiver::~McastReceiver() {
+	stop();
+}
+
+
+// --- START ---
+// Join 'group' and start receiving on 'port'. With 'iface' set, join on the network interface
+// of this name.
+bool McastReceiver::start(std::string group, uint16_t port, std::string iface) {
+	stop();
+	
+	try {
+		groupAddress = Poco::Net::IPAddress(group);
+		socket = Poco::Net::MulticastSocket(groupAddress.family());
+		socket.bind(Poco::Net::SocketAddress(Poco::Net::IPAddress(groupAddress.family()), port),
+																						true);
+		if (iface.empty()) {
+			socket.joinGroup(groupAddress);
+		}
+		else {
+			socket.joinGroup(groupAddress, Poco::Net::NetworkInterface::forName(iface));
+		}
+		
+		socket.setReceiveBufferSize(MC_SOCKET_BUFFER);
+		socket.setReceiveTimeout(Poco::Timespan(0, MC_POLL_INTERVAL * 1000));
+	}
+	catch (Poco::Exception &e) {
+		NYMPH_LOG_ERROR("Failed to join multicast group: " + e.displayText());
+		return false;
+	}
+	
+	{
+		std::lock_guard<std::mutex> lk(decoderMutex);
+		decoder.restart();
+	}
+	
+	running = true;
+	worker = std::thread(&McastReceiver::run, this);
+	
+	NYMPH_LOG_INFORMATION("Receiving media data from multicast group " + group + ":" +
+											Poco::NumberFormatter::format(port) + ".");
+	
+	return true;
+}
+
+
+// --- STOP ---
+void McastReceiver::stop() {
+	running = false;
+	if (!worker.joinable()) { return; }
+	
+	worker.join();
+	try {
+		socket.leaveGroup(groupAddress);
+	}
+	catch (Poco::Exception&) { }
+	
+	socket.close();
+}
+
+
+// --- RESET ---
+// Drop buffered packets and continue with the sender's new 'stream', e.g. on a seek.
+void McastReceiver::reset(uint32_t stream) {
+	std::lock_guard<std::mutex> lk(decoderMutex);
+	decoder.reset(stream);
+}
+
+
+// --- GET STATS ---
+McastStats McastReceiver::getStats() {
+	std::lock_guard<std::mutex> lk(decoderMutex);
+	return decoder.getStats();
+}
+
+
+// --- RUN ---
+void McastReceiver::run() {
+	std::vector<uint8_t> buf(MC_HEADER_SIZE + MC_PAYLOAD_MAX);
+	std::chrono::steady_clock::time_point lastPoll = std::chrono::steady_clock::now();
+	while (running) {
+		int n = 0;
+		try {
+			n = socket.receiveBytes(buf.data(), (int) buf.size());
+		}
+		catch (Poco::TimeoutException&) { }
+		catch (Poco::Exception &e) {
+			NYMPH_LOG_ERROR("Multicast receive failed: " + e.displayText());
+			running = false;
+			break;
+		}
+		
+		std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+		int64_t now = std::chrono::duration_cast<std::chrono::microseconds>(
+															t.time_since_epoch()).count();
+		
+		std::vector<McastNackRange> requests;
+		{
+			std::lock_guard<std::mutex> lk(decoderMutex);
+			if (n > 0) { decoder.input(buf.data(), n, now); }
+			
+			if (t - lastPoll >= std::chrono::milliseconds(MC_POLL_INTERVAL)) {
+				decoder.poll(now);
+				lastPoll = t;
+			}
+			
+			requests.swap(nacks);
+		}
+		
+		for (size_t i = 0; i < requests.size(); ++i) {
+			nack(requests[i].stream, requests[i].seq, requests[i].count);
+		}
+	}
+}
@@ -0,0 +1,219 @@
+/*
+	multicast.h - Header for the master to slave multicast media transport.
+	
+	Revision 0
+	
+	Features:
+			- Sends each chunk of media data once over UDP multicast to all slave receivers,
+				instead of over one RPC stream per slave.
+			- Packets are sequence numbered. Each group of up to MC_GROUP_SIZE data packets is
+				followed by an XOR parity packet, which allows a receiver to restore one lost
+				packet per group.
+			- Receivers deliver the data in order and request packets which could not be
+				restored (NACK). The sender keeps recent packets around to send those again.
+			- While no data is sent, the sender regularly sends the next sequence number, so that
+				receivers also notice the loss of the last packets of a file.
+	
+	Notes:
+			- Packet format: 20 byte header (network byte order), followed by the payload.
+				0: magic 'NCMC', 4: stream, 8: sequence number (parity: first of the group,
+				status: next data packet), 12: group size (parity only), 13: type, 14: flags,
+				16: payload length.
+			- The stream number changes when the data is reset (seek). Receivers drop packets
+				of earlier streams.
+			- McastEncoder & McastDecoder hold the protocol logic, McastSender & McastReceiver
+				add the sockets.
+			- The sender does not wait for receivers, the data rate is set by the client. Packets
+				older than the sender's history (MC_HISTORY) can no longer be sent again.
+	
+	2026/10/18, Maya Posch
+*/
+
+
+#ifndef MULTICAST_H
+#define MULTICAST_H
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
+
+#include <Poco/Net/MulticastSocket.h>
+#include <Poco/Net/SocketAddress.h>
+
+
+#define MC_HEADER_SIZE 20
+#define MC_PAYLOAD_MAX 1380		// Keeps packets within a 1500 byte MTU with IP & UDP headers.
+#define MC_GROUP_SIZE 8			// Data packets per parity packet.
+
+
+enum McastPacketType {
+	MC_TYPE_DATA = 0,
+	MC_TYPE_PARITY,
+	MC_TYPE_STATUS
+};
+
+
+enum McastFlags {
+	MC_FLAG_DONE = 0x01			// Last packet of the media file.
+};
+
+
+struct McastPacket {
+	uint32_t stream = 0;
+	uint32_t seq = 0;			// Parity: first data packet of the group. Status: next data packet.
+	uint8_t count = 0;			// Parity: number of data packets in the group.
+	uint8_t type = MC_TYPE_DATA;
+	uint8_t flags = 0;			// Parity: flags of the group's data packets XOR-ed.
+	uint16_t length = 0;		// Parity: payload lengths of the group's data packets XOR-ed.
+	std::string payload;		// Parity: payloads of the group's data packets XOR-ed.
+	
+	std::string serialize() const;
+	bool parse(const uint8_t* data, size_t size);
+};
+
+
+struct McastStats {
+	uint64_t received = 0;		// Data & parity packets received.
+	uint64_t duplicates = 0;	// Data packets received more than once.
+	uint64_t recovered = 0;		// Data packets restored using parity.
+	uint64_t nacked = 0;		// Data packets requested again.
+	uint64_t lost = 0;			// Data packets given up on.
+};
+
+
+typedef std::function<void(const std::string&)> McastOutput;
+// Takes in-order media data, returns the number of bytes accepted. The EOF flag only applies if
+// all data was accepted.
+typedef std::function<uint32_t(const char*, uint32_t, bool)> McastDeliver;
+typedef std::function<void(uint32_t, uint32_t, uint32_t)> McastNack;
+typedef std::function<bool(const McastPacket&)> McastLossHook;
+
+
+class McastEncoder {
+	McastOutput output;
+	uint32_t stream = 1;
+	uint32_t seq = 0;				// Sequence number of the next data packet.
+	McastPacket parity;				// Parity of the current group.
+	std::vector<std::string> history;	// Sent data packets, by sequence number.
+	std::vector<int64_t> resent;		// Time each packet was last sent again.
+	
+	void addData(const char* data, uint16_t length, uint8_t flags);
+	void closeGroup();
+
+public:
+	McastEncoder(McastOutput output);
+	void write(const char* data, uint32_t length, bool done);
+	void status();
+	void reset();
+	bool resend(uint32_t stream, uint32_t seq, int64_t now);
+	uint32_t getStream() { return stream; }
+};
+
+
+struct McastNackRange {
+	uint32_t stream;
+	uint32_t seq;
+	uint32_t count;
+};
+
+
+struct McastGap {
+	int64_t seen;		// Time the packet was first found missing.
+	int64_t nacked;		// Time of the last request, or 0.
+};
+
+
+class McastDecoder {
+	McastDeliver deliver;
+	McastNack nack;
+	bool started = false;
+	uint32_t stream = 0;
+	uint32_t nextSeq = 0;						// Next data packet to deliver.
+	uint32_t endSeq = 0;						// One past the highest data packet known of.
+	std::map<uint32_t, McastPacket> data;		// Data packets, including recently delivered.
+	std::map<uint32_t, McastPacket> parity;		// Parity packets, by first sequence number.
+	std::map<uint32_t, McastGap> gaps;			// Missing data packets.
+	std::string pending;		// Data the receiving side had no room for yet.
+	bool pendingDone = false;
+	McastStats stats;
+	
+	void clear();
+	void startStream(uint32_t stream);
+	void extend(uint32_t end, int64_t now);
+	bool recover(uint32_t seq);
+	void recoverGroup(uint32_t seq);
+	void flushReady();
+
+public:
+	McastDecoder(McastDeliver deliver, McastNack nack);
+	void input(const uint8_t* data, size_t size, int64_t now);
+	void poll(int64_t now);
+	void reset(uint32_t stream);
+	void restart();
+	McastStats getStats() { return stats; }
+};
+
+
+class McastSender {
+	Poco::Net::MulticastSocket socket;
+	Poco::Net::SocketAddress target;
+	McastEncoder encoder;
+	std::mutex senderMutex;
+	std::condition_variable statusCv;
+	std::thread statusThread;
+	std::chrono::steady_clock::time_point lastSend;
+	McastLossHook lossHook = 0;
+	bool open = false;
+	
+	static std::string loggerName;
+	
+	void output(const std::string &packet);
+	void sendStatus();
+
+public:
+	McastSender();
+	~McastSender();
+	bool start(std::string group, uint16_t port, std::string iface = std::string());
+	void stop();
+	bool isOpen() { return open; }
+	void send(const char* data, uint32_t length, bool done);
+	void reset();
+	uint32_t getStream();
+	void resend(uint32_t stream, uint32_t seq, uint32_t count);
+	void setLossHook(McastLossHook hook);
+};
+
+
+class McastReceiver {
+	Poco::Net::MulticastSocket socket;
+	Poco::Net::IPAddress groupAddress;
+	McastDecoder decoder;
+	std::mutex decoderMutex;
+	McastNack nack;
+	std::vector<McastNackRange> nacks;		// Requests collected by the decoder.
+	std::thread worker;
+	std::atomic<bool> running = { false };
+	
+	static std::string loggerName;
+	
+	void run();
+
+public:
+	McastReceiver(McastDeliver deliver, McastNack nack);
+	~McastReceiver();
+	bool start(std::string group, uint16_t port, std::string iface = std::string());
+	void stop();
+	bool isRunning() { return running; }
+	void reset(uint32_t stream);
+	McastStats getStats();
+};
+
+#endif
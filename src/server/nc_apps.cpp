@@ -15,39 +15,115 @@
 
 #include "nc_apps.h"
 
-#include <Poco/URI.h>
-#include <Poco/Net/HTTPClientSession.h>
-#include <Poco/Net/HTTPSClientSession.h>
-#include <Poco/Net/HTTPRequest.h>
-#include <Poco/Net/HTTPResponse.h>
-#include <Poco/StreamCopier.h>
-#include <Poco/Data/Session.h>
-#include <Poco/Data/SQLite/Connector.h>
-#include <Poco/Data/SQLite/SQLiteException.h>
-#include <Poco/Timestamp.h>
-
 #include <nymph/nymph.h>
-#include "databuffer.h"
+#include "session_registry.h"
+#include "app_store.h"
+#include "http_client.h"
 
 #include <angelscript/json/json.h>
 #include <angelscript/regexp/regexp.h>
 
 #include <fstream>
 #include <streambuf>
+#include <filesystem>
+#include <cstring>
 
 // Debug
 #include <iostream>
 
 
+#define NC_APPS_BYTECODE_MAGIC 0x4E434142		// 'NCAB'
+#define NC_APPS_BYTECODE_VERSION 1		// Increase when the registered script interface changes.
+#define NC_APPS_WORKERS 4				// Apps which can run at the same time.
+#define NC_APPS_TIMEOUT 30				// Time a script may run before it is aborted, in seconds.
+#define NC_APPS_CONTEXT_POOL 8			// Idle script contexts kept for reuse.
+
+
 // Static initialisations.
 std::string NCApps::appsFolder;
-std::string NCApps::activeAppId;
-std::mutex NCApps::activeAppMutex;
+std::map<std::string, std::unique_ptr<AppStore> > NCApps::stores;
+std::mutex NCApps::storesMutex;
+uint32_t NCApps::storeCacheSize = 256;
+bool NCApps::storeWriteBack = false;
+
+
+// --- BYTE CODE STREAM ---
+// File stream for saving & loading the bytecode of a module.
+class ByteCodeStream : public asIBinaryStream {
+	std::fstream file;
+	
+public:
+	bool open(std::string path, std::ios::openmode mode) {
+		file.open(path, mode | std::ios::binary);
+		return file.is_open();
+	}
+	
+	int Read(void* ptr, asUINT size) {
+		if (size == 0) { return 0; }
+		file.read((char*) ptr, size);
+		return file ? 0 : -1;
+	}
+	
+	int Write(const void* ptr, asUINT size) {
+		if (size == 0) { return 0; }
+		file.write((const char*) ptr, size);
+		return file ? 0 : -1;
+	}
+	
+	template<typename T> bool read(T &value) { return Read(&value, sizeof(T)) == 0; }
+	template<typename T> bool write(const T &value) { return Write(&value, sizeof(T)) == 0; }
+	bool good() { return file.good(); }
+	void close() { file.close(); }
+};
+
+
+// Header of a bytecode file.
+struct ByteCodeHeader {
+	uint32_t magic = NC_APPS_BYTECODE_MAGIC;
+	uint32_t version = NC_APPS_BYTECODE_VERSION;
+	char asVersion[16] = { 0 };		// ANGELSCRIPT_VERSION_STRING
+	uint64_t size = 0;				// Size of the script.
+	int64_t mtime = 0;				// Modification time of the script.
+	uint64_t hash = 0;				// FNV-1a hash of the script.
+};
+
+
+// --- HASH SCRIPT ---
+static uint64_t hashScript(const std::string &script) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < script.size(); ++i) {
+		hash ^= (uint8_t) script[i];
+		hash *= 0x100000001b3ULL;
+	}
+	
+	return hash;
+}
+
+
+// --- BYTE CODE PATH ---
+// The bytecode of an app is stored next to its script, e.g. 'app/app.asb' for 'app/app.as'.
+static std::string byteCodePath(const std::string &scriptPath) {
+	std::filesystem::path p(scriptPath);
+	p.replace_extension(".asb");
+	return p.string();
+}
+
+
+// --- SCRIPT MTIME ---
+// Returns the modification time of the script, or 0 if it can't be determined.
+static int64_t scriptMtime(const std::string &scriptPath) {
+	std::error_code ec;
+	std::filesystem::file_time_type t = std::filesystem::last_write_time(scriptPath, ec);
+	if (ec) { return 0; }
+	
+	return (int64_t) t.time_since_epoch().count();
+}
 
 
 // --- CONSTRUCTOR ---
 NCApps::NCApps() {
-	// Create the script engine
+	// Create the script engine. Apps run on several threads.
+	asPrepareMultithread();
 	engine = asCreateScriptEngine();
 	if (engine == 0) {
 		std::cout << "Failed to create script engine." << std::endl;
@@ -57,6 +133,9 @@ NCApps::NCApps() {
 	// The script compiler will write any compiler messages to the callback.
 	engine->SetMessageCallback(asFUNCTION(MessageCallback), 0, asCALL_CDECL);
 	
+	// Contexts are taken from a pool, instead of creating one for each call.
+	engine->SetContextCallbacks(requestContext, returnContext, this);
+	
 	// Register the script string type
 	RegisterStdString(engine);
 	RegisterScriptArray(engine, false);
@@ -70,6 +149,9 @@ NCApps::NCApps() {
 	r = engine->RegisterGlobalFunction(
 								"bool performHttpsQuery(string, string &out)", 
 								asFUNCTION(NCApps::performHttpsQuery), asCALL_CDECL);
+	r = engine->RegisterGlobalFunction(
+								"bool performHttpQueries(const array<string> &in, array<string> &out)", 
+								asFUNCTION(NCApps::performHttpQueries), asCALL_CDECL);
 	r = engine->RegisterGlobalFunction(
 								"void clientSend(int, string)", 
 								asFUNCTION(NCApps::clientSend), asCALL_CDECL);
@@ -94,7 +176,7 @@ NCApps::NCApps() {
 
 // --- DESTRUCTOR ---
 NCApps::~NCApps() {
-	//
+	stop();
 }
 
 
@@ -104,6 +186,22 @@ void NCApps::setAppsFolder(std::string folder) {
 }
 
 
+// --- SET STORE OPTIONS ---
+// Set the number of cached values per app & whether values are written to disk in the background.
+void NCApps::setStoreOptions(uint32_t cacheSize, bool writeBack) {
+	storeCacheSize = cacheSize;
+	storeWriteBack = writeBack;
+}
+
+
+// --- CLOSE STORES ---
+// Write out pending values and close the databases of the apps.
+void NCApps::closeStores() {
+	std::lock_guard<std::mutex> lk(storesMutex);
+	stores.clear();
+}
+
+
 // --- ADD APP ---
 bool NCApps::addApp(std::string name, NymphCastApp app) {
 	mutex.lock();
@@ -205,6 +303,18 @@ bool NCApps::readAppList(std::string path) {
 		if (!addApp(app.id, app)) { return false; }
 	}
 	
+	// Load the compiled modules of local apps, where still up to date. Other apps are compiled
+	// when first used.
+	std::unique_lock<std::shared_mutex> lk(engineMutex);
+	std::map<std::string, NymphCastApp>::iterator ait;
+	for (ait = apps.begin(); ait != apps.end(); ++ait) {
+		if (ait->second.location != NYMPHCAST_APP_LOCATION_LOCAL) { continue; }
+		std::string result;
+		if (loadByteCode(ait->second) && findFunctions(ait->second, result)) {
+			std::cout << "Loaded compiled " << ait->second.id << " app." << std::endl;
+		}
+	}
+	
 	if (apps.size() > 0) {
 		defaultApp = apps.begin()->second;
 	}
@@ -236,23 +346,43 @@ void NCApps::MessageCallback(const asSMessageInfo *msg, void *param) {
 }
 
 
-std::chrono::time_point<std::chrono::steady_clock> NCApps::timeGetTime() {
-	std::chrono::time_point<std::chrono::steady_clock> now;
-	now = std::chrono::steady_clock::now();
-	return now;
+// --- REQUEST CONTEXT ---
+// Returns a context from the pool, or a new one if the pool is empty.
+asIScriptContext* NCApps::requestContext(asIScriptEngine *engine, void *param) {
+	NCApps* self = (NCApps*) param;
+	std::lock_guard<std::mutex> lk(self->contextMutex);
+	if (self->contextPool.empty()) { return engine->CreateContext(); }
+	
+	asIScriptContext* ctx = self->contextPool.back();
+	self->contextPool.pop_back();
+	
+	return ctx;
 }
 
 
-void NCApps::LineCallback(asIScriptContext* ctx, std::chrono::time_point<std::chrono::steady_clock>* timeOut) {
-	// If the time out is reached we abort the script
-	if (*timeOut < NCApps::timeGetTime()) {
-		ctx->Abort();
+// --- RETURN CONTEXT ---
+void NCApps::returnContext(asIScriptEngine *engine, asIScriptContext *ctx, void *param) {
+	NCApps* self = (NCApps*) param;
+	ctx->Unprepare();
+	ctx->SetUserData(0);
+	
+	std::lock_guard<std::mutex> lk(self->contextMutex);
+	if (self->contextPool.size() >= NC_APPS_CONTEXT_POOL) {
+		ctx->Release();
+		return;
 	}
+	
+	self->contextPool.push_back(ctx);
+}
 
-	// It would also be possible to only suspend the script,
-	// instead of aborting it. That would allow the application
-	// to resume the execution where it left of at a later 
-	// time, by simply calling Execute() again.
+
+// --- CURRENT APP ID ---
+// Returns the ID of the app which calls a registered function, as set on its context.
+std::string NCApps::currentAppId() {
+	asIScriptContext* ctx = asGetActiveContext();
+	if (ctx == 0 || ctx->GetUserData() == 0) { return std::string(); }
+	
+	return *((std::string*) ctx->GetUserData());
 }
 
 
@@ -262,7 +392,7 @@ void NCApps::clientSend(uint32_t id, std::string message) {
 	// Send a message to a client for an app, if the cliend ID exists.
 	std::vector<NymphType*> values;
 	std::string result;
-	if (!NymphRemoteClient::callCallback(DataBuffer::getSessionHandle(), "ReceiveFromAppCallback", 
+	if (!NymphRemoteClient::callCallback(SessionRegistry::getActiveSession(), "ReceiveFromAppCallback", 
 																				values, result)) {
 		std::cerr << "Calling callback failed: " << result << std::endl;
 		return;
@@ -272,89 +402,43 @@ void NCApps::clientSend(uint32_t id, std::string message) {
 
 // --- PERFORM HTTP QUERY ---
 bool NCApps::performHttpQuery(std::string query, std::string &response) {
-	// Create Poco HTTP query, send it off, wait for response.
-	Poco::URI uri(query);
-	std::string path(uri.getPathAndQuery());
-	if (path.empty()) { path = "/"; }
-	
-	Poco::Net::HTTPClientSession session(uri.getHost(), uri.getPort());
-	Poco::Net::HTTPRequest req(Poco::Net::HTTPRequest::HTTP_GET, path, 
-											Poco::Net::HTTPMessage::HTTP_1_1);
-	session.sendRequest(req);
-	Poco::Net::HTTPResponse httpResponse;
-	std::istream& rs = session.receiveResponse(httpResponse);
-	std::cout << httpResponse.getStatus() << " " << httpResponse.getReason() << std::endl;
-	if (httpResponse.getStatus() == Poco::Net::HTTPResponse::HTTP_OK) {
-		Poco::StreamCopier::copyToString(rs, response);
-		return true;
-	}
-	else {
-		// Something went wrong.
-		return false;
-	}
+	HttpResult result = HttpClient::get(query);
+	response = result.body;
 	
-	
-	return true;
+	return result.success;
 }
 
 
 // --- PERFORM HTTPS QUERY ---
 bool NCApps::performHttpsQuery(std::string query, std::string &response) {
-	// Create Poco HTTPS query, send it off, wait for response.
-	Poco::URI uri(query);
-	std::string path(uri.getPathAndQuery());
-	if (path.empty()) { path = "/"; }
-	
-	// Debug:
-	std::cout << "HTTPS query: " << query << std::endl;
-	
-	/* const Poco::Net::Context::Ptr context = new Poco::Net::Context(
-		Poco::Net::Context::CLIENT_USE, "", "", "",
-		Poco::Net::Context::VERIFY_RELAXED, 9, false,
-		"ALL:!ADH:!LOW:!EXP:!MD5:@STRENGTH"); */
-	
-	//Poco::Net::HTTPSClientSession session(uri.getHost(), uri.getPort(), context);
-	Poco::Net::HTTPSClientSession session(uri.getHost(), uri.getPort());
-	Poco::Net::HTTPRequest req(Poco::Net::HTTPRequest::HTTP_GET, path, 
-											Poco::Net::HTTPMessage::HTTP_1_1);
-	req.setContentLength(0);
-	req.set("user-agent", "Mozilla/5.0 (Windows NT 6.1; WOW64; rv:39.0) Gecko/20100101 Firefox/75.0");
-	
-	try {
-		session.sendRequest(req);
-	} 
-	catch (Poco::Exception& exc) {
-		std::cout << "Exception caught while attempting to connect." << std::endl;
-		std::cerr << exc.displayText() << std::endl;
-		return false;
+	HttpResult result = HttpClient::get(query);
+	response = result.body;
+	if (!result.success) {
+		std::cout << "HTTPS query failed (" << result.status << "). Query: " << query << std::endl;
 	}
 	
-	Poco::Net::HTTPResponse httpResponse;
-	std::istream& rs = session.receiveResponse(httpResponse);
-	
-	//
-	std::cout << httpResponse.getStatus() << " " << httpResponse.getReason() << std::endl;
-	
-	if (httpResponse.getStatus() == Poco::Net::HTTPResponse::HTTP_OK) {
-		Poco::StreamCopier::copyToString(rs, response);
-		
-		// Debug
-		//std::cout << "HTTP response:\n---------------\n";
-		//std::cout << response;
-		//std::cout << "\n---------------\n";
-		
-		return true;
-	}
-	else {
-		// Something went wrong.
-		Poco::StreamCopier::copyToString(rs, response);
-		std::cout << "HTTPS query failed. Path: " << path << ". Query: " << query << std::endl;
-		std::cout << "Response: \n" << response << std::endl;
-		return false;
+	return result.success;
+}
+
+
+// --- PERFORM HTTP QUERIES ---
+// Perform HTTP(S) queries in parallel and wait for all of them. Returns true if all succeeded.
+// The responses are in the order of the queries.
+bool NCApps::performHttpQueries(const CScriptArray &queries, CScriptArray &responses) {
+	std::vector<std::string> urls;
+	for (asUINT i = 0; i < queries.GetSize(); ++i) {
+		urls.push_back(*((const std::string*) queries.At(i)));
 	}
 	
+	std::vector<HttpResult> results = HttpClient::getAll(urls);
+	responses.Resize((asUINT) results.size());
+	bool success = true;
+	for (size_t i = 0; i < results.size(); ++i) {
+		*((std::string*) responses.At((asUINT) i)) = results[i].body;
+		if (!results[i].success) { success = false; }
+	}
 	
-	return true;
+	return success;
 }
 
 
@@ -366,44 +450,37 @@ bool NCApps::streamTrack(std::string url) {
 }
 
 
+// --- GET STORE ---
+// Returns the key/value store of the active app, opening its database on first use.
+AppStore* NCApps::getStore() {
+	std::string appId = currentAppId();
+	if (appId.empty()) { return 0; }
+	
+	std::lock_guard<std::mutex> lk(storesMutex);
+	std::map<std::string, std::unique_ptr<AppStore> >::iterator it = stores.find(appId);
+	if (it != stores.end()) { return it->second.get(); }
+	
+	std::unique_ptr<AppStore> store(new AppStore(appsFolder + appId + "/" + appId + ".db", 
+												storeCacheSize, storeWriteBack));
+	if (!store->open()) {
+		std::cerr << "Failed to open the database for " << appId << "." << std::endl;
+		return 0;
+	}
+	
+	AppStore* ptr = store.get();
+	stores[appId] = std::move(store);
+	
+	return ptr;
+}
+
+
 // --- STORE VALUE ---
 // App-level storage: store a single key/value pair for an NC app.
 bool NCApps::storeValue(std::string key, std::string &value) {
-	Poco::Data::Session db("SQLite", appsFolder + activeAppId + "/" + activeAppId + ".db");
+	AppStore* store = getStore();
+	if (!store) { return false; }
 	
-	std::cout << "Opened database file for " << activeAppId << std::endl;
-	
-	// Create table if it doesn't exist yet.
-	try {
-		db << "CREATE TABLE IF NOT EXISTS data (id TEXT PRIMARY KEY NOT NULL, value TEXT NOT NULL, updated INTEGER)", 
-			Poco::Data::Keywords::now;
-	}
-	catch(Poco::Data::SQLite::SQLiteException &exc) {
-		std::cout << "SQL error: " << exc.displayText() << std::endl;
-	}
-	catch (...) {
-		std::cerr << "Creating table failed." << std::endl;
-		return false;
-	}
-		
-	std::cout << "Table 'data' exists." << std::endl;
-		
-	// Get the current timestamp for database insertion.
-	Poco::Timestamp ts;
-	int64_t updated = (int64_t) ts.epochMicroseconds();
-	
-	std::cout << "Writing value into database. Key: " << key << ", value: " << value << std::endl;
-	
-	// Write or update the key/value pair in the table.
-	db << "INSERT OR REPLACE INTO data (id, value, updated) VALUES (:key, :value, :updated)",
-		Poco::Data::Keywords::use(key),
-		Poco::Data::Keywords::use(value),
-		Poco::Data::Keywords::use(updated),
-		Poco::Data::Keywords::now;
-		
-	std::cout << "Updated table." << std::endl;
-		
-	return true;
+	return store->store(key, value);
 }
 
 
@@ -412,47 +489,161 @@ bool NCApps::storeValue(std::string key, std::string &value) {
 // The 'age' parameter (in microseconds) sets the maximum allowed age of the value since its last
 // update. Omitting it or setting it to 0 means that any age is acceptable.
 bool NCApps::readValue(std::string key, std::string &value, uint64_t age) {
-	Poco::Data::Session db("SQLite", appsFolder + activeAppId + "/" + activeAppId + ".db");
+	AppStore* store = getStore();
+	if (!store) { return false; }
 	
-	std::cout << "Opened database file for " << activeAppId << std::endl;
+	return store->read(key, value, age);
+}
+
+
+// --- READ TEMPLATE ---
+bool NCApps::readTemplate(std::string name, std::string &contents) {
+	// Try to read indicated file from the active app's template folder.
+	std::string appId = currentAppId();
+	if (appId.empty()) { return false; }
+	
+	std::ifstream t(appsFolder + appId + "/templates/" + name);
+	if (!t.is_open()) { return false; }
 	
-	// Return false if the table doesn't exist.
-	Poco::Data::Statement statement = db << 
-							"SELECT name FROM sqlite_master WHERE type='table' AND name='data'";
-	try {
-		while (!statement.done()) { statement.execute(); }
+	t.seekg(0, std::ios::end);   
+	contents.reserve(t.tellg());
+	t.seekg(0, std::ios::beg);
+
+	contents.assign((std::istreambuf_iterator<char>(t)), std::istreambuf_iterator<char>());
+	
+	return true;
+}
+
+
+// --- READ SCRIPT ---
+// Read the script of the app from disk or its remote location.
+bool NCApps::readScript(NymphCastApp &app, std::string &script, std::string &result) {
+	if (app.location == NYMPHCAST_APP_LOCATION_LOCAL) {
+		// We will load the script from a file on the disk.
+		FILE *f = fopen((appsFolder + app.url).c_str(), "rb");
+		if (f == 0) {
+			std::cout << "Failed to open the script file '" << app.url << "'." << std::endl;
+			result = "Failed to open the script file.";
+			return false;
+		}
+
+		// Determine the size of the file	
+		fseek(f, 0, SEEK_END);
+		int len = ftell(f);
+		fseek(f, 0, SEEK_SET);
+
+		// On Win32 it is possible to do the following instead
+		// int len = _filelength(_fileno(f));
+
+		// Read the entire file
+		script.resize(len);
+		size_t c = fread(&script[0], len, 1, f);
+		fclose(f);
+
+		if (c == 0) {
+			std::cerr << "Failed to load script file." << std::endl;
+			result = "Failed to load script file.";
+			return false;
+		}
 	}
-	catch(Poco::Data::SQLite::SQLiteException &exc) {
-		std::cout << "SQL error: " << exc.displayText() << std::endl;
+	else if (app.location == NYMPHCAST_APP_LOCATION_HTTP) {
+		// Load the script file from a remote location (HTTP or HTTPS).			
+		// Determine whether to call the HTTP or HTTPS function.
+		std::string response;
+		if (app.url.substr(0, 5) == "https") {
+			std::string query = "";
+			if (!performHttpsQuery(query, response)) {
+				std::cerr << "Error while performing HTTPS query: " << query << std::endl;
+				result = "Error while performing HTTPS query.";
+				return false;
+			}
+		}
+		else if (app.url.substr(0, 5) == "http:") {
+			std::string query = "";
+			if (!performHttpQuery(query, response)) {
+				std::cerr << "Error while performing HTTP query: " << query << std::endl;
+				result = "Error while performing HTTP query.";
+				return false;
+			}
+		}
+		
+		// Response string should contain the script.
+		script = response;
 	}
-	catch(...) {
-		std::cout << "Failed to execute query." << std::endl;
+	
+	return true;
+}
+
+
+// --- LOAD BYTE CODE ---
+// Load the saved bytecode of a local app into its module, if the script has not changed since.
+// The script is only read if its modification time differs, to compare the hash.
+bool NCApps::loadByteCode(NymphCastApp &app) {
+	std::string scriptPath = appsFolder + app.url;
+	ByteCodeStream in;
+	if (!in.open(byteCodePath(scriptPath), std::ios::in)) { return false; }
+	
+	ByteCodeHeader header;
+	ByteCodeHeader expected;
+	strncpy(expected.asVersion, ANGELSCRIPT_VERSION_STRING, sizeof(expected.asVersion) - 1);
+	if (!in.read(header) || header.magic != expected.magic || header.version != expected.version
+			|| strncmp(header.asVersion, expected.asVersion, sizeof(header.asVersion)) != 0) {
 		return false;
 	}
 	
-	if (statement.rowsExtracted() < 1) { 
-		std::cout << "Table 'data' does not exist. Returning..." << std::endl;
+	std::error_code ec;
+	uint64_t size = std::filesystem::file_size(scriptPath, ec);
+	if (ec || size != header.size) { return false; }
+	
+	if (scriptMtime(scriptPath) != header.mtime) {
+		std::string script;
+		std::string result;
+		if (!readScript(app, script, result) || hashScript(script) != header.hash) {
+			return false;
+		}
+	}
+	
+	asIScriptModule* mod = engine->GetModule(app.id.c_str(), asGM_ALWAYS_CREATE);
+	if (mod->LoadByteCode(&in) < 0) {
+		std::cout << "Failed to load the bytecode of the " << app.id << " app." << std::endl;
+		mod->Discard();
 		return false;
 	}
 	
-	// Read out value and return true.
-	int64_t updated = 0;
-	db << "SELECT value, updated FROM data WHERE id=:key", 
-		Poco::Data::Keywords::use(key), 
-		Poco::Data::Keywords::into(value),
-		Poco::Data::Keywords::into(updated),
-		Poco::Data::Keywords::now;
-		
-	if (updated == 0) { 
-		std::cout << "Updated: 0, key: " << key << ", value: " << value << std::endl;
+	app.asModule = mod;
+	
+	return true;
+}
+
+
+// --- SAVE BYTE CODE ---
+// Save the bytecode of a local app's module next to its script, for the next start.
+bool NCApps::saveByteCode(NymphCastApp &app, const std::string &script) {
+	if (app.location != NYMPHCAST_APP_LOCATION_LOCAL) { return false; }
+	
+	std::string scriptPath = appsFolder + app.url;
+	std::string path = byteCodePath(scriptPath);
+	std::string tmpPath = path + ".tmp";
+	ByteCodeStream out;
+	if (!out.open(tmpPath, std::ios::out | std::ios::trunc)) {
+		std::cout << "Failed to save the bytecode of the " << app.id << " app." << std::endl;
 		return false;
 	}
-		
-	// If 'age' parameter has been set, check whether value has expired.
-	Poco::Timestamp ts;
-	Poco::Timestamp uts(updated);
-	if ((uts + age) < ts) {
-		std::cout << "Value was older than age. Dropping..." << std::endl;
+	
+	ByteCodeHeader header;
+	strncpy(header.asVersion, ANGELSCRIPT_VERSION_STRING, sizeof(header.asVersion) - 1);
+	header.size = script.size();
+	header.mtime = scriptMtime(scriptPath);
+	header.hash = hashScript(script);
+	bool success = out.write(header) && app.asModule->SaveByteCode(&out) >= 0 && out.good();
+	out.close();
+	
+	// Replace the earlier file only once the new one is complete.
+	std::error_code ec;
+	if (success) { std::filesystem::rename(tmpPath, path, ec); }
+	if (!success || ec) {
+		std::filesystem::remove(tmpPath, ec);
+		std::cout << "Failed to save the bytecode of the " << app.id << " app." << std::endl;
 		return false;
 	}
 	
@@ -460,17 +651,75 @@ bool NCApps::readValue(std::string key, std::string &value, uint64_t age) {
 }
 
 
-// --- READ TEMPLATE ---
-bool NCApps::readTemplate(std::string name, std::string &contents) {
-	// Try to read indicated file from the active app's template folder.
-	std::ifstream t(appsFolder + activeAppId + "/templates/" + name);
-	if (!t.is_open()) { return false; }
+// --- BUILD MODULE ---
+// Compile the app into its own module, named after the app. The bytecode of local apps is saved,
+// so that the next start can skip this.
+bool NCApps::buildModule(NymphCastApp &app, std::string &result) {
+	std::cout << "Loading " << app.id << " app..." << std::endl;
 	
-	t.seekg(0, std::ios::end);   
-	contents.reserve(t.tellg());
-	t.seekg(0, std::ios::beg);
+	std::string script;
+	if (!readScript(app, script, result)) { return false; }
+	
+	std::cout << "Creating module." << std::endl;
 
-	contents.assign((std::istreambuf_iterator<char>(t)), std::istreambuf_iterator<char>());
+	// Add the script sections that will be compiled into executable code.
+	// If we want to combine more than one file into the same script, then 
+	// we can call AddScriptSection() several times for the same module and
+	// the script engine will treat them all as if they were one. The script
+	// section name, will allow us to localize any errors in the script code.
+	asIScriptModule *mod = engine->GetModule(app.id.c_str(), asGM_ALWAYS_CREATE);
+	int r = mod->AddScriptSection("script", script.data(), script.length());
+	if (r < 0) {
+		std::cout << "AddScriptSection() failed" << std::endl;
+		result = "AddScriptSection() failed";
+		mod->Discard();
+		return false;
+	}
+	
+	std::cout << "Compile script." << std::endl;
+	
+	// Compile the script. If there are any compiler messages they will
+	// be written to the message stream that we set right after creating the 
+	// script engine. If there are no errors, and no warnings, nothing will
+	// be written to the stream.
+	r = mod->Build();
+	if (r < 0) {
+		std::cout << "Build() failed" << std::endl;
+		result = "Build() failed";
+		mod->Discard();
+		return false;
+	}
+
+	// The engine doesn't keep a copy of the script sections after Build() has
+	// returned. So if the script needs to be recompiled, then all the script
+	// sections must be added again.
+
+	// Each app is compiled into its own module. Each module uses its own namespace and 
+	// scope, so function names, and global variables will not conflict with
+	// each other.
+	app.asModule = mod;
+	saveByteCode(app, script);
+	
+	return true;
+}
+
+
+// --- FIND FUNCTIONS ---
+// Find the functions we want to execute in the module of the app.
+bool NCApps::findFunctions(NymphCastApp &app, std::string &result) {
+	app.asHtmlFunction = app.asModule->GetFunctionByDecl("string html_processor(string)");
+	if (app.asHtmlFunction == 0) {
+		std::cout << "The function 'string html_processor(string)' was not found." << std::endl;
+		result = "The function 'string html_processor(string)' was not found.";
+		return false;
+	}
+	
+	app.asFunction = app.asModule->GetFunctionByDecl("string command_processor(string, int)");
+	if (app.asFunction == 0) {
+		std::cout << "The function 'string command_processor(string, int)' was not found." << std::endl;
+		result = "The function 'string command_processor(string, int)' was not found.";
+		return false;
+	}
 	
 	return true;
 }
@@ -478,208 +727,111 @@ bool NCApps::readTemplate(std::string name, std::string &contents) {
 
 // --- RUN APP ---
 // string app_send(string appId, string data)
+// Queue the request for a worker and wait for its result.
 bool NCApps::runApp(std::string name, std::string message, uint8_t format, std::string &result) {
-	NymphCastApp app = findApp(name);
+	// Use the app in the list, so that its compiled module is kept.
+	NymphCastApp& app = findApp(name);
 	if (app.id.empty()) { 
 		std::cerr << "Failed to find a matching application for '" << name << "'." << std::endl;
 		result = "Failed to find a matching application for '" + name + "'.";
 		return false; 
 	}
 	
-	// Update active app ID.
-	activeAppMutex.lock();
-	activeAppId = name;
-	activeAppMutex.unlock();
-	
-	// Compile the app if it hasn't been compiled yet.
-	if (app.asFunction == 0) {
-		// Initialise new instance of the app.
-		int r;
-		
-		std::cout << "Loading " << app.id << " app..." << std::endl;
-
-		std::string script;
-		int len;
-		if (app.location == NYMPHCAST_APP_LOCATION_LOCAL) {
-			// We will load the script from a file on the disk.
-			FILE *f = fopen((appsFolder + app.url).c_str(), "rb");
-			if (f == 0) {
-				std::cout << "Failed to open the script file '" << app.url << "'." << std::endl;
-				result = "Failed to open the script file.";
-				return false;
-			}
-
-			// Determine the size of the file	
-			fseek(f, 0, SEEK_END);
-			len = ftell(f);
-			fseek(f, 0, SEEK_SET);
-
-			// On Win32 it is possible to do the following instead
-			// int len = _filelength(_fileno(f));
-
-			// Read the entire file
-			script.resize(len);
-			size_t c = fread(&script[0], len, 1, f);
-			fclose(f);
-
-			if (c == 0) {
-				std::cerr << "Failed to load script file." << std::endl;
-				result = "Failed to load script file.";
-				return false;
-			}
+	std::future<bool> done;
+	{
+		std::lock_guard<std::mutex> lk(jobsMutex);
+		if (stopped) {
+			result = "Apps have been stopped.";
+			return false;
 		}
-		else if (app.location == NYMPHCAST_APP_LOCATION_HTTP) {
-			// Load the script file from a remote location (HTTP or HTTPS).			
-			// Determine whether to call the HTTP or HTTPS function.
-			std::string response;
-			if (app.url.substr(0, 5) == "https") {
-				std::string query = "";
-				if (!performHttpsQuery(query, response)) {
-					std::cerr << "Error while performing HTTPS query: " << query << std::endl;
-					result = "Error while performing HTTPS query.";
-					return false;
-				}
-			}
-			else if (app.url.substr(0, 5) == "http:") {
-				std::string query = "";
-				if (!performHttpQuery(query, response)) {
-					std::cerr << "Error while performing HTTP query: " << query << std::endl;
-					result = "Error while performing HTTP query.";
-					return false;
-				}
+		
+		if (!running) {
+			running = true;
+			for (int i = 0; i < NC_APPS_WORKERS; ++i) {
+				workers.push_back(std::thread(&NCApps::runWorker, this));
 			}
 			
-			// Response string should contain the script.
-			script = response;
-			len = script.length();
+			watchdog = std::thread(&NCApps::runWatchdog, this);
 		}
 		
-		std::cout << "Creating module." << std::endl;
-
-		// Add the script sections that will be compiled into executable code.
-		// If we want to combine more than one file into the same script, then 
-		// we can call AddScriptSection() several times for the same module and
-		// the script engine will treat them all as if they were one. The script
-		// section name, will allow us to localize any errors in the script code.
-		asIScriptModule *mod = engine->GetModule(0, asGM_ALWAYS_CREATE);
-		r = mod->AddScriptSection("script", &script[0], len);
-		if (r < 0) {
-			std::cout << "AddScriptSection() failed" << std::endl;
-			result = "AddScriptSection() failed";
-			return false;
-		}
-		
-		std::cout << "Compile script." << std::endl;
-		
-		// Compile the script. If there are any compiler messages they will
-		// be written to the message stream that we set right after creating the 
-		// script engine. If there are no errors, and no warnings, nothing will
-		// be written to the stream.
-		r = mod->Build();
-		if (r < 0) {
-			std::cout << "Build() failed" << std::endl;
-			result = "Build() failed";
-			return false;
-		}
+		NCAppJob job;
+		job.app = &app;
+		job.message = message;
+		job.format = format;
+		job.result = &result;
+		done = job.done.get_future();
+		jobs.push_back(std::move(job));
+	}
+	
+	jobsCv.notify_all();
+	
+	return done.get();
+}
 
-		// The engine doesn't keep a copy of the script sections after Build() has
-		// returned. So if the script needs to be recompiled, then all the script
-		// sections must be added again.
 
-		// If we want to have several scripts executing at different times but 
-		// that have no direct relation with each other, then we can compile them
-		// into separate script modules. Each module use their own namespace and 
-		// scope, so function names, and global variables will not conflict with
-		// each other.
-		
-		std::cout << "Creating context." << std::endl;
-		
-		// Create a context that will execute the script.
-		app.asContext = engine->CreateContext();
-		if (app.asContext == 0) {
-			std::cout << "Failed to create the context." << std::endl;
-			result = "Failed to create the context.";
-			engine->Release();
-			return false;
-		}
-		
-		std::cout << "Setting line callback." << std::endl;
-
-		// We don't want to allow the script to hang the application, e.g. with an
-		// infinite loop, so we'll use the line callback function to set a timeout
-		// that will abort the script after a certain time. Before executing the 
-		// script the timeOut variable will be set to the time when the script must 
-		// stop executing. 
-		r = app.asContext->SetLineCallback(asFUNCTION(NCApps::LineCallback), &timeOut, asCALL_CDECL);
-		if (r < 0) {
-			std::cout << "Failed to set the line callback function." << std::endl;
-			result = "Failed to set the line callback function.";
-			app.asContext->Release();
-			engine->Release();
-			return false;
-		}
-		
-		std::cout << "Find function." << std::endl;
-
-		// Find the function for the function we want to execute.
-		app.asFunction = engine->GetModule(0)->GetFunctionByDecl("string command_processor(string, int)");
-		if (app.asFunction == 0) {
-			std::cout << "The function 'string command_processor(string, int)' was not found." << std::endl;
-			result = "The function 'string command_processor(string, int)' was not found.";
-			app.asContext->Release();
-			engine->Release();
-			return false;
-		}
-		
-		app.asHtmlFunction = engine->GetModule(0)->GetFunctionByDecl("string html_processor(string)");
-		if (app.asHtmlFunction == 0) {
-			std::cout << "The function 'string command_processor(string, int)' was not found." << std::endl;
-			result = "The function 'string command_processor(string, int)' was not found.";
-			app.asContext->Release();
-			engine->Release();
-			return false;
-		}
+// --- EXECUTE APP ---
+// Run the command or HTML processor of the app. Called by a worker, which has marked the app busy.
+bool NCApps::executeApp(NymphCastApp &app, std::string &message, uint8_t format, 
+																		std::string &result) {
+	// Compile the app and find its functions on first use, unless loaded at startup. Modules
+	// can't be built while other scripts are running.
+	if (app.asFunction == 0) {
+		std::unique_lock<std::shared_mutex> lk(engineMutex);
+		if (app.asModule == 0 && !buildModule(app, result)) { return false; }
+		if (!findFunctions(app, result)) { return false; }
 	}
 	
-	std::cout << "Preparing script context." << std::endl;
+	std::shared_lock<std::shared_mutex> lk(engineMutex);
+	asIScriptContext* ctx = engine->RequestContext();
+	if (ctx == 0) {
+		std::cout << "Failed to create the context." << std::endl;
+		result = "Failed to create the context.";
+		return false;
+	}
+	
+	// Registered functions use this to find the app which calls them.
+	ctx->SetUserData(&app.id);
 				
 	// Prepare the script context with the function we wish to execute. Prepare()
 	// must be called on the context before each new script function that will be
-	// executed. Note, that if you intend to execute the same function several 
-	// times, it might be a good idea to store the function returned by 
-	// GetFunctionByDecl(), so that this relatively slow call can be skipped.
+	// executed.
 	int r = 0;
 	if (format == 1) {
 		std::cout << "Running with HTML output." << std::endl;
-		r = app.asContext->Prepare(app.asHtmlFunction);
+		r = ctx->Prepare(app.asHtmlFunction);
 	}
 	else {
-		r = app.asContext->Prepare(app.asFunction);
+		r = ctx->Prepare(app.asFunction);
 	}
 	
 	if (r < 0) {
 		std::cout << "Failed to prepare the context." << std::endl;
 		result = "Failed to prepare the context.";
-		app.asContext->Release();
-		engine->Release();
+		engine->ReturnContext(ctx);
 		return false;
 	}
 	
-	std::cout << "Setting app arguments." << std::endl;
-	
 	// Pass string to app.
-	app.asContext->SetArgObject(0, (void*) &message);
-	//app.asContext->SetArgAddress(1, &format);
+	ctx->SetArgObject(0, (void*) &message);
+	//ctx->SetArgAddress(1, &format);
+	
+	// We don't want to allow the script to hang the application, e.g. with an infinite loop, so
+	// the watchdog aborts it once the time-out has passed.
+	{
+		std::lock_guard<std::mutex> wlk(watchdogMutex);
+		deadlines[ctx] = std::chrono::steady_clock::now() + std::chrono::seconds(NC_APPS_TIMEOUT);
+	}
 	
-	// Set the timeout before executing the function. Give the function 30 seconds
-	// to return before we'll abort it.
-	timeOut = timeGetTime() + std::chrono::seconds(30);
+	watchdogCv.notify_one();
 
 	// Execute the function.
-	std::cout << "Executing the script." << std::endl;
-	std::cout << "---" << std::endl;
-	r = app.asContext->Execute();
-	std::cout << "---" << std::endl;
+	std::cout << "Executing the " << app.id << " app." << std::endl;
+	r = ctx->Execute();
+	{
+		std::lock_guard<std::mutex> wlk(watchdogMutex);
+		deadlines.erase(ctx);
+	}
+	
 	if (r != asEXECUTION_FINISHED) {
 		// The execution didn't finish as we had planned. Determine why.
 		if (r == asEXECUTION_ABORTED) {
@@ -690,12 +842,12 @@ bool NCApps::runApp(std::string name, std::string message, uint8_t format, std::
 			std::cout << "The script ended with an exception." << std::endl;
 
 			// Write some information about the script exception
-			asIScriptFunction* func = app.asContext->GetExceptionFunction();
+			asIScriptFunction* func = ctx->GetExceptionFunction();
 			std::cout << "func: " << func->GetDeclaration() << std::endl;
 			std::cout << "modl: " << func->GetModuleName() << std::endl;
 			std::cout << "sect: " << func->GetScriptSectionName() << std::endl;
-			std::cout << "line: " << app.asContext->GetExceptionLineNumber() << std::endl;
-			std::cout << "desc: " << app.asContext->GetExceptionString() << std::endl;
+			std::cout << "line: " << ctx->GetExceptionLineNumber() << std::endl;
+			std::cout << "desc: " << ctx->GetExceptionString() << std::endl;
 		}
 		else
 			std::cout << "The script ended for some unforeseen reason (" << r << ")." 
@@ -703,10 +855,113 @@ bool NCApps::runApp(std::string name, std::string message, uint8_t format, std::
 	}
 	else {
 		// Retrieve the return value from the context
-		result = *(std::string*) app.asContext->GetReturnObject();
+		result = *(std::string*) ctx->GetReturnObject();
 		std::cout << "The script function returned: " << result << std::endl;
 	}
 	
+	engine->ReturnContext(ctx);
+	
 	return true;
 }
 
+
+// --- RUN WORKER ---
+// Takes the oldest request for an app which isn't running yet.
+void NCApps::runWorker() {
+	std::unique_lock<std::mutex> lk(jobsMutex);
+	while (running) {
+		std::deque<NCAppJob>::iterator it = jobs.end();
+		jobsCv.wait(lk, [&] {
+			if (!running) { return true; }
+			for (it = jobs.begin(); it != jobs.end(); ++it) {
+				if (!it->app->busy) { return true; }
+			}
+			
+			return false;
+		});
+		
+		if (!running) { break; }
+		
+		NCAppJob job = std::move(*it);
+		jobs.erase(it);
+		job.app->busy = true;
+		lk.unlock();
+		
+		bool success = executeApp(*job.app, job.message, job.format, *job.result);
+		job.done.set_value(success);
+		
+		lk.lock();
+		job.app->busy = false;
+		jobsCv.notify_all();
+	}
+	
+	lk.unlock();
+	asThreadCleanup();
+}
+
+
+// --- RUN WATCHDOG ---
+// Aborts scripts which passed their deadline.
+void NCApps::runWatchdog() {
+	std::unique_lock<std::mutex> lk(watchdogMutex);
+	while (true) {
+		{
+			std::lock_guard<std::mutex> jlk(jobsMutex);
+			if (!running) { break; }
+		}
+		
+		std::map<asIScriptContext*, std::chrono::steady_clock::time_point>::iterator it;
+		std::map<asIScriptContext*, std::chrono::steady_clock::time_point>::iterator first;
+		first = deadlines.end();
+		for (it = deadlines.begin(); it != deadlines.end(); ++it) {
+			if (first == deadlines.end() || it->second < first->second) { first = it; }
+		}
+		
+		if (first == deadlines.end()) {
+			watchdogCv.wait(lk);
+			continue;
+		}
+		
+		std::chrono::steady_clock::time_point deadline = first->second;
+		if (deadline <= std::chrono::steady_clock::now()) {
+			first->first->Abort();
+			deadlines.erase(first);
+			continue;
+		}
+		
+		watchdogCv.wait_until(lk, deadline);
+	}
+}
+
+
+// --- STOP ---
+// Stop the workers & the watchdog. Queued requests fail.
+void NCApps::stop() {
+	{
+		std::lock_guard<std::mutex> lk(jobsMutex);
+		if (stopped) { return; }
+		
+		stopped = true;
+		running = false;
+	}
+	
+	jobsCv.notify_all();
+	{
+		std::lock_guard<std::mutex> lk(watchdogMutex);
+		watchdogCv.notify_all();
+	}
+	
+	for (size_t i = 0; i < workers.size(); ++i) {
+		workers[i].join();
+	}
+	
+	workers.clear();
+	if (watchdog.joinable()) { watchdog.join(); }
+	
+	std::lock_guard<std::mutex> lk(jobsMutex);
+	while (!jobs.empty()) {
+		*(jobs.front().result) = "Apps have been stopped.";
+		jobs.front().done.set_value(false);
+		jobs.pop_front();
+	}
+}
@@ -4,7 +4,18 @@
 	Revision 0
 	
 	Features:
-			- 
+			- Compiled app modules are kept for the lifetime of the server, one named module
+				per app.
+			- The bytecode of local apps is saved next to the script (.asb) and loaded at
+				startup, unless the script has changed since.
+			- App storage (storeValue/readValue) keeps the database of each app open, with a
+				cache of recent values in front of it. See AppStore.
+			- HTTP(S) queries share kept-alive connections & a response cache, and can be
+				performed in parallel (performHttpQueries). See HttpClient.
+			- Apps run on a pool of worker threads, so that different apps run in parallel.
+				Requests for the same app run one after the other.
+			- Script contexts are pooled. A watchdog thread aborts scripts which run longer
+				than NC_APPS_TIMEOUT.
 			
 	Notes:
 			-
@@ -22,6 +33,12 @@
 #include <mutex>
 #include <map>
 #include <vector>
+#include <memory>
+#include <deque>
+#include <thread>
+#include <future>
+#include <shared_mutex>
+#include <condition_variable>
 
 #include <angelscript.h>
 #include <scriptstdstring/scriptstdstring.h>
@@ -34,6 +51,7 @@
 
 // Forward declarations.
 bool streamTrack(std::string url);
+class AppStore;
 
 
 enum NymphCastAppLocation {
@@ -47,9 +65,19 @@ struct NymphCastApp {
 	NymphCastAppLocation location;
 	std::string url;
 	
-	asIScriptContext* asContext = 0;
+	asIScriptModule* asModule = 0;
 	asIScriptFunction* asFunction = 0;
 	asIScriptFunction* asHtmlFunction = 0;
+	bool busy = false;		// A worker is running the app.
+};
+
+
+struct NCAppJob {
+	NymphCastApp* app;
+	std::string message;
+	uint8_t format;
+	std::string* result;
+	std::promise<bool> done;
 };
 
 
@@ -59,30 +87,62 @@ class NCApps {
 	std::mutex mutex;
 	NymphCastApp defaultApp;
 	asIScriptEngine* engine = 0;
+	std::shared_mutex engineMutex;		// Held exclusively while a module is built.
 	asIScriptContext* soundcloudContext = 0;
 	asIScriptFunction* soundcloudFunction = 0;
-	std::chrono::time_point<std::chrono::steady_clock> timeOut;
+	
+	std::vector<asIScriptContext*> contextPool;
+	std::mutex contextMutex;
+	
+	std::deque<NCAppJob> jobs;
+	std::vector<std::thread> workers;
+	std::mutex jobsMutex;
+	std::condition_variable jobsCv;
+	bool running = false;
+	bool stopped = false;
+	
+	std::thread watchdog;
+	std::map<asIScriptContext*, std::chrono::steady_clock::time_point> deadlines;
+	std::mutex watchdogMutex;
+	std::condition_variable watchdogCv;
+	
 	static std::string appsFolder;
-	static std::string activeAppId;
-	static std::mutex activeAppMutex;
+	static std::map<std::string, std::unique_ptr<AppStore> > stores;	// Key/value store per app.
+	static std::mutex storesMutex;
+	static uint32_t storeCacheSize;
+	static bool storeWriteBack;
 	
 	static void MessageCallback(const asSMessageInfo *msg, void *param);
-	static std::chrono::time_point<std::chrono::steady_clock> timeGetTime();
-	static void LineCallback(asIScriptContext *ctx, std::chrono::time_point<std::chrono::steady_clock> *timeOut);
+	static asIScriptContext* requestContext(asIScriptEngine *engine, void *param);
+	static void returnContext(asIScriptEngine *engine, asIScriptContext *ctx, void *param);
+	static std::string currentAppId();
 	
 	static void clientSend(uint32_t id, std::string message);
 	static bool performHttpQuery(std::string query, std::string &response);
 	static bool performHttpsQuery(std::string query, std::string &response);
+	static bool performHttpQueries(const CScriptArray &queries, CScriptArray &responses);
 	static bool streamTrack(std::string url);
+	static AppStore* getStore();
 	static bool storeValue(std::string key, std::string &value);
 	static bool readValue(std::string key, std::string &value, uint64_t age = 0);
 	static bool readTemplate(std::string name, std::string &contents);
 	
+	bool readScript(NymphCastApp &app, std::string &script, std::string &result);
+	bool buildModule(NymphCastApp &app, std::string &result);
+	bool loadByteCode(NymphCastApp &app);
+	bool saveByteCode(NymphCastApp &app, const std::string &script);
+	bool findFunctions(NymphCastApp &app, std::string &result);
+	bool executeApp(NymphCastApp &app, std::string &message, uint8_t format, std::string &result);
+	void runWorker();
+	void runWatchdog();
+	
 public:
 	NCApps();
 	~NCApps();
 	
 	void setAppsFolder(std::string folder);
+	void setStoreOptions(uint32_t cacheSize, bool writeBack);
+	void closeStores();
 	bool addApp(std::string name, NymphCastApp app);
 	bool removeApp(std::string name);
 	NymphCastApp& findApp(std::string name);
@@ -90,6 +150,7 @@ public:
 	std::vector<std::string> appNames();
 	
 	bool runApp(std::string name, std::string message, uint8_t format, std::string &result);
+	void stop();
 };
 
 
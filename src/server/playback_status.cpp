@@ -0,0 +1,362 @@
+/*
+	playback_status.cpp - Implementation of the PlaybackStatus class.
+	
+	Revision 0.
+	
+	Notes:
+			- The status is read through the callback set with init(), at most once per push
+				interval unless a change was signalled with update().
+			- The struct returned by getStatus() is owned by the caller.
+			- Buffer statistics are only included while playing. A delta struct for the switch to
+				stopped has no buffer fields.
+	
+	2026/10/18, Maya Posch
+*/
+
+
+#include "playback_status.h"
+
+#include <vector>
+
+#include <nymph/nymph_logger.h>
+
+#include <Poco/NumberFormatter.h>
+
+
+// Fields of the status struct, as used for deltas.
+enum {
+	PS_FIELD_STATUS				= 0x0001,
+	PS_FIELD_PLAYING			= 0x0002,
+	PS_FIELD_STOPPED			= 0x0004,
+	PS_FIELD_DURATION			= 0x0008,
+	PS_FIELD_POSITION			= 0x0010,
+	PS_FIELD_TITLE				= 0x0020,
+	PS_FIELD_ARTIST				= 0x0040,
+	PS_FIELD_VOLUME				= 0x0080,
+	PS_FIELD_SUBTITLE_DISABLE	= 0x0100,
+	PS_FIELD_BUFFER_BLOCK_SIZE	= 0x0200,
+	PS_FIELD_BUFFER_REQUESTS	= 0x0400,
+	PS_FIELD_BUFFER_RTT			= 0x0800,
+	PS_FIELD_BUFFER_THROUGHPUT	= 0x1000,
+	PS_FIELD_BUFFER_RECEIVED	= 0x2000,
+	PS_FIELD_BUFFER_UNREAD		= 0x4000,
+	PS_FIELD_ALL				= 0x7fff
+};
+
+
+// Static variables.
+std::mutex PlaybackStatus::snapshotMutex;
+std::shared_ptr<StatusSnapshot> PlaybackStatus::snapshot;
+uint64_t PlaybackStatus::lastVersion = 0;
+StatusReadCallback PlaybackStatus::readCallback = 0;
+std::mutex PlaybackStatus::clientsMutex;
+std::map<uint32_t, StatusClient> PlaybackStatus::clients;
+std::mutex PlaybackStatus::pushMutex;
+std::condition_variable PlaybackStatus::pushCv;
+std::thread PlaybackStatus::pusher;
+bool PlaybackStatus::pending = false;
+bool PlaybackStatus::stale = true;
+bool PlaybackStatus::running = false;
+std::chrono::milliseconds PlaybackStatus::interval(0);
+std::string PlaybackStatus::loggerName = "PlaybackStatus";
+
+
+// --- ADD PAIR ---
+void addPair(std::map<std::string, NymphPair>* pairs, const char* name, NymphType* value) {
+	std::string* key = new std::string(name);
+	NymphPair pair;
+	pair.key = new NymphType(key, true);
+	pair.value = value;
+	pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
+}
+
+
+// --- COMPARE ---
+// Returns the fields which differ between two states.
+uint32_t PlaybackStatus::compare(const PlaybackState &a, const PlaybackState &b) {
+	uint32_t fields = 0;
+	if (a.status != b.status) { fields |= PS_FIELD_STATUS; }
+	if (a.playing != b.playing) { fields |= PS_FIELD_PLAYING; }
+	if (a.stopped != b.stopped) { fields |= PS_FIELD_STOPPED; }
+	if (a.duration != b.duration) { fields |= PS_FIELD_DURATION; }
+	if (a.position != b.position) { fields |= PS_FIELD_POSITION; }
+	if (a.title != b.title) { fields |= PS_FIELD_TITLE; }
+	if (a.artist != b.artist) { fields |= PS_FIELD_ARTIST; }
+	if (a.volume != b.volume) { fields |= PS_FIELD_VOLUME; }
+	if (a.subtitleDisable != b.subtitleDisable) { fields |= PS_FIELD_SUBTITLE_DISABLE; }
+	if (a.buffer.blockSize != b.buffer.blockSize) { fields |= PS_FIELD_BUFFER_BLOCK_SIZE; }
+	if (a.buffer.requestsInFlight != b.buffer.requestsInFlight) { fields |= PS_FIELD_BUFFER_REQUESTS; }
+	if (a.buffer.rtt != b.buffer.rtt) { fields |= PS_FIELD_BUFFER_RTT; }
+	if (a.buffer.throughput != b.buffer.throughput) { fields |= PS_FIELD_BUFFER_THROUGHPUT; }
+	if (a.buffer.bytesReceived != b.buffer.bytesReceived) { fields |= PS_FIELD_BUFFER_RECEIVED; }
+	if (a.buffer.unread != b.buffer.unread) { fields |= PS_FIELD_BUFFER_UNREAD; }
+	
+	return fields;
+}
+
+
+// --- BUILD ---
+// Build a status struct with the selected fields of the state.
+std::map<std::string, NymphPair>* PlaybackStatus::build(const PlaybackState &state, uint32_t fields,
+																		uint64_t version, bool delta) {
+	std::map<std::string, NymphPair>* pairs = new std::map<std::string, NymphPair>();
+	addPair(pairs, "version", new NymphType(version));
+	if (delta) { addPair(pairs, "delta", new NymphType(true)); }
+	
+	if (fields & PS_FIELD_STATUS) { addPair(pairs, "status", new NymphType(state.status)); }
+	if (fields & PS_FIELD_PLAYING) { addPair(pairs, "playing", new NymphType(state.playing)); }
+	if (fields & PS_FIELD_STOPPED) { addPair(pairs, "stopped", new NymphType(state.stopped)); }
+	if (fields & PS_FIELD_DURATION) { addPair(pairs, "duration", new NymphType(state.duration)); }
+	if (fields & PS_FIELD_POSITION) { addPair(pairs, "position", new NymphType(state.position)); }
+	if (fields & PS_FIELD_TITLE) {
+		addPair(pairs, "title", new NymphType(new std::string(state.title), true));
+	}
+	
+	if (fields & PS_FIELD_ARTIST) {
+		addPair(pairs, "artist", new NymphType(new std::string(state.artist), true));
+	}
+	
+	if (fields & PS_FIELD_VOLUME) { addPair(pairs, "volume", new NymphType(state.volume)); }
+	if (fields & PS_FIELD_SUBTITLE_DISABLE) {
+		addPair(pairs, "subtitle_disable", new NymphType(state.subtitleDisable));
+	}
+	
+	if (!state.playing) { return pairs; }
+	
+	// Read-ahead statistics for the session being played.
+	if (fields & PS_FIELD_BUFFER_BLOCK_SIZE) {
+		addPair(pairs, "buffer_block_size", new NymphType(state.buffer.blockSize));
+	}
+	
+	if (fields & PS_FIELD_BUFFER_REQUESTS) {
+		addPair(pairs, "buffer_requests", new NymphType(state.buffer.requestsInFlight));
+	}
+	
+	if (fields & PS_FIELD_BUFFER_RTT) {
+		addPair(pairs, "buffer_rtt", new NymphType(state.buffer.rtt));
+	}
+	
+	if (fields & PS_FIELD_BUFFER_THROUGHPUT) {
+		addPair(pairs, "buffer_throughput", new NymphType(state.buffer.throughput));
+	}
+	
+	if (fields & PS_FIELD_BUFFER_RECEIVED) {
+		addPair(pairs, "buffer_received", new NymphType(state.buffer.bytesReceived));
+	}
+	
+	if (fields & PS_FIELD_BUFFER_UNREAD) {
+		addPair(pairs, "buffer_unread", new NymphType(state.buffer.unread));
+	}
+	
+	return pairs;
+}
+
+
+// --- REFRESH ---
+// Returns the snapshot of the current status. The status is read again if a change was signalled,
+// if the snapshot is older than the push interval, or if forced.
+std::shared_ptr<StatusSnapshot> PlaybackStatus::refresh(bool force) {
+	std::lock_guard<std::mutex> lk(snapshotMutex);
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (snapshot && !force && !stale && now - snapshot->time < interval) { return snapshot; }
+	
+	stale = false;
+	PlaybackState state = {};
+	if (readCallback) { readCallback(state); }
+	
+	if (snapshot && compare(snapshot->state, state) == 0) {
+		snapshot->time = now;
+		return snapshot;
+	}
+	
+	std::shared_ptr<StatusSnapshot> snap = std::make_shared<StatusSnapshot>();
+	snap->version = ++lastVersion;
+	snap->state = state;
+	snap->time = now;
+	snapshot = snap;
+	return snap;
+}
+
+
+// --- SEND ---
+// Send a snapshot to a client. Clients which opted in get the fields which changed since the last
+// status they were sent. Returns false if the callback failed.
+bool PlaybackStatus::send(uint32_t handle, const std::shared_ptr<StatusSnapshot> &snap) {
+	StatusClient client = {};
+	bool known = false;
+	{
+		std::lock_guard<std::mutex> lk(clientsMutex);
+		std::map<uint32_t, StatusClient>::iterator it = clients.find(handle);
+		if (it != clients.end()) {
+			client = it->second;
+			known = true;
+		}
+	}
+	
+	// Nothing new for this client.
+	if (client.version == snap->version) { return true; }
+	
+	std::vector<NymphType*> values;
+	if (client.delta && client.version != 0) {
+		uint32_t fields = compare(client.state, snap->state);
+		if (fields != 0) {
+			values.push_back(new NymphType(build(snap->state, fields, snap->version, true), true));
+		}
+	}
+	else {
+		values.push_back(new NymphType(build(snap->state, PS_FIELD_ALL, snap->version, false), true));
+	}
+	
+	if (!values.empty()) {
+		std::string result;
+		if (!NymphRemoteClient::callCallback(handle, "MediaStatusCallback", values, result)) {
+			NYMPH_LOG_ERROR("Calling media status callback failed: " + result);
+			return false;
+		}
+	}
+	
+	if (known) {
+		std::lock_guard<std::mutex> lk(clientsMutex);
+		std::map<uint32_t, StatusClient>::iterator it = clients.find(handle);
+		if (it != clients.end()) {
+			it->second.version = snap->version;
+			it->second.state = snap->state;
+		}
+	}
+	
+	return true;
+}
+
+
+// --- RUN ---
+// Pushes the status to all clients after a change, at most once per push interval.
+void PlaybackStatus::run() {
+	std::unique_lock<std::mutex> lk(pushMutex);
+	std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+	while (running) {
+		if (!pending) {
+			pushCv.wait(lk);
+			continue;
+		}
+		
+		// Changes until the next push are coalesced into it.
+		if (std::chrono::steady_clock::now() < next) {
+			pushCv.wait_until(lk, next);
+			continue;
+		}
+		
+		pending = false;
+		lk.unlock();
+		
+		std::shared_ptr<StatusSnapshot> snap = refresh(true);
+		std::vector<uint32_t> handles;
+		{
+			std::lock_guard<std::mutex> clk(clientsMutex);
+			std::map<uint32_t, StatusClient>::const_iterator it;
+			for (it = clients.begin(); it != clients.end(); ++it) {
+				handles.push_back(it->first);
+			}
+		}
+		
+		NYMPH_LOG_DEBUG("Sending status version " + Poco::NumberFormatter::format(snap->version) +
+							" to " + Poco::NumberFormatter::format(handles.size()) + " clients.");
+		
+		for (uint32_t i = 0; i < handles.size(); ++i) {
+			if (!send(handles[i], snap)) {
+				// An error here very likely means that the client no longer exists. Remove it.
+				removeClient(handles[i]);
+			}
+		}
+		
+		lk.lock();
+		next = std::chrono::steady_clock::now() + interval;
+	}
+}
+
+
+// --- INIT ---
+// Set the callback which reads the current status, and start pushing status changes at most
+// 'rate' times per second to each client. A rate of 0 pushes each change right away.
+void PlaybackStatus::init(StatusReadCallback cb, uint32_t rate) {
+	readCallback = cb;
+	interval = std::chrono::milliseconds(rate == 0 ? 0 : 1000 / rate);
+	
+	std::lock_guard<std::mutex> lk(pushMutex);
+	if (running) { return; }
+	running = true;
+	pusher = std::thread(&PlaybackStatus::run);
+}
+
+
+// --- CLEANUP ---
+void PlaybackStatus::cleanup() {
+	{
+		std::lock_guard<std::mutex> lk(pushMutex);
+		running = false;
+	}
+	
+	pushCv.notify_one();
+	if (pusher.joinable()) { pusher.join(); }
+	
+	std::lock_guard<std::mutex> lk(snapshotMutex);
+	snapshot.reset();
+}
+
+
+// --- ADD CLIENT ---
+// Register a client for status pushes. It gets the full status struct until it opts in to deltas.
+void PlaybackStatus::addClient(uint32_t handle) {
+	std::lock_guard<std::mutex> lk(clientsMutex);
+	StatusClient client = {};
+	clients[handle] = client;
+}
+
+
+// --- REMOVE CLIENT ---
+void PlaybackStatus::removeClient(uint32_t handle) {
+	std::lock_guard<std::mutex> lk(clientsMutex);
+	clients.erase(handle);
+}
+
+
+// --- SET DELTA ---
+// Set whether the client gets only the changed fields with each push.
+void PlaybackStatus::setDelta(uint32_t handle, bool delta) {
+	std::lock_guard<std::mutex> lk(clientsMutex);
+	std::map<uint32_t, StatusClient>::iterator it = clients.find(handle);
+	if (it != clients.end()) {
+		it->second.delta = delta;
+	}
+}
+
+
+// --- GET STATUS ---
+// Returns the full status struct, owned by the caller.
+std::map<std::string, NymphPair>* PlaybackStatus::getStatus() {
+	std::shared_ptr<StatusSnapshot> snap = refresh(false);
+	return build(snap->state, PS_FIELD_ALL, snap->version, false);
+}
+
+
+// --- UPDATE ---
+// Signal a change of the status, to be pushed to all clients.
+void PlaybackStatus::update() {
+	{
+		std::lock_guard<std::mutex> lk(snapshotMutex);
+		stale = true;
+	}
+	
+	{
+		std::lock_guard<std::mutex> lk(pushMutex);
+		pending = true;
+	}
+	
+	pushCv.notify_one();
+}
+
+
+// --- PUSH ---
+// Send the current status to a single client right away.
+void PlaybackStatus::push(uint32_t handle) {
+	send(handle, refresh(false));
+}
@@ -0,0 +1,116 @@
+/*
+	playback_status.h - Header for the playback status of the receiver, as sent to clients.
+	
+	Revision 0
+	
+	Features:
+			- Keeps the last read playback status, with a version which is increased on each change.
+			- The status is read once per version, and shared by the playback_status method and
+				the status pushed to each client. Each of those gets its own struct built from it.
+			- Status pushes are coalesced: a burst of changes results in at most one push per
+				push interval to each client.
+			- Clients can opt in to receiving only the fields which changed since their last push.
+	
+	Notes:
+			- Clients get the full status struct by default, as before.
+			- Each struct includes a 'version' field. Delta structs also include 'delta' (true).
+	
+	2026/10/18, Maya Posch
+*/
+
+
+#ifndef PLAYBACK_STATUS_H
+#define PLAYBACK_STATUS_H
+
+
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <map>
+#include <string>
+#include <functional>
+
+#include <nymph/nymph.h>
+
+#include "databuffer.h"
+
+
+// Add a named value to a struct's pairs. The struct takes ownership of the value.
+void addPair(std::map<std::string, NymphPair>* pairs, const char* name, NymphType* value);
+
+
+struct PlaybackState {
+	uint32_t status;			// NymphPlaybackStatus.
+	bool playing;
+	bool stopped;
+	uint64_t duration;
+	double position;
+	std::string title;
+	std::string artist;
+	uint8_t volume;
+	bool subtitleDisable;
+	DataBufferStats buffer;		// Only sent while playing.
+};
+
+
+struct StatusSnapshot {
+	uint64_t version;
+	PlaybackState state;
+	std::chrono::steady_clock::time_point time;
+};
+
+
+struct StatusClient {
+	bool delta;					// Client accepts delta structs.
+	uint64_t version;			// Version last sent to the client, 0 if none.
+	PlaybackState state;		// State last sent to the client.
+};
+
+
+typedef std::function<void(PlaybackState &state)> StatusReadCallback;
+
+
+class PlaybackStatus {
+	static std::mutex snapshotMutex;
+	static std::shared_ptr<StatusSnapshot> snapshot;
+	static uint64_t lastVersion;
+	static StatusReadCallback readCallback;
+	
+	static std::mutex clientsMutex;
+	static std::map<uint32_t, StatusClient> clients;
+	
+	static std::mutex pushMutex;
+	static std::condition_variable pushCv;
+	static std::thread pusher;
+	static bool pending;
+	static bool stale;						// Status changed since the last read. (snapshotMutex)
+	static bool running;
+	static std::chrono::milliseconds interval;
+	
+	static std::string loggerName;
+	
+	static uint32_t compare(const PlaybackState &a, const PlaybackState &b);
+	static std::map<std::string, NymphPair>* build(const PlaybackState &state, uint32_t fields,
+																			uint64_t version, bool delta);
+	static std::shared_ptr<StatusSnapshot> refresh(bool force);
+	static bool send(uint32_t handle, const std::shared_ptr<StatusSnapshot> &snap);
+	static void run();
+
+public:
+	static void init(StatusReadCallback cb, uint32_t rate);
+	static void cleanup();
+	
+	static void addClient(uint32_t handle);
+	static void removeClient(uint32_t handle);
+	static void setDelta(uint32_t handle, bool delta);
+	
+	static std::map<std::string, NymphPair>* getStatus();
+	static void update();
+	static void push(uint32_t handle);
+};
+
+#endif
@@ -0,0 +1,244 @@
+/*
+	resource_cache.cpp - Implementation of the ResourceCache class.
+	
+	Revision 0.
+	
+	Notes:
+			- Text resources (HTML, CSS, JS, ...) of RC_GZIP_MIN to RC_GZIP_MAX bytes are compressed
+				when loaded, and the result kept if it saves at least 10%.
+			- The token is the FNV-1a hash of the contents, with the size.
+	
+	2026/10/18, Maya Posch
+*/
+
+
+#include "resource_cache.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+
+#include <Poco/DeflatingStream.h>
+#include <Poco/NumberFormatter.h>
+
+#include <nymph/nymph.h>
+
+
+#define RC_GZIP_MIN 512						// Size range of text resources which are compressed.
+#define RC_GZIP_MAX (4 * 1024 * 1024)
+
+
+namespace fs = std::filesystem;
+
+
+// Static variables.
+std::mutex ResourceCache::cacheMutex;
+std::list<ResourceEntry> ResourceCache::cache;
+std::unordered_map<std::string, std::list<ResourceEntry>::iterator> ResourceCache::cacheIndex;
+size_t ResourceCache::cacheBytes = 0;
+size_t ResourceCache::cacheMax = 0;
+std::string ResourceCache::loggerName = "ResourceCache";
+
+
+// --- FILE TIME ---
+// Modification time of a file, in seconds of the file system clock.
+static bool fileTime(const std::string &path, int64_t &mtime) {
+	std::error_code ec;
+	fs::file_time_type time = fs::last_write_time(path, ec);
+	if (ec) { return false; }
+	
+	mtime = std::chrono::duration_cast<std::chrono::seconds>(time.time_since_epoch()).count();
+	return true;
+}
+
+
+// --- IS TEXT ---
+// Whether a resource compresses well, by its extension.
+static bool isText(const std::string &path) {
+	std::string ext = fs::path(path).extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+	return ext == ".html" || ext == ".htm" || ext == ".css" || ext == ".js" || ext == ".json" ||
+			ext == ".svg" || ext == ".txt" || ext == ".xml";
+}
+
+
+// --- INIT ---
+// Set the maximum size of the cache in bytes. 0 disables caching.
+void ResourceCache::init(size_t size) {
+	std::lock_guard<std::mutex> lk(cacheMutex);
+	cacheMax = size;
+}
+
+
+// --- CLEANUP ---
+void ResourceCache::cleanup() {
+	clear();
+}
+
+
+// --- READ FILE ---
+// Read a file into memory. Files are not mapped, as a file truncated while mapped would crash the
+// server (SIGBUS) on the next access.
+std::shared_ptr<const std::string> ResourceCache::readFile(const std::string &path, int64_t size) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) { return std::shared_ptr<const std::string>(); }
+	
+	std::shared_ptr<std::string> buffer = std::make_shared<std::string>();
+	buffer->resize((size_t) size);
+	file.read(&(*buffer)[0], size);
+	buffer->resize((size_t) file.gcount());
+	return buffer;
+}
+
+
+// --- LOAD ---
+// Read the file of an entry, and set up its token & gzip variant.
+bool ResourceCache::load(ResourceEntry &entry) {
+	NYMPH_LOG_INFORMATION("Reading file: " + entry.path);
+	entry.data = readFile(entry.path, entry.size);
+	if (!entry.data) {
+		NYMPH_LOG_ERROR("Failed to read file '" + entry.path + "'.");
+		return false;
+	}
+	
+	uint64_t hash = 14695981039346656037ULL;
+	const unsigned char* p = (const unsigned char*) entry.data->data();
+	for (size_t i = 0; i < entry.data->size(); ++i) {
+		hash ^= p[i];
+		hash *= 1099511628211ULL;
+	}
+	
+	entry.token = Poco::NumberFormatter::formatHex(hash, 16) + "-" +
+					Poco::NumberFormatter::formatHex((uint64_t) entry.data->size());
+	
+	// A pre-compressed variant which is at least as new as the file is used as it is.
+	std::string gzPath = entry.path + ".gz";
+	std::error_code ec;
+	int64_t gzMtime;
+	entry.gzip.reset();
+	entry.gzipMtime = 0;
+	if (fs::is_regular_file(gzPath, ec) && fileTime(gzPath, gzMtime) && gzMtime >= entry.mtime) {
+		entry.gzip = readFile(gzPath, (int64_t) fs::file_size(gzPath, ec));
+		if (entry.gzip) { entry.gzipMtime = gzMtime; }
+	}
+	else if (isText(entry.path) && entry.data->size() >= RC_GZIP_MIN && 
+												entry.data->size() <= RC_GZIP_MAX) {
+		std::ostringstream out;
+		Poco::DeflatingOutputStream deflater(out, Poco::DeflatingStreamBuf::STREAM_GZIP);
+		deflater.write(entry.data->data(), entry.data->size());
+		deflater.close();
+		
+		std::string compressed = out.str();
+		if (compressed.size() < entry.data->size() - entry.data->size() / 10) {
+			entry.gzip = std::make_shared<std::string>(std::move(compressed));
+		}
+	}
+	
+	return true;
+}
+
+
+// --- REMOVE ---
+// Call with cacheMutex locked.
+void ResourceCache::remove(std::list<ResourceEntry>::iterator it) {
+	cacheBytes -= it->data->size() + (it->gzip ? it->gzip->size() : 0);
+	cacheIndex.erase(it->key);
+	cache.erase(it);
+}
+
+
+// --- GET ---
+// Get a resource of an app, or of the apps root folder (empty app ID).
+// path		: file of the resource.
+// token	: token returned with the copy the client has, or empty.
+// flags	: RC_FLAG_* values.
+ResourceResult ResourceCache::get(const std::string &appId, const std::string &name,
+								const std::string &path, const std::string &token, uint8_t flags) {
+	ResourceResult result;
+	std::string key = appId + "/" + name;
+	std::error_code ec;
+	ResourceEntry entry;
+	entry.size = fs::is_regular_file(path, ec) ? (int64_t) fs::file_size(path, ec) : -1;
+	if (ec || entry.size < 0 || !fileTime(path, entry.mtime)) {
+		std::lock_guard<std::mutex> lk(cacheMutex);
+		std::unordered_map<std::string, std::list<ResourceEntry>::iterator>::iterator it;
+		it = cacheIndex.find(key);
+		if (it != cacheIndex.end()) { remove(it->second); }
+		return result;
+	}
+	
+	bool found = false;
+	{
+		std::lock_guard<std::mutex> lk(cacheMutex);
+		std::unordered_map<std::string, std::list<ResourceEntry>::iterator>::iterator it;
+		it = cacheIndex.find(key);
+		if (it != cacheIndex.end()) {
+			ResourceEntry &cached = *it->second;
+			int64_t gzMtime = 0;
+			bool current = cached.path == path && cached.size == entry.size && cached.mtime == entry.mtime;
+			if (current && cached.gzipMtime != 0) {
+				current = fileTime(path + ".gz", gzMtime) && gzMtime == cached.gzipMtime;
+			}
+			
+			if (current) {
+				cache.splice(cache.begin(), cache, it->second);
+				entry = cached;
+				found = true;
+			}
+			else {
+				remove(it->second);
+			}
+		}
+	}
+	
+	if (!found) {
+		entry.key = key;
+		entry.path = path;
+		if (!load(entry)) { return result; }
+		
+		std::lock_guard<std::mutex> lk(cacheMutex);
+		size_t bytes = entry.data->size() + (entry.gzip ? entry.gzip->size() : 0);
+		if (cacheMax > 0 && bytes <= cacheMax) {
+			// Another request may have loaded it in the meantime.
+			std::unordered_map<std::string, std::list<ResourceEntry>::iterator>::iterator it;
+			it = cacheIndex.find(key);
+			if (it != cacheIndex.end()) { remove(it->second); }
+			
+			cache.push_front(entry);
+			cacheIndex[key] = cache.begin();
+			cacheBytes += bytes;
+			while (cacheBytes > cacheMax) {
+				remove(std::prev(cache.end()));
+			}
+		}
+	}
+	
+	result.token = entry.token;
+	if (!token.empty() && token == entry.token) {
+		result.status = RC_STATUS_NOT_MODIFIED;
+		return result;
+	}
+	
+	result.status = RC_STATUS_OK;
+	if ((flags & RC_FLAG_GZIP) && entry.gzip) {
+		result.data = entry.gzip;
+		result.encoding = "gzip";
+	}
+	else {
+		result.data = entry.data;
+	}
+	
+	return result;
+}
+
+
+// --- CLEAR ---
+void ResourceCache::clear() {
+	std::lock_guard<std::mutex> lk(cacheMutex);
+	while (!cache.empty()) {
+		remove(cache.begin());
+	}
+}
@@ -0,0 +1,84 @@
+/*
+	resource_cache.h - Header for the cache of resources loaded from the apps folder.
+	
+	Revision 0
+	
+	Features:
+			- Keeps the files requested with app_loadResource in memory, by app ID & name. An entry
+				is used as long as the size & modification time of the file are unchanged.
+			- Keeps a gzip variant of a resource: a pre-compressed '<name>.gz' file next to it, or
+				one compressed when text resources are loaded.
+			- Each resource gets a token (hash of its contents). A client which passes the token of
+				the copy it has gets a 'not modified' reply without the data.
+	
+	Notes:
+			- Files are read into memory, and each reply gets its own copy of the data. Data which
+				is removed from the cache stays alive while a result still refers to it.
+	
+	2026/10/18, Maya Posch
+*/
+
+
+#ifndef RESOURCE_CACHE_H
+#define RESOURCE_CACHE_H
+
+
+#include <cstdint>
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+
+
+// Status of a resource request.
+#define RC_STATUS_OK 0				// Data of the resource included.
+#define RC_STATUS_NOT_MODIFIED 1	// The token passed matches, no data included.
+#define RC_STATUS_NOT_FOUND 2
+
+// Request flags.
+#define RC_FLAG_GZIP 0x01			// Client accepts gzip encoded data.
+
+
+struct ResourceEntry {
+	std::string key;
+	std::string path;
+	int64_t size;
+	int64_t mtime;
+	int64_t gzipMtime;				// Of the '.gz' file used as gzip variant, 0 if none.
+	std::string token;
+	std::shared_ptr<const std::string> data;
+	std::shared_ptr<const std::string> gzip;	// Empty if there is no smaller gzip variant.
+};
+
+
+struct ResourceResult {
+	uint8_t status = RC_STATUS_NOT_FOUND;
+	std::string token;
+	std::string encoding;			// "gzip" or empty.
+	std::shared_ptr<const std::string> data;	// Set if the status is RC_STATUS_OK.
+};
+
+
+class ResourceCache {
+	static std::mutex cacheMutex;
+	static std::list<ResourceEntry> cache;		// Most recently used first.
+	static std::unordered_map<std::string, std::list<ResourceEntry>::iterator> cacheIndex;
+	static size_t cacheBytes;
+	static size_t cacheMax;
+	
+	static std::string loggerName;
+	
+	static std::shared_ptr<const std::string> readFile(const std::string &path, int64_t size);
+	static bool load(ResourceEntry &entry);
+	static void remove(std::list<ResourceEntry>::iterator it);
+
+public:
+	static void init(size_t size);
+	static void cleanup();
+	static ResourceResult get(const std::string &appId, const std::string &name,
+								const std::string &path, const std::string &token, uint8_t flags);
+	static void clear();
+};
+
+#endif
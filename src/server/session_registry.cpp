@@ -0,0 +1,313 @@
+/*
+	session_registry.cpp - Implementation of the SessionRegistry class.
+	
+	Revision 0.
+	
+	Notes:
+			- The active session is the one the player reads from. Its buffer is handed to the
+				player as AVIO opaque pointer, so a session removed during playback stays alive
+				until the player releases it.
+			- A session started while another is playing gets queued, up to SR_MAX_QUEUED.
+				It prefetches into its smaller buffer, which grows to the active size on handover.
+			- The active buffer gets the budget minus the buffers of the sessions actually queued.
+				It shrinks when a session gets queued, and grows again on the next handover.
+	
+	2026/10/18, Maya Posch
+*/
+
+
+#include "session_registry.h"
+
+#include <nymph/nymph_logger.h>
+
+#include <Poco/NumberFormatter.h>
+
+
+#define SR_MAX_QUEUED 2		// Maximum number of sessions queued behind the active one.
+
+
+// Static variables.
+std::mutex SessionRegistry::sessionsMutex;
+std::map<uint32_t, std::shared_ptr<DataBuffer> > SessionRegistry::sessions;
+std::deque<uint32_t> SessionRegistry::nextSessions;
+std::shared_ptr<DataBuffer> SessionRegistry::activeBuffer;
+uint32_t SessionRegistry::activeSession = 0;
+bool SessionRegistry::hasActive = false;
+uint32_t SessionRegistry::budget = 0;
+SeekRequestCallback SessionRegistry::seekRequestCallback = 0;
+DataRequestCallback SessionRegistry::dataRequestCallback = 0;
+std::mutex SessionRegistry::streamTrackQueueMutex;
+std::queue<std::string> SessionRegistry::streamTrackQueue;
+std::string SessionRegistry::loggerName = "SessionRegistry";
+
+
+// --- ACTIVE CAPACITY ---
+// Buffer size of the session being played, with the current queue. Call with the sessions lock held.
+uint32_t SessionRegistry::activeCapacity() {
+	return budget - ((uint32_t) nextSessions.size() * queuedCapacity());
+}
+
+
+// --- QUEUED CAPACITY ---
+// Buffer size of a session waiting for its turn.
+uint32_t SessionRegistry::queuedCapacity() {
+	return budget / 8;
+}
+
+
+// --- INIT ---
+// Set the total buffer size, in bytes, to be divided over the sessions.
+void SessionRegistry::init(uint32_t budget) {
+	SessionRegistry::budget = budget;
+}
+
+
+// --- CLEAN UP ---
+// Drop all sessions.
+void SessionRegistry::cleanup() {
+	std::lock_guard<std::mutex> lk(sessionsMutex);
+	nextSessions.clear();
+	activeBuffer.reset();
+	hasActive = false;
+	
+	std::map<uint32_t, std::shared_ptr<DataBuffer> >::iterator it;
+	for (it = sessions.begin(); it != sessions.end(); ++it) {
+		it->second->cleanup();
+	}
+	
+	sessions.clear();
+}
+
+
+// --- SET SEEK REQUEST CALLBACK ---
+void SessionRegistry::setSeekRequestCallback(SeekRequestCallback cb) {
+	seekRequestCallback = cb;
+}
+
+
+// --- SET DATA REQUEST CALLBACK ---
+void SessionRegistry::setDataRequestCallback(DataRequestCallback cb) {
+	dataRequestCallback = cb;
+}
+
+
+// --- CREATE ---
+// Create the buffer for a new session, replacing any earlier buffer of the same session. With
+// 'queue' set it is queued behind the current playback, otherwise it becomes the active
+// session, replacing an active session which never started playing.
+// Returns the new buffer, or an empty pointer if the queue is full or allocation failed.
+std::shared_ptr<DataBuffer> SessionRegistry::create(uint32_t session, int64_t filesize,
+																				bool queue) {
+	std::unique_lock<std::mutex> lk(sessionsMutex);
+	
+	// Drop an earlier file stream of this session.
+	std::deque<uint32_t>::iterator qit;
+	for (qit = nextSessions.begin(); qit != nextSessions.end(); ++qit) {
+		if (*qit == session) { nextSessions.erase(qit); break; }
+	}
+	
+	if (hasActive && activeSession == session) {
+		activeBuffer.reset();
+		hasActive = false;
+	}
+	
+	sessions.erase(session);
+	
+	if (queue && nextSessions.size() >= SR_MAX_QUEUED) {
+		NYMPH_LOG_ERROR("Session queue is full, rejecting session " +
+										Poco::NumberFormatter::format(session) + ".");
+		return std::shared_ptr<DataBuffer>();
+	}
+	
+	std::shared_ptr<DataBuffer> db = std::make_shared<DataBuffer>();
+	if (!db->init(queue ? queuedCapacity() : activeCapacity())) {
+		NYMPH_LOG_ERROR("Failed to allocate buffer for session " +
+										Poco::NumberFormatter::format(session) + ".");
+		return std::shared_ptr<DataBuffer>();
+	}
+	
+	db->setSeekRequestCallback(seekRequestCallback);
+	db->setDataRequestCallback(dataRequestCallback);
+	db->setSessionHandle(session);
+	db->setFileSize(filesize);
+	
+	sessions[session] = db;
+	if (queue) {
+		nextSessions.push_back(session);
+	}
+	else {
+		if (hasActive) { sessions.erase(activeSession); }
+		activeBuffer = db;
+		activeSession = session;
+		hasActive = true;
+	}
+	
+	if (!queue || !hasActive) { return db; }
+	
+	// Make room for the queued buffer. Resizing waits for the reader, so do this without
+	// holding the lock.
+	std::shared_ptr<DataBuffer> active = activeBuffer;
+	uint32_t capacity = activeCapacity();
+	lk.unlock();
+	if (active->getCapacity() > capacity && !active->resize(capacity)) {
+		NYMPH_LOG_WARNING("Failed to shrink active buffer, exceeding the buffer budget.");
+	}
+	
+	return db;
+}
+
+
+// --- GET ---
+// Returns the buffer of the session, or an empty pointer if it has none.
+std::shared_ptr<DataBuffer> SessionRegistry::get(uint32_t session) {
+	std::lock_guard<std::mutex> lk(sessionsMutex);
+	std::map<uint32_t, std::shared_ptr<DataBuffer> >::iterator it = sessions.find(session);
+	if (it == sessions.end()) { return std::shared_ptr<DataBuffer>(); }
+	
+	return it->second;
+}
+
+
+// --- REMOVE ---
+// Drop the buffer of the session, e.g. when its client disconnects.
+void SessionRegistry::remove(uint32_t session) {
+	std::lock_guard<std::mutex> lk(sessionsMutex);
+	std::deque<uint32_t>::iterator qit;
+	for (qit = nextSessions.begin(); qit != nextSessions.end(); ++qit) {
+		if (*qit == session) { nextSessions.erase(qit); break; }
+	}
+	
+	if (hasActive && activeSession == session) {
+		activeBuffer.reset();
+		hasActive = false;
+	}
+	
+	sessions.erase(session);
+}
+
+
+// --- GET ACTIVE ---
+// Returns the buffer of the session being played, or an empty pointer.
+std::shared_ptr<DataBuffer> SessionRegistry::getActive() {
+	std::lock_guard<std::mutex> lk(sessionsMutex);
+	return activeBuffer;
+}
+
+
+// --- GET ACTIVE SESSION ---
+// Returns the ID of the session being played, or 0.
+uint32_t SessionRegistry::getActiveSession() {
+	std::lock_guard<std::mutex> lk(sessionsMutex);
+	return hasActive ? activeSession : 0;
+}
+
+
+// --- IS ACTIVE ---
+bool SessionRegistry::isActive(uint32_t session) {
+	std::lock_guard<std::mutex> lk(sessionsMutex);
+	return hasActive && activeSession == session;
+}
+
+
+// --- HAS NEXT ---
+// Returns true if a session is queued to be played next.
+bool SessionRegistry::hasNext() {
+	std::lock_guard<std::mutex> lk(sessionsMutex);
+	return !nextSessions.empty();
+}
+
+
+// --- GET NEXT ---
+// Returns the buffer of the session to be played next, or an empty pointer.
+std::shared_ptr<DataBuffer> SessionRegistry::getNext() {
+	std::lock_guard<std::mutex> lk(sessionsMutex);
+	if (nextSessions.empty()) { return std::shared_ptr<DataBuffer>(); }
+	
+	return sessions[nextSessions.front()];
+}
+
+
+// --- ACTIVATE NEXT ---
+// Called after playback ended. Drops the finished session and makes the first queued session
+// the active one, growing its buffer to the active size. Its prefetched data is kept.
+// Returns true if there is a new active session to be played.
+bool SessionRegistry::activateNext() {
+	std::shared_ptr<DataBuffer> db;
+	uint32_t session = 0;
+	uint32_t capacity = 0;
+	{
+		std::lock_guard<std::mutex> lk(sessionsMutex);
+		if (hasActive) {
+			sessions.erase(activeSession);
+			activeBuffer.reset();
+			hasActive = false;
+		}
+		
+		while (!nextSessions.empty()) {
+			session = nextSessions.front();
+			nextSessions.pop_front();
+			std::map<uint32_t, std::shared_ptr<DataBuffer> >::iterator it = sessions.find(session);
+			if (it == sessions.end()) { continue; }
+			
+			db = it->second;
+			activeBuffer = db;
+			activeSession = session;
+			hasActive = true;
+			capacity = activeCapacity();
+			break;
+		}
+	}
+	
+	if (!db) { return false; }
+	
+	// The player probes the container first, with read-ahead starting after that as usual.
+	// Resizing waits for outstanding data requests, so do this without holding the lock.
+	db->stopPrefetch();
+	if (!db->resize(capacity)) {
+		NYMPH_LOG_WARNING("Failed to grow buffer of session " +
+										Poco::NumberFormatter::format(session) + ".");
+	}
+	
+	NYMPH_LOG_INFORMATION("Activated queued session " + Poco::NumberFormatter::format(session) +
+																					".");
+	
+	return true;
+}
+
+
+// --- ADD STREAM TRACK ---
+// Add a streaming track to the queue.
+void SessionRegistry::addStreamTrack(std::string track) {
+	streamTrackQueueMutex.lock();
+	streamTrackQueue.push(track);
+	streamTrackQueueMutex.unlock();
+}
+
+
+// --- HAS STREAM TRACK ---
+bool SessionRegistry::hasStreamTrack() {
+	std::lock_guard<std::mutex> lk(streamTrackQueueMutex);
+	return !streamTrackQueue.empty();
+}
+
+
+// --- PEEK STREAM TRACK ---
+// Returns the next stream string in the queue without removing it, or an empty string.
+std::string SessionRegistry::peekStreamTrack() {
+	std::lock_guard<std::mutex> lk(streamTrackQueueMutex);
+	if (streamTrackQueue.empty()) { return std::string(); }
+	
+	return streamTrackQueue.front();
+}
+
+
+// --- GET STREAM TRACK ---
+// Returns the next stream string in the queue, or an empty string if queue is empty.
+std::string SessionRegistry::getStreamTrack() {
+	std::lock_guard<std::mutex> lk(streamTrackQueueMutex);
+	if (streamTrackQueue.empty()) { return std::string(); }
+	std::string tStr = streamTrackQueue.front();
+	streamTrackQueue.pop();
+	
+	return tStr;
+}
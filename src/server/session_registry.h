@@ -0,0 +1,73 @@
+/*
+	session_registry.h - Header for the cast session registry.
+	
+	Revision 0
+	
+	Features:
+			- Owns the DataBuffer instance of each cast session, keyed on the session ID.
+			- Splits the total buffer size between the active session and queued sessions.
+			- Queued sessions prefetch their first data while the active session plays.
+			- Holds the queue of URLs to stream next.
+	
+	Notes:
+			- Budget: each queued session gets 1/8 of the total, the active session the rest.
+	
+	2026/10/18, Maya Posch
+*/
+
+
+#ifndef SESSION_REGISTRY_H
+#define SESSION_REGISTRY_H
+
+
+#include <mutex>
+#include <memory>
+#include <map>
+#include <deque>
+#include <queue>
+#include <string>
+
+#include "databuffer.h"
+
+
+class SessionRegistry {
+	static std::mutex sessionsMutex;
+	static std::map<uint32_t, std::shared_ptr<DataBuffer> > sessions;
+	static std::deque<uint32_t> nextSessions;	// Queued sessions, in playback order.
+	static std::shared_ptr<DataBuffer> activeBuffer;
+	static uint32_t activeSession;
+	static bool hasActive;
+	static uint32_t budget;						// Total buffer size for all sessions, in bytes.
+	static SeekRequestCallback seekRequestCallback;
+	static DataRequestCallback dataRequestCallback;
+	
+	static std::mutex streamTrackQueueMutex;
+	static std::queue<std::string> streamTrackQueue;
+	
+	static std::string loggerName;
+	
+	static uint32_t activeCapacity();
+	static uint32_t queuedCapacity();
+	
+public:
+	static void init(uint32_t budget);
+	static void cleanup();
+	static void setSeekRequestCallback(SeekRequestCallback cb);
+	static void setDataRequestCallback(DataRequestCallback cb);
+	static std::shared_ptr<DataBuffer> create(uint32_t session, int64_t filesize, bool queue);
+	static std::shared_ptr<DataBuffer> get(uint32_t session);
+	static void remove(uint32_t session);
+	static std::shared_ptr<DataBuffer> getActive();
+	static uint32_t getActiveSession();
+	static bool isActive(uint32_t session);
+	static bool hasNext();
+	static std::shared_ptr<DataBuffer> getNext();
+	static bool activateNext();
+	
+	static void addStreamTrack(std::string track);
+	static bool hasStreamTrack();
+	static std::string peekStreamTrack();
+	static std::string getStreamTrack();
+};
+
+#endif
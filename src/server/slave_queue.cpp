@@ -0,0 +1,239 @@
+/*
+	slave_queue.cpp - Implementation of the SlaveQueue class.
+	
+	Revision 0.
+	
+	Notes:
+			- The slave returns the free space in its buffer with each receiveDataMaster call.
+				While a chunk does not fit, the worker polls slave_buffer_free instead.
+			- flush() drops queued chunks and waits for a chunk being sent, so that nothing of
+				the old data reaches the slave after e.g. a seek.
+	
+	2026/10/18, Maya Posch
+*/
+
+
+#include "slave_queue.h"
+
+#include <vector>
+#include <chrono>
+
+#include <nymph/nymph.h>
+
+#include <Poco/NumberFormatter.h>
+
+
+#define SQ_MAX_BYTES (16 * 1024 * 1024)	// Data queued per slave before waitSpace() blocks.
+#define SQ_POLL_INTERVAL 50				// Time between buffer polls of a full slave, in ms.
+
+
+// Static variables.
+std::string SlaveQueue::loggerName = "SlaveQueue";
+
+
+// --- CONSTRUCTOR ---
+SlaveQueue::SlaveQueue(uint32_t handle, std::string name) {
+	this->handle = handle;
+	this->name = name;
+}
+
+
+// --- DESTRUCTOR ---
+SlaveQueue::~SlaveQueue() {
+	stop();
+}
+
+
+// --- START ---
+void SlaveQueue::start() {
+	std::lock_guard<std::mutex> lk(queueMutex);
+	if (running) { return; }
+	
+	running = true;
+	failed = false;
+	slaveFree = 0;
+	worker = std::thread(&SlaveQueue::run, this);
+}
+
+
+// --- STOP ---
+// Stop the worker, dropping any queued data.
+void SlaveQueue::stop() {
+	{
+		std::lock_guard<std::mutex> lk(queueMutex);
+		if (!running) { return; }
+		
+		running = false;
+		generation++;
+		chunks.clear();
+		queuedBytes = 0;
+	}
+	
+	queueCv.notify_all();
+	spaceCv.notify_all();
+	if (worker.joinable()) { worker.join(); }
+}
+
+
+// --- PUSH ---
+// Queue a chunk for the slave, without waiting for room. See waitSpace().
+// Returns false if the slave has been dropped or the queue is stopped.
+bool SlaveQueue::push(std::shared_ptr<std::string> data, bool done, int64_t when) {
+	std::lock_guard<std::mutex> lk(queueMutex);
+	if (!running || failed) { return false; }
+	
+	SlaveChunk chunk;
+	chunk.data = data;
+	chunk.done = done;
+	chunk.when = when;
+	chunks.push_back(chunk);
+	queuedBytes += data->length();
+	queueCv.notify_one();
+	
+	return true;
+}
+
+
+// --- WAIT SPACE ---
+// Wait until less than SQ_MAX_BYTES is queued, or until the deadline. A slave still behind at the
+// deadline is dropped.
+// Returns false if the slave has been dropped or the queue is stopped.
+bool SlaveQueue::waitSpace(std::chrono::steady_clock::time_point deadline) {
+	std::unique_lock<std::mutex> lk(queueMutex);
+	if (!running || failed) { return false; }
+	
+	if (!spaceCv.wait_until(lk, deadline, 
+								[this] { return queuedBytes < SQ_MAX_BYTES || !running; })) {
+		NYMPH_LOG_ERROR("Slave " + name + " is not keeping up, dropping it.");
+		failed = true;
+		generation++;
+		chunks.clear();
+		queuedBytes = 0;
+		queueCv.notify_all();
+		return false;
+	}
+	
+	return running;
+}
+
+
+// --- FLUSH ---
+// Drop all queued data. Returns once a chunk being sent has been received by the slave.
+// A dropped slave is taken back, as it continues from a reset buffer after this.
+void SlaveQueue::flush() {
+	std::unique_lock<std::mutex> lk(queueMutex);
+	generation++;
+	chunks.clear();
+	queuedBytes = 0;
+	
+	spaceCv.notify_all();
+	queueCv.notify_all();
+	
+	spaceCv.wait(lk, [this] { return !sending; });
+	if (running && failed) {
+		NYMPH_LOG_INFORMATION("Taking slave " + name + " back after flush.");
+		failed = false;
+		slaveFree = 0;
+	}
+}
+
+
+// --- GET QUEUED ---
+// Bytes waiting to be sent to the slave.
+uint32_t SlaveQueue::getQueued() {
+	std::lock_guard<std::mutex> lk(queueMutex);
+	return queuedBytes;
+}
+
+
+// --- POLL FREE ---
+// Ask the slave for the free space in its buffer.
+bool SlaveQueue::pollFree() {
+	std::vector<NymphType*> values;
+	std::string result;
+	NymphType* returnValue = 0;
+	if (!NymphRemoteServer::callMethod(handle, "slave_buffer_free", values, returnValue, result)) {
+		NYMPH_LOG_ERROR("Calling slave_buffer_free on " + name + " failed: " + result);
+		return false;
+	}
+	
+	slaveFree = returnValue->getUint32();
+	delete returnValue;
+	
+	return true;
+}
+
+
+// --- SEND ---
+bool SlaveQueue::send(SlaveChunk &chunk) {
+	// The chunk stays alive until the call returns, so the data does not need to be copied.
+	std::vector<NymphType*> values;
+	values.push_back(new NymphType((char*) chunk.data->data(), chunk.data->length()));
+	values.push_back(new NymphType(chunk.done));
+	values.push_back(new NymphType(chunk.when));
+	
+	std::string result;
+	NymphType* returnValue = 0;
+	if (!NymphRemoteServer::callMethod(handle, "receiveDataMaster", values, returnValue, result)) {
+		NYMPH_LOG_ERROR("Calling receiveDataMaster on " + name + " failed: " + result);
+		return false;
+	}
+	
+	slaveFree = returnValue->getUint32();
+	delete returnValue;
+	
+	return true;
+}
+
+
+// --- RUN ---
+// Worker thread. Sends the queued chunks in order, as the slave's buffer has room for them.
+void SlaveQueue::run() {
+	while (true) {
+		SlaveChunk chunk;
+		uint32_t gen;
+		{
+			std::unique_lock<std::mutex> lk(queueMutex);
+			queueCv.wait(lk, [this] { return !running || (!chunks.empty() && !failed); });
+			if (!running) { break; }
+			
+			// Mark the chunk as being sent before it leaves the queue, so that flush() waits for it.
+			sending = true;
+			chunk = chunks.front();
+			gen = generation;
+		}
+		
+		// Wait for room in the slave's buffer. Keep the chunk queued meanwhile, so that it
+		// counts towards the queue limit.
+		bool ok = true;
+		while (slaveFree < chunk.data->length()) {
+			{
+				std::unique_lock<std::mutex> lk(queueMutex);
+				queueCv.wait_for(lk, std::chrono::milliseconds(SQ_POLL_INTERVAL), 
+												[this, gen] { return generation != gen; });
+			}
+			
+			if (generation != gen) { ok = false; break; }
+			if (!pollFree()) { failed = true; ok = false; break; }
+		}
+		
+		if (ok && !send(chunk)) { failed = true; }
+		
+		{
+			std::lock_guard<std::mutex> lk(queueMutex);
+			if (generation == gen) {
+				chunks.pop_front();
+				queuedBytes -= chunk.data->length();
+			}
+			
+			if (failed) {
+				chunks.clear();
+				queuedBytes = 0;
+			}
+			
+			sending = false;
+		}
+		
+		spaceCv.notify_all();
+	}
+}
@@ -0,0 +1,84 @@
+/*
+	slave_queue.h - Header for the master to slave media data queue.
+	
+	Revision 0
+	
+	Features:
+			- One queue & worker thread per slave receiver, so that forwarding media data to a
+				slave does not block the client or the other slaves.
+			- Chunks are reference counted & shared between the queues of all slaves.
+			- Data is only sent when the slave's buffer has room for it, as reported by the slave.
+	
+	Notes:
+			- push() does not block. The caller pushes a chunk to all slaves, then waits once
+				with waitSpace() for all of them, up to a shared deadline.
+			- A slave which is still more than SQ_MAX_BYTES behind at that deadline is dropped,
+				instead of stalling the client. It rejoins on the next flush (seek), as the
+				slave's buffer gets reset then.
+	
+	2026/10/18, Maya Posch
+*/
+
+
+#ifndef SLAVE_QUEUE_H
+#define SLAVE_QUEUE_H
+
+
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+#include <chrono>
+
+
+#define SQ_PUSH_TIMEOUT 2000	// Time to wait for room in the slave queues, in milliseconds.
+
+
+struct SlaveChunk {
+	std::shared_ptr<std::string> data;
+	bool done;
+	int64_t when;
+};
+
+
+class SlaveQueue {
+	uint32_t handle;				// RPC handle of the slave.
+	std::string name;
+	std::deque<SlaveChunk> chunks;	// Chunks not yet sent, oldest first.
+	uint32_t queuedBytes = 0;
+	std::mutex queueMutex;
+	std::condition_variable queueCv;	// Signalled on push & stop.
+	std::condition_variable spaceCv;	// Signalled when queued data was sent or dropped.
+	bool sending = false;				// A chunk is on its way to the slave.
+	std::thread worker;
+	bool running = false;
+	std::atomic<bool> failed = { false };
+	std::atomic<uint32_t> generation = { 0 };	// Increased by flush().
+	uint32_t slaveFree = 0;		// Last reported free space in the slave's buffer, in bytes.
+	
+	static std::string loggerName;
+	
+	void run();
+	bool send(SlaveChunk &chunk);
+	bool pollFree();
+
+public:
+	SlaveQueue(uint32_t handle, std::string name);
+	~SlaveQueue();
+	SlaveQueue(const SlaveQueue&) = delete;
+	SlaveQueue& operator=(const SlaveQueue&) = delete;
+	
+	void start();
+	void stop();
+	bool push(std::shared_ptr<std::string> data, bool done, int64_t when);
+	bool waitSpace(std::chrono::steady_clock::time_point deadline);
+	void flush();
+	bool isFailed() { return failed; }
+	uint32_t getQueued();
+};
+
+#endif
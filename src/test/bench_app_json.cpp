@@ -0,0 +1,224 @@
+/*
+	bench_app_json.cpp - Benchmark for the JSON API of NymphCast apps.
+	
+	Notes:
+			- Replays the parsing done by the SoundCloud app: the search results (collection with
+				ID, title & user of each entry), a playlist (track IDs) and a track (media URL).
+			- Compares the JSONFile/JSONValue API used by apps with a Poco::JSON DOM, as used by
+				the API before.
+			- Recorded API responses can be passed as arguments. Without arguments a generated
+				search response of about 300 kB is used.
+			- Usage: bench_app_json [-n <iterations>] [response.json ...]
+*/
+
+
+#include "../server/angelscript/json/jsonfile.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+
+#include <Poco/JSON/Parser.h>
+#include <Poco/JSON/Object.h>
+#include <Poco/JSON/Array.h>
+#include <Poco/Dynamic/Var.h>
+#include <Poco/Exception.h>
+
+
+// --- GENERATE ---
+// Generate a search response in the format of the SoundCloud API.
+std::string generate(int entries) {
+	std::string description = "Recorded live at the \\\"Caf\\u00e9\\\", remastered.\\n"
+								"Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod "
+								"tempor incididunt ut labore et dolore magna aliqua.\\n";
+	std::string json = "{\"collection\":[";
+	for (int i = 0; i < entries; ++i) {
+		std::string id = std::to_string(547239669 + i);
+		std::string uid = std::to_string(2147483000 + i);
+		if (i > 0) { json += ","; }
+		json += "{\"artwork_url\":\"https://i1.sndcdn.com/artworks-" + id + "-large.jpg\","
+				"\"caption\":null,\"commentable\":true,\"comment_count\":" + std::to_string(i * 3) + ","
+				"\"created_at\":\"2020-04-29T12:00:00Z\",\"description\":\"" + description + description + "\","
+				"\"downloadable\":false,\"duration\":" + std::to_string(180000 + i * 1000) + ","
+				"\"genre\":\"Electronic\",\"id\":" + id + ",\"kind\":\"track\",\"license\":\"all-rights-reserved\","
+				"\"likes_count\":" + std::to_string(i * 17) + ",\"permalink\":\"track-" + id + "\","
+				"\"playback_count\":" + std::to_string(i * 1001) + ",\"public\":true,"
+				"\"tag_list\":\"electronic ambient \\\"live set\\\"\",\"title\":\"Track " + id + " (Live)\","
+				"\"uri\":\"https://api.soundcloud.com/tracks/" + id + "\",\"waveform_url\":\"https://wave.sndcdn.com/"
+				+ id + "_m.json\",\"media\":{\"transcodings\":["
+				"{\"url\":\"https://api-v2.soundcloud.com/media/soundcloud:tracks:" + id + "/hls\","
+				"\"preset\":\"mp3_0_0\",\"duration\":180000,\"snipped\":false,"
+				"\"format\":{\"protocol\":\"hls\",\"mime_type\":\"audio/mpeg\"},\"quality\":\"sq\"},"
+				"{\"url\":\"https://api-v2.soundcloud.com/media/soundcloud:tracks:" + id + "/progressive\","
+				"\"preset\":\"mp3_0_0\",\"duration\":180000,\"snipped\":false,"
+				"\"format\":{\"protocol\":\"progressive\",\"mime_type\":\"audio/mpeg\"},\"quality\":\"sq\"}]},"
+				"\"user\":{\"avatar_url\":\"https://i1.sndcdn.com/avatars-" + uid + "-large.jpg\","
+				"\"city\":\"Berlin\",\"country_code\":\"DE\",\"first_name\":\"\",\"followers_count\":"
+				+ std::to_string(i * 31) + ",\"full_name\":\"\",\"id\":" + uid + ",\"kind\":\"user\","
+				"\"last_modified\":\"2020-04-29T12:00:00Z\",\"permalink\":\"user-" + uid + "\","
+				"\"username\":\"User " + uid + "\",\"verified\":false}}";
+	}
+	
+	json += "],\"total_results\":" + std::to_string(entries) + ",\"next_href\":null,\"query_urn\":\"soundcloud:search\"}";
+	return json;
+}
+
+
+// --- READ APP ---
+// Parse a response and read it the way the SoundCloud app does, with JSONFile.
+size_t readApp(const std::string &response) {
+	JSONFile json;
+	if (!json.fromString(response)) { return 0; }
+	
+	JSONValue root = json.getRoot();
+	size_t out = 0;
+	
+	// Search results.
+	JSONValue collection = root.get("collection");
+	for (unsigned i = 0; i < collection.size(); ++i) {
+		JSONValue jv = collection[i];
+		std::string id = std::to_string(jv.get("id").GetUInt());
+		std::string title = jv.get("title").GetString();
+		JSONValue user = jv.get("user");
+		std::string userId = std::to_string(user.get("id").GetUInt());
+		std::string username = user.get("username").GetString();
+		out += id.size() + title.size() + userId.size() + username.size();
+	}
+	
+	// Playlist.
+	JSONValue tracks = root.get("tracks");
+	for (unsigned i = 0; i < tracks.size(); ++i) {
+		out += tracks[i].get("id").GetUInt() > 0;
+	}
+	
+	// Track.
+	out += root.get("media").get("transcodings")[1].get("url").GetString().size();
+	
+	return out;
+}
+
+
+// --- POCO STRING ---
+std::string pocoString(Poco::JSON::Object::Ptr object, const std::string &key) {
+	Poco::Dynamic::Var value = object->get(key);
+	return value.isString() ? value.convert<std::string>() : std::string();
+}
+
+
+// --- POCO UINT ---
+unsigned int pocoUInt(Poco::JSON::Object::Ptr object, const std::string &key) {
+	Poco::Dynamic::Var value = object->get(key);
+	return value.isNumeric() ? value.convert<unsigned int>() : 0;
+}
+
+
+// --- READ POCO ---
+// Parse a response and read the same values with a Poco::JSON DOM.
+size_t readPoco(const std::string &response) {
+	Poco::JSON::Parser parser;
+	Poco::Dynamic::Var result;
+	try {
+		result = parser.parse(response);
+	}
+	catch (Poco::Exception &exc) {
+		return 0;
+	}
+	
+	if (result.type() != typeid(Poco::JSON::Object::Ptr)) { return 0; }
+	
+	Poco::JSON::Object::Ptr root = result.extract<Poco::JSON::Object::Ptr>();
+	size_t out = 0;
+	
+	Poco::JSON::Array::Ptr collection = root->getArray("collection");
+	for (unsigned i = 0; collection && i < collection->size(); ++i) {
+		Poco::JSON::Object::Ptr jv = collection->getObject(i);
+		if (!jv) { continue; }
+		
+		std::string id = std::to_string(pocoUInt(jv, "id"));
+		std::string title = pocoString(jv, "title");
+		Poco::JSON::Object::Ptr user = jv->getObject("user");
+		std::string userId = user ? std::to_string(pocoUInt(user, "id")) : std::string();
+		std::string username = user ? pocoString(user, "username") : std::string();
+		out += id.size() + title.size() + userId.size() + username.size();
+	}
+	
+	Poco::JSON::Array::Ptr tracks = root->getArray("tracks");
+	for (unsigned i = 0; tracks && i < tracks->size(); ++i) {
+		Poco::JSON::Object::Ptr track = tracks->getObject(i);
+		out += track && pocoUInt(track, "id") > 0;
+	}
+	
+	Poco::JSON::Object::Ptr media = root->getObject("media");
+	Poco::JSON::Array::Ptr transcodings = media ? media->getArray("transcodings") : 0;
+	if (transcodings && transcodings->size() > 1 && transcodings->getObject(1)) {
+		out += pocoString(transcodings->getObject(1), "url").size();
+	}
+	
+	return out;
+}
+
+
+// --- TIME ---
+// Average time of a function over a number of iterations, in microseconds.
+double timeRuns(size_t (*fn)(const std::string&), const std::string &response, int iterations, size_t &out) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; ++i) {
+		out = fn(response);
+	}
+	
+	std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count() / iterations;
+}
+
+
+int main(int argc, char** argv) {
+	int iterations = 100;
+	std::vector<std::string> names;
+	std::vector<std::string> responses;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "-n" && i + 1 < argc) {
+			iterations = std::atoi(argv[++i]);
+			continue;
+		}
+		
+		std::ifstream file(arg, std::ios::binary);
+		if (!file.is_open()) {
+			std::cerr << "Failed to open " << arg << std::endl;
+			return 1;
+		}
+		
+		std::stringstream ss;
+		ss << file.rdbuf();
+		names.push_back(arg);
+		responses.push_back(ss.str());
+	}
+	
+	if (responses.empty()) {
+		names.push_back("generated search response");
+		responses.push_back(generate(200));
+	}
+	
+	if (iterations < 1) { iterations = 1; }
+	
+	bool success = true;
+	for (size_t i = 0; i < responses.size(); ++i) {
+		size_t outApp = 0;
+		size_t outPoco = 0;
+		double app = timeRuns(readApp, responses[i], iterations, outApp);
+		double poco = timeRuns(readPoco, responses[i], iterations, outPoco);
+		
+		std::cout << names[i] << " (" << responses[i].size() / 1024 << " kB): JSONFile " << app
+					<< " us, Poco::JSON " << poco << " us, " << (app > 0 ? poco / app : 0) << "x." << std::endl;
+		if (outApp != outPoco) {
+			std::cout << "FAILED: different results (" << outApp << " / " << outPoco << ")." << std::endl;
+			success = false;
+		}
+	}
+	
+	return success ? 0 : 1;
+}
@@ -14,8 +14,11 @@
 
 
 // Globals
+DataBuffer db;
 uint8_t lastnum = 0;
+std::mutex dataRequestMtx;
 std::condition_variable dataRequestCv;
+uint32_t dataRequests = 0;
 std::atomic<bool> running = { true };
 
 
@@ -24,24 +27,34 @@ void seekingHandler(uint32_t session, int64_t offset) {
 	//
 }
 
+// --- DATA REQUEST HANDLER ---
+// Called by the DataBuffer. Hands the request to the data request function.
+bool dataRequestHandler(uint32_t session, uint32_t size) {
+	{
+		std::lock_guard<std::mutex> lk(dataRequestMtx);
+		dataRequests++;
+	}
+	
+	dataRequestCv.notify_one();
+	return true;
+}
+
 void dataRequestFunction() {
 	std::cout << "Starting data request function..." << std::endl;
-	
-	// Create and share condition variable with DataBuffer class.
-	std::mutex dataRequestMtx;
-	DataBuffer::setDataRequestCondition(&dataRequestCv);
-	
 	std::cout << "Entering data request loop..." << std::endl;
 	
 	while (running) {
-		// Wait for the condition to be signalled.
+		// Wait for a data request.
 		std::unique_lock<std::mutex> lk(dataRequestMtx);
-		dataRequestCv.wait(lk);
+		dataRequestCv.wait(lk, [] { return dataRequests > 0 || !running; });
 		
 		if (!running) { 
 			std::cout << "Shutting down data request function..." << std::endl;
 			break;
 		}
+		
+		dataRequests--;
+		lk.unlock();
 				
 		// Write into the buffer. We use a 10 byte pattern.
 		std::string data;
@@ -49,7 +62,7 @@ void dataRequestFunction() {
 			data.append(1, (char) lastnum++);
 		}
 		
-		uint32_t wrote = DataBuffer::write(data);
+		uint32_t wrote = db.write(data);
 		
 		std::cout << "Wrote " << wrote << " \t- ";
 		for (uint32_t i = 0; i < wrote; ++i) {
@@ -59,7 +72,7 @@ void dataRequestFunction() {
 		std::cout << std::endl;
 		
 		if (lastnum >= 100) {
-			DataBuffer::setEof(true);
+			db.setEof(true);
 		}
 	}
 }
@@ -69,10 +82,12 @@ int main() {
 	std::cout << "Running DataBuffer test..." << std::endl;
 	
 	// Create 20 byte buffer.
-	DataBuffer::init(20); 
+	db.init(20); 
+	db.setFileSize(100);
 	
-	// Set seek handler.
-	//DataBuffer::setSeekRequestCallback(seekingHandler);
+	// Set seek & data request handlers.
+	//db.setSeekRequestCallback(seekingHandler);
+	db.setDataRequestCallback(dataRequestHandler);
 	
 	// Start the data request handler in its own thread.
 	std::thread drq(dataRequestFunction);
@@ -85,15 +100,15 @@ int main() {
 	uint8_t bytes[8];
 	uint8_t expected = 0;
 	bool abort = false;
-	while (!DataBuffer::isEof()) {
-		uint32_t read = DataBuffer::read(8, bytes);
+	while (!db.isEof()) {
+		uint32_t read = db.read(8, bytes);
 		if (read == 0) {
 			std::cout << "Failed to read. Aborting." << std::endl;
 			break;
 		}
 		
 		std::cout << "Read " << read << "\t- ";
-		for (uint32_t i = 0; i < 8; ++i) {
+		for (uint32_t i = 0; i < read; ++i) {
 			std::cout << (uint16_t) bytes[i] << " ";
 			
 			if (expected++ != bytes[i]) {
@@ -118,7 +133,11 @@ int main() {
 	
 	std::cout << "Shutting down..." << std::endl;
 	
-	running = false;
+	{
+		std::lock_guard<std::mutex> lk(dataRequestMtx);
+		running = false;
+	}
+	
 	dataRequestCv.notify_one();
 	drq.join();
 	
@@ -4,10 +4,17 @@
 // - Wrap-around: Alternatingly write a number of bytes in the databuffer and read them from the buffer.
 // - Reset:
 // - Seek:
+// - Resize: Grow a buffer holding unread data, as on a session handover.
+// - Resize while writing: Resize back and forth while data is being written and read.
 
 #include "../server/databuffer.h"
 #include <iostream>
 #include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+
+DataBuffer* db = 0;	// Buffer under test.
 
 template< typename T >
 char to_char( T v )
@@ -78,7 +85,9 @@ int test_wraparound()
 
 	const int size_buffer = 20;
 
-	DataBuffer::init(size_buffer);
+	DataBuffer buffer;
+	db = &buffer;
+	db->init(size_buffer);
 
 	const int Nrepeat_size     = 30;
 	const int size_write_begin = 3;
@@ -88,8 +97,8 @@ int test_wraparound()
 	{
 		const int size_read = size_write;
 
-		// DataBuffer::cleanup();
-		// DataBuffer::init(size_buffer);
+		// db->cleanup();
+		// db->init(size_buffer);
 
 		const int b = 1;
 		const int e = size_write + 1;
@@ -99,8 +108,8 @@ int test_wraparound()
 		{
 			std::vector<uint8_t> bytes(size_read, to_char(99));
 
-			const uint32_t Nw = DataBuffer::write(data);
-			const uint32_t Nr = DataBuffer::read(size_read, bytes.data());
+			const uint32_t Nw = db->write(data);
+			const uint32_t Nr = db->read(size_read, bytes.data());
 
 			std::cout << "*** Test wraparound: Iteration #" << i+1 << ":\n";
 
@@ -126,7 +135,9 @@ int test_reset()
 
 	const int size_buffer = 20;
 
-	DataBuffer::init(size_buffer);
+	DataBuffer buffer;
+	db = &buffer;
+	db->init(size_buffer);
 
 	const int size_write = 3;
 	const int size_read  = size_write;
@@ -139,16 +150,16 @@ int test_reset()
 	{
 		std::vector<uint8_t> bytes(size_read, to_char(99));
 
-		const uint32_t Nw = DataBuffer::write(data);
+		const uint32_t Nw = db->write(data);
 
 #if 0
-		if ( Nw != DataBuffer::size() )
+		if ( Nw != db->size() )
 		{
-			std::cout << "*** Test reset: expecting '" << Nw << "' items in buffer, got '" << DataBuffer::size() << "'\n";
+			std::cout << "*** Test reset: expecting '" << Nw << "' items in buffer, got '" << db->size() << "'\n";
 			return EXIT_FAILURE;
 		}
 #endif
-		const uint32_t Nr = DataBuffer::read(size_read, bytes.data());
+		const uint32_t Nr = db->read(size_read, bytes.data());
 
 		if ( Nr != Nw || create_data(bytes) != data)
 		{
@@ -161,13 +172,13 @@ int test_reset()
 	{
 		std::vector<uint8_t> bytes(size_read, to_char(99));
 
-		const uint32_t Nw = DataBuffer::write(data);
+		const uint32_t Nw = db->write(data);
 
 		// clear buffer, keep allocated memory:
 		std::cout << "*** Test reset: Reset buffer\n";
-		DataBuffer::reset();
+		db->reset();
 
-		const uint32_t Nr = DataBuffer::read(size_read, bytes.data());
+		const uint32_t Nr = db->read(size_read, bytes.data());
 
 		if ( Nr != 0 || bytes[0] != to_char(99))
 		{
@@ -186,7 +197,7 @@ int test_reset()
 
 // --- SEEKING HANDLER ---
 void seekingHandler(uint32_t session, int64_t offset) {
-	if (DataBuffer::seeking()) {
+	if (db->seeking()) {
 		const int size_write = 3;
 		const int size_read  = size_write;
 
@@ -194,7 +205,7 @@ void seekingHandler(uint32_t session, int64_t offset) {
 		const int e = size_write + 1;
 		std::string data = create_range(b, e);
 		
-		const uint32_t Nw = DataBuffer::write(data);
+		const uint32_t Nw = db->write(data);
 				
 		return; 
 	}
@@ -207,9 +218,11 @@ int test_seek()
 
 	const int size_buffer = 20;
 
-	DataBuffer::init(size_buffer);
+	DataBuffer buffer;
+	db = &buffer;
+	db->init(size_buffer);
 
-	DataBuffer::setSeekRequestCallback(seekingHandler);
+	db->setSeekRequestCallback(seekingHandler);
 
 	const int size_write = 3;
 	const int size_read  = size_write;
@@ -220,13 +233,13 @@ int test_seek()
 
 	// test various variants of seeking:
 	{
-		const uint32_t Nw = DataBuffer::write(data);
-		DataBuffer::setFileSize(Nw);
+		const uint32_t Nw = db->write(data);
+		db->setFileSize(Nw);
 
 		// seek start:
 		std::cout << "\n*** Test seek: seek(DB_SEEK_START) ***\n";													
 		{
-			const int64_t Ns = DataBuffer::seek(DB_SEEK_START, 1);
+			const int64_t Ns = db->seek(DB_SEEK_START, 1);
 
 			if ( Ns != 1 )
 			{
@@ -238,7 +251,7 @@ int test_seek()
 		// seek current:
 		std::cout << "\n*** Test seek: seek(DB_SEEK_CURRENT) ***\n";
 		{
-			const int64_t Ns = DataBuffer::seek(DB_SEEK_CURRENT, 1);
+			const int64_t Ns = db->seek(DB_SEEK_CURRENT, 1);
 
 			if ( Ns != 2 )
 			{
@@ -250,7 +263,7 @@ int test_seek()
 		// seek end:
 		std::cout << "\n*** Test seek: seek(DB_SEEK_END) ***\n";
 		{
-			const int64_t  Ns = DataBuffer::seek(DB_SEEK_END, 0);
+			const int64_t  Ns = db->seek(DB_SEEK_END, 0);
 
 			if ( Ns != 2 )
 			{
@@ -264,8 +277,8 @@ int test_seek()
 		{
 			std::vector<uint8_t> bytes(size_read, to_char(99));
 
-			const int64_t  Ns = DataBuffer::seek(DB_SEEK_START, 0);
-			const uint32_t Nr = DataBuffer::read(size_read, bytes.data());
+			const int64_t  Ns = db->seek(DB_SEEK_START, 0);
+			const uint32_t Nr = db->read(size_read, bytes.data());
 
 			if ( Nr != Nw || create_data(bytes) != data)
 			{
@@ -278,7 +291,7 @@ int test_seek()
 			// verify buffer is empty now: suggestion: add public method `size()`:
 			{
 #if 0
-				if ( 0 != DataBuffer::size() )
+				if ( 0 != db->size() )
 				{
 					std::cout << "*** Test seek: expecting empty buffer***\n";
 					return EXIT_FAILURE;
@@ -286,7 +299,7 @@ int test_seek()
 #else
 				std::vector<uint8_t> bytes(size_read, to_char(99));
 
-				const uint32_t Nr = DataBuffer::read(size_read, bytes.data());
+				const uint32_t Nr = db->read(size_read, bytes.data());
 
 				if ( Nr != 0 || bytes[0] != to_char(99))
 				{
@@ -307,11 +320,189 @@ int test_seek()
 	return EXIT_SUCCESS;
 }
 
+// --- DATA REQUEST HANDLER ---
+// Answers data requests on another thread, as the RPC thread does.
+bool dataRequestHandler(uint32_t session, uint32_t size)
+{
+	std::thread([]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(2500));
+		std::string data = create_range(50, 53);
+		db->write(data);
+	}).detach();
+
+	return true;
+}
+
+int test_resize()
+{
+	std::cout << "\n*** Test resize ***\n";
+
+	const int size_buffer = 20;
+
+	DataBuffer buffer;
+	db = &buffer;
+	db->init(size_buffer);
+
+	// Prefetched data of a queued session, partly read by the player probing it.
+	std::string data = create_range(1, 16);
+	const uint32_t Nw = db->write(data);
+	db->setFileSize(Nw);
+
+	std::vector<uint8_t> bytes(5, to_char(99));
+	if ( db->read(5, bytes.data()) != 5 )
+	{
+		std::cout << "*** Test resize: failed to read before resizing\n";
+		return EXIT_FAILURE;
+	}
+
+	// Grow the buffer on handover: the unread data stays in place.
+	if ( !db->resize(4096) || db->getCapacity() < 4096 )
+	{
+		std::cout << "*** Test resize: failed to grow buffer\n";
+		return EXIT_FAILURE;
+	}
+
+	bytes.assign(10, to_char(99));
+	const uint32_t Nr = db->read(10, bytes.data());
+	if ( Nr != 10 || create_data(bytes) != data.substr(5) )
+	{
+		std::cout << "*** Test resize: unread data lost on resize:\n";
+		print("*** ", data.substr(5), "\n");
+		print("*** ", bytes, "\n");
+		return EXIT_FAILURE;
+	}
+
+	// The data dropped on resize is still in the pinned data, as the player did not start reading
+	// ahead yet.
+	bytes.assign(5, to_char(99));
+	if ( db->seek(DB_SEEK_START, 0) != 0 || db->read(5, bytes.data()) != 5
+			|| create_data(bytes) != data.substr(0, 5) )
+	{
+		std::cout << "*** Test resize: failed to seek back to the start\n";
+		return EXIT_FAILURE;
+	}
+
+	// Unread data larger than the new capacity.
+	db->reset();
+	db->write(data);
+	if ( db->resize(8) )
+	{
+		std::cout << "*** Test resize: shrunk below the unread data\n";
+		return EXIT_FAILURE;
+	}
+
+	// A data request that is not answered in time makes the resize fail, leaving the buffer as is.
+	db->reset();
+	db->setFileSize(1000);
+	db->setDataRequestCallback(dataRequestHandler);
+	db->requestData();
+	const uint32_t capacity = db->getCapacity();
+	if ( db->resize(capacity * 2) || db->getCapacity() != capacity )
+	{
+		std::cout << "*** Test resize: resized with a data request in flight\n";
+		return EXIT_FAILURE;
+	}
+
+	// Let the late answer arrive before the buffer goes away.
+	std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+
+	std::cout << "\n* * * Resize tests completed successfully * * *\n";
+
+	return EXIT_SUCCESS;
+}
+
+int test_resize_writing()
+{
+	std::cout << "\n*** Test resize while writing ***\n";
+
+	DataBuffer buffer;
+	db = &buffer;
+	db->init(4096);
+	db->startBufferAhead();
+
+	// The writer streams a pattern as the RPC thread would, while the buffer gets resized as when
+	// sessions are queued during playback.
+	const uint32_t total = 1024 * 1024;
+	std::atomic<bool> done = { false };
+	std::thread writer([total]() {
+		uint32_t written = 0;
+		while ( written < total )
+		{
+			std::string chunk;
+			for ( uint32_t i = written; i < written + 100 && i < total; ++i )
+				chunk.append(1, to_char(i % 251));
+
+			const uint32_t Nw = db->write(chunk.data(), chunk.size());
+			written += Nw;
+			if ( Nw < chunk.size() )
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+
+		// Lets the reader have the last bytes, which are less than it asks for.
+		db->setEof(true);
+	});
+
+	int resizes = 0;
+	std::thread resizer([&done, &resizes]() {
+		uint32_t capacity = 8192;
+		while ( !done )
+		{
+			if ( db->resize(capacity) )
+				resizes++;
+
+			capacity = (capacity == 8192) ? 4096 : 8192;
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+		}
+	});
+
+	uint32_t readTotal = 0;
+	bool ok = true;
+	std::vector<uint8_t> bytes(300);
+	while ( ok && readTotal < total )
+	{
+		const uint32_t Nr = db->read(bytes.size(), bytes.data());
+		if ( Nr == 0 )
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+			continue;
+		}
+
+		for ( uint32_t i = 0; i < Nr; ++i )
+		{
+			if ( bytes[i] != (uint8_t) ((readTotal + i) % 251) )
+			{
+				std::cout << "*** Test resize while writing: wrong data at byte " << readTotal + i << "\n";
+				ok = false;
+				break;
+			}
+		}
+
+		readTotal += Nr;
+	}
+
+	done = true;
+	resizer.join();
+	writer.join();
+
+	std::cout << "*** Test resize while writing: " << resizes << " resizes\n";
+	if ( !ok || resizes == 0 )
+	{
+		std::cout << "*** Test resize while writing: failed\n";
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "\n* * * Resize while writing tests completed successfully * * *\n";
+
+	return EXIT_SUCCESS;
+}
+
 int main()
 {
 	return test_wraparound()
 		|| test_reset()
-		|| test_seek();
+		|| test_seek()
+		|| test_resize()
+		|| test_resize_writing();
 }
 
 // g++ -std=c++17 -g3 -O0 -o bin/test_databuffer_mm -I../. ../server/databuffer.cpp test_databuffer_mm.cpp -pthread
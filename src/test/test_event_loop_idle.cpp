@@ -0,0 +1,271 @@
+/*
+	test_event_loop_idle.cpp - CPU use of the SDL event loop while idle.
+	
+	Runs SdlRenderer::run_event_loop() on the main thread in three phases: with nothing active,
+	with the player events active but no stream (as between stream_open() and the first frame),
+	and while playing a short audio-only file, so that Player::next_timeout() and
+	Player::refresh_needed() see a VideoState without video.
+	Fails if the process uses more than MAX_CPU percent of a core in the first two phases, or
+	MAX_AUDIO_CPU percent while playing.
+	
+	Usage: test_event_loop_idle [seconds per phase] [-v]. -v opens a (hidden) video window, which
+	makes the player draw the audio visualisation.
+	Set SDL_AUDIODRIVER=dummy to run without an audio device.
+*/
+
+
+#include <Poco/Condition.h>
+#include <Poco/Path.h>
+#include <Poco/File.h>
+
+#include <iostream>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <chrono>
+#include <ctime>
+#include <cstdlib>
+
+#include "types.h"
+#include "ffplay.h"
+#include "player.h"
+#include "stream_handler.h"
+#include "sdl_renderer.h"
+
+#ifdef main
+#undef main
+#endif
+
+
+#define MAX_CPU 1.0			// Percent of a core.
+#define MAX_AUDIO_CPU 5.0	// Percent of a core, while decoding & playing audio.
+#define WAV_RATE 8000		// Sample rate of the audio file.
+
+
+// Global objects.
+FileMetaInfo file_meta;
+Poco::Condition gCon;
+Poco::Condition playerCon;
+Poco::Mutex playerMutex;
+Poco::Condition slavePlayCon;
+Poco::Mutex slavePlayMutex;
+std::atomic<int64_t> slaveStartTime = { 0 };
+NcsMode serverMode = NCS_MODE_STANDALONE;
+
+const uint32_t nymph_seek_event = SDL_RegisterEvents(1);
+
+/* current context */
+int is_full_screen;
+int64_t audio_callback_time;
+
+unsigned sws_flags = SWS_BICUBIC;
+
+AVPacket flush_pkt;
+
+/* options specified by the user */
+AVInputFormat *file_iformat;
+const char *input_filename;
+const char *window_title;
+int default_width  = 640;
+int default_height = 480;
+std::atomic<int> screen_width  = { 0 };
+std::atomic<int> screen_height = { 0 };
+int screen_left = SDL_WINDOWPOS_CENTERED;
+int screen_top = SDL_WINDOWPOS_CENTERED;
+int audio_disable = 0;
+int video_disable;
+bool subtitle_disable;
+const char* wanted_stream_spec[AVMEDIA_TYPE_NB] = {0};
+int seek_by_bytes = -1;
+float seek_interval = 10;
+int display_disable = 1;
+bool gui_enable;
+bool screensaver_enable;
+int borderless;
+int alwaysontop;
+int startup_volume = 100;
+int show_status = 0;
+int av_sync_type = AV_SYNC_AUDIO_MASTER;
+int64_t start_time = AV_NOPTS_VALUE;
+int64_t duration = AV_NOPTS_VALUE;
+int fast = 0;
+int genpts = 0;
+int lowres = 0;
+int decoder_reorder_pts = -1;
+int autoexit = 1;
+int exit_on_keydown;
+int exit_on_mousedown;
+int loop = 1;
+int framedrop = -1;
+int infinite_buffer = -1;
+enum ShowMode show_mode = SHOW_MODE_NONE;
+const char *audio_codec_name;
+const char *subtitle_codec_name;
+const char *video_codec_name;
+std::string hwaccel = "none";
+double rdftspeed = 0.02;
+int64_t cursor_last_shown;
+int cursor_hidden = 1;
+#if CONFIG_AVFILTER
+const char **vfilters_list = NULL;
+int nb_vfilters = 0;
+char *afilters = NULL;
+#endif
+int autorotate = 1;
+int find_stream_info = 1;
+int filter_nbthreads = 0;
+bool gapless = false;
+bool refresh_rate_match = false;
+std::atomic<uint32_t> audio_volume = { 100 };
+// ---
+
+const char program_name[] = "ffplay";
+const int program_birth_year = 2003;
+void show_help_default(const char *opt, const char *arg) { }
+
+// Normally in NymphCastServer.cpp.
+void finishPlayback() { }
+void sendGlobalStatusUpdate() { }
+bool startSlavePlayback() { return false; }
+
+
+// --- CPU TIME ---
+// CPU time used by the process so far, in seconds.
+double cpuTime() {
+	return (double) std::clock() / CLOCKS_PER_SEC;
+}
+
+
+// --- MEASURE ---
+// Percentage of a core used by the process over the given number of seconds.
+double measure(int seconds) {
+	double cpuStart = cpuTime();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::this_thread::sleep_for(std::chrono::seconds(seconds));
+	double cpu = cpuTime() - cpuStart;
+	double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return cpu / wall * 100.0;
+}
+
+
+// --- WRITE WAV ---
+// Write 'seconds' of silence to 'path' as 16-bit mono PCM WAV.
+bool writeWav(const std::string &path, int seconds) {
+	std::ofstream out(path, std::ios::binary);
+	if (!out.good()) { return false; }
+	
+	// Little-endian fields of the header.
+	auto le = [&out](uint32_t value, int bytes) {
+		for (int i = 0; i < bytes; i++) { out.put((char) ((value >> (8 * i)) & 0xff)); }
+	};
+	
+	uint32_t size = WAV_RATE * 2 * seconds;
+	out.write("RIFF", 4);
+	le(36 + size, 4);
+	out.write("WAVEfmt ", 8);
+	le(16, 4);				// Format chunk size.
+	le(1, 2);				// PCM.
+	le(1, 2);				// Channels.
+	le(WAV_RATE, 4);
+	le(WAV_RATE * 2, 4);	// Bytes per second.
+	le(2, 2);				// Bytes per sample frame.
+	le(16, 2);				// Bits per sample.
+	out.write("data", 4);
+	le(size, 4);
+	
+	std::string silence(size, '\0');
+	out.write(silence.data(), silence.size());
+	
+	return out.good();
+}
+
+
+int main(int argc, char** argv) {
+	int seconds = 5;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "-v") { display_disable = 0; }
+		else { seconds = atoi(argv[i]); }
+	}
+	
+	if (seconds <= 0) { seconds = 5; }
+	
+	// Long enough to still be playing at the end of the measurement.
+	std::string wavPath = Poco::Path::temp() + "test_event_loop_idle.wav";
+	if (!writeWav(wavPath, seconds + 5)) {
+		std::cerr << "Failed to write " << wavPath << ". Aborting..." << std::endl;
+		return 1;
+	}
+	
+	if (!SdlRenderer::init()) {
+		std::cerr << "Failed to init SDL. Aborting..." << std::endl;
+		return 1;
+	}
+	
+	double idle = 0.0;
+	double player = 0.0;
+	double audio = 0.0;
+	bool audioStarted = false;
+	bool audioPlayed = false;
+	std::thread measurer([&]() {
+		// Let the loop settle first.
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+		
+		idle = measure(seconds);
+		
+		SdlRenderer::playerEvents(true);
+		player = measure(seconds);
+		SdlRenderer::playerEvents(false);
+		
+		// Audio-only stream, set up as Ffplay::run() does.
+		VideoState* is = StreamHandler::stream_open(wavPath.c_str(), NULL, NULL);
+		if (is) {
+			Player::setVideoState(is);
+			SdlRenderer::playerEvents(true);
+			
+			// Wait for the read thread to open the stream.
+			for (int i = 0; i < 40 && !StreamHandler::get_running(); i++) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			}
+			
+			std::this_thread::sleep_for(std::chrono::milliseconds(500));
+			audioStarted = StreamHandler::get_running() && is->audio_st && !is->video_st;
+			audio = measure(seconds);
+			audioPlayed = StreamHandler::get_running();
+			
+			SdlRenderer::playerEvents(false);
+			Player::setVideoState(0);
+			StreamHandler::stream_close(is);
+		}
+		
+		SdlRenderer::stop_event_loop();
+	});
+	
+	SdlRenderer::run_event_loop();
+	measurer.join();
+	SdlRenderer::quit();
+	Poco::File(wavPath).remove();
+	
+	std::cout << "Idle: " << idle << "% CPU." << std::endl;
+	std::cout << "Player events: " << player << "% CPU." << std::endl;
+	std::cout << "Audio-only stream: " << audio << "% CPU." << std::endl;
+	
+	if (idle > MAX_CPU || player > MAX_CPU) {
+		std::cerr << "FAIL: more than " << MAX_CPU << "% CPU used while idle." << std::endl;
+		return 1;
+	}
+	
+	if (!audioStarted || !audioPlayed) {
+		std::cerr << "FAIL: audio-only stream did not play through the measurement." << std::endl;
+		return 1;
+	}
+	
+	if (audio > MAX_AUDIO_CPU) {
+		std::cerr << "FAIL: more than " << MAX_AUDIO_CPU << "% CPU used playing audio." << std::endl;
+		return 1;
+	}
+	
+	std::cout << "PASS" << std::endl;
+	
+	return 0;
+}
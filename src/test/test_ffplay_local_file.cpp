@@ -108,6 +108,7 @@ enum ShowMode show_mode = SHOW_MODE_NONE;
 const char *audio_codec_name;
 const char *subtitle_codec_name;
 const char *video_codec_name;
+std::string hwaccel = "none";
 double rdftspeed = 0.02;
 int64_t cursor_last_shown;
 int cursor_hidden = 0;
@@ -0,0 +1,187 @@
+/*
+	test_frame_pacing.cpp - Pacing analysis of the FramePacer on a simulated display.
+	
+	The display refreshes at a fixed rate. A present blocks until the next refresh, as with vsync.
+	Frames are scheduled the way VideoRenderer::video_refresh() does it, with jitter on each wake
+	up. The refresh each frame is shown on is compared to the frame's target time.
+*/
+
+
+#include "frame_pacer.h"
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+
+
+#define REFRESH_RATE_US 10000	// Maximum time between refreshes of the player.
+
+
+int failures = 0;
+
+
+// --- CHECK ---
+void check(bool ok, const std::string &what) {
+	std::cout << (ok ? "PASS: " : "FAIL: ") << what << std::endl;
+	if (!ok) { failures++; }
+}
+
+
+struct Display {
+	double hz;
+	double t0;
+	
+	// Index of the first refresh after 'now'.
+	int64_t nextRefresh(double now) { return (int64_t) std::floor((now - t0) * hz / 1000000.0) + 1; }
+	double refreshTime(int64_t k) { return t0 + k * 1000000.0 / hz; }
+};
+
+
+struct Run {
+	std::vector<int64_t> refresh;	// Refresh each frame was shown on, -1 if dropped.
+	std::vector<double> target;
+	FramePacerStats stats;
+};
+
+
+// --- PLAY ---
+// Show 'count' frames at 'fps' on the display. The pacer starts from 'modeHz', the rate the
+// display mode reports. 'stall' adds a pause of that many us in the scheduler at frame 'stallAt'.
+Run play(Display display, double fps, double modeHz, int count, int64_t stall = 0, int stallAt = 0) {
+	Run run;
+	FramePacer::reset(modeHz);
+	uint32_t seed = 12345;
+	double frameTime = 1000000.0 / fps;
+	double now = 1000.0;
+	double start = display.refreshTime(display.nextRefresh(now)) + 20000.0;
+	int i = 0;
+	while (i < count) {
+		double target = start + i * frameTime;
+		
+		// Drop frames of which the next one is due already, as video_refresh() does.
+		if (i + 1 < count && now > start + (i + 1) * frameTime) {
+			FramePacer::dropped();
+			run.refresh.push_back(-1);
+			run.target.push_back(target);
+			i++;
+			continue;
+		}
+		
+		if (FramePacer::due((int64_t) target, (int64_t) now)) {
+			FramePacer::frame((int64_t) frameTime);
+			int64_t k = display.nextRefresh(now);
+			now = display.refreshTime(k);
+			FramePacer::presentDone((int64_t) now, true);
+			run.refresh.push_back(k);
+			run.target.push_back(target);
+			i++;
+			now += 300.0; // Work after the present.
+			if (stall > 0 && i == stallAt) { now += stall; }
+			continue;
+		}
+		
+		// Sleep until due, with up to 2 ms of jitter.
+		seed = seed * 1103515245 + 12345;
+		double wait = (double) FramePacer::waitTime((int64_t) target, (int64_t) now);
+		if (wait > REFRESH_RATE_US) { wait = REFRESH_RATE_US; }
+		now += wait + (seed >> 16) % 2000;
+	}
+	
+	run.stats = FramePacer::stats();
+	return run;
+}
+
+
+// --- CADENCE ---
+// Count how many frames stayed on screen for each number of refreshes (index 0: dropped or
+// replaced on the same refresh). Starts after the first frame, like maxError().
+std::vector<int> cadence(const Run &run) {
+	std::vector<int> counts(8, 0);
+	int64_t last = -1;
+	for (size_t i = 1; i < run.refresh.size(); i++) {
+		if (run.refresh[i] < 0) { counts[0]++; continue; }
+		if (last >= 0) {
+			int64_t shown = run.refresh[i] - last;
+			counts[(shown < 7) ? shown : 7]++;
+		}
+		
+		last = run.refresh[i];
+	}
+	
+	return counts;
+}
+
+
+// --- MAX ERROR ---
+// Largest distance between a frame's target time and the refresh it was shown on, in refreshes.
+// The first frame is skipped: the refreshes are not known before it is presented.
+double maxError(const Run &run, Display display) {
+	double max = 0.0;
+	for (size_t i = 1; i < run.refresh.size(); i++) {
+		if (run.refresh[i] < 0) { continue; }
+		double error = std::fabs(display.refreshTime(run.refresh[i]) - run.target[i]);
+		error = error * display.hz / 1000000.0;
+		if (error > max) { max = error; }
+	}
+	
+	return max;
+}
+
+
+int main() {
+	// 23.976 fps on 60 Hz: 3:2 cadence, each frame on the refresh closest to its target.
+	Display d60 = { 60.0, 0.0 };
+	Run run = play(d60, 24000.0 / 1001.0, 60.0, 2000);
+	std::vector<int> c = cadence(run);
+	std::cout << "23.976 fps @ 60 Hz: 2 refreshes " << c[2] << ", 3 refreshes " << c[3] <<
+				", presented " << run.stats.presented << ", dropped " << run.stats.dropped <<
+				", repeated " << run.stats.repeated << ", max error " << maxError(run, d60) << std::endl;
+	check(c[0] == 0 && c[1] == 0 && c[4] == 0 && c[5] == 0, "23.976 @ 60 Hz only uses 2 & 3 refreshes");
+	check(std::abs(c[2] - c[3]) < 20, "23.976 @ 60 Hz alternates 3:2");
+	check(maxError(run, d60) <= 0.5 + 0.01, "23.976 @ 60 Hz frames on the nearest refresh");
+	check(run.stats.presented == 2000 && run.stats.dropped == 0 && run.stats.repeated == 0,
+																"23.976 @ 60 Hz stats");
+	
+	// The same content on a matched 23.976 Hz mode: each frame is shown for one refresh.
+	Display d24 = { 24000.0 / 1001.0, 3000.0 };
+	run = play(d24, 24000.0 / 1001.0, 23.0, 1000);
+	c = cadence(run);
+	std::cout << "23.976 fps @ 23.976 Hz: 1 refresh " << c[1] << ", other " <<
+				(int) run.refresh.size() - 2 - c[1] << ", repeated " << run.stats.repeated << std::endl;
+	check(c[1] == 998, "23.976 @ 23.976 Hz shows each frame once");
+	check(run.stats.dropped == 0 && run.stats.repeated == 0, "23.976 @ 23.976 Hz stats");
+	
+	// 50 fps on 50 Hz, with the phase of the display between refreshes.
+	Display d50 = { 50.0, 7777.0 };
+	run = play(d50, 50.0, 50.0, 1000);
+	c = cadence(run);
+	check(c[1] == 998 && run.stats.repeated == 0, "50 fps @ 50 Hz shows each frame once");
+	
+	// Display mode reports 60 Hz, actual refresh is 59.94 Hz: the period is refined.
+	Display d5994 = { 60000.0 / 1001.0, 0.0 };
+	run = play(d5994, 30000.0 / 1001.0, 60.0, 2000);
+	c = cadence(run);
+	std::cout << "Refined period: " << FramePacer::refreshPeriod() << " us." << std::endl;
+	check(std::llabs(FramePacer::refreshPeriod() - 16683) <= 10, "59.94 Hz period refined");
+	check(c[2] == 1998, "29.97 fps @ 59.94 Hz shows each frame for 2 refreshes");
+	
+	// A stall of the scheduler leaves a frame on screen for longer, and drops the frames behind.
+	run = play(d60, 24000.0 / 1001.0, 60.0, 500, 150000, 250);
+	std::cout << "Stall: presented " << run.stats.presented << ", dropped " << run.stats.dropped <<
+				", repeated " << run.stats.repeated << std::endl;
+	check(run.stats.repeated > 0 && run.stats.dropped > 0, "stall counted as repeated & dropped");
+	check(run.stats.presented + run.stats.dropped == 500, "stall stats add up");
+	
+	// Refresh rate matching.
+	std::vector<int> rates = { 60, 50, 30, 24, 23 };
+	check(FramePacer::matchRate(24000.0 / 1001.0, rates, 60) == 24, "23.976 fps picks 24 Hz");
+	check(FramePacer::matchRate(25.0, rates, 60) == 50, "25 fps picks 50 Hz");
+	check(FramePacer::matchRate(30000.0 / 1001.0, rates, 60) == 60, "29.97 fps keeps 60 Hz");
+	check(FramePacer::matchRate(25.0, std::vector<int>{ 60, 24 }, 60) == 0, "25 fps without 50 Hz");
+	check(FramePacer::matchRate(0.0, rates, 60) == 0, "unknown frame rate");
+	
+	std::cout << (failures ? "FAILED" : "All tests passed.") << std::endl;
+	
+	return failures ? 1 : 0;
+}
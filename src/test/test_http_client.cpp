@@ -0,0 +1,181 @@
+/*
+	test_http_client.cpp - Test for the HTTP client of NymphCast apps.
+	
+	Notes:
+			- Runs a local Poco HTTP server as a stand-in for the APIs used by apps, and counts
+				the connections & requests it sees.
+			- Checks connection reuse, caching with max-age, ETag revalidation, no-store and the
+				parallel batch.
+*/
+
+
+#include "../server/http_client.h"
+
+#include <iostream>
+#include <string>
+#include <set>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <chrono>
+
+#include <Poco/Net/HTTPServer.h>
+#include <Poco/Net/HTTPServerParams.h>
+#include <Poco/Net/HTTPRequestHandler.h>
+#include <Poco/Net/HTTPRequestHandlerFactory.h>
+#include <Poco/Net/HTTPServerRequest.h>
+#include <Poco/Net/HTTPServerResponse.h>
+#include <Poco/Net/ServerSocket.h>
+#include <Poco/URI.h>
+
+
+// Globals
+const int slow_delay = 200;		// Response time of /slow, in milliseconds.
+const int batch_size = 8;
+
+std::mutex serverMutex;
+std::set<std::string> clients;				// Client addresses seen, one per connection.
+std::map<std::string, int> hits;			// Requests per path.
+
+
+class TestHandler : public Poco::Net::HTTPRequestHandler {
+public:
+	void handleRequest(Poco::Net::HTTPServerRequest &request, Poco::Net::HTTPServerResponse &response) {
+		Poco::URI uri(request.getURI());
+		std::string path = uri.getPath();
+		{
+			std::lock_guard<std::mutex> lk(serverMutex);
+			clients.insert(request.clientAddress().toString());
+			hits[path]++;
+		}
+		
+		std::string body = "body of " + request.getURI();
+		if (path == "/max-age") {
+			response.set("Cache-Control", "max-age=60");
+		}
+		else if (path == "/etag") {
+			response.set("ETag", "\"v1\"");
+			if (request.has("If-None-Match") && request.get("If-None-Match") == "\"v1\"") {
+				response.setStatusAndReason(Poco::Net::HTTPResponse::HTTP_NOT_MODIFIED);
+				response.setContentLength(0);
+				response.send();
+				return;
+			}
+		}
+		else if (path == "/no-store") {
+			response.set("Cache-Control", "no-store");
+		}
+		else if (path == "/slow") {
+			std::this_thread::sleep_for(std::chrono::milliseconds(slow_delay));
+		}
+		else if (path == "/missing") {
+			response.setStatusAndReason(Poco::Net::HTTPResponse::HTTP_NOT_FOUND);
+		}
+		
+		response.setContentLength(body.size());
+		response.send() << body;
+	}
+};
+
+
+class TestHandlerFactory : public Poco::Net::HTTPRequestHandlerFactory {
+public:
+	Poco::Net::HTTPRequestHandler* createRequestHandler(const Poco::Net::HTTPServerRequest&) {
+		return new TestHandler;
+	}
+};
+
+
+// --- CHECK ---
+bool check(bool condition, std::string message) {
+	std::cout << (condition ? "OK: " : "FAILED: ") << message << std::endl;
+	return condition;
+}
+
+
+// --- HITS ---
+int getHits(std::string path) {
+	std::lock_guard<std::mutex> lk(serverMutex);
+	return hits[path];
+}
+
+
+int main() {
+	std::cout << "Running HTTP client test..." << std::endl;
+	
+	Poco::Net::ServerSocket socket(0);
+	Poco::Net::HTTPServerParams::Ptr params = new Poco::Net::HTTPServerParams;
+	params->setKeepAlive(true);
+	params->setMaxThreads(batch_size * 2);
+	Poco::Net::HTTPServer server(new TestHandlerFactory, socket, params);
+	server.start();
+	
+	std::string base = "http://127.0.0.1:" + std::to_string(socket.address().port());
+	bool success = true;
+	
+	// Sequential requests share a single connection.
+	for (int i = 0; i < 10; ++i) {
+		HttpResult result = HttpClient::get(base + "/plain?i=" + std::to_string(i));
+		if (!result.success || result.body != "body of /plain?i=" + std::to_string(i)) {
+			success = check(false, "Plain request " + std::to_string(i));
+		}
+	}
+	
+	HttpStats stats = HttpClient::getStats();
+	success &= check(stats.connections == 1 && stats.reused == 9, "10 requests on "
+						+ std::to_string(stats.connections) + " connection(s).");
+	
+	// max-age: the second request is answered from the cache.
+	HttpClient::get(base + "/max-age");
+	HttpResult result = HttpClient::get(base + "/max-age");
+	success &= check(result.success && result.body == "body of /max-age" && getHits("/max-age") == 1,
+						"max-age response cached.");
+	
+	// ETag: the second request is revalidated.
+	HttpClient::get(base + "/etag");
+	result = HttpClient::get(base + "/etag");
+	stats = HttpClient::getStats();
+	success &= check(result.success && result.body == "body of /etag" && getHits("/etag") == 2
+						&& stats.revalidated == 1, "ETag response revalidated.");
+	
+	// no-store: never cached.
+	HttpClient::get(base + "/no-store");
+	HttpClient::get(base + "/no-store");
+	success &= check(getHits("/no-store") == 2, "no-store response not cached.");
+	
+	// Errors.
+	result = HttpClient::get(base + "/missing");
+	success &= check(!result.success && result.status == 404, "404 reported.");
+	
+	// Batch: requests run in parallel, results in order.
+	std::vector<std::string> urls;
+	for (int i = 0; i < batch_size; ++i) {
+		urls.push_back(base + "/slow?i=" + std::to_string(i));
+	}
+	
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<HttpResult> results = HttpClient::getAll(urls);
+	int64_t elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+										std::chrono::steady_clock::now() - start).count();
+	bool ordered = results.size() == urls.size();
+	for (size_t i = 0; ordered && i < results.size(); ++i) {
+		ordered = results[i].success && results[i].body == "body of /slow?i=" + std::to_string(i);
+	}
+	
+	success &= check(ordered, "Batch results in order.");
+	success &= check(elapsed < slow_delay * batch_size / 2, "Batch of " + std::to_string(batch_size)
+						+ " took " + std::to_string(elapsed) + " ms.");
+	
+	stats = HttpClient::getStats();
+	std::cout << "Requests " << stats.requests << ", connections " << stats.connections
+				<< ", reused " << stats.reused << ", cache hits " << stats.cacheHits
+				<< ", revalidated " << stats.revalidated << ". Server saw " << clients.size()
+				<< " connections." << std::endl;
+	
+	HttpClient::cleanup();
+	server.stop();
+	
+	std::cout << std::endl << "Test result: " << (success ? "Success." : "Failed.") << std::endl;
+	
+	return success ? 0 : 1;
+}
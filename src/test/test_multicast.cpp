@@ -0,0 +1,154 @@
+/*
+	test_multicast.cpp - Loopback test for the multicast media transport.
+	
+	Notes:
+			- Sends a file-sized block of random data in session_data sized chunks to two
+				receivers on the loopback interface, as a master does to its slaves.
+			- Packet loss is injected on the sending side: random loss plus bursts. NACKs go
+				straight to the sender instead of over the RPC channel.
+			- One receiver reports a full buffer for a while, as a slave which has fallen behind.
+*/
+
+
+#include "../server/multicast.h"
+
+#include <iostream>
+#include <string>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+
+// Globals
+const std::string group = "239.255.78.67";
+const uint16_t port = 4015;
+const uint32_t total_size = 8 * 1024 * 1024;	// Bytes sent.
+const uint32_t chunk_size = 200 * 1024;			// Bytes per chunk, as with session_data.
+const double loss_rate = 0.05;					// Random loss, per packet.
+const int burst_interval = 500;					// Packets between loss bursts.
+const int burst_length = 3;						// Packets lost per burst.
+
+McastSender sender;
+std::atomic<uint64_t> nackCalls = { 0 };
+
+
+struct TestReceiver {
+	std::string name;
+	std::string data;
+	std::mutex dataMutex;
+	std::atomic<bool> done = { false };
+	std::atomic<bool> full = { false };		// Emulates a full DataBuffer.
+	McastReceiver receiver;
+	
+	TestReceiver(std::string name) : name(name), receiver(
+		[this](const char* buf, uint32_t length, bool eof) { return deliver(buf, length, eof); },
+		[](uint32_t stream, uint32_t seq, uint32_t count) {
+			nackCalls++;
+			sender.resend(stream, seq, count);
+		}) { }
+	
+	uint32_t deliver(const char* buf, uint32_t length, bool eof) {
+		if (full) { return 0; }
+		
+		std::lock_guard<std::mutex> lk(dataMutex);
+		data.append(buf, length);
+		if (eof) { done = true; }
+		
+		return length;
+	}
+};
+
+
+// --- PRINT STATS ---
+void printStats(TestReceiver &rcv) {
+	McastStats stats = rcv.receiver.getStats();
+	std::cout << rcv.name << ": received " << stats.received << ", duplicates " << stats.duplicates
+				<< ", recovered " << stats.recovered << ", nacked " << stats.nacked << ", lost "
+				<< stats.lost << std::endl;
+}
+
+
+int main() {
+	std::cout << "Running multicast transport test..." << std::endl;
+	
+	std::string source(total_size, 0);
+	std::mt19937 rng(42);
+	for (uint32_t i = 0; i < total_size; ++i) {
+		source[i] = (char) rng();
+	}
+	
+	TestReceiver first("receiver 1");
+	TestReceiver second("receiver 2");
+	if (!first.receiver.start(group, port, "lo") || !second.receiver.start(group, port, "lo")) {
+		std::cout << "Failed to start receivers." << std::endl;
+		return 1;
+	}
+	
+	if (!sender.start(group, port, "lo")) {
+		std::cout << "Failed to start sender." << std::endl;
+		return 1;
+	}
+	
+	uint64_t sent = 0;
+	uint64_t dropped = 0;
+	std::uniform_real_distribution<double> dist(0.0, 1.0);
+	sender.setLossHook([&](const McastPacket &pkt) {
+		sent++;
+		bool drop = (sent % burst_interval) < burst_length || dist(rng) < loss_rate;
+		if (drop) { dropped++; }
+		
+		return drop;
+	});
+	
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (uint32_t offset = 0; offset < total_size; offset += chunk_size) {
+		uint32_t length = std::min(chunk_size, total_size - offset);
+		sender.send(source.data() + offset, length, offset + length == total_size);
+		
+		// The second receiver stalls for a few chunks in the middle of the file.
+		second.full = (offset >= total_size / 2 && offset < total_size / 2 + 4 * chunk_size);
+		
+		// Pace the chunks, like the client does while the buffers fill.
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	
+	second.full = false;
+	
+	// Wait for the outstanding NACKs to be answered.
+	for (int i = 0; i < 1000 && !(first.done && second.done); ++i) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	
+	first.receiver.stop();
+	second.receiver.stop();
+	sender.stop();
+	
+	std::cout << "Sent " << sent << " packets, dropped " << dropped << ", NACK calls " << nackCalls
+				<< ", " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
+				<< " ms." << std::endl;
+	printStats(first);
+	printStats(second);
+	
+	bool success = true;
+	TestReceiver* receivers[] = { &first, &second };
+	for (TestReceiver* rcv : receivers) {
+		if (!rcv->done) {
+			std::cout << rcv->name << ": end of file not received." << std::endl;
+			success = false;
+		}
+		
+		if (rcv->data != source) {
+			std::cout << rcv->name << ": data mismatch, " << rcv->data.size() << " of "
+						<< source.size() << " bytes." << std::endl;
+			success = false;
+		}
+	}
+	
+	std::cout << std::endl << "Test result: " << (success ? "Success." : "Failed.") << std::endl;
+	
+	return success ? 0 : 1;
+}
@@ -0,0 +1,330 @@
+/*
+	test_packet_queue.cpp - Test & microbenchmark for the pooled PacketQueue.
+	
+	Notes:
+			- Checks packet order, serials, flush & null packets of the pooled queue.
+			- Compares put/get throughput and the queueing latency between a producer and a
+				consumer thread against the previous implementation, which allocated a list
+				node per packet.
+*/
+
+
+#include "types.h"
+#include "packet_queue.h"
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+
+// Globals
+AVPacket flush_pkt;
+
+const int packet_count = 1000000;	// Packets per benchmark run.
+const int batch_size = 32;			// Packets queued before dequeuing, single thread run.
+const int max_queued = 512;			// Producer waits above this, like the read thread.
+
+
+// --- Legacy queue ---
+// The previous implementation: one av_malloc() per packet, packets copied by struct.
+struct LegacyNode {
+	AVPacket pkt;
+	LegacyNode* next;
+	int serial;
+};
+
+
+struct LegacyQueue {
+	LegacyNode *first_pkt, *last_pkt;
+	std::atomic<int> nb_packets;
+	int size;
+	int64_t duration;
+	int abort_request;
+	int serial;
+	SDL_mutex *mutex;
+	SDL_cond *cond;
+};
+
+
+int legacy_put(LegacyQueue* q, AVPacket* pkt) {
+	SDL_LockMutex(q->mutex);
+	LegacyNode* pkt1 = (LegacyNode*) av_malloc(sizeof(LegacyNode));
+	if (!pkt1) { SDL_UnlockMutex(q->mutex); return -1; }
+	pkt1->pkt = *pkt;
+	pkt1->next = NULL;
+	pkt1->serial = q->serial;
+	if (!q->last_pkt) { q->first_pkt = pkt1; }
+	else { q->last_pkt->next = pkt1; }
+	q->last_pkt = pkt1;
+	q->nb_packets++;
+	q->size += pkt1->pkt.size + sizeof(*pkt1);
+	q->duration += pkt1->pkt.duration;
+	SDL_CondSignal(q->cond);
+	SDL_UnlockMutex(q->mutex);
+	return 0;
+}
+
+
+int legacy_get(LegacyQueue* q, AVPacket* pkt, int block) {
+	int ret;
+	SDL_LockMutex(q->mutex);
+	for (;;) {
+		LegacyNode* pkt1 = q->first_pkt;
+		if (pkt1) {
+			q->first_pkt = pkt1->next;
+			if (!q->first_pkt) { q->last_pkt = NULL; }
+			q->nb_packets--;
+			q->size -= pkt1->pkt.size + sizeof(*pkt1);
+			q->duration -= pkt1->pkt.duration;
+			*pkt = pkt1->pkt;
+			av_free(pkt1);
+			ret = 1;
+			break;
+		}
+		else if (!block) { ret = 0; break; }
+		else { SDL_CondWait(q->cond, q->mutex); }
+	}
+	
+	SDL_UnlockMutex(q->mutex);
+	return ret;
+}
+
+
+// --- Benchmark adapters ---
+struct Pooled {
+	PacketQueue q;
+	const char* name() { return "pooled"; }
+	void init() { PacketQueueC::packet_queue_init(&q); q.abort_request = 0; }
+	void destroy() { PacketQueueC::packet_queue_destroy(&q); }
+	int put(AVPacket* pkt) { return PacketQueueC::packet_queue_put(&q, pkt); }
+	int get(AVPacket* pkt) { return PacketQueueC::packet_queue_get(&q, pkt, 1, NULL); }
+	int count() { return q.nb_packets; }
+};
+
+
+struct Legacy {
+	LegacyQueue q;
+	const char* name() { return "legacy"; }
+	void init() {
+		q.first_pkt = q.last_pkt = NULL;
+		q.nb_packets = 0;
+		q.size = 0;
+		q.duration = 0;
+		q.abort_request = 0;
+		q.serial = 0;
+		q.mutex = SDL_CreateMutex();
+		q.cond = SDL_CreateCond();
+	}
+	
+	void destroy() { SDL_DestroyMutex(q.mutex); SDL_DestroyCond(q.cond); }
+	
+	// The queue now owns the packet's reference, it must not be released through 'pkt'.
+	int put(AVPacket* pkt) { int ret = legacy_put(&q, pkt); pkt->buf = NULL; return ret; }
+	int get(AVPacket* pkt) { return legacy_get(&q, pkt, 1); }
+	int count() { return q.nb_packets; }
+};
+
+
+// --- BENCH SINGLE ---
+// Put a batch, get the batch, on one thread. Returns nanoseconds per put/get pair.
+template<typename Q>
+double benchSingle(AVPacket* src) {
+	Q queue;
+	queue.init();
+	AVPacket* pkt = av_packet_alloc();
+	
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int i = 0; i < packet_count; i += batch_size) {
+		for (int j = 0; j < batch_size; j++) {
+			av_packet_ref(pkt, src);
+			queue.put(pkt);
+		}
+		
+		for (int j = 0; j < batch_size; j++) {
+			queue.get(pkt);
+			av_packet_unref(pkt);
+		}
+	}
+	
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	av_packet_free(&pkt);
+	queue.destroy();
+	
+	return std::chrono::duration<double, std::nano>(end - start).count() / packet_count;
+}
+
+
+// --- BENCH THREADED ---
+// Producer & consumer thread. Collects the time each packet spent in the queue, in us.
+// Returns the packets per second.
+template<typename Q>
+double benchThreaded(AVPacket* src, std::vector<int64_t> &latency) {
+	Q queue;
+	queue.init();
+	latency.clear();
+	latency.reserve(packet_count);
+	
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::thread consumer([&]() {
+		AVPacket* pkt = av_packet_alloc();
+		for (int i = 0; i < packet_count; i++) {
+			queue.get(pkt);
+			latency.push_back(av_gettime_relative() - pkt->pts);
+			av_packet_unref(pkt);
+		}
+		
+		av_packet_free(&pkt);
+	});
+	
+	AVPacket* pkt = av_packet_alloc();
+	for (int i = 0; i < packet_count; i++) {
+		while (queue.count() > max_queued) { std::this_thread::yield(); }
+		av_packet_ref(pkt, src);
+		pkt->pts = av_gettime_relative();
+		queue.put(pkt);
+	}
+	
+	consumer.join();
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	av_packet_free(&pkt);
+	queue.destroy();
+	
+	return packet_count / std::chrono::duration<double>(end - start).count();
+}
+
+
+// --- PERCENTILE ---
+int64_t percentile(std::vector<int64_t> &v, double p) {
+	size_t i = (size_t) (p * (v.size() - 1));
+	std::nth_element(v.begin(), v.begin() + i, v.end());
+	return v[i];
+}
+
+
+template<typename Q>
+void runBenchmark(AVPacket* src) {
+	Q queue;
+	double single = benchSingle<Q>(src);
+	std::vector<int64_t> latency;
+	double rate = benchThreaded<Q>(src, latency);
+	
+	std::cout << std::setw(8) << queue.name()
+				<< std::setw(12) << std::fixed << std::setprecision(1) << single << " ns"
+				<< std::setw(12) << (int64_t) rate << " pkt/s"
+				<< std::setw(8) << percentile(latency, 0.5)
+				<< std::setw(8) << percentile(latency, 0.99)
+				<< std::setw(8) << percentile(latency, 0.999)
+				<< std::setw(10) << *std::max_element(latency.begin(), latency.end()) << std::endl;
+}
+
+
+// --- CHECK QUEUE ---
+// Verify order, serials and the flush & null packets of the pooled queue.
+bool checkQueue(AVPacket* src) {
+	PacketQueue q;
+	if (PacketQueueC::packet_queue_init(&q) < 0) { return false; }
+	PacketQueueC::packet_queue_start(&q);		// Queues a flush packet, serial 1.
+	
+	// Fill beyond the initial pool size, so that the pool has to grow.
+	AVPacket* pkt = av_packet_alloc();
+	const int count = PACKET_POOL_CHUNK * 3;
+	for (int i = 0; i < count; i++) {
+		av_packet_ref(pkt, src);
+		pkt->pts = i;
+		pkt->duration = 1;
+		if (PacketQueueC::packet_queue_put(&q, pkt) < 0) { return false; }
+		if (pkt->buf != NULL) {
+			std::cout << "Reference was not moved into the queue." << std::endl;
+			return false;
+		}
+	}
+	
+	PacketQueueC::packet_queue_put_nullpacket(&q, 3);
+	
+	bool success = true;
+	int serial = 0;
+	if (PacketQueueC::packet_queue_get(&q, pkt, 0, &serial) != 1 || pkt->data != flush_pkt.data
+																				|| serial != 1) {
+		std::cout << "Flush packet missing." << std::endl;
+		success = false;
+	}
+	
+	if (q.duration != count) {
+		std::cout << "Queue duration is " << q.duration << ", expected " << count << std::endl;
+		success = false;
+	}
+	
+	for (int i = 0; i < count && success; i++) {
+		if (PacketQueueC::packet_queue_get(&q, pkt, 0, &serial) != 1 || pkt->pts != i
+																		|| pkt->data != src->data) {
+			std::cout << "Packet " << i << " out of order or corrupted." << std::endl;
+			success = false;
+		}
+		
+		av_packet_unref(pkt);
+	}
+	
+	if (success && (PacketQueueC::packet_queue_get(&q, pkt, 0, &serial) != 1 || pkt->data != NULL
+																	|| pkt->stream_index != 3)) {
+		std::cout << "Null packet missing." << std::endl;
+		success = false;
+	}
+	
+	if (success && (q.nb_packets != 0 || q.size != 0 || q.duration != 0)) {
+		std::cout << "Queue not empty after getting all packets." << std::endl;
+		success = false;
+	}
+	
+	// A flush packet put after packets bumps the serial, a flush of the queue drops them.
+	av_packet_ref(pkt, src);
+	PacketQueueC::packet_queue_put(&q, pkt);
+	PacketQueueC::packet_queue_put(&q, &flush_pkt);
+	PacketQueueC::packet_queue_flush(&q);
+	if (success && (PacketQueueC::packet_queue_get(&q, pkt, 0, &serial) != 0 || q.serial != 2)) {
+		std::cout << "Flushing the queue failed." << std::endl;
+		success = false;
+	}
+	
+	PacketQueueC::packet_queue_abort(&q);
+	if (success && PacketQueueC::packet_queue_get(&q, pkt, 1, &serial) != -1) {
+		std::cout << "Get on aborted queue did not fail." << std::endl;
+		success = false;
+	}
+	
+	av_packet_free(&pkt);
+	PacketQueueC::packet_queue_destroy(&q);
+	
+	return success;
+}
+
+
+int main() {
+	std::cout << "Running PacketQueue test..." << std::endl;
+	
+	// As set up in Ffplay::run().
+	flush_pkt.data = (uint8_t*) &flush_pkt;
+	
+	// Reference counted source packet, as returned by the demuxer.
+	AVPacket* src = av_packet_alloc();
+	if (av_new_packet(src, 4096) < 0) {
+		std::cout << "Failed to allocate packet." << std::endl;
+		return 1;
+	}
+	
+	bool success = checkQueue(src);
+	std::cout << std::endl << "Test result: " << (success ? "Success." : "Failed.") << std::endl;
+	
+	std::cout << std::endl << "Benchmark, " << packet_count << " packets. Latency in us." << std::endl;
+	std::cout << std::setw(8) << "queue" << std::setw(15) << "put+get" << std::setw(18) << "threaded"
+				<< std::setw(8) << "p50" << std::setw(8) << "p99" << std::setw(8) << "p99.9"
+				<< std::setw(10) << "max" << std::endl;
+	runBenchmark<Legacy>(src);
+	runBenchmark<Pooled>(src);
+	
+	av_packet_free(&src);
+	
+	return success ? 0 : 1;
+}
@@ -0,0 +1,117 @@
+/*
+	test_session_registry.cpp - Tests for the SessionRegistry: session queue, buffer budget and
+								the handover to the next session.
+
+	Notes:
+			- Data is written into the session buffers directly, as session_data does.
+*/
+
+
+#include "../server/session_registry.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+// Globals
+const uint32_t budget = 8 * 1024 * 1024;
+int failures = 0;
+
+
+// --- CHECK ---
+void check(bool ok, const std::string &what) {
+	std::cout << (ok ? "PASS: " : "FAIL: ") << what << std::endl;
+	if (!ok) { failures++; }
+}
+
+
+// --- PATTERN ---
+// 'length' bytes of test data, starting at 'offset' in the file.
+std::string pattern(uint32_t offset, uint32_t length) {
+	std::string data;
+	for (uint32_t i = 0; i < length; ++i) {
+		data.append(1, (char) ((offset + i) % 251));
+	}
+
+	return data;
+}
+
+
+// --- READ ALL ---
+// Read 'length' bytes from the buffer, as the player does.
+std::string readAll(std::shared_ptr<DataBuffer> db, uint32_t length) {
+	std::vector<uint8_t> bytes(length);
+	uint32_t total = 0;
+	while (total < length) {
+		uint32_t read = db->read(length - total, bytes.data() + total);
+		if (read == 0) { break; }
+		total += read;
+	}
+
+	return std::string((char*) bytes.data(), total);
+}
+
+
+int main() {
+	SessionRegistry::init(budget);
+
+	// A single session gets the whole budget.
+	std::shared_ptr<DataBuffer> db1 = SessionRegistry::create(1, 1000000, false);
+	check(db1 && SessionRegistry::isActive(1), "first session is active");
+	check(db1 && db1->getCapacity() == budget, "active session gets the whole budget");
+	check(!SessionRegistry::hasNext() && !SessionRegistry::getNext(), "nothing queued");
+
+	// Queued sessions get a smaller buffer, the active one shrinks to stay within the budget.
+	std::shared_ptr<DataBuffer> db2 = SessionRegistry::create(2, 300000, true);
+	check(db2 && SessionRegistry::getActiveSession() == 1, "second session is queued");
+	check(db2 && db2->getCapacity() == budget / 8, "queued session gets a smaller buffer");
+	check(db1->getCapacity() == budget - (budget / 8), "active buffer shrinks for the queue");
+	check(SessionRegistry::getNext() == db2, "second session is next");
+
+	std::shared_ptr<DataBuffer> db3 = SessionRegistry::create(3, 1000, true);
+	check(db3 && db1->getCapacity() == budget - 2 * (budget / 8), "active buffer shrinks again");
+	check(!SessionRegistry::create(4, 1000, true), "full queue rejects a session");
+	check(!SessionRegistry::get(4), "rejected session has no buffer");
+	check(SessionRegistry::get(3) == db3, "lookup of a queued session");
+
+	// A client which disconnects drops its queued session.
+	SessionRegistry::remove(3);
+	check(!SessionRegistry::get(3), "removed session has no buffer");
+	check(SessionRegistry::getNext() == db2, "second session is still next");
+
+	// Data of the active session, partly read.
+	std::string data1 = pattern(0, 1000);
+	db1->write(data1.data(), data1.size());
+	check(readAll(db1, 400) == data1.substr(0, 400), "active session reads");
+
+	// The queued session prefetches, and the player probes the start of it already.
+	std::string data2 = pattern(0, 200000);
+	check(db2->write(data2.data(), data2.size()) == data2.size(), "queued session prefetches");
+	check(readAll(db2, 1000) == data2.substr(0, 1000), "queued session probed");
+
+	// Handover: the active session is dropped, the queued one takes its place with its data.
+	check(SessionRegistry::activateNext(), "handover to the queued session");
+	check(SessionRegistry::getActive() == db2 && SessionRegistry::isActive(2),
+																"queued session is active");
+	check(!SessionRegistry::get(1), "finished session dropped");
+	check(!SessionRegistry::hasNext(), "queue is empty after handover");
+	check(db2->getCapacity() == budget, "buffer grows to the whole budget on handover");
+	check(readAll(db2, 199000) == data2.substr(1000), "prefetched data kept on handover");
+
+	// The rest of the file arrives in the grown buffer.
+	std::string rest = pattern(200000, 100000);
+	check(db2->write(rest.data(), rest.size()) == rest.size(), "grown buffer takes more data");
+	check(readAll(db2, 100000) == rest, "data after the handover");
+
+	// Nothing left to hand over to.
+	check(!SessionRegistry::activateNext(), "no handover without a queued session");
+	check(!SessionRegistry::getActive() && SessionRegistry::getActiveSession() == 0,
+																"no active session");
+
+	SessionRegistry::cleanup();
+
+	std::cout << (failures ? "FAILED" : "All tests passed.") << std::endl;
+
+	return failures ? 1 : 0;
+}